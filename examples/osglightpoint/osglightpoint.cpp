@@ -70,6 +70,7 @@ void addToLightPointNode(osgSim::LightPointNode& lpn,osgSim::LightPoint& start,o
 #undef INTERPOLATE
 
 bool usePointSprites;
+bool useShaders;
 
 osg::Node* createLightPointsDatabase()
 {
@@ -133,6 +134,8 @@ osg::Node* createLightPointsDatabase()
             set->setTextureAttributeAndModes(0, tex, osg::StateAttribute::ON);
         }
 
+        lpn->setUseShaders(useShaders);
+
         //set->setMode(GL_BLEND, osg::StateAttribute::ON);
         //osg::BlendFunc *fn = new osg::BlendFunc();
         //fn->setFunction(osg::BlendFunc::SRC_ALPHA, osg::BlendFunc::DST_ALPHA);
@@ -157,6 +160,7 @@ osg::Node* createLightPointsDatabase()
 static osg::Node* CreateBlinkSequenceLightNode()
 {
    osgSim::LightPointNode*      lightPointNode = new osgSim::LightPointNode;;
+   lightPointNode->setUseShaders(useShaders);
 
    osgSim::LightPointNode::LightPointList       lpList;
 
@@ -215,6 +219,7 @@ int main( int argc, char **argv )
     arguments.getApplicationUsage()->setCommandLineUsage(arguments.getApplicationName()+" [options] filename ...");
     arguments.getApplicationUsage()->addCommandLineOption("-h or --help","Display this information");
     arguments.getApplicationUsage()->addCommandLineOption("--sprites","Point sprites.");
+    arguments.getApplicationUsage()->addCommandLineOption("--shaders","Evaluate the light points with shaders.");
 
     // construct the viewer.
     osgViewer::Viewer viewer;
@@ -229,6 +234,9 @@ int main( int argc, char **argv )
     usePointSprites = false;
     while (arguments.read("--sprites")) { usePointSprites = true; };
 
+    useShaders = false;
+    while (arguments.read("--shaders")) { useShaders = true; };
+
     osg::Group* rootnode = new osg::Group;
 
     // load the nodes from the commandline arguments.
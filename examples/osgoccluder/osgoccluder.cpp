@@ -292,6 +292,7 @@ int main( int argc, char **argv )
     arguments.getApplicationUsage()->setCommandLineUsage(arguments.getApplicationName()+" [options] filename ...");
     arguments.getApplicationUsage()->addCommandLineOption("-h or --help","Display this information");
     arguments.getApplicationUsage()->addCommandLineOption("-m","Mannually create occluders");
+    arguments.getApplicationUsage()->addCommandLineOption("--software","Also rasterize the occluders into a software occlusion buffer");
    
     // initialize the viewer.
     osgViewer::Viewer viewer;
@@ -304,6 +305,11 @@ int main( int argc, char **argv )
         viewer.addEventHandler(new OccluderEventHandler(&viewer));
     }
 
+    while (arguments.read("--software"))
+    {
+        viewer.getCamera()->setCullingMode(viewer.getCamera()->getCullingMode() | osg::CullSettings::SOFTWARE_OCCLUSION_CULLING);
+    }
+
     // if user requests help write it out to cout.
     if (arguments.read("-h") || arguments.read("--help"))
     {
@@ -735,6 +735,9 @@ int main(int argc, char** argv)
     arguments.getApplicationUsage()->addCommandLineOption("--moveVCamFactor", "MSM, LiSPSM move the virtual frustum behind the real camera, (also back ground object can cast shadow).");
     arguments.getApplicationUsage()->addCommandLineOption("--minLightMargin", "MSM, LiSPSM the same as --moveVCamFactor.");
 
+    arguments.getApplicationUsage()->addCommandLineOption("--cull-threads <num>", "ViewDependentShadowMap number of additional threads used to cull the shadow maps.");
+    arguments.getApplicationUsage()->addCommandLineOption("--reuse-casters", "ViewDependentShadowMap reuse the shadow casters of a light's first shadow map for its other shadow maps.");
+
     arguments.getApplicationUsage()->addCommandLineOption("-1", "Use test model one.");
     arguments.getApplicationUsage()->addCommandLineOption("-2", "Use test model two.");
     arguments.getApplicationUsage()->addCommandLineOption("-3", "Use test model three (default).");
@@ -937,6 +940,11 @@ int main(int argc, char** argv)
         if (arguments.read("--parallel-split") || arguments.read("--ps") ) settings->setMultipleShadowMapHint(osgShadow::ShadowSettings::PARALLEL_SPLIT);
         if (arguments.read("--cascaded")) settings->setMultipleShadowMapHint(osgShadow::ShadowSettings::CASCADED);
 
+        unsigned int numCullThreads;
+        if (arguments.read("--cull-threads",numCullThreads)) settings->setNumShadowCastingCullThreads(numCullThreads);
+
+        if (arguments.read("--reuse-casters")) settings->setReuseShadowCastersAcrossSplits(true);
+
 
         int mapres = 1024;
         while (arguments.read("--mapres", mapres))
@@ -189,6 +189,15 @@ int main(int argc, char** argv)
         else if (strBlendingPolicy == "ENABLE_BLENDING_WHEN_ALPHA_PRESENT") blendingPolicy = osgTerrain::TerrainTile::ENABLE_BLENDING_WHEN_ALPHA_PRESENT;
     }
 
+    bool shareTileTopology = false;
+    while(arguments.read("--share-topology")) { shareTileTopology = true; }
+
+    bool useCompactNormals = false;
+    while(arguments.read("--compact-normals")) { useCompactNormals = true; }
+
+    bool initTilesOnLoad = false;
+    while(arguments.read("--init-tiles-on-load")) { initTilesOnLoad = true; }
+
     // load the nodes from the commandline arguments.
     osg::ref_ptr<osg::Node> rootnode = osgDB::readNodeFiles(arguments);
 
@@ -225,6 +234,9 @@ int main(int argc, char** argv)
     terrain->setSampleRatio(sampleRatio);
     terrain->setVerticalScale(verticalScale);
     terrain->setBlendingPolicy(blendingPolicy);
+    terrain->setShareTileTopology(shareTileTopology);
+    terrain->setUseCompactNormals(useCompactNormals);
+    terrain->setInitTilesOnLoad(initTilesOnLoad);
 
     // register our custom handler for adjust Terrain settings
     viewer.addEventHandler(new TerrainHandler(terrain.get()));
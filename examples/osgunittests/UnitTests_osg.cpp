@@ -18,10 +18,14 @@
 
 #include "UnitTestFramework.h"
 
+#include <osg/BufferObject>
+#include <osg/InstancedGeometry>
 #include <osg/Matrixd>
 #include <osg/Matrixf>
+#include <osg/OcclusionBuffer>
 #include <osg/Vec3d>
 #include <osg/Vec3>
+#include <osgDB/Registry>
 #include <sstream>
 
 namespace osg
@@ -380,5 +384,472 @@ OSGUTX_END_TESTSUITE
 
 OSGUTX_AUTOREGISTER_TESTSUITE_AT(Matrix, root.osg)
 
+///////////////////////////////////////////////////////////////////////////////
+// 
+//  BufferSubAllocator Tests
+//
+class BufferSubAllocatorTestFixture
+{
+public:
+
+    void testAlignment(const osgUtx::TestContext& ctx);
+    void testDelayedReuse(const osgUtx::TestContext& ctx);
+    void testMerge(const osgUtx::TestContext& ctx);
+    void testBestFit(const osgUtx::TestContext& ctx);
+
+};
+
+void BufferSubAllocatorTestFixture::testAlignment(const osgUtx::TestContext&)
+{
+    osg::ref_ptr<osg::BufferSubAllocator> allocator = new osg::BufferSubAllocator(1024, 16);
+
+    unsigned int offset1 = 1, offset2 = 1;
+    OSGUTX_TEST_F( allocator->allocate(10, offset1) )
+    OSGUTX_TEST_F( allocator->allocate(20, offset2) )
+    OSGUTX_TEST_F( offset1==0 )
+    OSGUTX_TEST_F( offset2==16 )
+    OSGUTX_TEST_F( allocator->getAllocatedSize()==48 )
+    OSGUTX_TEST_F( allocator->getFreeSize()==1024-48 )
+}
+
+void BufferSubAllocatorTestFixture::testDelayedReuse(const osgUtx::TestContext&)
+{
+    osg::ref_ptr<osg::BufferSubAllocator> allocator = new osg::BufferSubAllocator(1024, 16);
+
+    unsigned int offset = 0;
+    OSGUTX_TEST_F( allocator->allocate(1024, offset) )
+    OSGUTX_TEST_F( !allocator->allocate(16, offset) )
+
+    allocator->release(0, 5);
+    OSGUTX_TEST_F( allocator->getPendingSize()==1024 )
+    OSGUTX_TEST_F( !allocator->allocate(16, offset) )
+
+    allocator->reclaim(6, 2);
+    OSGUTX_TEST_F( !allocator->allocate(16, offset) )
+
+    allocator->reclaim(7, 2);
+    OSGUTX_TEST_F( allocator->getPendingSize()==0 )
+    OSGUTX_TEST_F( allocator->allocate(1024, offset) )
+    OSGUTX_TEST_F( offset==0 )
+}
+
+void BufferSubAllocatorTestFixture::testMerge(const osgUtx::TestContext&)
+{
+    osg::ref_ptr<osg::BufferSubAllocator> allocator = new osg::BufferSubAllocator(1024, 16);
+
+    unsigned int a = 0, b = 0, c = 0, d = 0;
+    allocator->allocate(256, a);
+    allocator->allocate(256, b);
+    allocator->allocate(256, c);
+    allocator->allocate(256, d);
+
+    // release out of order so that the middle range has to merge with free ranges on both sides.
+    allocator->release(a, 0);
+    allocator->release(c, 0);
+    allocator->release(b, 0);
+    allocator->reclaimAll();
+
+    OSGUTX_TEST_F( allocator->getNumFreeRanges()==1 )
+    OSGUTX_TEST_F( allocator->getLargestFreeRange()==768 )
+
+    allocator->release(d, 0);
+    allocator->reclaimAll();
+
+    OSGUTX_TEST_F( allocator->isEmpty() )
+    OSGUTX_TEST_F( allocator->getNumFreeRanges()==1 )
+    OSGUTX_TEST_F( allocator->getLargestFreeRange()==1024 )
+}
+
+void BufferSubAllocatorTestFixture::testBestFit(const osgUtx::TestContext&)
+{
+    osg::ref_ptr<osg::BufferSubAllocator> allocator = new osg::BufferSubAllocator(1024, 16);
+
+    unsigned int a = 0, b = 0, c = 0, d = 0;
+    allocator->allocate(128, a);
+    allocator->allocate(64, b);
+    allocator->allocate(64, c);
+    allocator->allocate(64, d);
+
+    // leave free ranges of 128 at the start and 64 in the middle, besides the remainder at the end.
+    allocator->release(a, 0);
+    allocator->release(c, 0);
+    allocator->reclaimAll();
+
+    unsigned int offset = 0;
+    OSGUTX_TEST_F( allocator->allocate(64, offset) )
+    OSGUTX_TEST_F( offset==c )
+    OSGUTX_TEST_F( allocator->allocate(100, offset) )
+    OSGUTX_TEST_F( offset==a )
+}
+
+OSGUTX_BEGIN_TESTSUITE(BufferSubAllocator)
+    OSGUTX_ADD_TESTCASE(BufferSubAllocatorTestFixture, testAlignment)
+    OSGUTX_ADD_TESTCASE(BufferSubAllocatorTestFixture, testDelayedReuse)
+    OSGUTX_ADD_TESTCASE(BufferSubAllocatorTestFixture, testMerge)
+    OSGUTX_ADD_TESTCASE(BufferSubAllocatorTestFixture, testBestFit)
+OSGUTX_END_TESTSUITE
+
+OSGUTX_AUTOREGISTER_TESTSUITE_AT(BufferSubAllocator, root.osg)
+
+///////////////////////////////////////////////////////////////////////////////
+// 
+//  OcclusionBuffer Tests
+//
+class OcclusionBufferTestFixture
+{
+public:
+
+    OcclusionBufferTestFixture();
+
+    void testEmpty(const osgUtx::TestContext& ctx);
+    void testBehindOccluder(const osgUtx::TestContext& ctx);
+    void testInFrontOfOccluder(const osgUtx::TestContext& ctx);
+    void testBesideOccluder(const osgUtx::TestContext& ctx);
+    void testInactive(const osgUtx::TestContext& ctx);
+
+private:
+
+    // rasterize a quad in the plane z=depth, from xMin to xMax and yMin to yMax in eye coordinates.
+    void rasterizeQuad(OcclusionBuffer& buffer, float xMin, float xMax, float yMin, float yMax, float depth);
+
+    Matrix _projection;
+
+};
+
+OcclusionBufferTestFixture::OcclusionBufferTestFixture():
+    _projection(Matrix::perspective(90.0, 1.0, 1.0, 100.0))
+{
+}
+
+void OcclusionBufferTestFixture::rasterizeQuad(OcclusionBuffer& buffer, float xMin, float xMax, float yMin, float yMax, float depth)
+{
+    Vec4 c00 = Vec4(xMin, yMin, depth, 1.0f) * _projection;
+    Vec4 c10 = Vec4(xMax, yMin, depth, 1.0f) * _projection;
+    Vec4 c11 = Vec4(xMax, yMax, depth, 1.0f) * _projection;
+    Vec4 c01 = Vec4(xMin, yMax, depth, 1.0f) * _projection;
+    buffer.rasterizeTriangle(c00, c10, c11);
+    buffer.rasterizeTriangle(c00, c11, c01);
+}
+
+void OcclusionBufferTestFixture::testEmpty(const osgUtx::TestContext&)
+{
+    ref_ptr<OcclusionBuffer> buffer = new OcclusionBuffer(64, 64);
+    buffer->clear(_projection);
+
+    OSGUTX_TEST_F( buffer->getNumTrianglesRasterized()==0 )
+    OSGUTX_TEST_F( !buffer->isOccluded(_projection, BoundingBox(-1.0f, -1.0f, -51.0f, 1.0f, 1.0f, -49.0f)) )
+}
+
+void OcclusionBufferTestFixture::testBehindOccluder(const osgUtx::TestContext&)
+{
+    ref_ptr<OcclusionBuffer> buffer = new OcclusionBuffer(64, 64);
+    buffer->clear(_projection);
+    rasterizeQuad(*buffer, -20.0f, 20.0f, -20.0f, 20.0f, -10.0f);
+
+    OSGUTX_TEST_F( buffer->getNumTrianglesRasterized()==2 )
+    OSGUTX_TEST_F( buffer->isOccluded(_projection, BoundingBox(-1.0f, -1.0f, -51.0f, 1.0f, 1.0f, -49.0f)) )
+    OSGUTX_TEST_F( buffer->isOccluded(_projection, BoundingSphere(Vec3(0.0f, 0.0f, -50.0f), 1.0f)) )
+}
+
+void OcclusionBufferTestFixture::testInFrontOfOccluder(const osgUtx::TestContext&)
+{
+    ref_ptr<OcclusionBuffer> buffer = new OcclusionBuffer(64, 64);
+    buffer->clear(_projection);
+    rasterizeQuad(*buffer, -20.0f, 20.0f, -20.0f, 20.0f, -10.0f);
+
+    OSGUTX_TEST_F( !buffer->isOccluded(_projection, BoundingBox(-1.0f, -1.0f, -6.0f, 1.0f, 1.0f, -4.0f)) )
+
+    // crossing the occluder
+    OSGUTX_TEST_F( !buffer->isOccluded(_projection, BoundingBox(-1.0f, -1.0f, -20.0f, 1.0f, 1.0f, -5.0f)) )
+
+    // crossing the near plane
+    OSGUTX_TEST_F( !buffer->isOccluded(_projection, BoundingSphere(Vec3(0.0f, 0.0f, -1.0f), 2.0f)) )
+}
+
+void OcclusionBufferTestFixture::testBesideOccluder(const osgUtx::TestContext&)
+{
+    ref_ptr<OcclusionBuffer> buffer = new OcclusionBuffer(64, 64);
+    buffer->clear(_projection);
+
+    // covers the left half of the view.
+    rasterizeQuad(*buffer, -20.0f, 0.0f, -20.0f, 20.0f, -10.0f);
+
+    OSGUTX_TEST_F( buffer->isOccluded(_projection, BoundingBox(-25.0f, -1.0f, -51.0f, -20.0f, 1.0f, -49.0f)) )
+    OSGUTX_TEST_F( !buffer->isOccluded(_projection, BoundingBox(20.0f, -1.0f, -51.0f, 25.0f, 1.0f, -49.0f)) )
+
+    // straddling the edge of the occluder
+    OSGUTX_TEST_F( !buffer->isOccluded(_projection, BoundingBox(-5.0f, -1.0f, -51.0f, 5.0f, 1.0f, -49.0f)) )
+}
+
+void OcclusionBufferTestFixture::testInactive(const osgUtx::TestContext&)
+{
+    ref_ptr<OcclusionBuffer> buffer = new OcclusionBuffer(64, 64);
+    buffer->clear(_projection);
+    rasterizeQuad(*buffer, -20.0f, 20.0f, -20.0f, 20.0f, -10.0f);
+
+    buffer->setActive(false);
+    OSGUTX_TEST_F( !buffer->getActive() )
+
+    // the active flag is left for the CullingSet to check, the depth buffer itself is unchanged.
+    OSGUTX_TEST_F( buffer->isOccluded(_projection, BoundingBox(-1.0f, -1.0f, -51.0f, 1.0f, 1.0f, -49.0f)) )
+}
+
+OSGUTX_BEGIN_TESTSUITE(OcclusionBuffer)
+    OSGUTX_ADD_TESTCASE(OcclusionBufferTestFixture, testEmpty)
+    OSGUTX_ADD_TESTCASE(OcclusionBufferTestFixture, testBehindOccluder)
+    OSGUTX_ADD_TESTCASE(OcclusionBufferTestFixture, testInFrontOfOccluder)
+    OSGUTX_ADD_TESTCASE(OcclusionBufferTestFixture, testBesideOccluder)
+    OSGUTX_ADD_TESTCASE(OcclusionBufferTestFixture, testInactive)
+OSGUTX_END_TESTSUITE
+
+OSGUTX_AUTOREGISTER_TESTSUITE_AT(OcclusionBuffer, root.osg)
+
+///////////////////////////////////////////////////////////////////////////////
+// 
+//  InstancedGeometry Tests
+//
+class InstancedGeometryTestFixture
+{
+public:
+
+    InstancedGeometryTestFixture();
+
+    void testDisplayListsDisabled(const osgUtx::TestContext& ctx);
+    void testViewChange(const osgUtx::TestContext& ctx);
+    void testInstanceMatricesChange(const osgUtx::TestContext& ctx);
+
+private:
+
+    // gives access to the per draw culling of the instances, which only needs the matrices of the State.
+    class CullableInstancedGeometry : public InstancedGeometry
+    {
+    public:
+
+        std::vector<unsigned int> getVisibleInstances(const Matrix& modelView, const Matrix& projection) const
+        {
+            ref_ptr<State> state = new State;
+            state->applyProjectionMatrix(new RefMatrix(projection));
+            state->applyModelViewMatrix(new RefMatrix(modelView));
+
+            ref_ptr<PerContextInstances> pci = new PerContextInstances;
+            cullInstances(*state, *pci);
+            return pci->visibleInstances;
+        }
+    };
+
+    Matrix _projection;
+    ref_ptr<CullableInstancedGeometry> _geometry;
+
+};
+
+InstancedGeometryTestFixture::InstancedGeometryTestFixture():
+    _projection(Matrix::perspective(90.0, 1.0, 1.0, 100.0)),
+    _geometry(new CullableInstancedGeometry)
+{
+    ref_ptr<Vec3Array> vertices = new Vec3Array;
+    vertices->push_back(Vec3(-1.0f, 0.0f, 0.0f));
+    vertices->push_back(Vec3(1.0f, 0.0f, 0.0f));
+    vertices->push_back(Vec3(0.0f, 1.0f, 0.0f));
+    _geometry->setVertexArray(vertices.get());
+    _geometry->addPrimitiveSet(new DrawArrays(GL_TRIANGLES, 0, 3));
+
+    // instances to the left of, in front of and to the right of the view at the origin.
+    ref_ptr<MatrixfArray> matrices = new MatrixfArray;
+    matrices->push_back(Matrixf::translate(-200.0f, 0.0f, -50.0f));
+    matrices->push_back(Matrixf::translate(0.0f, 0.0f, -50.0f));
+    matrices->push_back(Matrixf::translate(200.0f, 0.0f, -50.0f));
+    _geometry->setInstanceMatrixArray(matrices.get());
+}
+
+void InstancedGeometryTestFixture::testDisplayListsDisabled(const osgUtx::TestContext&)
+{
+    OSGUTX_TEST_F( !_geometry->getSupportsDisplayList() )
+    OSGUTX_TEST_F( !_geometry->getUseDisplayList() )
+
+    ref_ptr<Geometry> geometry = new Geometry;
+    ref_ptr<InstancedGeometry> fromGeometry = new InstancedGeometry(*geometry);
+    OSGUTX_TEST_F( !fromGeometry->getSupportsDisplayList() )
+
+    ref_ptr<InstancedGeometry> copy = new InstancedGeometry(*_geometry);
+    OSGUTX_TEST_F( !copy->getSupportsDisplayList() )
+}
+
+void InstancedGeometryTestFixture::testViewChange(const osgUtx::TestContext&)
+{
+    std::vector<unsigned int> visible = _geometry->getVisibleInstances(Matrix::identity(), _projection);
+    OSGUTX_TEST_F( visible.size()==1 && visible[0]==1 )
+
+    visible = _geometry->getVisibleInstances(Matrix::translate(-200.0, 0.0, 0.0), _projection);
+    OSGUTX_TEST_F( visible.size()==1 && visible[0]==2 )
+
+    visible = _geometry->getVisibleInstances(Matrix::translate(200.0, 0.0, 0.0), _projection);
+    OSGUTX_TEST_F( visible.size()==1 && visible[0]==0 )
+
+    // looking away from all of them.
+    visible = _geometry->getVisibleInstances(Matrix::rotate(PI, Vec3(0.0f, 1.0f, 0.0f)), _projection);
+    OSGUTX_TEST_F( visible.empty() )
+}
+
+void InstancedGeometryTestFixture::testInstanceMatricesChange(const osgUtx::TestContext&)
+{
+    (*_geometry->getInstanceMatrixArray())[0] = Matrixf::translate(10.0f, 0.0f, -50.0f);
+    _geometry->dirtyInstances();
+
+    std::vector<unsigned int> visible = _geometry->getVisibleInstances(Matrix::identity(), _projection);
+    OSGUTX_TEST_F( visible.size()==2 && visible[0]==0 && visible[1]==1 )
+
+    _geometry->setCullInstances(false);
+    visible = _geometry->getVisibleInstances(Matrix::identity(), _projection);
+    OSGUTX_TEST_F( visible.size()==3 )
+}
+
+OSGUTX_BEGIN_TESTSUITE(InstancedGeometry)
+    OSGUTX_ADD_TESTCASE(InstancedGeometryTestFixture, testDisplayListsDisabled)
+    OSGUTX_ADD_TESTCASE(InstancedGeometryTestFixture, testViewChange)
+    OSGUTX_ADD_TESTCASE(InstancedGeometryTestFixture, testInstanceMatricesChange)
+OSGUTX_END_TESTSUITE
+
+OSGUTX_AUTOREGISTER_TESTSUITE_AT(InstancedGeometry, root.osg)
+
+///////////////////////////////////////////////////////////////////////////////
+// 
+//  Geometry serializer Tests
+//
+class GeometrySerializerTestFixture
+{
+public:
+
+    GeometrySerializerTestFixture();
+
+    void testQuantizedRoundTrip(const osgUtx::TestContext& ctx);
+    void testUnquantizedRoundTrip(const osgUtx::TestContext& ctx);
+
+private:
+
+    // write the geometry to a binary osgb stream with the given options and read it back.
+    ref_ptr<Geometry> roundTrip(const std::string& options);
+
+    ref_ptr<Vec3Array> _vertices;
+    ref_ptr<Vec3Array> _normals;
+    ref_ptr<Vec4Array> _colors;
+    ref_ptr<Geometry> _geometry;
+
+};
+
+GeometrySerializerTestFixture::GeometrySerializerTestFixture():
+    _vertices(new Vec3Array),
+    _normals(new Vec3Array),
+    _colors(new Vec4Array),
+    _geometry(new Geometry)
+{
+    for(unsigned int i=0; i<16; ++i)
+    {
+        float angle = float(i)*PI/8.0f;
+        _vertices->push_back(Vec3(1000.0f+100.0f*cosf(angle), -500.0f+100.0f*sinf(angle), 20.0f+float(i)));
+
+        Vec3 normal(cosf(angle), sinf(angle), 0.5f);
+        normal.normalize();
+        _normals->push_back(normal);
+
+        _colors->push_back(Vec4(float(i)/15.0f, 1.0f-float(i)/15.0f, 0.5f, 1.0f));
+    }
+
+    // the vertices are quantized in memory, the normals and colors when written.
+    Matrixd decodeMatrix;
+    ref_ptr<Vec3sArray> quantized = quantizeVertexArray(_vertices.get(), decodeMatrix);
+    _geometry->setVertexArray(quantized.get());
+    _geometry->setVertexDecodeMatrix(new RefMatrix(decodeMatrix));
+    _geometry->setNormalArray(_normals.get());
+    _geometry->setNormalBinding(Geometry::BIND_PER_VERTEX);
+    _geometry->setColorArray(_colors.get());
+    _geometry->setColorBinding(Geometry::BIND_PER_VERTEX);
+    _geometry->addPrimitiveSet(new DrawArrays(GL_TRIANGLE_FAN, 0, _vertices->size()));
+}
+
+ref_ptr<Geometry> GeometrySerializerTestFixture::roundTrip(const std::string& options)
+{
+    osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension("osgb");
+    if (!rw) return 0;
+
+    ref_ptr<osgDB::Options> opts = new osgDB::Options(options);
+
+    std::stringstream buffer;
+    if (!rw->writeObject(*_geometry, buffer, opts.get()).success()) return 0;
+
+    osgDB::ReaderWriter::ReadResult result = rw->readObject(buffer, opts.get());
+    return dynamic_cast<Geometry*>(result.getObject());
+}
+
+void GeometrySerializerTestFixture::testQuantizedRoundTrip(const osgUtx::TestContext&)
+{
+    ref_ptr<Geometry> geometry = roundTrip("QuantizeVertexData");
+    OSGUTX_TEST_F( geometry.valid() )
+    if (!geometry) return;
+
+    OSGUTX_TEST_F( dynamic_cast<Vec3sArray*>(geometry->getVertexArray())!=0 )
+    OSGUTX_TEST_F( geometry->getVertexDecodeMatrix()!=0 )
+
+    ref_ptr<Vec3Array> vertices = geometry->createDecodedVertexArray();
+    OSGUTX_TEST_F( vertices.valid() && vertices->size()==_vertices->size() )
+    if (!vertices || vertices->size()!=_vertices->size()) return;
+
+    // 16 bits across an extent of 200 units.
+    bool verticesMatch = true;
+    for(unsigned int i=0; i<vertices->size(); ++i)
+    {
+        if (((*vertices)[i]-(*_vertices)[i]).length()>0.01f) verticesMatch = false;
+    }
+    OSGUTX_TEST_F( verticesMatch )
+
+    const Vec3bArray* normals = dynamic_cast<const Vec3bArray*>(geometry->getNormalArray());
+    OSGUTX_TEST_F( normals && normals->size()==_normals->size() )
+    if (!normals || normals->size()!=_normals->size()) return;
+
+    bool normalsMatch = true;
+    for(unsigned int i=0; i<normals->size(); ++i)
+    {
+        const Vec3b& n = (*normals)[i];
+        Vec3 decoded(float(n.x())/127.0f, float(n.y())/127.0f, float(n.z())/127.0f);
+        if ((decoded-(*_normals)[i]).length()>0.01f) normalsMatch = false;
+    }
+    OSGUTX_TEST_F( normalsMatch )
+
+    const Vec4ubArray* colors = dynamic_cast<const Vec4ubArray*>(geometry->getColorArray());
+    OSGUTX_TEST_F( colors && colors->size()==_colors->size() )
+    if (!colors || colors->size()!=_colors->size()) return;
+
+    bool colorsMatch = true;
+    for(unsigned int i=0; i<colors->size(); ++i)
+    {
+        const Vec4ub& c = (*colors)[i];
+        Vec4 decoded(float(c.r())/255.0f, float(c.g())/255.0f, float(c.b())/255.0f, float(c.a())/255.0f);
+        if ((decoded-(*_colors)[i]).length()>0.005f) colorsMatch = false;
+    }
+    OSGUTX_TEST_F( colorsMatch )
+}
+
+void GeometrySerializerTestFixture::testUnquantizedRoundTrip(const osgUtx::TestContext&)
+{
+    ref_ptr<Geometry> geometry = roundTrip("");
+    OSGUTX_TEST_F( geometry.valid() )
+    if (!geometry) return;
+
+    // without the option the normals and colors are written as they are held.
+    const Vec3Array* normals = dynamic_cast<const Vec3Array*>(geometry->getNormalArray());
+    OSGUTX_TEST_F( normals && normals->size()==_normals->size() && (*normals)[3]==(*_normals)[3] )
+
+    const Vec4Array* colors = dynamic_cast<const Vec4Array*>(geometry->getColorArray());
+    OSGUTX_TEST_F( colors && colors->size()==_colors->size() && (*colors)[3]==(*_colors)[3] )
+
+    OSGUTX_TEST_F( dynamic_cast<Vec3sArray*>(geometry->getVertexArray())!=0 && geometry->getVertexDecodeMatrix()!=0 )
+}
+
+OSGUTX_BEGIN_TESTSUITE(GeometrySerializer)
+    OSGUTX_ADD_TESTCASE(GeometrySerializerTestFixture, testQuantizedRoundTrip)
+    OSGUTX_ADD_TESTCASE(GeometrySerializerTestFixture, testUnquantizedRoundTrip)
+OSGUTX_END_TESTSUITE
+
+OSGUTX_AUTOREGISTER_TESTSUITE_AT(GeometrySerializer, root.osg)
+
 
 }
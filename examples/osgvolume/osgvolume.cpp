@@ -69,6 +69,7 @@
 #include <osgVolume/VolumeTile>
 #include <osgVolume/RayTracedTechnique>
 #include <osgVolume/FixedFunctionTechnique>
+#include <osgVolume/BrickedVolumeBuilder>
 
 enum ShadingModel
 {
@@ -544,6 +545,12 @@ int main( int argc, char **argv )
     arguments.getApplicationUsage()->addCommandLineOption("--sd <num>","Short hand for --sequence-length");
     arguments.getApplicationUsage()->addCommandLineOption("--sdwm <num>","Set the SampleDensityWhenMovingProperty to specified value");
     arguments.getApplicationUsage()->addCommandLineOption("--lod","Enable techniques to reduce the level of detail when moving.");
+    arguments.getApplicationUsage()->addCommandLineOption("--no-empty-space-skipping","Disable the skipping of empty bricks of the volume by the ray traced shaders.");
+    arguments.getApplicationUsage()->addCommandLineOption("--brick-size <num>","Set the size in voxels of the bricks used for empty space skipping.");
+    arguments.getApplicationUsage()->addCommandLineOption("--paged <filename>","Write the volume as a hierarchy of bricks into the specified .osga archive and page them in while viewing.");
+    arguments.getApplicationUsage()->addCommandLineOption("--paged-brick-size <num>","Set the size in voxels of the bricks written by --paged.");
+    arguments.getApplicationUsage()->addCommandLineOption("--max-screen-error <pixels>","Set the on screen size of a voxel at which the finer bricks written by --paged are paged in.");
+    arguments.getApplicationUsage()->addCommandLineOption("--memory-budget <megabytes>","Set the memory that the bricks paged in by --paged should be kept within.");
 //    arguments.getApplicationUsage()->addCommandLineOption("--raw <sizeX> <sizeY> <sizeZ> <numberBytesPerComponent> <numberOfComponents> <endian> <filename>","read a raw image data");
 
     // construct the viewer.
@@ -714,6 +721,24 @@ int main( int argc, char **argv )
 
     while(arguments.read("--lod")) { sampleDensityWhenMoving = 0.02; }
 
+    bool emptySpaceSkipping = true;
+    while(arguments.read("--no-empty-space-skipping")) { emptySpaceSkipping = false; }
+
+    unsigned int emptySpaceBrickSize = 16;
+    while(arguments.read("--brick-size", emptySpaceBrickSize)) {}
+
+    std::string pagedArchive;
+    while(arguments.read("--paged", pagedArchive)) {}
+
+    unsigned int pagedBrickSize = 64;
+    while(arguments.read("--paged-brick-size", pagedBrickSize)) {}
+
+    float maximumScreenSpaceError = 1.0f;
+    while(arguments.read("--max-screen-error", maximumScreenSpaceError)) {}
+
+    double memoryBudget = 256.0;
+    while(arguments.read("--memory-budget", memoryBudget)) {}
+
     double sequenceLength = 10.0;
     while(arguments.read("--sequence-duration", sequenceLength) ||
           arguments.read("--sd", sequenceLength)) {}
@@ -1180,7 +1205,10 @@ int main( int argc, char **argv )
         layer->addProperty(sp);
 
 
-        tile->setVolumeTechnique(new osgVolume::RayTracedTechnique);
+        osgVolume::RayTracedTechnique* rayTracedTechnique = new osgVolume::RayTracedTechnique;
+        rayTracedTechnique->setEmptySpaceSkipping(emptySpaceSkipping);
+        rayTracedTechnique->setEmptySpaceBrickSize(emptySpaceBrickSize);
+        tile->setVolumeTechnique(rayTracedTechnique);
     }
     else
     {
@@ -1188,6 +1216,28 @@ int main( int argc, char **argv )
         tile->setVolumeTechnique(new osgVolume::FixedFunctionTechnique);
     }
 
+    if (!pagedArchive.empty())
+    {
+        osg::ref_ptr<osgVolume::BrickedVolumeBuilder> builder = new osgVolume::BrickedVolumeBuilder;
+        builder->setBrickSize(pagedBrickSize);
+        builder->setMaximumScreenSpaceError(maximumScreenSpaceError);
+        builder->setVolumeTechniquePrototype(tile->getVolumeTechnique());
+
+        osg::ref_ptr<osgVolume::Volume> pagedVolume = builder->build(layer.get(), pagedArchive);
+        if (!pagedVolume)
+        {
+            std::cout<<"Unable to write paged volume to "<<pagedArchive<<std::endl;
+            return 1;
+        }
+
+        std::cout<<"Written "<<builder->getNumBricks()<<" bricks in "<<builder->getNumLevels()<<" levels to "<<pagedArchive<<std::endl;
+
+        viewer.getDatabasePager()->setTargetMaximumNumberOfPageLOD(osg::maximum(builder->computeMaximumNumberOfPagedLOD(memoryBudget), 1u));
+        viewer.setSceneData(pagedVolume.get());
+
+        return viewer.run();
+    }
+
     if (!outputFile.empty())
     {
         std::string ext = osgDB::getFileExtension(outputFile);
@@ -12,6 +12,7 @@
  * OpenSceneGraph Public License for more details.
 */
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 #include <float.h>
 
@@ -24,6 +25,7 @@
 #include <osg/State>
 #include <osg/PrimitiveSet>
 #include <osg/Array>
+#include <osg/ApplicationUsage>
 
 #include <OpenThreads/ScopedLock>
 #include <OpenThreads/Mutex>
@@ -45,6 +47,8 @@ GLBufferObject::GLBufferObject(unsigned int contextID, BufferObject* bufferObjec
     _glObjectID(glObjectID),
     _profile(0,0,0),
     _allocatedSize(0),
+    _heap(0),
+    _heapOffset(0),
     _dirty(true),
     _bufferObject(0),
     _set(0),
@@ -57,7 +61,9 @@ GLBufferObject::GLBufferObject(unsigned int contextID, BufferObject* bufferObjec
 
     _extensions = GLBufferObject::getExtensions(contextID, true);
 
-    if (glObjectID==0)
+    // buffers that may be suballocated from a GLBufferHeap only generate their own buffer object in allocateStorage() if required.
+    if (glObjectID==0 &&
+        !(bufferObject && GLBufferObjectManager::getGLBufferObjectManager(contextID)->isGLBufferHeapSupported(bufferObject->getTarget(), bufferObject->getUsage())))
     {
         _extensions->glGenBuffers(1, &_glObjectID);
     }
@@ -173,8 +179,6 @@ void GLBufferObject::compileBuffer()
         _bufferEntries.erase(_bufferEntries.begin()+i, _bufferEntries.end());
     }
 
-    _extensions->glBindBuffer(_profile._target, _glObjectID);
-
     if (newTotalSize > _profile._size)
     {
         OSG_INFO<<"newTotalSize="<<newTotalSize<<", _profile._size="<<_profile._size<<std::endl;
@@ -191,9 +195,13 @@ void GLBufferObject::compileBuffer()
     if (_allocatedSize != _profile._size)
     {
         _allocatedSize = _profile._size;
-        _extensions->glBufferData(_profile._target, _profile._size, NULL, _profile._usage);
+        allocateStorage();
         compileAll = true;
     }
+    else
+    {
+        _extensions->glBindBuffer(_profile._target, _glObjectID);
+    }
 
     for(BufferEntries::iterator itr = _bufferEntries.begin();
         itr != _bufferEntries.end();
@@ -208,7 +216,7 @@ void GLBufferObject::compileBuffer()
             const osg::Image* image = entry.dataSource->asImage();
             if (image && !(image->isDataContiguous()))
             {
-                unsigned int offset = entry.offset;
+                unsigned int offset = _heapOffset + entry.offset;
                 for(osg::Image::DataIterator img_itr(image); img_itr.valid(); ++img_itr)
                 {
                     //OSG_NOTICE<<"Copying to buffer object using DataIterator, offset="<<offset<<", size="<<img_itr.size()<<", data="<<(void*)img_itr.data()<<std::endl;
@@ -218,17 +226,63 @@ void GLBufferObject::compileBuffer()
             }
             else
             {
-                _extensions->glBufferSubData(_profile._target, (GLintptrARB)entry.offset, (GLsizeiptrARB)entry.dataSize, entry.dataSource->getDataPointer());
+                _extensions->glBufferSubData(_profile._target, (GLintptrARB)(_heapOffset + entry.offset), (GLsizeiptrARB)entry.dataSize, entry.dataSource->getDataPointer());
             }
 
         }
     }
 }
 
+void GLBufferObject::allocateStorage()
+{
+    if (_heap)
+    {
+        _heap->release(_glObjectID, _heapOffset);
+        _heap = 0;
+        _heapOffset = 0;
+        _glObjectID = 0;
+    }
+
+    GLBufferObjectManager* manager = _set ? _set->getParent() : GLBufferObjectManager::getGLBufferObjectManager(_contextID).get();
+    GLBufferHeap* heap = manager->getGLBufferHeap(_profile);
+    if (heap)
+    {
+        GLuint glObjectID = 0;
+        unsigned int offset = 0;
+        if (heap->allocate(_profile._size, glObjectID, offset))
+        {
+            // the storage now comes from the heap so the buffer object is no longer required.
+            if (_glObjectID!=0) _extensions->glDeleteBuffers(1, &_glObjectID);
+
+            _heap = heap;
+            _heapOffset = offset;
+            _glObjectID = glObjectID;
+
+            _extensions->glBindBuffer(_profile._target, _glObjectID);
+            return;
+        }
+    }
+
+    if (_glObjectID==0) _extensions->glGenBuffers(1, &_glObjectID);
+
+    _extensions->glBindBuffer(_profile._target, _glObjectID);
+    _extensions->glBufferData(_profile._target, _profile._size, NULL, _profile._usage);
+}
+
 void GLBufferObject::deleteGLObject()
 {
     OSG_INFO<<"GLBufferObject::deleteGLObject() "<<_glObjectID<<std::endl;
-    if (_glObjectID!=0)
+    if (_heap)
+    {
+        _heap->release(_glObjectID, _heapOffset);
+        _heap = 0;
+        _heapOffset = 0;
+        _glObjectID = 0;
+
+        _allocatedSize = 0;
+        _bufferEntries.clear();
+    }
+    else if (_glObjectID!=0)
     {
         _extensions->glDeleteBuffers(1, &_glObjectID);
         _glObjectID = 0;
@@ -992,12 +1046,261 @@ unsigned int GLBufferObjectSet::computeNumGLBufferObjectsInList() const
 }
 
 
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// BufferSubAllocator
+//
+BufferSubAllocator::BufferSubAllocator(unsigned int size, unsigned int alignment):
+    _size(size),
+    _alignment(alignment<1 ? 1 : alignment),
+    _allocatedSize(0),
+    _pendingSize(0)
+{
+    if (_size>0) addFreeRange(0, _size);
+}
+
+void BufferSubAllocator::addFreeRange(unsigned int offset, unsigned int size)
+{
+    _freeByOffset[offset] = size;
+    _freeBySize.insert(FreeBySizeMap::value_type(size, offset));
+}
+
+void BufferSubAllocator::removeFreeRange(unsigned int offset, unsigned int size)
+{
+    _freeByOffset.erase(offset);
+
+    std::pair<FreeBySizeMap::iterator, FreeBySizeMap::iterator> range = _freeBySize.equal_range(size);
+    for(FreeBySizeMap::iterator itr = range.first; itr != range.second; ++itr)
+    {
+        if (itr->second==offset)
+        {
+            _freeBySize.erase(itr);
+            return;
+        }
+    }
+}
+
+bool BufferSubAllocator::allocate(unsigned int size, unsigned int& offset)
+{
+    // round up to the alignment so that every range starts on an aligned offset.
+    unsigned int alignedSize = size==0 ? _alignment : ((size+_alignment-1)/_alignment)*_alignment;
+    if (alignedSize<size) return false;
+
+    // best fit, the smallest free range that is large enough.
+    FreeBySizeMap::iterator itr = _freeBySize.lower_bound(alignedSize);
+    if (itr==_freeBySize.end()) return false;
+
+    unsigned int rangeOffset = itr->second;
+    unsigned int rangeSize = itr->first;
+
+    removeFreeRange(rangeOffset, rangeSize);
+    if (rangeSize>alignedSize) addFreeRange(rangeOffset+alignedSize, rangeSize-alignedSize);
+
+    _allocations[rangeOffset] = alignedSize;
+    _allocatedSize += alignedSize;
+
+    offset = rangeOffset;
+    return true;
+}
+
+void BufferSubAllocator::release(unsigned int offset, unsigned int frameNumber)
+{
+    OffsetSizeMap::iterator itr = _allocations.find(offset);
+    if (itr==_allocations.end())
+    {
+        OSG_NOTICE<<"Warning: BufferSubAllocator::release("<<offset<<") no range allocated at offset."<<std::endl;
+        return;
+    }
+
+    _pending.push_back(PendingRange(itr->first, itr->second, frameNumber));
+    _allocatedSize -= itr->second;
+    _pendingSize += itr->second;
+
+    _allocations.erase(itr);
+}
+
+void BufferSubAllocator::reclaim(unsigned int frameNumber, unsigned int numFramesToDelay)
+{
+    while(!_pending.empty() &&
+          frameNumber>=_pending.front().frameNumber &&
+          (frameNumber-_pending.front().frameNumber)>=numFramesToDelay)
+    {
+        unsigned int offset = _pending.front().offset;
+        unsigned int size = _pending.front().size;
+
+        _pendingSize -= size;
+        _pending.pop_front();
+
+        // merge with the following free range
+        OffsetSizeMap::iterator next = _freeByOffset.lower_bound(offset);
+        if (next!=_freeByOffset.end() && next->first==offset+size)
+        {
+            size += next->second;
+            removeFreeRange(next->first, next->second);
+        }
+
+        // merge with the preceding free range
+        next = _freeByOffset.lower_bound(offset);
+        if (next!=_freeByOffset.begin())
+        {
+            OffsetSizeMap::iterator previous = next;
+            --previous;
+            if (previous->first+previous->second==offset)
+            {
+                offset = previous->first;
+                size += previous->second;
+                removeFreeRange(previous->first, previous->second);
+            }
+        }
+
+        addFreeRange(offset, size);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// GLBufferHeap
+//
+GLBufferHeap::GLBufferHeap(GLBufferObjectManager* parent, GLenum target, GLenum usage, unsigned int blockSize):
+    _parent(parent),
+    _target(target),
+    _usage(usage),
+    _blockSize(blockSize),
+    _numFramesToDelayReuse(3)
+{
+}
+
+GLBufferHeap::~GLBufferHeap()
+{
+}
+
+bool GLBufferHeap::allocate(unsigned int size, GLuint& glObjectID, unsigned int& offset)
+{
+    if (size>_blockSize) return false;
+
+    for(Blocks::iterator itr = _blocks.begin();
+        itr != _blocks.end();
+        ++itr)
+    {
+        if (itr->allocator->allocate(size, offset))
+        {
+            glObjectID = itr->glObjectID;
+            return true;
+        }
+    }
+
+    GLBufferObject::Extensions* extensions = GLBufferObject::getExtensions(_parent->getContextID(), true);
+
+    Block block;
+    block.glObjectID = 0;
+    extensions->glGenBuffers(1, &block.glObjectID);
+    if (block.glObjectID==0) return false;
+
+    extensions->glBindBuffer(_target, block.glObjectID);
+    extensions->glBufferData(_target, _blockSize, NULL, _usage);
+
+    block.allocator = new BufferSubAllocator(_blockSize);
+    _blocks.push_back(block);
+
+    OSG_INFO<<"GLBufferHeap::allocate() created block "<<block.glObjectID<<" of "<<_blockSize<<" bytes, numBlocks="<<_blocks.size()<<std::endl;
+
+    glObjectID = block.glObjectID;
+    return block.allocator->allocate(size, offset);
+}
+
+void GLBufferHeap::release(GLuint glObjectID, unsigned int offset)
+{
+    for(Blocks::iterator itr = _blocks.begin();
+        itr != _blocks.end();
+        ++itr)
+    {
+        if (itr->glObjectID==glObjectID)
+        {
+            itr->allocator->release(offset, _parent->getFrameNumber());
+            return;
+        }
+    }
+}
+
+void GLBufferHeap::reclaim(unsigned int frameNumber)
+{
+    for(unsigned int i=0; i<_blocks.size();)
+    {
+        BufferSubAllocator* allocator = _blocks[i].allocator.get();
+        allocator->reclaim(frameNumber, _numFramesToDelayReuse);
+
+        // keep the first block so that paging a few buffers in and out doesn't keep creating and deleting blocks.
+        if (i>0 && allocator->isEmpty())
+        {
+            OSG_INFO<<"GLBufferHeap::reclaim() deleting unused block "<<_blocks[i].glObjectID<<std::endl;
+
+            GLBufferObject::getExtensions(_parent->getContextID(), true)->glDeleteBuffers(1, &_blocks[i].glObjectID);
+            _blocks.erase(_blocks.begin()+i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+void GLBufferHeap::deleteAllBlocks()
+{
+    GLBufferObject::Extensions* extensions = GLBufferObject::getExtensions(_parent->getContextID(), true);
+    for(Blocks::iterator itr = _blocks.begin();
+        itr != _blocks.end();
+        ++itr)
+    {
+        extensions->glDeleteBuffers(1, &(itr->glObjectID));
+    }
+    _blocks.clear();
+}
+
+void GLBufferHeap::discardAllBlocks()
+{
+    _blocks.clear();
+}
+
+unsigned int GLBufferHeap::getAllocatedSize() const
+{
+    unsigned int size = 0;
+    for(Blocks::const_iterator itr = _blocks.begin();
+        itr != _blocks.end();
+        ++itr)
+    {
+        size += itr->allocator->getAllocatedSize();
+    }
+    return size;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// GLBufferObjectManager
+//
+static ApplicationUsageProxy GLBufferObjectManager_e0(ApplicationUsage::ENVIRONMENTAL_VARIABLE,
+        "OSG_BUFFER_HEAP_BLOCK_SIZE <int>",
+        "Set the size in bytes of the buffer objects that small, static vertex and element buffers are suballocated from, 0 disables suballocation.");
+
+static unsigned int getDefaultGLBufferHeapBlockSize()
+{
+    static unsigned int s_blockSize = 0;
+    static bool s_initialized = false;
+    if (!s_initialized)
+    {
+        const char* ptr = getenv("OSG_BUFFER_HEAP_BLOCK_SIZE");
+        if (ptr) s_blockSize = atoi(ptr);
+        s_initialized = true;
+    }
+    return s_blockSize;
+}
+
 GLBufferObjectManager::GLBufferObjectManager(unsigned int contextID):
     _contextID(contextID),
     _numActiveGLBufferObjects(0),
     _numOrphanedGLBufferObjects(0),
     _currGLBufferObjectPoolSize(0),
     _maxGLBufferObjectPoolSize(0),
+    _glBufferHeapBlockSize(getDefaultGLBufferHeapBlockSize()),
     _frameNumber(0),
     _numFrames(0),
     _numDeleted(0),
@@ -1054,6 +1357,23 @@ GLBufferObjectSet* GLBufferObjectManager::getGLBufferObjectSet(const BufferObjec
     return tos.get();
 }
 
+bool GLBufferObjectManager::isGLBufferHeapSupported(GLenum target, GLenum usage) const
+{
+    return _glBufferHeapBlockSize>0 &&
+           (target==GL_ARRAY_BUFFER_ARB || target==GL_ELEMENT_ARRAY_BUFFER_ARB) &&
+           usage==GL_STATIC_DRAW_ARB;
+}
+
+GLBufferHeap* GLBufferObjectManager::getGLBufferHeap(const BufferObjectProfile& profile)
+{
+    // only small buffers are suballocated, large ones gain little and would fragment the heap.
+    if (!isGLBufferHeapSupported(profile._target, profile._usage) || profile._size>_glBufferHeapBlockSize/4) return 0;
+
+    osg::ref_ptr<GLBufferHeap>& heap = _glBufferHeapMap[std::pair<GLenum, GLenum>(profile._target, profile._usage)];
+    if (!heap) heap = new GLBufferHeap(this, profile._target, profile._usage, _glBufferHeapBlockSize);
+    return heap.get();
+}
+
 void GLBufferObjectManager::handlePendingOrphandedGLBufferObjects()
 {
     for(GLBufferObjectSetMap::iterator itr = _glBufferObjectSetMap.begin();
@@ -1074,6 +1394,13 @@ void GLBufferObjectManager::deleteAllGLBufferObjects()
     {
         (*itr).second->deleteAllGLBufferObjects();
     }
+
+    for(GLBufferHeapMap::iterator itr = _glBufferHeapMap.begin();
+        itr != _glBufferHeapMap.end();
+        ++itr)
+    {
+        (*itr).second->deleteAllBlocks();
+    }
 }
 
 void GLBufferObjectManager::discardAllGLBufferObjects()
@@ -1084,6 +1411,13 @@ void GLBufferObjectManager::discardAllGLBufferObjects()
     {
         (*itr).second->discardAllGLBufferObjects();
     }
+
+    for(GLBufferHeapMap::iterator itr = _glBufferHeapMap.begin();
+        itr != _glBufferHeapMap.end();
+        ++itr)
+    {
+        (*itr).second->discardAllBlocks();
+    }
 }
 
 void GLBufferObjectManager::flushAllDeletedGLBufferObjects()
@@ -1133,6 +1467,13 @@ void GLBufferObjectManager::newFrame(osg::FrameStamp* fs)
     else ++_frameNumber;
 
     ++_numFrames;
+
+    for(GLBufferHeapMap::iterator itr = _glBufferHeapMap.begin();
+        itr != _glBufferHeapMap.end();
+        ++itr)
+    {
+        (*itr).second->reclaim(_frameNumber);
+    }
 }
 
 void GLBufferObjectManager::reportStats(std::ostream& out)
@@ -1145,6 +1486,13 @@ void GLBufferObjectManager::reportStats(std::ostream& out)
     out<<"   total _numApplied="<<_numApplied<<", _applyTime="<<_applyTime<<", averagePerFrame="<<_applyTime/numFrames*1000.0<<"ms"<<std::endl;
     out<<"   getMaxGLBufferObjectPoolSize()="<<getMaxGLBufferObjectPoolSize()<<" current/max size = "<<double(_currGLBufferObjectPoolSize)/double(getMaxGLBufferObjectPoolSize())<<std::endl;;
 
+    for(GLBufferHeapMap::const_iterator itr = _glBufferHeapMap.begin();
+        itr != _glBufferHeapMap.end();
+        ++itr)
+    {
+        out<<"   GLBufferHeap target="<<std::hex<<itr->first.first<<std::dec<<", numBlocks="<<itr->second->getNumBlocks()<<", allocatedSize="<<itr->second->getAllocatedSize()<<std::endl;
+    }
+
     recomputeStats(out);
 
 }
@@ -178,6 +178,21 @@ void CollectOccludersVisitor::apply(osg::OccluderNode& node)
         }
     }
 
+    // rasterize the occluder into the occlusion buffer, once the node has been found not to be hidden by the
+    // occluders already rasterized.
+    if ((getCullingMode()&SOFTWARE_OCCLUSION_CULLING) && getOcclusionBuffer())
+    {
+        Matrix localToClip = (*getModelViewMatrix()) * (*getProjectionMatrix());
+        if (node.getOccluderGeometry())
+        {
+            getOcclusionBuffer()->rasterize(localToClip, *node.getOccluderGeometry());
+        }
+        if (node.getOccluder())
+        {
+            getOcclusionBuffer()->rasterize(localToClip, *node.getOccluder());
+        }
+    }
+
     handle_cull_callbacks_and_traverse(node);
 
     // pop the culling mode.
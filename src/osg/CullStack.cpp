@@ -184,6 +184,12 @@ void CullStack::pushProjectionMatrix(RefMatrix* matrix)
         }
     }
 
+    // set up the occlusion buffer if it was rasterized with this projection.
+    if ((_cullingMode&SOFTWARE_OCCLUSION_CULLING) && _occlusionBuffer.valid() &&
+        _occlusionBuffer->getProjectionMatrix()==*matrix)
+    {
+        cullingSet.setOcclusionBuffer(_occlusionBuffer.get(), *matrix);
+    }
 
 
     // need to recompute frustum volume.
@@ -199,6 +199,19 @@ BoundingSphere Geode::computeBound() const
     return bsphere;
 }
 
+BoundingBox Geode::computeAxisAlignedBound() const
+{
+    // computeBound() leaves the union of the drawables' boxes in _bbox, subclasses such as Billboard place their
+    // drawables differently so fall back to the box around their bounding sphere.
+    getBound();
+
+    BoundingSphere bsphere;
+    if (_bbox.valid()) bsphere.expandBy(_bbox);
+    if (!isBoundComputedAs(bsphere)) return Node::computeAxisAlignedBound();
+
+    return _bbox;
+}
+
 void Geode::compileDrawables(RenderInfo& renderInfo)
 {
     for(DrawableList::iterator itr = _drawables.begin();
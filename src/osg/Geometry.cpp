@@ -50,6 +50,7 @@ Geometry::Geometry()
 Geometry::Geometry(const Geometry& geometry,const CopyOp& copyop):
     Drawable(geometry,copyop),
     _vertexData(geometry._vertexData,copyop),
+    _vertexDecodeMatrix(geometry._vertexDecodeMatrix.valid() ? new RefMatrix(*geometry._vertexDecodeMatrix) : 0),
     _normalData(geometry._normalData,copyop),
     _colorData(geometry._colorData,copyop),
     _secondaryColorData(geometry._secondaryColorData,copyop),
@@ -144,6 +145,107 @@ void Geometry::setVertexData(const ArrayData& arrayData)
     if (_useVertexBufferObjects && arrayData.array.valid()) addVertexBufferObjectIfRequired(arrayData.array.get());
 }
 
+void Geometry::setVertexDecodeMatrix(RefMatrix* matrix)
+{
+    _vertexDecodeMatrix = matrix;
+
+    // the decode matrix is applied to the modelview matrix when drawing, which can't be compiled into a display list.
+    if (_vertexDecodeMatrix.valid()) setSupportsDisplayList(false);
+
+    dirtyDisplayList();
+    dirtyBound();
+}
+
+namespace
+{
+
+template<class ARRAY>
+void decodeVertices(const ARRAY& array, const Matrix& matrix, Vec3Array& decoded)
+{
+    decoded.resize(array.size());
+    for(unsigned int i=0; i<array.size(); ++i)
+    {
+        Vec3d v;
+        for(unsigned int c=0; c<ARRAY::ElementDataType::num_components && c<3; ++c) v[c] = array[i][c];
+        decoded[i] = v * matrix;
+    }
+}
+
+// apply the decode matrix of quantized vertices to the modelview matrix for the duration of a draw.
+struct ApplyVertexDecodeMatrix
+{
+    ApplyVertexDecodeMatrix(State& state, const RefMatrix* decodeMatrix):
+        _state(state),
+        _decodeMatrix(decodeMatrix),
+        _rescaleNormal(false)
+    {
+        if (!_decodeMatrix) return;
+
+        _modelView = state.getModelViewMatrix();
+        state.applyModelViewMatrix((*_decodeMatrix) * _modelView);
+
+        // the matrix uniforms are otherwise only passed to the program by RenderLeaf::render() before the draw.
+        if (state.getUseModelViewAndProjectionUniforms()) state.applyModelViewAndProjectionUniformsIfRequired();
+
+    #if defined(OSG_GL_FIXED_FUNCTION_AVAILABLE)
+        // the normals are scaled along with the vertices
+        _rescaleNormal = state.getLastAppliedMode(GL_RESCALE_NORMAL);
+        state.applyMode(GL_RESCALE_NORMAL, true);
+    #endif
+    }
+
+    ~ApplyVertexDecodeMatrix()
+    {
+        if (!_decodeMatrix) return;
+
+        _state.applyModelViewMatrix(_modelView);
+        if (_state.getUseModelViewAndProjectionUniforms()) _state.applyModelViewAndProjectionUniformsIfRequired();
+
+    #if defined(OSG_GL_FIXED_FUNCTION_AVAILABLE)
+        _state.applyMode(GL_RESCALE_NORMAL, _rescaleNormal);
+    #endif
+    }
+
+    State&              _state;
+    const RefMatrix*    _decodeMatrix;
+    Matrix              _modelView;
+    bool                _rescaleNormal;
+
+protected:
+
+    ApplyVertexDecodeMatrix& operator = (const ApplyVertexDecodeMatrix&) { return *this; }
+};
+
+}
+
+Vec3Array* Geometry::createDecodedVertexArray() const
+{
+    const Array* vertices = _vertexData.array.get();
+    if (!_vertexDecodeMatrix || !vertices) return 0;
+
+    ref_ptr<Vec3Array> decoded = new Vec3Array;
+    const Matrix& matrix = *_vertexDecodeMatrix;
+    switch(vertices->getType())
+    {
+        case(Array::Vec2sArrayType): decodeVertices(*static_cast<const Vec2sArray*>(vertices), matrix, *decoded); break;
+        case(Array::Vec3sArrayType): decodeVertices(*static_cast<const Vec3sArray*>(vertices), matrix, *decoded); break;
+        case(Array::Vec4sArrayType): decodeVertices(*static_cast<const Vec4sArray*>(vertices), matrix, *decoded); break;
+        case(Array::Vec2bArrayType): decodeVertices(*static_cast<const Vec2bArray*>(vertices), matrix, *decoded); break;
+        case(Array::Vec3bArrayType): decodeVertices(*static_cast<const Vec3bArray*>(vertices), matrix, *decoded); break;
+        case(Array::Vec4bArrayType): decodeVertices(*static_cast<const Vec4bArray*>(vertices), matrix, *decoded); break;
+        case(Array::Vec2ArrayType): decodeVertices(*static_cast<const Vec2Array*>(vertices), matrix, *decoded); break;
+        case(Array::Vec3ArrayType): decodeVertices(*static_cast<const Vec3Array*>(vertices), matrix, *decoded); break;
+        case(Array::Vec4ArrayType): decodeVertices(*static_cast<const Vec4Array*>(vertices), matrix, *decoded); break;
+        case(Array::Vec2dArrayType): decodeVertices(*static_cast<const Vec2dArray*>(vertices), matrix, *decoded); break;
+        case(Array::Vec3dArrayType): decodeVertices(*static_cast<const Vec3dArray*>(vertices), matrix, *decoded); break;
+        case(Array::Vec4dArrayType): decodeVertices(*static_cast<const Vec4dArray*>(vertices), matrix, *decoded); break;
+        default:
+            OSG_WARN<<"Warning: Geometry::createDecodedVertexArray() cannot decode Vertex Array type"<<vertices->getType()<<std::endl;
+            return 0;
+    }
+    return decoded.release();
+}
+
 void Geometry::setNormalArray(Array* array)
 {
     _normalData.array = array;
@@ -1007,21 +1109,39 @@ void Geometry::drawImplementation(RenderInfo& renderInfo) const
     }
 #endif
 
+    State& state = *renderInfo.getState();
+
+    ApplyVertexDecodeMatrix applyVertexDecodeMatrix(state, _vertexDecodeMatrix.get());
+
     if (_internalOptimizedGeometry.valid())
     {
         _internalOptimizedGeometry->drawImplementation(renderInfo);
         return;
     }
 
-    State& state = *renderInfo.getState();
-
     bool checkForGLErrors = state.getCheckForGLErrors()==osg::State::ONCE_PER_ATTRIBUTE;
     if (checkForGLErrors) state.checkGLErrors("start of Geometry::drawImplementation()");
 
+    drawVertexArraysImplementation(renderInfo);
+
+    if (checkForGLErrors) state.checkGLErrors("Geometry::drawImplementation() after vertex arrays setup.");
+
+    drawPrimitivesImplementation(renderInfo);
+
+    // unbind the VBO's if any are used.
+    state.unbindVertexBufferObject();
+    state.unbindElementBufferObject();
+
+    if (checkForGLErrors) state.checkGLErrors("end of Geometry::drawImplementation().");
+}
+
+void Geometry::drawVertexArraysImplementation(RenderInfo& renderInfo) const
+{
+    State& state = *renderInfo.getState();
+
     bool useFastPath = areFastPathsUsed();
     // useFastPath = false;
 
-    bool usingVertexBufferObjects = _useVertexBufferObjects && state.isVertexBufferObjectSupported();
     bool handleVertexAttributes = !_vertexAttribList.empty();
 
     ArrayDispatchers& arrayDispatchers = state.getArrayDispatchers();
@@ -1096,14 +1216,22 @@ void Geometry::drawImplementation(RenderInfo& renderInfo) const
     }
 
     state.applyDisablingOfVertexAttributes();
+}
+
+void Geometry::drawPrimitivesImplementation(RenderInfo& renderInfo) const
+{
+    State& state = *renderInfo.getState();
+
+    bool useFastPath = areFastPathsUsed();
+    bool usingVertexBufferObjects = _useVertexBufferObjects && state.isVertexBufferObjectSupported();
+
+    ArrayDispatchers& arrayDispatchers = state.getArrayDispatchers();
 
     bool bindPerPrimitiveSetActive = arrayDispatchers.active(BIND_PER_PRIMITIVE_SET);
     bool bindPerPrimitiveActive = arrayDispatchers.active(BIND_PER_PRIMITIVE);
 
     unsigned int primitiveNum = 0;
 
-    if (checkForGLErrors) state.checkGLErrors("Geometry::drawImplementation() after vertex arrays setup.");
-
 
     ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     //
@@ -1273,12 +1401,6 @@ void Geometry::drawImplementation(RenderInfo& renderInfo) const
             }
         }
     }
-
-    // unbind the VBO's if any are used.
-    state.unbindVertexBufferObject();
-    state.unbindElementBufferObject();
-
-    if (checkForGLErrors) state.checkGLErrors("end of Geometry::drawImplementation().");
 }
 
 class AttributeFunctorArrayVisitor : public ArrayVisitor
@@ -1442,6 +1564,15 @@ void Geometry::accept(PrimitiveFunctor& functor) const
 
     if (!vertices || vertices->getNumElements()==0) return;
 
+    // pass on the decoded coordinates of quantized vertices
+    ref_ptr<Vec3Array> decodedVertices;
+    if (_vertexDecodeMatrix.valid() && vertices==_vertexData.array.get())
+    {
+        decodedVertices = createDecodedVertexArray();
+        if (!decodedVertices) return;
+        vertices = decodedVertices.get();
+    }
+
     if (!indices)
     {
         switch(vertices->getType())
@@ -1741,6 +1872,15 @@ void Geometry::accept(PrimitiveIndexFunctor& functor) const
 
     if (!vertices || vertices->getNumElements()==0) return;
 
+    // pass on the decoded coordinates of quantized vertices
+    ref_ptr<Vec3Array> decodedVertices;
+    if (_vertexDecodeMatrix.valid() && vertices==_vertexData.array.get())
+    {
+        decodedVertices = createDecodedVertexArray();
+        if (!decodedVertices) return;
+        vertices = decodedVertices.get();
+    }
+
     switch(vertices->getType())
     {
     case(Array::Vec2ArrayType):
@@ -2749,3 +2889,75 @@ Geometry* osg::createTexturedQuadGeometry(const Vec3& corner,const Vec3& widthVe
 
     return geom;
 }
+
+Vec3sArray* osg::quantizeVertexArray(const Array* array, Matrixd& decodeMatrix)
+{
+    const Vec3Array* vertices = dynamic_cast<const Vec3Array*>(array);
+    if (!vertices || vertices->empty()) return 0;
+
+    BoundingBox bb;
+    for(Vec3Array::const_iterator itr = vertices->begin(); itr != vertices->end(); ++itr)
+    {
+        bb.expandBy(*itr);
+    }
+
+    Vec3d center = bb.center();
+    double extent = maximum(bb.xMax()-bb.xMin(), maximum(bb.yMax()-bb.yMin(), bb.zMax()-bb.zMin())) * 0.5;
+    double scale = extent>0.0 ? extent/32767.0 : 1.0;
+
+    Vec3sArray* quantized = new Vec3sArray(vertices->size());
+    for(unsigned int i=0; i<vertices->size(); ++i)
+    {
+        Vec3d v = (Vec3d((*vertices)[i]) - center) / scale;
+        (*quantized)[i].set(static_cast<short>(floor(v.x()+0.5)),
+                            static_cast<short>(floor(v.y()+0.5)),
+                            static_cast<short>(floor(v.z()+0.5)));
+    }
+
+    decodeMatrix = Matrixd::scale(scale, scale, scale) * Matrixd::translate(center);
+    return quantized;
+}
+
+Vec3bArray* osg::quantizeNormalArray(const Array* array)
+{
+    const Vec3Array* normals = dynamic_cast<const Vec3Array*>(array);
+    if (!normals) return 0;
+
+    Vec3bArray* quantized = new Vec3bArray(normals->size());
+    for(unsigned int i=0; i<normals->size(); ++i)
+    {
+        const Vec3& n = (*normals)[i];
+        (*quantized)[i].set(static_cast<signed char>(floorf(clampBetween(n.x(), -1.0f, 1.0f)*127.0f+0.5f)),
+                            static_cast<signed char>(floorf(clampBetween(n.y(), -1.0f, 1.0f)*127.0f+0.5f)),
+                            static_cast<signed char>(floorf(clampBetween(n.z(), -1.0f, 1.0f)*127.0f+0.5f)));
+    }
+    return quantized;
+}
+
+Vec4ubArray* osg::quantizeColorArray(const Array* array)
+{
+    const Vec4Array* colors4 = dynamic_cast<const Vec4Array*>(array);
+    const Vec3Array* colors3 = dynamic_cast<const Vec3Array*>(array);
+    if (!colors4 && !colors3) return 0;
+
+    unsigned int numColors = array->getNumElements();
+    unsigned int numComponents = colors4 ? 4 : 3;
+    const float* values = static_cast<const float*>(array->getDataPointer());
+
+    // colors outside 0..1 can't be represented
+    for(unsigned int i=0; i<numColors*numComponents; ++i)
+    {
+        if (!(values[i]>=0.0f && values[i]<=1.0f)) return 0;
+    }
+
+    Vec4ubArray* quantized = new Vec4ubArray(numColors);
+    for(unsigned int i=0; i<numColors; ++i)
+    {
+        Vec4 c = colors4 ? (*colors4)[i] : Vec4((*colors3)[i], 1.0f);
+        (*quantized)[i].set(static_cast<unsigned char>(floorf(c.r()*255.0f+0.5f)),
+                            static_cast<unsigned char>(floorf(c.g()*255.0f+0.5f)),
+                            static_cast<unsigned char>(floorf(c.b()*255.0f+0.5f)),
+                            static_cast<unsigned char>(floorf(c.a()*255.0f+0.5f)));
+    }
+    return quantized;
+}
@@ -379,6 +379,29 @@ BoundingSphere Group::computeBound() const
     return bsphere;
 }
 
+BoundingBox Group::computeAxisAlignedBound() const
+{
+    if (!isBoundComputedAs(Group::computeBound())) return Node::computeAxisAlignedBound();
+
+    return computeChildrenBoundingBox();
+}
+
+BoundingBox Group::computeChildrenBoundingBox() const
+{
+    BoundingBox bb;
+    for(NodeList::const_iterator itr=_children.begin();
+        itr!=_children.end();
+        ++itr)
+    {
+        const osg::Transform* transform = (*itr)->asTransform();
+        if (!transform || transform->getReferenceFrame()==osg::Transform::RELATIVE_RF)
+        {
+            bb.expandBy((*itr)->getAxisAlignedBound());
+        }
+    }
+    return bb;
+}
+
 void Group::setThreadSafeRefUnref(bool threadSafe)
 {
     Node::setThreadSafeRefUnref(threadSafe);
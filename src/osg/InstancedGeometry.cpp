@@ -0,0 +1,749 @@
+/* -*-c++-*- OpenSceneGraph - Copyright (C) 1998-2006 Robert Osfield
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+*/
+#include <osg/InstancedGeometry>
+#include <osg/Polytope>
+#include <osg/TemplatePrimitiveFunctor>
+#include <osg/Notify>
+
+#include <OpenThreads/ScopedLock>
+
+#include <string.h>
+
+using namespace osg;
+
+namespace
+{
+
+struct ComputeModelBound
+{
+    void operator() (const Vec3& v1, bool) { bb.expandBy(v1); }
+    void operator() (const Vec3& v1, const Vec3& v2, bool) { bb.expandBy(v1); bb.expandBy(v2); }
+    void operator() (const Vec3& v1, const Vec3& v2, const Vec3& v3, bool) { bb.expandBy(v1); bb.expandBy(v2); bb.expandBy(v3); }
+    void operator() (const Vec3& v1, const Vec3& v2, const Vec3& v3, const Vec3& v4, bool) { bb.expandBy(v1); bb.expandBy(v2); bb.expandBy(v3); bb.expandBy(v4); }
+
+    BoundingBox bb;
+};
+
+// passes the primitives on to another PrimitiveFunctor with the vertices transformed by the instance matrix.
+class TransformPrimitiveFunctor : public PrimitiveFunctor
+{
+    public:
+
+        TransformPrimitiveFunctor(PrimitiveFunctor& functor): _functor(functor) {}
+
+        void setMatrix(const Matrixf& matrix) { _matrix = matrix; }
+
+        virtual void setVertexArray(unsigned int count,const Vec2* vertices)
+        {
+            _vertices.resize(count);
+            for(unsigned int i=0; i<count; ++i) _vertices[i] = Vec3(vertices[i].x(), vertices[i].y(), 0.0f) * _matrix;
+            _functor.setVertexArray(count, count>0 ? &_vertices.front() : 0);
+        }
+
+        virtual void setVertexArray(unsigned int count,const Vec3* vertices)
+        {
+            _vertices.resize(count);
+            for(unsigned int i=0; i<count; ++i) _vertices[i] = vertices[i] * _matrix;
+            _functor.setVertexArray(count, count>0 ? &_vertices.front() : 0);
+        }
+
+        virtual void setVertexArray(unsigned int count,const Vec4* vertices)
+        {
+            _vertices4.resize(count);
+            for(unsigned int i=0; i<count; ++i) _vertices4[i] = vertices[i] * _matrix;
+            _functor.setVertexArray(count, count>0 ? &_vertices4.front() : 0);
+        }
+
+        virtual void setVertexArray(unsigned int count,const Vec2d* vertices)
+        {
+            _verticesd.resize(count);
+            for(unsigned int i=0; i<count; ++i) _verticesd[i] = Vec3d(vertices[i].x(), vertices[i].y(), 0.0) * Matrixd(_matrix);
+            _functor.setVertexArray(count, count>0 ? &_verticesd.front() : 0);
+        }
+
+        virtual void setVertexArray(unsigned int count,const Vec3d* vertices)
+        {
+            Matrixd matrix(_matrix);
+            _verticesd.resize(count);
+            for(unsigned int i=0; i<count; ++i) _verticesd[i] = vertices[i] * matrix;
+            _functor.setVertexArray(count, count>0 ? &_verticesd.front() : 0);
+        }
+
+        virtual void setVertexArray(unsigned int count,const Vec4d* vertices)
+        {
+            Matrixd matrix(_matrix);
+            _vertices4d.resize(count);
+            for(unsigned int i=0; i<count; ++i) _vertices4d[i] = vertices[i] * matrix;
+            _functor.setVertexArray(count, count>0 ? &_vertices4d.front() : 0);
+        }
+
+        virtual void drawArrays(GLenum mode,GLint first,GLsizei count) { _functor.drawArrays(mode, first, count); }
+        virtual void drawElements(GLenum mode,GLsizei count,const GLubyte* indices) { _functor.drawElements(mode, count, indices); }
+        virtual void drawElements(GLenum mode,GLsizei count,const GLushort* indices) { _functor.drawElements(mode, count, indices); }
+        virtual void drawElements(GLenum mode,GLsizei count,const GLuint* indices) { _functor.drawElements(mode, count, indices); }
+
+        virtual void begin(GLenum mode) { _functor.begin(mode); }
+        virtual void vertex(const Vec2& vert) { _functor.vertex(Vec3(vert.x(), vert.y(), 0.0f) * _matrix); }
+        virtual void vertex(const Vec3& vert) { _functor.vertex(vert * _matrix); }
+        virtual void vertex(const Vec4& vert) { _functor.vertex(vert * _matrix); }
+        virtual void vertex(float x,float y) { vertex(Vec3(x, y, 0.0f)); }
+        virtual void vertex(float x,float y,float z) { vertex(Vec3(x, y, z)); }
+        virtual void vertex(float x,float y,float z,float w) { vertex(Vec4(x, y, z, w)); }
+        virtual void end() { _functor.end(); }
+
+    protected:
+
+        TransformPrimitiveFunctor& operator = (const TransformPrimitiveFunctor&) { return *this; }
+
+        PrimitiveFunctor&   _functor;
+        Matrixf             _matrix;
+        std::vector<Vec3>   _vertices;
+        std::vector<Vec4>   _vertices4;
+        std::vector<Vec3d>  _verticesd;
+        std::vector<Vec4d>  _vertices4d;
+};
+
+// records the vertices that Geometry passes to a PrimitiveIndexFunctor, which are decoded when quantized.
+class CollectVerticesFunctor : public PrimitiveIndexFunctor
+{
+    public:
+
+        virtual void setVertexArray(unsigned int count,const Vec2* vertices) { _vertices.resize(count); for(unsigned int i=0; i<count; ++i) _vertices[i].set(vertices[i].x(), vertices[i].y(), 0.0f); }
+        virtual void setVertexArray(unsigned int count,const Vec3* vertices) { _vertices.assign(vertices, vertices+count); }
+        virtual void setVertexArray(unsigned int count,const Vec4* vertices) { _vertices.resize(count); for(unsigned int i=0; i<count; ++i) _vertices[i].set(vertices[i].x(), vertices[i].y(), vertices[i].z()); }
+        virtual void setVertexArray(unsigned int count,const Vec2d* vertices) { _vertices.resize(count); for(unsigned int i=0; i<count; ++i) _vertices[i].set(vertices[i].x(), vertices[i].y(), 0.0f); }
+        virtual void setVertexArray(unsigned int count,const Vec3d* vertices) { _vertices.resize(count); for(unsigned int i=0; i<count; ++i) _vertices[i] = vertices[i]; }
+        virtual void setVertexArray(unsigned int count,const Vec4d* vertices) { _vertices.resize(count); for(unsigned int i=0; i<count; ++i) _vertices[i].set(vertices[i].x(), vertices[i].y(), vertices[i].z()); }
+
+        virtual void drawArrays(GLenum,GLint,GLsizei) {}
+        virtual void drawElements(GLenum,GLsizei,const GLubyte*) {}
+        virtual void drawElements(GLenum,GLsizei,const GLushort*) {}
+        virtual void drawElements(GLenum,GLsizei,const GLuint*) {}
+
+        virtual void begin(GLenum) {}
+        virtual void vertex(unsigned int) {}
+        virtual void end() {}
+
+        std::vector<Vec3> _vertices;
+};
+
+// passes the primitives of an instance on to another PrimitiveIndexFunctor, with the indices offset to the
+// vertices of the instance within the vertices of all the instances.
+class OffsetPrimitiveIndexFunctor : public PrimitiveIndexFunctor
+{
+    public:
+
+        OffsetPrimitiveIndexFunctor(PrimitiveIndexFunctor& functor): _functor(functor), _offset(0) {}
+
+        void setOffset(unsigned int offset) { _offset = offset; }
+
+        // the vertices of all the instances have already been passed on.
+        virtual void setVertexArray(unsigned int,const Vec2*) {}
+        virtual void setVertexArray(unsigned int,const Vec3*) {}
+        virtual void setVertexArray(unsigned int,const Vec4*) {}
+        virtual void setVertexArray(unsigned int,const Vec2d*) {}
+        virtual void setVertexArray(unsigned int,const Vec3d*) {}
+        virtual void setVertexArray(unsigned int,const Vec4d*) {}
+
+        virtual void drawArrays(GLenum mode,GLint first,GLsizei count) { _functor.drawArrays(mode, first+_offset, count); }
+        virtual void drawElements(GLenum mode,GLsizei count,const GLubyte* indices) { drawOffsetElements(mode, count, indices); }
+        virtual void drawElements(GLenum mode,GLsizei count,const GLushort* indices) { drawOffsetElements(mode, count, indices); }
+        virtual void drawElements(GLenum mode,GLsizei count,const GLuint* indices) { drawOffsetElements(mode, count, indices); }
+
+        virtual void begin(GLenum mode) { _functor.begin(mode); }
+        virtual void vertex(unsigned int pos) { _functor.vertex(pos+_offset); }
+        virtual void end() { _functor.end(); }
+
+    protected:
+
+        OffsetPrimitiveIndexFunctor& operator = (const OffsetPrimitiveIndexFunctor&) { return *this; }
+
+        template<typename T>
+        void drawOffsetElements(GLenum mode, GLsizei count, const T* indices)
+        {
+            if (count<=0) return;
+
+            _indices.resize(count);
+            for(GLsizei i=0; i<count; ++i) _indices[i] = indices[i]+_offset;
+            _functor.drawElements(mode, count, &_indices.front());
+        }
+
+        PrimitiveIndexFunctor&  _functor;
+        unsigned int            _offset;
+        std::vector<GLuint>     _indices;
+};
+
+// copy the three rows of the column vector form of an affine matrix, the first three columns of the Matrixf.
+inline void copyInstanceMatrixRows(const Matrixf& matrix, float* rows)
+{
+    for(unsigned int row=0; row<3; ++row)
+    {
+        for(unsigned int c=0; c<4; ++c) rows[row*4+c] = matrix(c,row);
+    }
+}
+
+const unsigned int INSTANCE_MATRIX_ROWS_SIZE = 12*sizeof(float);
+
+void drawElementsInstanced(State& state, GLenum mode, const PrimitiveSet* primitiveset, GLenum type, GLsizei numInstances, bool useVertexBufferObjects)
+{
+    if (primitiveset->getNumIndices()==0) return;
+
+    GLBufferObject* ebo = useVertexBufferObjects ? primitiveset->getOrCreateGLBufferObject(state.getContextID()) : 0;
+    if (ebo)
+    {
+        state.bindElementBufferObject(ebo);
+        state.glDrawElementsInstanced(mode, primitiveset->getNumIndices(), type, (const GLvoid *)(ebo->getOffset(primitiveset->getBufferIndex())), numInstances);
+    }
+    else
+    {
+        state.unbindElementBufferObject();
+        state.glDrawElementsInstanced(mode, primitiveset->getNumIndices(), type, primitiveset->getDataPointer(), numInstances);
+    }
+}
+
+// equivalent of PrimitiveSet::draw() with numInstances in place of the primitive set's own NumInstances.
+void drawPrimitiveSetInstanced(State& state, const PrimitiveSet* primitiveset, GLsizei numInstances, bool useVertexBufferObjects)
+{
+    GLenum mode = primitiveset->getMode();
+    #if defined(OSG_GLES1_AVAILABLE) || defined(OSG_GLES2_AVAILABLE)
+        if (mode==GL_POLYGON) mode = GL_TRIANGLE_FAN;
+        if (mode==GL_QUAD_STRIP) mode = GL_TRIANGLE_STRIP;
+    #endif
+
+    switch(primitiveset->getType())
+    {
+        case(PrimitiveSet::DrawArraysPrimitiveType):
+        {
+            const DrawArrays* drawArrays = static_cast<const DrawArrays*>(primitiveset);
+            #if defined(OSG_GLES1_AVAILABLE) || defined(OSG_GLES2_AVAILABLE)
+                if (mode==GL_QUADS)
+                {
+                    state.drawQuads(drawArrays->getFirst(), drawArrays->getCount(), numInstances);
+                    break;
+                }
+            #endif
+            state.glDrawArraysInstanced(mode, drawArrays->getFirst(), drawArrays->getCount(), numInstances);
+            break;
+        }
+        case(PrimitiveSet::DrawArrayLengthsPrimitiveType):
+        {
+            const DrawArrayLengths* drawArrayLengths = static_cast<const DrawArrayLengths*>(primitiveset);
+            GLint first = drawArrayLengths->getFirst();
+            for(DrawArrayLengths::const_iterator itr=drawArrayLengths->begin();
+                itr!=drawArrayLengths->end();
+                ++itr)
+            {
+                #if defined(OSG_GLES1_AVAILABLE) || defined(OSG_GLES2_AVAILABLE)
+                    if (mode==GL_QUADS) state.drawQuads(first, *itr, numInstances);
+                    else
+                #endif
+                state.glDrawArraysInstanced(mode, first, *itr, numInstances);
+                first += *itr;
+            }
+            break;
+        }
+        case(PrimitiveSet::DrawElementsUBytePrimitiveType):
+            drawElementsInstanced(state, mode, primitiveset, GL_UNSIGNED_BYTE, numInstances, useVertexBufferObjects);
+            break;
+        case(PrimitiveSet::DrawElementsUShortPrimitiveType):
+            drawElementsInstanced(state, mode, primitiveset, GL_UNSIGNED_SHORT, numInstances, useVertexBufferObjects);
+            break;
+        case(PrimitiveSet::DrawElementsUIntPrimitiveType):
+            drawElementsInstanced(state, mode, primitiveset, GL_UNSIGNED_INT, numInstances, useVertexBufferObjects);
+            break;
+        default:
+            break;
+    }
+}
+
+template<typename T>
+void readValues(const GLvoid* data, unsigned int index, GLint size, float scale, float* value)
+{
+    const T* ptr = static_cast<const T*>(data) + index*size;
+    for(GLint i=0; i<size && i<4; ++i) value[i] = static_cast<float>(ptr[i])*scale;
+}
+
+// read the per instance value of an attribute, as passed to glVertexAttrib4f when drawing without instanced arrays.
+bool getInstanceAttribValue(const Array* array, unsigned int index, GLboolean normalize, float* value)
+{
+    value[0] = 0.0f; value[1] = 0.0f; value[2] = 0.0f; value[3] = 1.0f;
+
+    const GLvoid* data = array->getDataPointer();
+    GLint size = array->getDataSize();
+    switch(array->getDataType())
+    {
+        case(GL_FLOAT): readValues<GLfloat>(data, index, size, 1.0f, value); return true;
+        case(GL_DOUBLE): readValues<GLdouble>(data, index, size, 1.0f, value); return true;
+        case(GL_BYTE): readValues<GLbyte>(data, index, size, normalize ? 1.0f/127.0f : 1.0f, value); return true;
+        case(GL_UNSIGNED_BYTE): readValues<GLubyte>(data, index, size, normalize ? 1.0f/255.0f : 1.0f, value); return true;
+        case(GL_SHORT): readValues<GLshort>(data, index, size, normalize ? 1.0f/32767.0f : 1.0f, value); return true;
+        case(GL_UNSIGNED_SHORT): readValues<GLushort>(data, index, size, normalize ? 1.0f/65535.0f : 1.0f, value); return true;
+        case(GL_INT): readValues<GLint>(data, index, size, 1.0f, value); return true;
+        case(GL_UNSIGNED_INT): readValues<GLuint>(data, index, size, 1.0f, value); return true;
+        default: return false;
+    }
+}
+
+}
+
+InstancedGeometry::PerContextInstances::PerContextInstances():
+    instanceData(new UByteArray)
+{
+    VertexBufferObject* vbo = new VertexBufferObject;
+    vbo->setUsage(GL_STREAM_DRAW_ARB);
+    instanceData->setVertexBufferObject(vbo);
+}
+
+InstancedGeometry::InstancedGeometry():
+    _cullInstances(true),
+    _instanceBoundsDirty(true),
+    _instanceMatricesModifiedCount(0)
+{
+    // the visible instances depend on the modelview matrix when drawn, so can't be compiled into a display list.
+    setSupportsDisplayList(false);
+
+    setInstanceMatrixAttribLocations(1, 6, 7);
+}
+
+InstancedGeometry::InstancedGeometry(const Geometry& geometry, const CopyOp& copyop):
+    Geometry(geometry, copyop),
+    _cullInstances(true),
+    _instanceBoundsDirty(true),
+    _instanceMatricesModifiedCount(0)
+{
+    // the visible instances depend on the modelview matrix when drawn, so can't be compiled into a display list.
+    setSupportsDisplayList(false);
+
+    setInstanceMatrixAttribLocations(1, 6, 7);
+}
+
+InstancedGeometry::InstancedGeometry(const InstancedGeometry& geometry, const CopyOp& copyop):
+    Geometry(geometry, copyop),
+    _instanceMatrices(geometry._instanceMatrices),
+    _instanceAttribList(geometry._instanceAttribList),
+    _cullInstances(geometry._cullInstances),
+    _instanceBoundsDirty(true),
+    _instanceMatricesModifiedCount(0)
+{
+    setSupportsDisplayList(false);
+
+    setInstanceMatrixAttribLocations(geometry._instanceMatrixAttribLocations[0], geometry._instanceMatrixAttribLocations[1], geometry._instanceMatrixAttribLocations[2]);
+
+    if ((copyop.getCopyFlags() & CopyOp::DEEP_COPY_ARRAYS))
+    {
+        if (_instanceMatrices.valid()) _instanceMatrices = static_cast<MatrixfArray*>(copyop(_instanceMatrices.get()));
+        for(InstanceAttribList::iterator itr=_instanceAttribList.begin();
+            itr!=_instanceAttribList.end();
+            ++itr)
+        {
+            if (itr->array.valid()) itr->array = copyop(itr->array.get());
+        }
+    }
+}
+
+InstancedGeometry::~InstancedGeometry()
+{
+}
+
+void InstancedGeometry::setInstanceMatrixArray(MatrixfArray* matrices)
+{
+    _instanceMatrices = matrices;
+    dirtyInstances();
+}
+
+void InstancedGeometry::setInstanceMatrixAttribLocations(unsigned int row0, unsigned int row1, unsigned int row2)
+{
+    _instanceMatrixAttribLocations[0] = row0;
+    _instanceMatrixAttribLocations[1] = row1;
+    _instanceMatrixAttribLocations[2] = row2;
+}
+
+void InstancedGeometry::setInstanceAttribArray(unsigned int location, Array* array, GLboolean normalize)
+{
+    if (location>=_instanceAttribList.size()) _instanceAttribList.resize(location+1);
+    _instanceAttribList[location] = InstanceAttrib(array, normalize);
+    dirtyInstances();
+}
+
+Array* InstancedGeometry::getInstanceAttribArray(unsigned int location)
+{
+    return location<_instanceAttribList.size() ? _instanceAttribList[location].array.get() : 0;
+}
+
+const Array* InstancedGeometry::getInstanceAttribArray(unsigned int location) const
+{
+    return location<_instanceAttribList.size() ? _instanceAttribList[location].array.get() : 0;
+}
+
+void InstancedGeometry::dirtyInstances()
+{
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_instanceBoundsMutex);
+        _instanceBoundsDirty = true;
+    }
+    dirtyBound();
+}
+
+BoundingBox InstancedGeometry::computeModelBound() const
+{
+    // use Geometry's accept() directly as InstancedGeometry's would pass on the primitives of every instance.
+    TemplatePrimitiveFunctor<ComputeModelBound> cb;
+    Geometry::accept(cb);
+    return cb.bb;
+}
+
+void InstancedGeometry::updateInstanceBounds() const
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_instanceBoundsMutex);
+
+    unsigned int modifiedCount = _instanceMatrices.valid() ? _instanceMatrices->getModifiedCount() : 0;
+    if (!_instanceBoundsDirty && modifiedCount==_instanceMatricesModifiedCount) return;
+
+    _instanceBoundsDirty = false;
+    _instanceMatricesModifiedCount = modifiedCount;
+    _modelBound = BoundingSphere(computeModelBound());
+
+    unsigned int numInstances = getNumInstances();
+    _instanceCentersX.resize(numInstances);
+    _instanceCentersY.resize(numInstances);
+    _instanceCentersZ.resize(numInstances);
+    _instanceRadii.resize(numInstances);
+
+    for(unsigned int i=0; i<numInstances; ++i)
+    {
+        const Matrixf& matrix = (*_instanceMatrices)[i];
+        Vec3 center = _modelBound.center() * matrix;
+
+        // scale the radius by the longest of the matrix's axes.
+        float sx = Vec3(matrix(0,0), matrix(0,1), matrix(0,2)).length2();
+        float sy = Vec3(matrix(1,0), matrix(1,1), matrix(1,2)).length2();
+        float sz = Vec3(matrix(2,0), matrix(2,1), matrix(2,2)).length2();
+
+        _instanceCentersX[i] = center.x();
+        _instanceCentersY[i] = center.y();
+        _instanceCentersZ[i] = center.z();
+        _instanceRadii[i] = _modelBound.valid() ? _modelBound.radius()*sqrtf(maximum(sx, maximum(sy, sz))) : -1.0f;
+    }
+}
+
+BoundingBox InstancedGeometry::computeBound() const
+{
+    updateInstanceBounds();
+
+    BoundingBox bb;
+    for(unsigned int i=0; i<_instanceRadii.size(); ++i)
+    {
+        if (_instanceRadii[i]>=0.0f)
+        {
+            bb.expandBy(BoundingSphere(Vec3(_instanceCentersX[i], _instanceCentersY[i], _instanceCentersZ[i]), _instanceRadii[i]));
+        }
+    }
+    return bb;
+}
+
+void InstancedGeometry::accept(PrimitiveFunctor& pf) const
+{
+    if (!_instanceMatrices) return;
+
+    TransformPrimitiveFunctor tpf(pf);
+    for(MatrixfArray::const_iterator itr=_instanceMatrices->begin();
+        itr!=_instanceMatrices->end();
+        ++itr)
+    {
+        tpf.setMatrix(*itr);
+        Geometry::accept(tpf);
+    }
+}
+
+void InstancedGeometry::accept(PrimitiveIndexFunctor& pif) const
+{
+    if (!_instanceMatrices || _instanceMatrices->empty()) return;
+
+    // use Geometry's accept() directly to get the vertices of the model, decoded if they are quantized.
+    CollectVerticesFunctor cvf;
+    Geometry::accept(cvf);
+
+    const std::vector<Vec3>& modelVertices = cvf._vertices;
+    unsigned int numModelVertices = modelVertices.size();
+    if (numModelVertices==0) return;
+
+    std::vector<Vec3> vertices;
+    vertices.reserve(numModelVertices*_instanceMatrices->size());
+    for(MatrixfArray::const_iterator itr=_instanceMatrices->begin();
+        itr!=_instanceMatrices->end();
+        ++itr)
+    {
+        for(unsigned int v=0; v<numModelVertices; ++v)
+        {
+            vertices.push_back(modelVertices[v] * (*itr));
+        }
+    }
+
+    pif.setVertexArray(vertices.size(), &vertices.front());
+
+    OffsetPrimitiveIndexFunctor opif(pif);
+    for(unsigned int i=0; i<_instanceMatrices->size(); ++i)
+    {
+        opif.setOffset(i*numModelVertices);
+        Geometry::accept(opif);
+    }
+}
+
+Matrixf InstancedGeometry::getInstanceDrawMatrix(unsigned int i) const
+{
+    // quantized vertices are decoded by the matrix passed for each instance.
+    if (_vertexDecodeMatrix.valid()) return Matrixf(*_vertexDecodeMatrix) * (*_instanceMatrices)[i];
+    return (*_instanceMatrices)[i];
+}
+
+void InstancedGeometry::cullInstances(State& state, PerContextInstances& pci) const
+{
+    updateInstanceBounds();
+
+    unsigned int numInstances = _instanceRadii.size();
+    std::vector<unsigned int>& visibleInstances = pci.visibleInstances;
+    visibleInstances.clear();
+    if (numInstances==0) return;
+
+    Polytope frustum;
+    frustum.setToUnitFrustum(true, true);
+    frustum.transformProvidingInverse(state.getModelViewMatrix()*state.getProjectionMatrix());
+
+    // when the whole of the bound is within the frustum there is no need to test the instances.
+    if (!_cullInstances || frustum.containsAllOf(BoundingSphere(getBound())))
+    {
+        visibleInstances.resize(numInstances);
+        for(unsigned int i=0; i<numInstances; ++i) visibleInstances[i] = i;
+        return;
+    }
+
+    // test all the instances against one plane at a time, without branches, so that the loop can be vectorized.
+    pci.visibleFlags.assign(numInstances, 1);
+    unsigned char* flags = &pci.visibleFlags.front();
+    const float* cx = &_instanceCentersX.front();
+    const float* cy = &_instanceCentersY.front();
+    const float* cz = &_instanceCentersZ.front();
+    const float* r = &_instanceRadii.front();
+
+    const Polytope::PlaneList& planes = frustum.getPlaneList();
+    for(Polytope::PlaneList::const_iterator pitr=planes.begin();
+        pitr!=planes.end();
+        ++pitr)
+    {
+        const float a = (*pitr)[0];
+        const float b = (*pitr)[1];
+        const float c = (*pitr)[2];
+        const float d = (*pitr)[3];
+        for(unsigned int i=0; i<numInstances; ++i)
+        {
+            flags[i] &= static_cast<unsigned char>((a*cx[i] + b*cy[i] + c*cz[i] + d) >= -r[i]);
+        }
+    }
+
+    for(unsigned int i=0; i<numInstances; ++i)
+    {
+        if (flags[i]) visibleInstances.push_back(i);
+    }
+}
+
+void InstancedGeometry::drawImplementation(RenderInfo& renderInfo) const
+{
+    if (getNumInstances()==0) return;
+
+    State& state = *renderInfo.getState();
+    unsigned int contextID = state.getContextID();
+
+    if (!_perContextInstances[contextID]) _perContextInstances[contextID] = new PerContextInstances;
+    PerContextInstances& pci = *_perContextInstances[contextID];
+
+    cullInstances(state, pci);
+    if (pci.visibleInstances.empty()) return;
+
+    bool checkForGLErrors = state.getCheckForGLErrors()==osg::State::ONCE_PER_ATTRIBUTE;
+    if (checkForGLErrors) state.checkGLErrors("start of InstancedGeometry::drawImplementation()");
+
+    drawVertexArraysImplementation(renderInfo);
+
+    if (areFastPathsUsed() && state.isInstancedArraysSupported())
+    {
+        drawInstancesWithArrays(renderInfo, pci.visibleInstances);
+    }
+    else
+    {
+        drawInstancesWithConstants(renderInfo, pci.visibleInstances);
+    }
+
+    // unbind the VBO's if any are used.
+    state.unbindVertexBufferObject();
+    state.unbindElementBufferObject();
+
+    if (checkForGLErrors) state.checkGLErrors("end of InstancedGeometry::drawImplementation().");
+}
+
+void InstancedGeometry::drawInstancesWithArrays(RenderInfo& renderInfo, const std::vector<unsigned int>& visibleInstances) const
+{
+    State& state = *renderInfo.getState();
+    unsigned int contextID = state.getContextID();
+    PerContextInstances& pci = *_perContextInstances[contextID];
+
+    unsigned int numInstances = getNumInstances();
+    unsigned int numVisible = visibleInstances.size();
+
+    // pack the matrices then each of the attributes of the visible instances into the instance data,
+    // starting each on a 16 byte boundary.
+    std::vector<unsigned int> attribOffsets(_instanceAttribList.size(), 0);
+    std::vector<unsigned int> attribElementSizes(_instanceAttribList.size(), 0);
+    unsigned int totalSize = numVisible*INSTANCE_MATRIX_ROWS_SIZE;
+    unsigned int location;
+    for(location=0; location<_instanceAttribList.size(); ++location)
+    {
+        const Array* array = _instanceAttribList[location].array.get();
+        if (!array || array->getNumElements()<numInstances) continue;
+
+        attribElementSizes[location] = array->getTotalDataSize()/array->getNumElements();
+        attribOffsets[location] = (totalSize+15) & ~15u;
+        totalSize = attribOffsets[location] + numVisible*attribElementSizes[location];
+    }
+
+    UByteArray& instanceData = *pci.instanceData;
+    instanceData.resize(totalSize);
+
+    unsigned char* dst = &instanceData.front();
+    for(unsigned int i=0; i<numVisible; ++i, dst+=INSTANCE_MATRIX_ROWS_SIZE)
+    {
+        copyInstanceMatrixRows(getInstanceDrawMatrix(visibleInstances[i]), reinterpret_cast<float*>(dst));
+    }
+
+    for(location=0; location<_instanceAttribList.size(); ++location)
+    {
+        unsigned int elementSize = attribElementSizes[location];
+        if (elementSize==0) continue;
+
+        const unsigned char* src = static_cast<const unsigned char*>(_instanceAttribList[location].array->getDataPointer());
+        dst = &instanceData.front() + attribOffsets[location];
+        for(unsigned int i=0; i<numVisible; ++i, dst+=elementSize)
+        {
+            memcpy(dst, src + visibleInstances[i]*elementSize, elementSize);
+        }
+    }
+
+    instanceData.dirty();
+
+    GLBufferObject* vbo = instanceData.getOrCreateGLBufferObject(contextID);
+    state.bindVertexBufferObject(vbo);
+    const unsigned char* base = reinterpret_cast<const unsigned char*>(vbo->getOffset(instanceData.getBufferIndex()));
+
+    for(unsigned int row=0; row<3; ++row)
+    {
+        state.setVertexAttribPointer(_instanceMatrixAttribLocations[row], 4, GL_FLOAT, GL_FALSE, INSTANCE_MATRIX_ROWS_SIZE, base+row*4*sizeof(float));
+        state.glVertexAttribDivisor(_instanceMatrixAttribLocations[row], 1);
+    }
+
+    for(location=0; location<_instanceAttribList.size(); ++location)
+    {
+        if (attribElementSizes[location]==0) continue;
+
+        const InstanceAttrib& attrib = _instanceAttribList[location];
+        state.setVertexAttribPointer(location, attrib.array->getDataSize(), attrib.array->getDataType(), attrib.normalize, 0, base+attribOffsets[location]);
+        state.glVertexAttribDivisor(location, 1);
+    }
+
+    bool usingVertexBufferObjects = _useVertexBufferObjects && state.isVertexBufferObjectSupported();
+    for(PrimitiveSetList::const_iterator itr=_primitives.begin();
+        itr!=_primitives.end();
+        ++itr)
+    {
+        drawPrimitiveSetInstanced(state, itr->get(), numVisible, usingVertexBufferObjects);
+    }
+
+    // restore the divisors so that the attribute locations can be used for per vertex arrays again.
+    for(unsigned int row=0; row<3; ++row)
+    {
+        state.glVertexAttribDivisor(_instanceMatrixAttribLocations[row], 0);
+    }
+
+    for(location=0; location<_instanceAttribList.size(); ++location)
+    {
+        if (attribElementSizes[location]!=0) state.glVertexAttribDivisor(location, 0);
+    }
+}
+
+void InstancedGeometry::drawInstancesWithConstants(RenderInfo& renderInfo, const std::vector<unsigned int>& visibleInstances) const
+{
+    State& state = *renderInfo.getState();
+
+    unsigned int numInstances = getNumInstances();
+    unsigned int location;
+    for(location=0; location<_instanceAttribList.size(); ++location)
+    {
+        if (_instanceAttribList[location].array.valid()) state.disableVertexAttribPointer(location);
+    }
+
+    for(unsigned int row=0; row<3; ++row)
+    {
+        state.disableVertexAttribPointer(_instanceMatrixAttribLocations[row]);
+    }
+
+    for(std::vector<unsigned int>::const_iterator itr=visibleInstances.begin();
+        itr!=visibleInstances.end();
+        ++itr)
+    {
+        float rows[12];
+        copyInstanceMatrixRows(getInstanceDrawMatrix(*itr), rows);
+        for(unsigned int row=0; row<3; ++row)
+        {
+            state.VerteAttrib(_instanceMatrixAttribLocations[row], rows[row*4], rows[row*4+1], rows[row*4+2], rows[row*4+3]);
+        }
+
+        for(location=0; location<_instanceAttribList.size(); ++location)
+        {
+            const InstanceAttrib& attrib = _instanceAttribList[location];
+            float value[4];
+            if (attrib.array.valid() && attrib.array->getNumElements()>=numInstances &&
+                getInstanceAttribValue(attrib.array.get(), *itr, attrib.normalize, value))
+            {
+                state.VerteAttrib(location, value[0], value[1], value[2], value[3]);
+            }
+        }
+
+        drawPrimitivesImplementation(renderInfo);
+    }
+}
+
+void InstancedGeometry::resizeGLObjectBuffers(unsigned int maxSize)
+{
+    Geometry::resizeGLObjectBuffers(maxSize);
+
+    _perContextInstances.resize(maxSize);
+}
+
+void InstancedGeometry::releaseGLObjects(State* state) const
+{
+    Geometry::releaseGLObjects(state);
+
+    if (state)
+    {
+        unsigned int contextID = state->getContextID();
+        if (contextID<_perContextInstances.size() && _perContextInstances[contextID].valid())
+        {
+            _perContextInstances[contextID]->instanceData->releaseGLObjects(state);
+        }
+    }
+    else
+    {
+        for(unsigned int i=0; i<_perContextInstances.size(); ++i)
+        {
+            if (_perContextInstances[i].valid()) _perContextInstances[i]->instanceData->releaseGLObjects(0);
+        }
+    }
+}
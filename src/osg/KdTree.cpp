@@ -94,6 +94,69 @@ struct TriangleIndicesCollector
 };
 
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Functor for collecting the vertices that Geometry passes on with its primitives,
+// which are decoded when quantized and cover every instance of an InstancedGeometry
+
+struct VertexCollector : public osg::PrimitiveIndexFunctor
+{
+    VertexCollector(osg::Vec3Array* geometryVertices):
+        _geometryVertices(geometryVertices) {}
+
+    template<typename T>
+    void copyVertices(unsigned int count, const T* vertices)
+    {
+        _vertices = new osg::Vec3Array(count);
+        for(unsigned int i=0; i<count; ++i)
+        {
+            (*_vertices)[i].set(vertices[i].x(), vertices[i].y(), vertices[i].z());
+        }
+    }
+
+    virtual void setVertexArray(unsigned int count,const osg::Vec2* vertices)
+    {
+        _vertices = new osg::Vec3Array(count);
+        for(unsigned int i=0; i<count; ++i) (*_vertices)[i].set(vertices[i].x(), vertices[i].y(), 0.0f);
+    }
+
+    virtual void setVertexArray(unsigned int count,const osg::Vec3* vertices)
+    {
+        // reuse the geometry's own vertices where they are passed on unchanged.
+        if (_geometryVertices.valid() && !_geometryVertices->empty() && vertices==&(_geometryVertices->front()) && count==_geometryVertices->size())
+        {
+            _vertices = _geometryVertices;
+        }
+        else
+        {
+            copyVertices(count, vertices);
+        }
+    }
+
+    virtual void setVertexArray(unsigned int count,const osg::Vec4* vertices) { copyVertices(count, vertices); }
+
+    virtual void setVertexArray(unsigned int count,const osg::Vec2d* vertices)
+    {
+        _vertices = new osg::Vec3Array(count);
+        for(unsigned int i=0; i<count; ++i) (*_vertices)[i].set(vertices[i].x(), vertices[i].y(), 0.0f);
+    }
+
+    virtual void setVertexArray(unsigned int count,const osg::Vec3d* vertices) { copyVertices(count, vertices); }
+    virtual void setVertexArray(unsigned int count,const osg::Vec4d* vertices) { copyVertices(count, vertices); }
+
+    virtual void drawArrays(GLenum,GLint,GLsizei) {}
+    virtual void drawElements(GLenum,GLsizei,const GLubyte*) {}
+    virtual void drawElements(GLenum,GLsizei,const GLushort*) {}
+    virtual void drawElements(GLenum,GLsizei,const GLuint*) {}
+
+    virtual void begin(GLenum) {}
+    virtual void vertex(unsigned int) {}
+    virtual void end() {}
+
+    osg::ref_ptr<osg::Vec3Array> _geometryVertices;
+    osg::ref_ptr<osg::Vec3Array> _vertices;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // BuildKdTree Implementation
@@ -105,7 +168,10 @@ bool BuildKdTree::build(KdTree::BuildOptions& options, osg::Geometry* geometry)
     OSG_NOTICE<<"osg::KDTreeBuilder::createKDTree()"<<std::endl;146
 #endif
 
-    osg::Vec3Array* vertices = dynamic_cast<osg::Vec3Array*>(geometry->getVertexArray());
+    VertexCollector collectVertices(dynamic_cast<osg::Vec3Array*>(geometry->getVertexArray()));
+    geometry->accept(collectVertices);
+
+    osg::Vec3Array* vertices = collectVertices._vertices.get();
     if (!vertices) return false;
 
     if (vertices->size() <= options._targetNumTrianglesPerLeaf) return false;
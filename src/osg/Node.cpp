@@ -57,6 +57,7 @@ Node::Node()
     :Object(true)
 {
     _boundingSphereComputed = false;
+    _axisAlignedBoundComputed = false;
     _nodeMask = 0xffffffff;
 
     _numChildrenRequiringUpdateTraversal = 0;
@@ -74,6 +75,8 @@ Node::Node(const Node& node,const CopyOp& copyop):
         _initialBound(node._initialBound),
         _boundingSphere(node._boundingSphere),
         _boundingSphereComputed(node._boundingSphereComputed),
+        _axisAlignedBound(node._axisAlignedBound),
+        _axisAlignedBoundComputed(node._axisAlignedBoundComputed),
         _parents(), // leave empty as parentList is managed by Group.
         _updateCallback(copyop(node._updateCallback.get())),
         _numChildrenRequiringUpdateTraversal(0), // assume no children yet.
@@ -523,12 +526,21 @@ BoundingSphere Node::computeBound() const
     return BoundingSphere();
 }
 
+BoundingBox Node::computeAxisAlignedBound() const
+{
+    BoundingBox bb;
+    const BoundingSphere& bsphere = getBound();
+    if (bsphere.valid()) bb.expandBy(bsphere);
+    return bb;
+}
+
 
 void Node::dirtyBound()
 {
     if (_boundingSphereComputed)
     {
         _boundingSphereComputed = false;
+        _axisAlignedBoundComputed = false;
 
         // dirty parent bounding sphere's to ensure that all are valid.
         for(ParentList::iterator itr=_parents.begin();
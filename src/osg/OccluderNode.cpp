@@ -20,7 +20,8 @@ OccluderNode::OccluderNode()
 
 OccluderNode::OccluderNode(const OccluderNode& node,const CopyOp& copyop):
     Group(node,copyop),
-    _occluder(dynamic_cast<ConvexPlanarOccluder*>(copyop(node._occluder.get())))
+    _occluder(dynamic_cast<ConvexPlanarOccluder*>(copyop(node._occluder.get()))),
+    _occluderGeometry(dynamic_cast<Geometry*>(copyop(node._occluderGeometry.get())))
 {
 }
 
@@ -43,5 +44,10 @@ BoundingSphere OccluderNode::computeBound() const
             bsphere.expandBy(bb);
         }
     }
+
+    if (getOccluderGeometry())
+    {
+        bsphere.expandBy(getOccluderGeometry()->getBound());
+    }
     return bsphere;
 }
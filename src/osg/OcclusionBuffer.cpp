@@ -0,0 +1,333 @@
+/* -*-c++-*- OpenSceneGraph - Copyright (C) 1998-2006 Robert Osfield
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+*/
+#include <osg/OcclusionBuffer>
+#include <osg/Geometry>
+#include <osg/ConvexPlanarOccluder>
+#include <osg/TriangleFunctor>
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+
+using namespace osg;
+
+OcclusionBuffer::OcclusionBuffer(unsigned int width, unsigned int height):
+    _width(0),
+    _height(0),
+    _numTilesX(0),
+    _numTilesY(0),
+    _active(true),
+    _resolveDirty(false),
+    _numTrianglesRasterized(0)
+{
+    setSize(width, height);
+}
+
+OcclusionBuffer::~OcclusionBuffer()
+{
+}
+
+void OcclusionBuffer::setSize(unsigned int width, unsigned int height)
+{
+    _numTilesX = osg::maximum((width+TILE_SIZE-1)/TILE_SIZE, 1u);
+    _numTilesY = osg::maximum((height+TILE_SIZE-1)/TILE_SIZE, 1u);
+    _width = _numTilesX*TILE_SIZE;
+    _height = _numTilesY*TILE_SIZE;
+
+    _depth.assign(_width*_height, 1.0f);
+    _resolvedDepth.assign(_width*_height, 1.0f);
+    _tileMaxDepth.assign(_numTilesX*_numTilesY, 1.0f);
+    _resolveDirty = false;
+}
+
+void OcclusionBuffer::clear(const Matrix& projection)
+{
+    _projection = projection;
+    std::fill(_depth.begin(), _depth.end(), 1.0f);
+    std::fill(_resolvedDepth.begin(), _resolvedDepth.end(), 1.0f);
+    std::fill(_tileMaxDepth.begin(), _tileMaxDepth.end(), 1.0f);
+    _resolveDirty = false;
+    _numTrianglesRasterized = 0;
+}
+
+void OcclusionBuffer::rasterizeTriangle(const Vec4& c0, const Vec4& c1, const Vec4& c2)
+{
+    // clip the triangle against the near plane, z>=-w, which leaves at most a quad.
+    const Vec4* input[3] = { &c0, &c1, &c2 };
+    Vec4 clipped[4];
+    unsigned int numClipped = 0;
+    for(unsigned int i=0; i<3; ++i)
+    {
+        const Vec4& a = *input[i];
+        const Vec4& b = *input[(i+1)%3];
+        float da = a.z()+a.w();
+        float db = b.z()+b.w();
+        if (da>=0.0f) clipped[numClipped++] = a;
+        if ((da>=0.0f)!=(db>=0.0f))
+        {
+            float r = da/(da-db);
+            clipped[numClipped++] = a + (b-a)*r;
+        }
+    }
+
+    if (numClipped<3) return;
+
+    ScreenVertex screen[4];
+    for(unsigned int i=0; i<numClipped; ++i)
+    {
+        const Vec4& c = clipped[i];
+        if (c.w()<=0.0f) return;
+
+        float inv_w = 1.0f/c.w();
+        screen[i].x = (c.x()*inv_w*0.5f+0.5f)*static_cast<float>(_width);
+        screen[i].y = (c.y()*inv_w*0.5f+0.5f)*static_cast<float>(_height);
+        screen[i].z = c.z()*inv_w*0.5f+0.5f;
+    }
+
+    rasterizeClippedTriangle(screen[0], screen[1], screen[2]);
+    if (numClipped==4) rasterizeClippedTriangle(screen[0], screen[2], screen[3]);
+
+    ++_numTrianglesRasterized;
+}
+
+void OcclusionBuffer::rasterizeClippedTriangle(const ScreenVertex& v0, const ScreenVertex& v1, const ScreenVertex& v2)
+{
+    float area = (v1.x-v0.x)*(v2.y-v0.y)-(v2.x-v0.x)*(v1.y-v0.y);
+    if (area==0.0f) return;
+
+    // orient the edges so that the inside of the triangle is positive, whichever the winding of the occluder.
+    const ScreenVertex* v[3] = { &v0, &v1, &v2 };
+    if (area<0.0f)
+    {
+        std::swap(v[1], v[2]);
+        area = -area;
+    }
+
+    float minX = osg::minimum(v[0]->x, osg::minimum(v[1]->x, v[2]->x));
+    float maxX = osg::maximum(v[0]->x, osg::maximum(v[1]->x, v[2]->x));
+    float minY = osg::minimum(v[0]->y, osg::minimum(v[1]->y, v[2]->y));
+    float maxY = osg::maximum(v[0]->y, osg::maximum(v[1]->y, v[2]->y));
+    float maxZ = osg::maximum(v[0]->z, osg::maximum(v[1]->z, v[2]->z));
+
+    int x0 = osg::maximum(static_cast<int>(floorf(minX)), 0);
+    int x1 = osg::minimum(static_cast<int>(ceilf(maxX)), static_cast<int>(_width))-1;
+    int y0 = osg::maximum(static_cast<int>(floorf(minY)), 0);
+    int y1 = osg::minimum(static_cast<int>(ceilf(maxY)), static_cast<int>(_height))-1;
+    if (x0>x1 || y0>y1) return;
+
+    // edge functions, a*x+b*y+c, positive inside the triangle, sampled at the pixel centers so that
+    // the triangles of a mesh cover its interior without cracks along their shared edges.
+    float a[3], b[3], c[3];
+    for(unsigned int i=0; i<3; ++i)
+    {
+        const ScreenVertex& p = *v[(i+1)%3];
+        const ScreenVertex& q = *v[(i+2)%3];
+        a[i] = p.y-q.y;
+        b[i] = q.x-p.x;
+        c[i] = p.x*q.y-q.x*p.y;
+    }
+
+    // depth plane.
+    float dzdx = ((v[1]->z-v[0]->z)*(v[2]->y-v[0]->y)-(v[2]->z-v[0]->z)*(v[1]->y-v[0]->y))/area;
+    float dzdy = ((v[2]->z-v[0]->z)*(v[1]->x-v[0]->x)-(v[1]->z-v[0]->z)*(v[2]->x-v[0]->x))/area;
+    float zOffset = v[0]->z - dzdx*v[0]->x - dzdy*v[0]->y;
+
+    bool written = false;
+    for(int y=y0; y<=y1; ++y)
+    {
+        float py = static_cast<float>(y)+0.5f;
+        float* row = &_depth[y*_width];
+        for(int x=x0; x<=x1; ++x)
+        {
+            float px = static_cast<float>(x)+0.5f;
+            if (a[0]*px+b[0]*py+c[0]>=0.0f &&
+                a[1]*px+b[1]*py+c[1]>=0.0f &&
+                a[2]*px+b[2]*py+c[2]>=0.0f)
+            {
+                float z = osg::minimum(dzdx*px+dzdy*py+zOffset, maxZ);
+                if (z<row[x])
+                {
+                    row[x] = z;
+                    written = true;
+                }
+            }
+        }
+    }
+
+    if (written) _resolveDirty = true;
+}
+
+namespace
+{
+
+struct RasterizeTriangleOperator
+{
+    RasterizeTriangleOperator(): _buffer(0), _localToClip(0) {}
+
+    inline void operator() (const Vec3& v1, const Vec3& v2, const Vec3& v3, bool)
+    {
+        _buffer->rasterizeTriangle(Vec4(v1,1.0f) * (*_localToClip),
+                                   Vec4(v2,1.0f) * (*_localToClip),
+                                   Vec4(v3,1.0f) * (*_localToClip));
+    }
+
+    OcclusionBuffer*    _buffer;
+    const Matrix*       _localToClip;
+};
+
+}
+
+void OcclusionBuffer::rasterize(const Matrix& localToClip, const Geometry& geometry)
+{
+    TriangleFunctor<RasterizeTriangleOperator> rasterizer;
+    rasterizer._buffer = this;
+    rasterizer._localToClip = &localToClip;
+    geometry.accept(rasterizer);
+}
+
+bool OcclusionBuffer::rasterize(const Matrix& localToClip, const ConvexPlanarOccluder& occluder)
+{
+    // rasterizing the polygon over its holes would hide what can be seen through them.
+    if (!occluder.getHoleList().empty()) return false;
+
+    const ConvexPlanarPolygon::VertexList& vertices = occluder.getOccluder().getVertexList();
+    if (vertices.size()<3) return true;
+
+    Vec4 first = Vec4(vertices[0],1.0f) * localToClip;
+    Vec4 previous = Vec4(vertices[1],1.0f) * localToClip;
+    for(unsigned int i=2; i<vertices.size(); ++i)
+    {
+        Vec4 current = Vec4(vertices[i],1.0f) * localToClip;
+        rasterizeTriangle(first, previous, current);
+        previous = current;
+    }
+    return true;
+}
+
+void OcclusionBuffer::resolve()
+{
+    // erode the occluders by a pixel, taking the farthest depth of the neighbouring pixels, so that pixels
+    // only partly covered by the occluders at their edges don't hide anything.
+    std::vector<float> rowMaxDepth(_depth.size());
+    int width = static_cast<int>(_width);
+    int height = static_cast<int>(_height);
+    for(int y=0; y<height; ++y)
+    {
+        const float* src = &_depth[y*width];
+        float* dst = &rowMaxDepth[y*width];
+        for(int x=0; x<width; ++x)
+        {
+            dst[x] = osg::maximum(src[osg::maximum(x-1,0)], osg::maximum(src[x], src[osg::minimum(x+1,width-1)]));
+        }
+    }
+
+    for(int y=0; y<height; ++y)
+    {
+        const float* above = &rowMaxDepth[osg::maximum(y-1,0)*width];
+        const float* src = &rowMaxDepth[y*width];
+        const float* below = &rowMaxDepth[osg::minimum(y+1,height-1)*width];
+        float* dst = &_resolvedDepth[y*width];
+        for(int x=0; x<width; ++x)
+        {
+            dst[x] = osg::maximum(above[x], osg::maximum(src[x], below[x]));
+        }
+    }
+
+    for(unsigned int ty=0; ty<_numTilesY; ++ty)
+    {
+        for(unsigned int tx=0; tx<_numTilesX; ++tx)
+        {
+            float maxDepth = 0.0f;
+            for(unsigned int y=ty*TILE_SIZE; y<(ty+1)*TILE_SIZE; ++y)
+            {
+                const float* row = &_resolvedDepth[y*_width+tx*TILE_SIZE];
+                for(unsigned int x=0; x<TILE_SIZE; ++x)
+                {
+                    maxDepth = osg::maximum(maxDepth, row[x]);
+                }
+            }
+            _tileMaxDepth[ty*_numTilesX+tx] = maxDepth;
+        }
+    }
+    _resolveDirty = false;
+}
+
+bool OcclusionBuffer::isOccluded(const Matrix& localToClip, const BoundingBox& bb)
+{
+    if (!bb.valid() || _numTrianglesRasterized==0) return false;
+
+    float minX = FLT_MAX, maxX = -FLT_MAX;
+    float minY = FLT_MAX, maxY = -FLT_MAX;
+    float minZ = FLT_MAX;
+    for(unsigned int i=0; i<8; ++i)
+    {
+        Vec4 c = Vec4(bb.corner(i),1.0f) * localToClip;
+
+        // bounding volumes crossing the near plane can't be occluded.
+        if (c.w()<=0.0f || c.z()<-c.w()) return false;
+
+        float inv_w = 1.0f/c.w();
+        float x = (c.x()*inv_w*0.5f+0.5f)*static_cast<float>(_width);
+        float y = (c.y()*inv_w*0.5f+0.5f)*static_cast<float>(_height);
+        float z = c.z()*inv_w*0.5f+0.5f;
+
+        minX = osg::minimum(minX, x); maxX = osg::maximum(maxX, x);
+        minY = osg::minimum(minY, y); maxY = osg::maximum(maxY, y);
+        minZ = osg::minimum(minZ, z);
+    }
+
+    // only the part of the bounding volume on screen needs to be hidden, view frustum culling deals with the rest.
+    int x0 = osg::maximum(static_cast<int>(floorf(minX)), 0);
+    int x1 = osg::minimum(static_cast<int>(floorf(maxX)), static_cast<int>(_width)-1);
+    int y0 = osg::maximum(static_cast<int>(floorf(minY)), 0);
+    int y1 = osg::minimum(static_cast<int>(floorf(maxY)), static_cast<int>(_height)-1);
+    if (x0>x1 || y0>y1) return false;
+
+    if (_resolveDirty) resolve();
+
+    int tx0 = x0/TILE_SIZE, tx1 = x1/TILE_SIZE;
+    int ty0 = y0/TILE_SIZE, ty1 = y1/TILE_SIZE;
+    for(int ty=ty0; ty<=ty1; ++ty)
+    {
+        for(int tx=tx0; tx<=tx1; ++tx)
+        {
+            // the whole tile is nearer than the bounding volume.
+            if (_tileMaxDepth[ty*_numTilesX+tx]<minZ) continue;
+
+            int px0 = osg::maximum(x0, tx*static_cast<int>(TILE_SIZE));
+            int px1 = osg::minimum(x1, (tx+1)*static_cast<int>(TILE_SIZE)-1);
+            int py0 = osg::maximum(y0, ty*static_cast<int>(TILE_SIZE));
+            int py1 = osg::minimum(y1, (ty+1)*static_cast<int>(TILE_SIZE)-1);
+            for(int y=py0; y<=py1; ++y)
+            {
+                const float* row = &_resolvedDepth[y*_width];
+                float maxDepth = 0.0f;
+                for(int x=px0; x<=px1; ++x)
+                {
+                    maxDepth = osg::maximum(maxDepth, row[x]);
+                }
+                if (maxDepth>=minZ) return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool OcclusionBuffer::isOccluded(const Matrix& localToClip, const BoundingSphere& bs)
+{
+    if (!bs.valid()) return false;
+
+    Vec3 r(bs.radius(), bs.radius(), bs.radius());
+    return isOccluded(localToClip, BoundingBox(bs.center()-r, bs.center()+r));
+}
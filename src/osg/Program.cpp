@@ -22,6 +22,8 @@
 
 #include <list>
 #include <fstream>
+#include <sstream>
+#include <iomanip>
 
 #include <osg/Notify>
 #include <osg/State>
@@ -130,6 +132,26 @@ void Program::ProgramBinary::assign(unsigned int size, const unsigned char* data
 }
 
 
+///////////////////////////////////////////////////////////////////////////
+// osg::Program::ProgramBinaryCache
+///////////////////////////////////////////////////////////////////////////
+
+static osg::ref_ptr<Program::ProgramBinaryCache>& getProgramBinaryCacheRef()
+{
+    static osg::ref_ptr<Program::ProgramBinaryCache> s_programBinaryCache;
+    return s_programBinaryCache;
+}
+
+void Program::setProgramBinaryCache(ProgramBinaryCache* cache)
+{
+    getProgramBinaryCacheRef() = cache;
+}
+
+Program::ProgramBinaryCache* Program::getProgramBinaryCache()
+{
+    return getProgramBinaryCacheRef().get();
+}
+
 ///////////////////////////////////////////////////////////////////////////
 // osg::Program
 ///////////////////////////////////////////////////////////////////////////
@@ -224,12 +246,18 @@ void Program::compileGLObjects( osg::State& state ) const
 
     const unsigned int contextID = state.getContextID();
 
-    for( unsigned int i=0; i < _shaderList.size(); ++i )
+    PerContextProgram* pcp = getPCP( contextID );
+
+    // no need to compile the shaders if the program's binary can be loaded from the ProgramBinaryCache
+    if( !(pcp->needsLink() && pcp->readCachedProgramBinary(state)) )
     {
-        _shaderList[i]->compileShader( state );
+        for( unsigned int i=0; i < _shaderList.size(); ++i )
+        {
+            _shaderList[i]->compileShader( state );
+        }
     }
 
-    getPCP( contextID )->linkProgram(state);
+    pcp->linkProgram(state);
 }
 
 void Program::setThreadSafeRefUnref(bool threadSafe)
@@ -559,7 +587,10 @@ void Program::PerContextProgram::linkProgram(osg::State& state)
 
     const ProgramBinary* programBinary = _program->getProgramBinary();
 
+    ProgramBinaryCache* programBinaryCache = getActiveProgramBinaryCache();
+
     _loadedBinary = false;
+    bool loadedCachedBinary = false;
     if (programBinary && programBinary->getSize())
     {
         GLint linked = GL_FALSE;
@@ -568,6 +599,27 @@ void Program::PerContextProgram::linkProgram(osg::State& state)
         _extensions->glGetProgramiv( _glProgramHandle, GL_LINK_STATUS, &linked );
         _loadedBinary = _isLinked = (linked == GL_TRUE);
     }
+    else if (_cachedProgramBinary.valid())
+    {
+        GLint linked = GL_FALSE;
+        _extensions->glProgramBinary( _glProgramHandle, _cachedProgramBinary->getFormat(),
+            reinterpret_cast<const GLvoid*>(_cachedProgramBinary->getData()), _cachedProgramBinary->getSize() );
+        _extensions->glGetProgramiv( _glProgramHandle, GL_LINK_STATUS, &linked );
+        _loadedBinary = _isLinked = loadedCachedBinary = (linked == GL_TRUE);
+        _cachedProgramBinary = 0;
+        if (_loadedBinary) _programBinaryKey.clear();
+
+        if (!_loadedBinary)
+        {
+            OSG_INFO << "Cached binary of osg::Program \"" << _program->getName() << "\" rejected, compiling from source" << std::endl;
+
+            // the shaders weren't compiled by Program::compileGLObjects() as the binary was expected to load.
+            for( unsigned int i=0; i < _program->_shaderList.size(); ++i )
+            {
+                _program->_shaderList[i]->compileShader( state );
+            }
+        }
+    }
 
     if (!_loadedBinary)
     {
@@ -583,7 +635,12 @@ void Program::PerContextProgram::linkProgram(osg::State& state)
             _extensions->glPatchParameteri( GL_PATCH_VERTICES, _program->_patchVertices );
             // todo: add default tessellation level
         }
+    }
 
+    // keep the attached shaders in step with the Program when the binary was loaded from the ProgramBinaryCache,
+    // so that a later relink from source, after the shaders have been modified, links all of them.
+    if (!_loadedBinary || loadedCachedBinary)
+    {
         // Detach removed shaders
         for( unsigned int i=0; i < _shadersToDetach.size(); ++i )
         {
@@ -592,7 +649,7 @@ void Program::PerContextProgram::linkProgram(osg::State& state)
     }
     _shadersToDetach.clear();
 
-    if (!_loadedBinary)
+    if (!_loadedBinary || loadedCachedBinary)
     {
         // Attach new shaders
         for( unsigned int i=0; i < _shadersToAttach.size(); ++i )
@@ -638,8 +695,8 @@ void Program::PerContextProgram::linkProgram(osg::State& state)
             _extensions->glBindFragDataLocation( _glProgramHandle, itr->second, reinterpret_cast<const GLchar*>(itr->first.c_str()) );
         }
 
-        // if any program binary has been set then assume we want to retrieve a binary later.
-        if (programBinary)
+        // if any program binary has been set, or binaries are cached, then assume we want to retrieve a binary later.
+        if (programBinary || programBinaryCache)
         {
             _extensions->glProgramParameteri( _glProgramHandle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
         }
@@ -649,6 +706,11 @@ void Program::PerContextProgram::linkProgram(osg::State& state)
         _extensions->glLinkProgram( _glProgramHandle );
         _extensions->glGetProgramiv( _glProgramHandle, GL_LINK_STATUS, &linked );
         _isLinked = (linked == GL_TRUE);
+
+        if (_isLinked && programBinaryCache)
+        {
+            writeCachedProgramBinary(state);
+        }
     }
 
     if( ! _isLinked )
@@ -927,6 +989,116 @@ Program::ProgramBinary* Program::PerContextProgram::compileProgramBinary(osg::St
     return 0;
 }
 
+Program::ProgramBinaryCache* Program::PerContextProgram::getActiveProgramBinaryCache() const
+{
+    // an explicitly assigned ProgramBinary takes precedence over the ProgramBinaryCache
+    if (_program->getProgramBinary()) return 0;
+    if (!_extensions->isGetProgramBinarySupported()) return 0;
+    return Program::getProgramBinaryCache();
+}
+
+std::string Program::PerContextProgram::computeProgramBinaryKey(osg::State& state) const
+{
+    std::ostringstream description;
+
+    const GLubyte* vendor = glGetString(GL_VENDOR);
+    const GLubyte* renderer = glGetString(GL_RENDERER);
+    const GLubyte* version = glGetString(GL_VERSION);
+    description << (vendor ? reinterpret_cast<const char*>(vendor) : "") << '\n'
+                << (renderer ? reinterpret_cast<const char*>(renderer) : "") << '\n'
+                << (version ? reinterpret_cast<const char*>(version) : "") << '\n';
+
+    for( unsigned int i=0; i < _program->_shaderList.size(); ++i )
+    {
+        const Shader* shader = _program->_shaderList[i].get();
+        description << shader->getType() << '\n' << shader->getShaderSource() << '\n';
+
+        const ShaderBinary* shaderBinary = shader->getShaderBinary();
+        if (shaderBinary && shaderBinary->getSize())
+        {
+            description.write(reinterpret_cast<const char*>(shaderBinary->getData()), shaderBinary->getSize());
+            description << '\n';
+        }
+    }
+
+    description << _program->_geometryVerticesOut << ' ' << _program->_geometryInputType << ' '
+                << _program->_geometryOutputType << ' ' << _program->_patchVertices << '\n';
+
+    const AttribBindingList& programBindlist = _program->getAttribBindingList();
+    for( AttribBindingList::const_iterator itr = programBindlist.begin(); itr != programBindlist.end(); ++itr )
+    {
+        description << "attrib " << itr->first << ' ' << itr->second << '\n';
+    }
+
+    if (state.getUseVertexAttributeAliasing())
+    {
+        const AttribBindingList& stateBindlist = state.getAttributeBindingList();
+        for( AttribBindingList::const_iterator itr = stateBindlist.begin(); itr != stateBindlist.end(); ++itr )
+        {
+            description << "alias " << itr->first << ' ' << itr->second << '\n';
+        }
+    }
+
+    const FragDataBindingList& fdbindlist = _program->getFragDataBindingList();
+    for( FragDataBindingList::const_iterator itr = fdbindlist.begin(); itr != fdbindlist.end(); ++itr )
+    {
+        description << "fragdata " << itr->first << ' ' << itr->second << '\n';
+    }
+
+    // 64 bit FNV-1a hash of the description
+    std::string str = description.str();
+    unsigned long long hash = 14695981039346656037ULL;
+    for( std::string::const_iterator itr = str.begin(); itr != str.end(); ++itr )
+    {
+        hash ^= static_cast<unsigned char>(*itr);
+        hash *= 1099511628211ULL;
+    }
+
+    std::ostringstream key;
+    key << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return key.str();
+}
+
+bool Program::PerContextProgram::readCachedProgramBinary(osg::State& state)
+{
+    _cachedProgramBinary = 0;
+
+    ProgramBinaryCache* programBinaryCache = getActiveProgramBinaryCache();
+    if (!programBinaryCache) return false;
+
+    _programBinaryKey = computeProgramBinaryKey(state);
+    _cachedProgramBinary = programBinaryCache->readProgramBinary(_programBinaryKey);
+    if (_cachedProgramBinary.valid() && _cachedProgramBinary->getSize()==0) _cachedProgramBinary = 0;
+
+    return _cachedProgramBinary.valid();
+}
+
+void Program::PerContextProgram::writeCachedProgramBinary(osg::State& state)
+{
+    ProgramBinaryCache* programBinaryCache = getActiveProgramBinaryCache();
+    if (!programBinaryCache) return;
+
+    if (_programBinaryKey.empty()) _programBinaryKey = computeProgramBinaryKey(state);
+
+    GLint binaryLength = 0;
+    _extensions->glGetProgramiv( _glProgramHandle, GL_PROGRAM_BINARY_LENGTH, &binaryLength );
+    if (binaryLength>0)
+    {
+        osg::ref_ptr<ProgramBinary> programBinary = new ProgramBinary;
+        programBinary->allocate(binaryLength);
+        GLenum binaryFormat = 0;
+        _extensions->glGetProgramBinary( _glProgramHandle, binaryLength, 0, &binaryFormat, reinterpret_cast<GLvoid*>(programBinary->getData()) );
+        programBinary->setFormat(binaryFormat);
+
+        if (!programBinaryCache->writeProgramBinary(_programBinaryKey, *programBinary))
+        {
+            OSG_INFO << "Unable to write binary of osg::Program \"" << _program->getName() << "\" to the ProgramBinaryCache" << std::endl;
+        }
+    }
+
+    _programBinaryKey.clear();
+}
+
 void Program::PerContextProgram::useProgram() const
 {
     _extensions->glUseProgram( _glProgramHandle  );
@@ -147,6 +147,7 @@ State::State():
     _glDisableVertexAttribArray = 0;
     _glDrawArraysInstanced = 0;
     _glDrawElementsInstanced = 0;
+    _glVertexAttribDivisor = 0;
 
     _dynamicObjectCount  = 0;
 
@@ -896,6 +897,7 @@ void State::initializeExtensionProcs()
 
     setGLExtensionFuncPtr(_glDrawArraysInstanced, "glDrawArraysInstanced","glDrawArraysInstancedARB","glDrawArraysInstancedEXT");
     setGLExtensionFuncPtr(_glDrawElementsInstanced, "glDrawElementsInstanced","glDrawElementsInstancedARB","glDrawElementsInstancedEXT");
+    setGLExtensionFuncPtr(_glVertexAttribDivisor, "glVertexAttribDivisor","glVertexAttribDivisorARB");
 
     if ( osg::getGLVersionNumber() >= 2.0 || osg::isGLExtensionSupported(_contextID,"GL_ARB_vertex_shader") || OSG_GLES2_FEATURES)
     {
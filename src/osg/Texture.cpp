@@ -56,6 +56,7 @@
 namespace osg {
 
 ApplicationUsageProxy Texture_e0(ApplicationUsage::ENVIRONMENTAL_VARIABLE,"OSG_MAX_TEXTURE_SIZE","Set the maximum size of textures.");
+ApplicationUsageProxy Texture_e1(ApplicationUsage::ENVIRONMENTAL_VARIABLE,"OSG_TEXTURE_STAGING_BUFFER_SIZE <int>","Set the size in bytes of the persistently mapped buffer that paged image data is staged in ahead of texture uploads, 0 disables staging.");
 
 typedef buffered_value< ref_ptr<Texture::Extensions> > BufferedExtensions;
 static BufferedExtensions s_extensions;
@@ -777,6 +778,22 @@ Texture::TextureObjectManager::TextureObjectManager(unsigned int contextID):
     _numApplied(0),
     _applyTime(0.0)
 {
+    const char* ptr = getenv("OSG_TEXTURE_STAGING_BUFFER_SIZE");
+    if (ptr) setTextureStagingBufferSize(atoi(ptr));
+}
+
+void Texture::TextureObjectManager::setTextureStagingBufferSize(unsigned int size)
+{
+    if (getTextureStagingBufferSize()==size) return;
+
+    if (_textureStagingBuffer.valid() && _textureStagingBuffer->isRealized())
+    {
+        OSG_NOTICE<<"Warning: TextureObjectManager::setTextureStagingBufferSize("<<size<<") cannot resize the TextureStagingBuffer once it has been realized."<<std::endl;
+        return;
+    }
+
+    if (size>0) _textureStagingBuffer = new TextureStagingBuffer(_contextID, size);
+    else _textureStagingBuffer = 0;
 }
 
 void Texture::TextureObjectManager::setMaxTexturePoolSize(unsigned int size)
@@ -855,6 +872,8 @@ void Texture::TextureObjectManager::deleteAllTextureObjects()
     {
         (*itr).second->deleteAllTextureObjects();
     }
+
+    if (_textureStagingBuffer.valid()) _textureStagingBuffer->deleteGLObjects();
 }
 
 void Texture::TextureObjectManager::discardAllTextureObjects()
@@ -867,6 +886,8 @@ void Texture::TextureObjectManager::discardAllTextureObjects()
     {
         (*itr).second->discardAllTextureObjects();
     }
+
+    if (_textureStagingBuffer.valid()) _textureStagingBuffer->discardGLObjects();
 }
 
 void Texture::TextureObjectManager::flushAllDeletedTextureObjects()
@@ -920,6 +941,13 @@ void Texture::TextureObjectManager::newFrame(osg::FrameStamp* fs)
     else ++_frameNumber;
 
     ++_numFrames;
+
+    if (_textureStagingBuffer.valid())
+    {
+        // realize here as newFrame() is called on the thread that the graphics context is current on.
+        if (!_textureStagingBuffer->isRealized()) _textureStagingBuffer->realize();
+        _textureStagingBuffer->newFrame(_frameNumber);
+    }
 }
 
 void Texture::TextureObjectManager::reportStats(std::ostream& out)
@@ -931,6 +959,11 @@ void Texture::TextureObjectManager::reportStats(std::ostream& out)
     out<<"   total _numDeleted="<<_numDeleted<<", _deleteTime="<<_deleteTime<<", averagePerFrame="<<_deleteTime/numFrames*1000.0<<"ms"<<std::endl;
     out<<"   total _numApplied="<<_numApplied<<", _applyTime="<<_applyTime<<", averagePerFrame="<<_applyTime/numFrames*1000.0<<"ms"<<std::endl;
     out<<"   getMaxTexturePoolSize()="<<getMaxTexturePoolSize()<<" current/max size = "<<double(_currTexturePoolSize)/double(getMaxTexturePoolSize())<<std::endl;
+    if (_textureStagingBuffer.valid())
+    {
+        out<<"   TextureStagingBuffer numImagesStaged="<<_textureStagingBuffer->getNumImagesStaged()<<", numImagesUploaded="<<_textureStagingBuffer->getNumImagesUploaded()
+           <<", numImagesExpired="<<_textureStagingBuffer->getNumImagesExpired()<<", numImagesRejected="<<_textureStagingBuffer->getNumImagesRejected()<<std::endl;
+    }
     recomputeStats(out);
 }
 
@@ -945,6 +978,8 @@ void Texture::TextureObjectManager::resetStats()
 
     _numApplied = 0;
     _applyTime = 0;
+
+    if (_textureStagingBuffer.valid()) _textureStagingBuffer->resetStats();
 }
 
 
@@ -1932,6 +1967,23 @@ void Texture::applyTexImage2D_load(State& state, GLenum target, const Image* ima
     {
         pbo = 0;
     }
+
+    // source the image data from the TextureStagingBuffer if it has been staged there ahead of the upload.
+    TextureStagingBuffer* stagingBuffer = 0;
+    if (!pbo && !needImageRescale && !useGluBuildMipMaps)
+    {
+        stagingBuffer = getTextureObjectManager(contextID)->getTextureStagingBuffer();
+        unsigned int offset = 0;
+        if (stagingBuffer && stagingBuffer->bindStagedImage(state, image, offset))
+        {
+            dataPtr = reinterpret_cast<unsigned char*>(offset);
+            rowLength = 0;
+        }
+        else
+        {
+            stagingBuffer = 0;
+        }
+    }
 #if !defined(OSG_GLES1_AVAILABLE) && !defined(OSG_GLES2_AVAILABLE)
     glPixelStorei(GL_UNPACK_ROW_LENGTH,rowLength);
 #endif
@@ -2049,6 +2101,11 @@ void Texture::applyTexImage2D_load(State& state, GLenum target, const Image* ima
 
     }
 
+    if (stagingBuffer)
+    {
+        stagingBuffer->unbindStagedImage(state, image);
+    }
+
     if (pbo)
     {
         state.unbindPixelBufferObject();
@@ -2187,6 +2244,23 @@ void Texture::applyTexImage2D_subload(State& state, GLenum target, const Image*
     {
         pbo = 0;
     }
+
+    // source the image data from the TextureStagingBuffer if it has been staged there ahead of the upload.
+    TextureStagingBuffer* stagingBuffer = 0;
+    if (!pbo && !needImageRescale && !useGluBuildMipMaps)
+    {
+        stagingBuffer = getTextureObjectManager(contextID)->getTextureStagingBuffer();
+        unsigned int offset = 0;
+        if (stagingBuffer && stagingBuffer->bindStagedImage(state, image, offset))
+        {
+            dataPtr = reinterpret_cast<unsigned char*>(offset);
+            rowLength = 0;
+        }
+        else
+        {
+            stagingBuffer = 0;
+        }
+    }
 #if !defined(OSG_GLES1_AVAILABLE) && !defined(OSG_GLES2_AVAILABLE)
     glPixelStorei(GL_UNPACK_ROW_LENGTH,rowLength);
 #endif
@@ -2285,6 +2359,11 @@ void Texture::applyTexImage2D_subload(State& state, GLenum target, const Image*
         }
     }
 
+    if (stagingBuffer)
+    {
+        stagingBuffer->unbindStagedImage(state, image);
+    }
+
     if (pbo)
     {
         state.unbindPixelBufferObject();
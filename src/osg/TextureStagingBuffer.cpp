@@ -0,0 +1,448 @@
+/* -*-c++-*- OpenSceneGraph - Copyright (C) 1998-2006 Robert Osfield
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+*/
+#include <osg/TextureStagingBuffer>
+#include <osg/BufferObject>
+#include <osg/GLExtensions>
+#include <osg/Image>
+#include <osg/State>
+#include <osg/Notify>
+
+#include <OpenThreads/ScopedLock>
+
+#include <string.h>
+
+#ifndef GL_MAP_WRITE_BIT
+    #define GL_MAP_WRITE_BIT                  0x0002
+#endif
+
+#ifndef GL_MAP_PERSISTENT_BIT
+    #define GL_MAP_PERSISTENT_BIT             0x0040
+    #define GL_MAP_COHERENT_BIT               0x0080
+#endif
+
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+    #define GL_SYNC_GPU_COMMANDS_COMPLETE     0x9117
+    #define GL_ALREADY_SIGNALED               0x911A
+    #define GL_TIMEOUT_EXPIRED                0x911B
+    #define GL_CONDITION_SATISFIED            0x911C
+    #define GL_WAIT_FAILED                    0x911D
+#endif
+
+using namespace osg;
+
+// image data is placed on offsets that suit any pixel data type.
+static const unsigned int s_stagingAlignment = 64;
+
+struct TextureStagingBuffer::Extensions
+{
+    // GLsync is an opaque pointer so is passed as void* to avoid depending on the GL headers declaring it.
+    typedef void (GL_APIENTRY * BufferStorageProc) (GLenum target, GLsizeiptr size, const GLvoid* data, GLbitfield flags);
+    typedef GLvoid* (GL_APIENTRY * MapBufferRangeProc) (GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+    typedef GLboolean (GL_APIENTRY * UnmapBufferProc) (GLenum target);
+    typedef void* (GL_APIENTRY * FenceSyncProc) (GLenum condition, GLbitfield flags);
+    typedef GLenum (GL_APIENTRY * ClientWaitSyncProc) (void* sync, GLbitfield flags, GLuint64EXT timeout);
+    typedef void (GL_APIENTRY * DeleteSyncProc) (void* sync);
+
+    Extensions(unsigned int contextID)
+    {
+        _glBufferStorage = 0;
+        _glMapBufferRange = 0;
+        _glUnmapBuffer = 0;
+        _glFenceSync = 0;
+        _glClientWaitSync = 0;
+        _glDeleteSync = 0;
+
+        if (isGLExtensionOrVersionSupported(contextID, "GL_ARB_buffer_storage", 4.4f) &&
+            isGLExtensionOrVersionSupported(contextID, "GL_ARB_sync", 3.2f))
+        {
+            setGLExtensionFuncPtr(_glBufferStorage, "glBufferStorage");
+            setGLExtensionFuncPtr(_glMapBufferRange, "glMapBufferRange");
+            setGLExtensionFuncPtr(_glUnmapBuffer, "glUnmapBuffer","glUnmapBufferARB");
+            setGLExtensionFuncPtr(_glFenceSync, "glFenceSync");
+            setGLExtensionFuncPtr(_glClientWaitSync, "glClientWaitSync");
+            setGLExtensionFuncPtr(_glDeleteSync, "glDeleteSync");
+        }
+
+        _bufferObjectExtensions = GLBufferObject::getExtensions(contextID, true);
+    }
+
+    bool isSupported() const
+    {
+        return _glBufferStorage && _glMapBufferRange && _glUnmapBuffer &&
+               _glFenceSync && _glClientWaitSync && _glDeleteSync &&
+               _bufferObjectExtensions->isPBOSupported();
+    }
+
+    BufferStorageProc       _glBufferStorage;
+    MapBufferRangeProc      _glMapBufferRange;
+    UnmapBufferProc         _glUnmapBuffer;
+    FenceSyncProc           _glFenceSync;
+    ClientWaitSyncProc      _glClientWaitSync;
+    DeleteSyncProc          _glDeleteSync;
+
+    GLBufferObject::Extensions* _bufferObjectExtensions;
+};
+
+TextureStagingBuffer::TextureStagingBuffer(unsigned int contextID, unsigned int size):
+    _contextID(contextID),
+    _size(size),
+    _numFramesToKeepStaged(100),
+    _glObjectID(0),
+    _mappedData(0),
+    _frameNumber(0),
+    _numWriting(0),
+    _numImagesStaged(0),
+    _numImagesUploaded(0),
+    _numImagesExpired(0),
+    _numImagesRejected(0),
+    _numBytesStaged(0),
+    _extensions(0)
+{
+    _uploadingRegion = _regions.end();
+}
+
+TextureStagingBuffer::~TextureStagingBuffer()
+{
+    if (_glObjectID!=0)
+    {
+        OSG_INFO<<"TextureStagingBuffer::~TextureStagingBuffer() pixel buffer object "<<_glObjectID<<" not deleted."<<std::endl;
+    }
+
+    delete _extensions;
+}
+
+bool TextureStagingBuffer::realize()
+{
+    if (_mappedData) return true;
+    if (_size==0) return false;
+
+    if (!_extensions)
+    {
+        _extensions = new Extensions(_contextID);
+        if (!_extensions->isSupported())
+        {
+            OSG_INFO<<"TextureStagingBuffer::realize() persistently mapped buffers not supported, texture staging disabled."<<std::endl;
+        }
+    }
+
+    if (!_extensions->isSupported()) return false;
+
+    GLBufferObject::Extensions* bufferExtensions = _extensions->_bufferObjectExtensions;
+
+    bufferExtensions->glGenBuffers(1, &_glObjectID);
+    bufferExtensions->glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, _glObjectID);
+
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    _extensions->_glBufferStorage(GL_PIXEL_UNPACK_BUFFER_ARB, _size, NULL, flags);
+
+    unsigned char* mappedData = reinterpret_cast<unsigned char*>(_extensions->_glMapBufferRange(GL_PIXEL_UNPACK_BUFFER_ARB, 0, _size, flags));
+
+    bufferExtensions->glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+
+    if (!mappedData)
+    {
+        OSG_NOTICE<<"Warning: TextureStagingBuffer::realize() unable to map pixel buffer object of "<<_size<<" bytes."<<std::endl;
+        bufferExtensions->glDeleteBuffers(1, &_glObjectID);
+        _glObjectID = 0;
+        return false;
+    }
+
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+    _mappedData = mappedData;
+
+    return true;
+}
+
+bool TextureStagingBuffer::allocate(unsigned int size, unsigned int& offset) const
+{
+    if (size>_size) return false;
+
+    if (_regions.empty())
+    {
+        offset = 0;
+        return true;
+    }
+
+    unsigned int front = _regions.front().offset;
+    unsigned int backEnd = _regions.back().offset + _regions.back().size;
+    backEnd = ((backEnd+s_stagingAlignment-1)/s_stagingAlignment)*s_stagingAlignment;
+
+    if (_regions.back().offset>=front)
+    {
+        // the used ranges are contiguous, so there is space after them and before them.
+        if (backEnd<=_size && size<=_size-backEnd)
+        {
+            offset = backEnd;
+            return true;
+        }
+        if (size<=front)
+        {
+            offset = 0;
+            return true;
+        }
+        return false;
+    }
+    else
+    {
+        // the used ranges wrap around the end of the ring, so the space is between the newest and the oldest.
+        if (backEnd<=front && size<=front-backEnd)
+        {
+            offset = backEnd;
+            return true;
+        }
+        return false;
+    }
+}
+
+bool TextureStagingBuffer::stage(const Image* image)
+{
+    if (!image || !image->data()) return false;
+
+    unsigned int size = image->getTotalDataSize();
+    if (size==0) return false;
+
+    Regions::iterator region_itr;
+    unsigned char* ptr = 0;
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+        if (!_mappedData) return false;
+
+        StagedImageMap::iterator itr = _stagedImages.find(image);
+        if (itr!=_stagedImages.end())
+        {
+            Region& region = *(itr->second);
+            if (region.image.get()==image && region.modifiedCount==image->getModifiedCount()) return true;
+
+            // the image has been modified, or a deleted image's address has been reused, so let the old copy expire.
+            // A copy that the draw thread is uploading from is left to be fenced by unbindStagedImage() and freed
+            // by newFrame() once the GPU has read it.
+            if (region.state==STAGED) region.state = FREE;
+            _stagedImages.erase(itr);
+        }
+
+        unsigned int offset = 0;
+        if (!allocate(size, offset))
+        {
+            ++_numImagesRejected;
+            return false;
+        }
+
+        Region region;
+        region.offset = offset;
+        region.size = size;
+        region.image = image;
+        region.modifiedCount = image->getModifiedCount();
+        region.frameNumber = _frameNumber;
+        region.state = WRITING;
+
+        region_itr = _regions.insert(_regions.end(), region);
+
+        // the WRITING region isn't released by newFrame(), and deleteGLObjects() and discardGLObjects() wait for
+        // _numWriting to return to zero, so the region and the mapping stay valid while the lock isn't held.
+        ptr = _mappedData + offset;
+        ++_numWriting;
+    }
+
+    // copy the image data without holding the lock so that other threads can stage images and the draw thread can upload in parallel.
+    if (image->isDataContiguous())
+    {
+        memcpy(ptr, image->data(), size);
+    }
+    else
+    {
+        for(Image::DataIterator img_itr(image); img_itr.valid(); ++img_itr)
+        {
+            memcpy(ptr, img_itr.data(), img_itr.size());
+            ptr += img_itr.size();
+        }
+    }
+
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+    if (--_numWriting==0) _writingCompleted.broadcast();
+
+    region_itr->state = STAGED;
+
+    // another thread may have staged the image meanwhile, in which case its copy expires in its place.
+    StagedImageMap::iterator itr = _stagedImages.find(image);
+    if (itr!=_stagedImages.end() && itr->second->state==STAGED) itr->second->state = FREE;
+    _stagedImages[image] = region_itr;
+
+    ++_numImagesStaged;
+    _numBytesStaged += size;
+
+    return true;
+}
+
+bool TextureStagingBuffer::isStaged(const Image* image) const
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+    StagedImageMap::const_iterator itr = _stagedImages.find(image);
+    if (itr==_stagedImages.end()) return false;
+
+    const Region& region = *(itr->second);
+    return region.state==STAGED && region.image.get()==image && region.modifiedCount==image->getModifiedCount();
+}
+
+bool TextureStagingBuffer::bindStagedImage(State& state, const Image* image, unsigned int& offset)
+{
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+        StagedImageMap::const_iterator itr = _stagedImages.find(image);
+        if (itr==_stagedImages.end()) return false;
+
+        Region& region = *(itr->second);
+        if (region.state!=STAGED || region.image.get()!=image || region.modifiedCount!=image->getModifiedCount()) return false;
+
+        // the region is no longer released if the image is staged again, until its upload has been fenced.
+        region.state = UPLOADING;
+        _uploadingRegion = itr->second;
+
+        offset = region.offset;
+    }
+
+    state.unbindPixelBufferObject();
+    _extensions->_bufferObjectExtensions->glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, _glObjectID);
+
+    return true;
+}
+
+void TextureStagingBuffer::unbindStagedImage(State& /*state*/, const Image* image)
+{
+    _extensions->_bufferObjectExtensions->glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+    if (_uploadingRegion==_regions.end()) return;
+
+    Region& region = *_uploadingRegion;
+    region.fence = _extensions->_glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    region.state = UPLOADED;
+    ++_numImagesUploaded;
+
+    // the image may have been staged again while it was being uploaded, in which case the new copy stays staged.
+    StagedImageMap::iterator itr = _stagedImages.find(image);
+    if (itr!=_stagedImages.end() && itr->second==_uploadingRegion) _stagedImages.erase(itr);
+
+    _uploadingRegion = _regions.end();
+}
+
+void TextureStagingBuffer::newFrame(unsigned int frameNumber)
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+    _frameNumber = frameNumber;
+
+    if (!_mappedData) return;
+
+    for(Regions::iterator itr = _regions.begin();
+        itr != _regions.end();
+        ++itr)
+    {
+        Region& region = *itr;
+        if (region.state==UPLOADED)
+        {
+            GLenum result = _extensions->_glClientWaitSync(region.fence, 0, 0);
+            if (result==GL_ALREADY_SIGNALED || result==GL_CONDITION_SATISFIED || result==GL_WAIT_FAILED)
+            {
+                _extensions->_glDeleteSync(region.fence);
+                region.fence = 0;
+                region.state = FREE;
+            }
+        }
+        else if (region.state==STAGED)
+        {
+            if (!region.image.valid() || (frameNumber-region.frameNumber)>_numFramesToKeepStaged)
+            {
+                // search by region as images that are deleted without being applied leave their entry keyed by the old address.
+                for(StagedImageMap::iterator sitr = _stagedImages.begin(); sitr != _stagedImages.end(); ++sitr)
+                {
+                    if (sitr->second==itr)
+                    {
+                        _stagedImages.erase(sitr);
+                        break;
+                    }
+                }
+
+                region.state = FREE;
+                ++_numImagesExpired;
+            }
+        }
+    }
+
+    releaseRegions();
+}
+
+void TextureStagingBuffer::releaseRegions()
+{
+    // ranges are reused in the order they were allocated, so only the oldest regions can be released.
+    while(!_regions.empty() && _regions.front().state==FREE)
+    {
+        _regions.pop_front();
+    }
+}
+
+void TextureStagingBuffer::deleteGLObjects()
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+    while(_numWriting>0) _writingCompleted.wait(&_mutex);
+
+    if (_glObjectID==0) return;
+
+    for(Regions::iterator itr = _regions.begin();
+        itr != _regions.end();
+        ++itr)
+    {
+        if (itr->fence) _extensions->_glDeleteSync(itr->fence);
+    }
+
+    GLBufferObject::Extensions* bufferExtensions = _extensions->_bufferObjectExtensions;
+    bufferExtensions->glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, _glObjectID);
+    _extensions->_glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER_ARB);
+    bufferExtensions->glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+    bufferExtensions->glDeleteBuffers(1, &_glObjectID);
+
+    _glObjectID = 0;
+    _mappedData = 0;
+    _regions.clear();
+    _stagedImages.clear();
+    _uploadingRegion = _regions.end();
+}
+
+void TextureStagingBuffer::discardGLObjects()
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+    while(_numWriting>0) _writingCompleted.wait(&_mutex);
+
+    _glObjectID = 0;
+    _mappedData = 0;
+    _regions.clear();
+    _stagedImages.clear();
+    _uploadingRegion = _regions.end();
+}
+
+void TextureStagingBuffer::resetStats()
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+    _numImagesStaged = 0;
+    _numImagesUploaded = 0;
+    _numImagesExpired = 0;
+    _numImagesRejected = 0;
+    _numBytesStaged = 0;
+}
@@ -193,3 +193,22 @@ BoundingSphere Transform::computeBound() const
     return bsphere;
 
 }
+
+BoundingBox Transform::computeAxisAlignedBound() const
+{
+    if (!isBoundComputedAs(Transform::computeBound())) return Node::computeAxisAlignedBound();
+
+    BoundingBox localbb = computeChildrenBoundingBox();
+    if (!localbb.valid()) return localbb;
+
+    Matrix l2w;
+
+    computeLocalToWorldMatrix(l2w,NULL);
+
+    BoundingBox bb;
+    for(unsigned int i=0; i<8; ++i)
+    {
+        bb.expandBy(localbb.corner(i)*l2w);
+    }
+    return bb;
+}
@@ -16,10 +16,304 @@
 #include <osgDB/Registry>
 #include <osgDB/Registry>
 #include <osgDB/ObjectWrapper>
+#include <OpenThreads/Thread>
+#include <OpenThreads/Atomic>
 #include <sstream>
+#include <vector>
+#include <string.h>
 
 using namespace osgDB;
 
+namespace
+{
+
+// Process a number of independent blocks, sharing them out between as many threads as there are processors
+class BlockOperation
+{
+public:
+    BlockOperation() : _numBlocks(0) {}
+    virtual ~BlockOperation() {}
+
+    virtual bool processBlock( unsigned int i ) = 0;
+
+    bool run( unsigned int numBlocks );
+
+    void processBlocks()
+    {
+        unsigned int i;
+        while ( (i = ++_nextBlock - 1) < _numBlocks )
+        {
+            if ( !processBlock(i) ) ++_numFailed;
+        }
+    }
+
+protected:
+    unsigned int _numBlocks;
+    OpenThreads::Atomic _nextBlock;
+    OpenThreads::Atomic _numFailed;
+};
+
+class BlockOperationThread : public OpenThreads::Thread
+{
+public:
+    BlockOperationThread( BlockOperation* op ) : _op(op) {}
+    virtual void run() { _op->processBlocks(); }
+
+protected:
+    BlockOperation* _op;
+};
+
+bool BlockOperation::run( unsigned int numBlocks )
+{
+    _numBlocks = numBlocks;
+    _nextBlock.exchange( 0 );
+    _numFailed.exchange( 0 );
+
+    unsigned int numProcessors = osg::maximum( OpenThreads::GetNumberOfProcessors(), 1 );
+    unsigned int numThreads = osg::minimum( numBlocks, numProcessors );
+
+    std::vector<BlockOperationThread*> threads;
+    for ( unsigned int i=1; i<numThreads; ++i )
+    {
+        BlockOperationThread* thread = new BlockOperationThread(this);
+        if ( thread->startThread()==0 ) threads.push_back( thread );
+        else delete thread;
+    }
+
+    processBlocks();
+
+    for ( std::vector<BlockOperationThread*>::iterator itr=threads.begin(); itr!=threads.end(); ++itr )
+    {
+        (*itr)->join();
+        delete *itr;
+    }
+    return _numFailed==0;
+}
+
+typedef std::vector<unsigned int> BlockSizes;
+typedef std::vector<std::string> Blocks;
+
+class CompressBlocksOperation : public BlockOperation
+{
+public:
+    CompressBlocksOperation( BlockCompressor* compressor, const std::string& src, unsigned int blockSize, Blocks& blocks )
+    :   _compressor(compressor), _src(src), _blockSize(blockSize), _blocks(blocks) {}
+
+    virtual bool processBlock( unsigned int i )
+    {
+        std::string::size_type begin = std::string::size_type(i)*_blockSize;
+        unsigned int size = osg::minimum( std::string::size_type(_blockSize), _src.size()-begin );
+
+        // store blocks that don't compress as they are, marked by their sizes being equal
+        std::string& block = _blocks[i];
+        if ( !_compressor->compressBlock(_src.data()+begin, size, block) || block.size()>=size )
+            block.assign( _src, begin, size );
+        return true;
+    }
+
+protected:
+    BlockCompressor* _compressor;
+    const std::string& _src;
+    unsigned int _blockSize;
+    Blocks& _blocks;
+};
+
+class DecompressBlocksOperation : public BlockOperation
+{
+public:
+    DecompressBlocksOperation( BlockCompressor* compressor, const Blocks& blocks, char* const* targets, const unsigned int* targetSizes )
+    :   _compressor(compressor), _blocks(blocks), _targets(targets), _targetSizes(targetSizes) {}
+
+    virtual bool processBlock( unsigned int i )
+    {
+        const std::string& block = _blocks[i];
+        if ( block.size()==_targetSizes[i] )
+        {
+            if ( !block.empty() ) memcpy( _targets[i], block.data(), block.size() );
+            return true;
+        }
+        return _compressor->decompressBlock( block.data(), block.size(), _targets[i], _targetSizes[i] );
+    }
+
+protected:
+    BlockCompressor* _compressor;
+    const Blocks& _blocks;
+    char* const* _targets;
+    const unsigned int* _targetSizes;
+};
+
+bool readBlockTable( std::istream& fin, BlockSizes& uncompressedSizes, BlockSizes& compressedSizes )
+{
+    unsigned int numBlocks = 0;
+    fin.read( (char*)&numBlocks, INT_SIZE );
+    if ( fin.fail() ) return false;
+
+    uncompressedSizes.resize( numBlocks );
+    compressedSizes.resize( numBlocks );
+    for ( unsigned int i=0; i<numBlocks && !fin.fail(); ++i )
+    {
+        fin.read( (char*)&uncompressedSizes[i], INT_SIZE );
+        fin.read( (char*)&compressedSizes[i], INT_SIZE );
+    }
+    return !fin.fail();
+}
+
+// Stream buffer decompressing the blocks a batch at a time as the data is read, with the blocks of each batch decompressed in parallel
+class BlockDecompressionBuffer : public std::streambuf
+{
+public:
+    BlockDecompressionBuffer( BlockCompressor* compressor, std::istream& fin, const BlockSizes& uncompressedSizes, const BlockSizes& compressedSizes )
+    :   _compressor(compressor), _fin(fin),
+        _uncompressedSizes(uncompressedSizes), _compressedSizes(compressedSizes),
+        _nextBlock(0), _batchBegin(0), _batchEnd(0)
+    {
+        unsigned int batchSize = osg::maximum( OpenThreads::GetNumberOfProcessors(), 1 );
+        _compressed.resize( batchSize );
+        _blocks.resize( batchSize );
+        setg( 0, 0, 0 );
+    }
+
+protected:
+    virtual int_type underflow()
+    {
+        while ( gptr()==egptr() )
+        {
+            if ( _nextBlock>=_uncompressedSizes.size() ) return traits_type::eof();
+            if ( _nextBlock>=_batchEnd && !readBatch() ) return traits_type::eof();
+
+            std::string& block = _blocks[_nextBlock-_batchBegin];
+            char* data = block.empty() ? 0 : &block[0];
+            setg( data, data, data+block.size() );
+            ++_nextBlock;
+        }
+        return traits_type::to_int_type( *gptr() );
+    }
+
+    bool readBatch()
+    {
+        _batchBegin = _nextBlock;
+        _batchEnd = osg::minimum( _batchBegin+(unsigned int)_blocks.size(), (unsigned int)_uncompressedSizes.size() );
+
+        unsigned int numBlocks = _batchEnd-_batchBegin;
+        std::vector<char*> targets( numBlocks );
+        for ( unsigned int i=0; i<numBlocks; ++i )
+        {
+            std::string& compressed = _compressed[i];
+            compressed.resize( _compressedSizes[_batchBegin+i] );
+            if ( !compressed.empty() ) _fin.read( &compressed[0], compressed.size() );
+            if ( _fin.fail() ) return false;
+
+            std::string& block = _blocks[i];
+            block.resize( _uncompressedSizes[_batchBegin+i] );
+            targets[i] = block.empty() ? 0 : &block[0];
+        }
+
+        DecompressBlocksOperation op( _compressor, _compressed, &targets.front(), &_uncompressedSizes[_batchBegin] );
+        if ( !op.run(numBlocks) )
+        {
+            OSG_WARN << "BlockCompressor: Failed to decompress block." << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    osg::ref_ptr<BlockCompressor> _compressor;
+    std::istream& _fin;
+    BlockSizes _uncompressedSizes;
+    BlockSizes _compressedSizes;
+    unsigned int _nextBlock;
+    unsigned int _batchBegin;
+    unsigned int _batchEnd;
+    Blocks _compressed;
+    Blocks _blocks;
+};
+
+class BlockDecompressionStream : public std::istream
+{
+public:
+    BlockDecompressionStream( BlockCompressor* compressor, std::istream& fin, const BlockSizes& uncompressedSizes, const BlockSizes& compressedSizes )
+    :   std::istream(0), _buffer(compressor, fin, uncompressedSizes, compressedSizes)
+    {
+        rdbuf( &_buffer );
+    }
+
+protected:
+    BlockDecompressionBuffer _buffer;
+};
+
+}
+
+BlockCompressor::BlockCompressor( unsigned int blockSize )
+:   _blockSize(blockSize)
+{
+}
+
+bool BlockCompressor::compress( std::ostream& fout, const std::string& src )
+{
+    unsigned int blockSize = osg::maximum( _blockSize, 1u );
+    unsigned int numBlocks = (src.size()+blockSize-1)/blockSize;
+
+    Blocks blocks( numBlocks );
+    CompressBlocksOperation op( this, src, blockSize, blocks );
+    if ( !op.run(numBlocks) ) return false;
+
+    // write the table of block sizes up front so that the reader can read each block in one go
+    fout.write( (char*)&numBlocks, INT_SIZE );
+    for ( unsigned int i=0; i<numBlocks; ++i )
+    {
+        unsigned int uncompressedSize = osg::minimum( std::string::size_type(blockSize), src.size()-std::string::size_type(i)*blockSize );
+        unsigned int compressedSize = blocks[i].size();
+        fout.write( (char*)&uncompressedSize, INT_SIZE );
+        fout.write( (char*)&compressedSize, INT_SIZE );
+    }
+
+    for ( unsigned int i=0; i<numBlocks; ++i )
+    {
+        fout.write( blocks[i].data(), blocks[i].size() );
+    }
+    return !fout.fail();
+}
+
+bool BlockCompressor::decompress( std::istream& fin, std::string& target )
+{
+    BlockSizes uncompressedSizes, compressedSizes;
+    if ( !readBlockTable(fin, uncompressedSizes, compressedSizes) ) return false;
+
+    unsigned int numBlocks = uncompressedSizes.size();
+    Blocks blocks( numBlocks );
+    std::string::size_type totalSize = 0;
+    for ( unsigned int i=0; i<numBlocks; ++i )
+    {
+        blocks[i].resize( compressedSizes[i] );
+        if ( !blocks[i].empty() ) fin.read( &blocks[i][0], blocks[i].size() );
+        if ( fin.fail() ) return false;
+        totalSize += uncompressedSizes[i];
+    }
+
+    target.resize( totalSize );
+
+    std::vector<char*> targets( numBlocks );
+    std::string::size_type offset = 0;
+    for ( unsigned int i=0; i<numBlocks; ++i )
+    {
+        targets[i] = &target[0] + offset;
+        offset += uncompressedSizes[i];
+    }
+
+    if ( numBlocks==0 ) return true;
+
+    DecompressBlocksOperation op( this, blocks, &targets.front(), &uncompressedSizes.front() );
+    return op.run( numBlocks );
+}
+
+std::istream* BlockCompressor::createDecompressionStream( std::istream& fin )
+{
+    BlockSizes uncompressedSizes, compressedSizes;
+    if ( !readBlockTable(fin, uncompressedSizes, compressedSizes) ) return NULL;
+
+    return new BlockDecompressionStream( this, fin, uncompressedSizes, compressedSizes );
+}
+
 // Example compressor copying data to/from stream directly
 class NullCompressor : public BaseCompressor
 {
@@ -48,6 +342,143 @@ public:
 
 REGISTER_COMPRESSOR( "null", NullCompressor )
 
+// Fast byte oriented LZ77 compressor, trading compression ratio for speed, with the blocks laid out as in LZ4:
+// a token holding the literal and match lengths, the literals, a 16 bit offset and any extra match length bytes.
+// The last sequence of a block only holds literals.
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 14
+
+class LZCompressor : public BlockCompressor
+{
+public:
+    LZCompressor() {}
+
+    virtual bool compressBlock( const char* src, unsigned int size, std::string& target )
+    {
+        const unsigned char* base = (const unsigned char*)src;
+        const unsigned char* end = base + size;
+        const unsigned char* matchLimit = size>=LZ_MIN_MATCH ? end - LZ_MIN_MATCH : base;
+        const unsigned char* ip = base;
+        const unsigned char* literals = base;
+
+        std::vector<unsigned int> hashTable( 1<<LZ_HASH_BITS, 0 );
+        unsigned int misses = 0;
+
+        while ( ip<matchLimit )
+        {
+            unsigned int sequence = read32( ip );
+            unsigned int& entry = hashTable[hash(sequence)];
+            const unsigned char* ref = base + entry;
+            entry = ip - base;
+
+            if ( ref<ip && ip-ref<=LZ_MAX_OFFSET && read32(ref)==sequence )
+            {
+                const unsigned char* matchEnd = ip + LZ_MIN_MATCH;
+                ref += LZ_MIN_MATCH;
+                while ( matchEnd<end && *matchEnd==*ref ) { ++matchEnd; ++ref; }
+
+                writeSequence( target, literals, ip-literals, matchEnd-ref, matchEnd-ip );
+                ip = matchEnd;
+                literals = ip;
+                misses = 0;
+            }
+            else
+            {
+                // step faster through data that doesn't compress
+                ip += 1 + (misses++ >> 6);
+            }
+        }
+
+        writeSequence( target, literals, end-literals, 0, 0 );
+        return true;
+    }
+
+    virtual bool decompressBlock( const char* src, unsigned int size, char* target, unsigned int targetSize )
+    {
+        const unsigned char* ip = (const unsigned char*)src;
+        const unsigned char* end = ip + size;
+        unsigned char* op = (unsigned char*)target;
+        unsigned char* opEnd = op + targetSize;
+
+        while ( ip<end )
+        {
+            unsigned int token = *ip++;
+
+            unsigned int length = token >> 4;
+            if ( length==15 && !readLength(ip, end, length) ) return false;
+            if ( length>(unsigned int)(end-ip) || length>(unsigned int)(opEnd-op) ) return false;
+            memcpy( op, ip, length );
+            ip += length;
+            op += length;
+
+            if ( ip==end ) break;
+
+            if ( end-ip<2 ) return false;
+            unsigned int offset = ip[0] | (ip[1]<<8);
+            ip += 2;
+            if ( offset==0 || offset>(unsigned int)(op-(unsigned char*)target) ) return false;
+
+            length = token & 15;
+            if ( length==15 && !readLength(ip, end, length) ) return false;
+            length += LZ_MIN_MATCH;
+            if ( length>(unsigned int)(opEnd-op) ) return false;
+
+            const unsigned char* ref = op - offset;
+            if ( offset>=length ) memcpy( op, ref, length );
+            else for ( unsigned int i=0; i<length; ++i ) op[i] = ref[i];  // overlapping copy repeats the pattern
+            op += length;
+        }
+        return op==opEnd;
+    }
+
+protected:
+    static unsigned int read32( const unsigned char* ptr )
+    {
+        unsigned int value; memcpy( &value, ptr, 4 );
+        return value;
+    }
+
+    static unsigned int hash( unsigned int sequence )
+    { return (sequence * 2654435761u) >> (32-LZ_HASH_BITS); }
+
+    static void writeLength( std::string& target, unsigned int length )
+    {
+        for ( length-=15; length>=255; length-=255 ) target.push_back( (char)255 );
+        target.push_back( (char)length );
+    }
+
+    static bool readLength( const unsigned char*& ip, const unsigned char* end, unsigned int& length )
+    {
+        unsigned int byte = 255;
+        while ( byte==255 )
+        {
+            if ( ip>=end ) return false;
+            byte = *ip++;
+            length += byte;
+        }
+        return true;
+    }
+
+    static void writeSequence( std::string& target, const unsigned char* literals, unsigned int numLiterals,
+                               unsigned int offset, unsigned int matchLength )
+    {
+        unsigned int matchCode = matchLength>0 ? matchLength-LZ_MIN_MATCH : 0;
+        target.push_back( (char)((osg::minimum(numLiterals, 15u)<<4) | osg::minimum(matchCode, 15u)) );
+        if ( numLiterals>=15 ) writeLength( target, numLiterals );
+        target.append( (const char*)literals, numLiterals );
+
+        if ( matchLength>0 )
+        {
+            target.push_back( (char)(offset & 0xff) );
+            target.push_back( (char)(offset >> 8) );
+            if ( matchCode>=15 ) writeLength( target, matchCode );
+        }
+    }
+};
+
+REGISTER_COMPRESSOR( "lz", LZCompressor )
+
 #ifdef USE_ZLIB
 
 #include <zlib.h>
@@ -173,4 +604,31 @@ public:
 
 REGISTER_COMPRESSOR( "zlib", ZLibCompressor )
 
+// ZLib compressor working on independent blocks, so that they can be compressed and decompressed in parallel
+class ZLibBlockCompressor : public BlockCompressor
+{
+public:
+    ZLibBlockCompressor() {}
+
+    virtual bool compressBlock( const char* src, unsigned int size, std::string& target )
+    {
+        std::string::size_type start = target.size();
+        uLongf targetSize = compressBound( size );
+        target.resize( start + targetSize );
+
+        int ret = compress2( (Bytef*)&target[start], &targetSize, (const Bytef*)src, size, 6 );
+        target.resize( start + (ret==Z_OK ? targetSize : 0) );
+        return ret==Z_OK;
+    }
+
+    virtual bool decompressBlock( const char* src, unsigned int size, char* target, unsigned int targetSize )
+    {
+        uLongf decompressedSize = targetSize;
+        int ret = uncompress( (Bytef*)target, &decompressedSize, (const Bytef*)src, size );
+        return ret==Z_OK && decompressedSize==targetSize;
+    }
+};
+
+REGISTER_COMPRESSOR( "zlib_blocks", ZLibBlockCompressor )
+
 #endif
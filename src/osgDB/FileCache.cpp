@@ -16,6 +16,11 @@
 #include <osgDB/FileNameUtils>
 #include <osgDB/ReadFile>
 #include <osgDB/WriteFile>
+#include <osgDB/fstream>
+
+#include <OpenThreads/ScopedLock>
+
+#include <stdio.h>
 
 using namespace osgDB;
 
@@ -252,6 +257,81 @@ ReaderWriter::WriteResult FileCache::writeShader(const osg::Shader& shader, cons
     return ReaderWriter::WriteResult::FILE_NOT_HANDLED;
 }
 
+// ProgramBinary files hold a header of magic number, version, binary format and binary size followed by the binary data.
+static const unsigned int PROGRAM_BINARY_MAGIC = 0x4250534f; // "OSPB"
+static const unsigned int PROGRAM_BINARY_VERSION = 1;
+
+osg::Program::ProgramBinary* FileCache::readProgramBinary(const std::string& originalFileName) const
+{
+    std::string cacheFileName = createCacheFileName(originalFileName);
+    if (cacheFileName.empty() || !osgDB::fileExists(cacheFileName) || isCachedFileBlackListed(originalFileName)) return 0;
+
+    osgDB::ifstream fin(cacheFileName.c_str(), std::ios::in | std::ios::binary);
+    if (!fin) return 0;
+
+    unsigned int header[4] = { 0, 0, 0, 0 };
+    fin.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!fin || header[0]!=PROGRAM_BINARY_MAGIC || header[1]!=PROGRAM_BINARY_VERSION || header[3]==0)
+    {
+        OSG_INFO<<"FileCache::readProgramBinary("<<originalFileName<<") invalid header in "<<cacheFileName<<std::endl;
+        return 0;
+    }
+
+    osg::ref_ptr<osg::Program::ProgramBinary> programBinary = new osg::Program::ProgramBinary;
+    programBinary->allocate(header[3]);
+    programBinary->setFormat(header[2]);
+    fin.read(reinterpret_cast<char*>(programBinary->getData()), header[3]);
+    if (!fin)
+    {
+        OSG_INFO<<"FileCache::readProgramBinary("<<originalFileName<<") truncated data in "<<cacheFileName<<std::endl;
+        return 0;
+    }
+
+    OSG_INFO<<"FileCache::readProgramBinaryFromCache("<<originalFileName<<") as "<<cacheFileName<<std::endl;
+    return programBinary.release();
+}
+
+bool FileCache::writeProgramBinary(const osg::Program::ProgramBinary& programBinary, const std::string& originalFileName) const
+{
+    std::string cacheFileName = createCacheFileName(originalFileName);
+    if (cacheFileName.empty() || programBinary.getSize()==0) return false;
+
+    std::string path = osgDB::getFilePath(cacheFileName);
+    if (!osgDB::fileExists(path) && !osgDB::makeDirectory(path))
+    {
+        OSG_NOTICE<<"Could not create cache directory: "<<path<<std::endl;
+        return false;
+    }
+
+    // write to a temporary file that is then renamed, so that other processes never read a partially written binary.
+    std::string tmpFileName = cacheFileName + ".tmp";
+    {
+        osgDB::ofstream fout(tmpFileName.c_str(), std::ios::out | std::ios::binary);
+        if (!fout) return false;
+
+        unsigned int header[4] = { PROGRAM_BINARY_MAGIC, PROGRAM_BINARY_VERSION, programBinary.getFormat(), programBinary.getSize() };
+        fout.write(reinterpret_cast<const char*>(header), sizeof(header));
+        fout.write(reinterpret_cast<const char*>(programBinary.getData()), programBinary.getSize());
+        if (!fout)
+        {
+            fout.close();
+            remove(tmpFileName.c_str());
+            return false;
+        }
+    }
+
+    remove(cacheFileName.c_str());
+    if (rename(tmpFileName.c_str(), cacheFileName.c_str())!=0)
+    {
+        remove(tmpFileName.c_str());
+        return false;
+    }
+
+    OSG_INFO<<"FileCache::writeProgramBinaryToCache("<<originalFileName<<") as "<<cacheFileName<<std::endl;
+    removeFileFromBlackListed(originalFileName);
+    return true;
+}
+
 
 bool FileCache::isCachedFileBlackListed(const std::string& originalFileName) const
 {
@@ -482,3 +562,26 @@ FileList* FileCache::readFileList(const std::string& originalFileName) const
     }
     return fileList.release();
 }
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+// ProgramBinaryFileCache
+//
+ProgramBinaryFileCache::ProgramBinaryFileCache(FileCache* fileCache):
+    _fileCache(fileCache)
+{
+}
+
+osg::Program::ProgramBinary* ProgramBinaryFileCache::readProgramBinary(const std::string& key)
+{
+    return _fileCache.valid() ? _fileCache->readProgramBinary(createFileName(key)) : 0;
+}
+
+bool ProgramBinaryFileCache::writeProgramBinary(const std::string& key, const osg::Program::ProgramBinary& programBinary)
+{
+    if (!_fileCache.valid()) return false;
+
+    // serialize writes as the same program may be linked on several graphics contexts at once.
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_writeMutex);
+    return _fileCache->writeProgramBinary(programBinary, createFileName(key));
+}
@@ -23,8 +23,25 @@ using namespace osgDB;
 
 static std::string s_lastSchema;
 
+template<typename T>
+static T* findByID( const std::vector< osg::ref_ptr<T> >& map, unsigned int id )
+{
+    return id<map.size() ? map[id].get() : NULL;
+}
+
+template<typename T>
+static bool insertByID( std::vector< osg::ref_ptr<T> >& map, unsigned int id, T* value )
+{
+    // IDs are allocated contiguously by OutputStream, so one far beyond those already read indicates a corrupt stream
+    if ( id>=map.size()+65536 ) return false;
+
+    if ( id>=map.size() ) map.resize( id+1 );
+    map[id] = value;
+    return true;
+}
+
 InputStream::InputStream( const osgDB::Options* options )
-    :   _fileVersion(0), _useSchemaData(false), _forceReadingImage(false), _dataDecompress(0)
+    :   _fileVersion(0), _useSchemaData(false), _useClassTable(false), _forceReadingImage(false), _dataDecompress(0)
 {
     BEGIN_BRACKET.set( "{", +INDENT_VALUE );
     END_BRACKET.set( "}", -INDENT_VALUE );
@@ -230,11 +247,8 @@ osg::Array* InputStream::readArray()
     unsigned int id = 0;
     *this >> PROPERTY("ArrayID") >> id;
 
-    ArrayMap::iterator itr = _arrayMap.find( id );
-    if ( itr!=_arrayMap.end() )
-    {
-        return itr->second.get();
-    }
+    osg::Array* existingArray = findByID( _arrayMap, id );
+    if ( existingArray ) return existingArray;
 
     DEF_MAPPEE(ArrayType, type);
     *this >> type;
@@ -392,7 +406,11 @@ osg::Array* InputStream::readArray()
     }
 
     if ( getException() ) return NULL;
-    _arrayMap[id] = array;
+    if ( !insertByID(_arrayMap, id, array.get()) )
+    {
+        throwException( "InputStream::readArray(): Invalid array ID." );
+        return NULL;
+    }
 
     return array.release();
 }
@@ -488,11 +506,8 @@ osg::Image* InputStream::readImage(bool readFromExternal)
     *this >> PROPERTY("UniqueID") >> id;
     if ( getException() ) return NULL;
 
-    IdentifierMap::iterator itr = _identifierMap.find( id );
-    if ( itr!=_identifierMap.end() )
-    {
-        return static_cast<osg::Image*>( itr->second.get() );
-    }
+    osg::Object* existingImage = findByID( _identifierMap, id );
+    if ( existingImage ) return static_cast<osg::Image*>( existingImage );
 
     std::string name;
     int writeHint, decision = IMAGE_EXTERNAL;
@@ -609,19 +624,29 @@ osg::Image* InputStream::readImage(bool readFromExternal)
 
 osg::Object* InputStream::readObject( osg::Object* existingObj )
 {
-    std::string className;
+    const ClassEntry* entry = NULL;
+    if ( _useClassTable )
+    {
+        entry = readClassEntry();
+    }
+    else
+    {
+        std::string className; *this >> className;
+        if ( !getException() ) entry = &getClassEntry( className );
+    }
+
     unsigned int id = 0;
-    *this >> className >> BEGIN_BRACKET >> PROPERTY("UniqueID") >> id;
-    if ( getException() ) return NULL;
+    *this >> BEGIN_BRACKET >> PROPERTY("UniqueID") >> id;
+    if ( getException() || !entry ) return NULL;
 
-    IdentifierMap::iterator itr = _identifierMap.find( id );
-    if ( itr!=_identifierMap.end() )
+    osg::Object* existingObject = findByID( _identifierMap, id );
+    if ( existingObject )
     {
         advanceToCurrentEndBracket();
-        return itr->second.get();
+        return existingObject;
     }
 
-    osg::ref_ptr<osg::Object> obj = readObjectFields( className, id, existingObj );
+    osg::ref_ptr<osg::Object> obj = readObjectFields( *entry, id, existingObj );
 
     advanceToCurrentEndBracket();
 
@@ -630,29 +655,31 @@ osg::Object* InputStream::readObject( osg::Object* existingObj )
 
 osg::Object* InputStream::readObjectFields( const std::string& className, unsigned int id, osg::Object* existingObj )
 {
-    ObjectWrapper* wrapper = Registry::instance()->getObjectWrapperManager()->findWrapper( className );
-    if ( !wrapper )
+    return readObjectFields( getClassEntry(className), id, existingObj );
+}
+
+osg::Object* InputStream::readObjectFields( const ClassEntry& entry, unsigned int id, osg::Object* existingObj )
+{
+    if ( !entry.wrapper )
     {
         OSG_WARN << "InputStream::readObject(): Unsupported wrapper class "
-                               << className << std::endl;
+                               << entry.name << std::endl;
+        return NULL;
+    }
+    _fields.push_back( entry.name );
+
+    osg::ref_ptr<osg::Object> obj = existingObj ? existingObj : entry.wrapper->getProto()->cloneType();
+    if ( !insertByID(_identifierMap, id, obj.get()) )
+    {
+        throwException( "InputStream::readObject(): Invalid object ID." );
         return NULL;
     }
-    _fields.push_back( className );
 
-    osg::ref_ptr<osg::Object> obj = existingObj ? existingObj : wrapper->getProto()->cloneType();
-    _identifierMap[id] = obj;
     if ( obj.valid() )
     {
-        const StringList& associates = wrapper->getAssociates();
-        for ( StringList::const_iterator itr=associates.begin(); itr!=associates.end(); ++itr )
+        for ( std::vector<ObjectWrapper*>::const_iterator itr=entry.associates.begin(); itr!=entry.associates.end(); ++itr )
         {
-            ObjectWrapper* assocWrapper = Registry::instance()->getObjectWrapperManager()->findWrapper(*itr);
-            if ( !assocWrapper )
-            {
-                OSG_WARN << "InputStream::readObject(): Unsupported associated class "
-                                       << *itr << std::endl;
-                continue;
-            }
+            ObjectWrapper* assocWrapper = *itr;
             _fields.push_back( assocWrapper->getName() );
 
             assocWrapper->read( *this, *obj );
@@ -665,6 +692,56 @@ osg::Object* InputStream::readObjectFields( const std::string& className, unsign
     return obj.release();
 }
 
+const InputStream::ClassEntry& InputStream::getClassEntry( const std::string& className )
+{
+    ClassEntryMap::iterator itr = _classEntryMap.find( className );
+    if ( itr!=_classEntryMap.end() ) return itr->second;
+
+    // resolve the wrapper and its associates once per stream rather than once per object
+    ClassEntry& entry = _classEntryMap[className];
+    entry.name = className;
+
+    ObjectWrapperManager* manager = Registry::instance()->getObjectWrapperManager();
+    entry.wrapper = manager->findWrapper( className );
+    if ( entry.wrapper )
+    {
+        const StringList& associates = entry.wrapper->getAssociates();
+        for ( StringList::const_iterator aitr=associates.begin(); aitr!=associates.end(); ++aitr )
+        {
+            ObjectWrapper* assocWrapper = manager->findWrapper( *aitr );
+            if ( !assocWrapper )
+            {
+                OSG_WARN << "InputStream::readObject(): Unsupported associated class "
+                                       << *aitr << std::endl;
+                continue;
+            }
+            entry.associates.push_back( assocWrapper );
+        }
+    }
+    return entry;
+}
+
+const InputStream::ClassEntry* InputStream::readClassEntry()
+{
+    // classes are numbered in the order they first appear in the stream, with the name following the number on its first appearance
+    unsigned int classID = 0; *this >> classID;
+    if ( getException() ) return NULL;
+
+    if ( classID==_classTable.size() )
+    {
+        std::string className; *this >> className;
+        if ( getException() ) return NULL;
+
+        _classTable.push_back( &getClassEntry(className) );
+    }
+    else if ( classID>_classTable.size() )
+    {
+        throwException( "InputStream::readObject(): Invalid class ID." );
+        return NULL;
+    }
+    return _classTable[classID];
+}
+
 void InputStream::readSchema( std::istream& fin )
 {
     // Read from external ascii stream
@@ -705,6 +782,7 @@ InputStream::ReadType InputStream::start( InputIterator* inIterator )
 
         unsigned int attributes; *this >> attributes;
         if ( attributes&0x2 ) _useSchemaData = true;
+        if ( attributes&0x4 ) _useClassTable = true;
     }
     if ( !isBinary() )
     {
@@ -732,7 +810,6 @@ void InputStream::decompress()
     std::string compressorName; *this >> compressorName;
     if ( compressorName!="0" )
     {
-        std::string data;
         _fields.push_back( "Decompression" );
 
         BaseCompressor* compressor = Registry::instance()->getObjectWrapperManager()->findCompressor(compressorName);
@@ -740,13 +817,22 @@ void InputStream::decompress()
         {
             OSG_WARN << "InputStream::decompress(): No such compressor "
                                    << compressorName << std::endl;
+            throwException( "InputStream: Failed to decompress stream." );
+            return;
         }
 
-        if ( !compressor->decompress(*(_in->getStream()), data) )
-            throwException( "InputStream: Failed to decompress stream." );
-        if ( getException() ) return;
+        // parse the data as it is decompressed if the compressor supports it, otherwise decompress it all up front
+        _dataDecompress = compressor->createDecompressionStream( *(_in->getStream()) );
+        if ( !_dataDecompress )
+        {
+            std::string data;
+            if ( !compressor->decompress(*(_in->getStream()), data) )
+                throwException( "InputStream: Failed to decompress stream." );
+            if ( getException() ) return;
+
+            _dataDecompress = new std::stringstream(data);
+        }
 
-        _dataDecompress = new std::stringstream(data);
         _in->setStream( _dataDecompress );
         _fields.pop_back();
     }
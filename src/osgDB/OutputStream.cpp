@@ -13,6 +13,7 @@
 // Written by Wang Rui, (C) 2010
 
 #include <osg/Version>
+#include <osg/Geometry>
 #include <osg/Notify>
 #include <osgDB/FileUtils>
 #include <osgDB/WriteFile>
@@ -23,7 +24,7 @@
 using namespace osgDB;
 
 OutputStream::OutputStream( const osgDB::Options* options )
-:   _writeImageHint(WRITE_USE_IMAGE_HINT), _useSchemaData(false)
+:   _writeImageHint(WRITE_USE_IMAGE_HINT), _quantizeVertexData(false), _useSchemaData(false), _useClassTable(false)
 {
     BEGIN_BRACKET.set( "{", +INDENT_VALUE );
     END_BRACKET.set( "}", -INDENT_VALUE );
@@ -33,6 +34,8 @@ OutputStream::OutputStream( const osgDB::Options* options )
 
     if ( options->getPluginStringData("SchemaData")=="true" )
         _useSchemaData = true;
+    if ( options->getPluginStringData("ClassTable")=="true" )
+        _useClassTable = true;
     if ( !options->getPluginStringData("SchemaFile").empty() )
         _schemaName = options->getPluginStringData("SchemaFile");
     if ( !options->getPluginStringData("Compressor").empty() )
@@ -45,12 +48,36 @@ OutputStream::OutputStream( const osgDB::Options* options )
         else if ( hintString=="UseExternal" ) _writeImageHint = WRITE_USE_EXTERNAL;
         else if ( hintString=="WriteOut" ) _writeImageHint = WRITE_EXTERNAL_FILE;
     }
+    if ( options->getPluginStringData("QuantizeVertexData")=="true" )
+        _quantizeVertexData = true;
 }
 
 OutputStream::~OutputStream()
 {
 }
 
+osg::Array* OutputStream::getQuantizedNormalArray( const osg::Array* array )
+{
+    QuantizedArray& quantized = _quantizedArrayMap[QuantizedArrayKey(array, 0)];
+    if ( !quantized.computed )
+    {
+        quantized.computed = true;
+        quantized.array = osg::quantizeNormalArray( array );
+    }
+    return quantized.array.get();
+}
+
+osg::Array* OutputStream::getQuantizedColorArray( const osg::Array* array )
+{
+    QuantizedArray& quantized = _quantizedArrayMap[QuantizedArrayKey(array, 1)];
+    if ( !quantized.computed )
+    {
+        quantized.computed = true;
+        quantized.array = osg::quantizeColorArray( array );
+    }
+    return quantized.array.get();
+}
+
 OutputStream& OutputStream::operator<<( const osg::Vec2b& v )
 { *this << v.x() << v.y(); return *this; }
 
@@ -459,7 +486,18 @@ void OutputStream::writeObject( const osg::Object* obj )
     bool newID = false;
     unsigned int id = findOrCreateObjectID( obj, newID );
 
-    *this << name << BEGIN_BRACKET << std::endl;       // Write object name
+    if ( _useClassTable )
+    {
+        bool newClass = false;
+        unsigned int classID = findOrCreateClassID( name, newClass );
+        *this << classID;                               // Write class number
+        if ( newClass ) *this << name;                  // Write class name on its first appearance
+    }
+    else
+    {
+        *this << name;                                  // Write object name
+    }
+    *this << BEGIN_BRACKET << std::endl;
     *this << PROPERTY("UniqueID") << id << std::endl;  // Write object ID
     if ( getException() ) return;
 
@@ -549,6 +587,12 @@ void OutputStream::start( OutputIterator* outIterator, OutputStream::WriteType t
             attributes |= 0x2;  // Record if we use inbuilt schema data or not
             useCompressSource = true;
         }
+
+        if ( _useClassTable )
+        {
+            attributes |= 0x4;  // Refer to classes by number, writing the class names only once
+        }
+
         *this << attributes;
 
         if ( !_compressorName.empty() )
@@ -577,6 +621,9 @@ void OutputStream::start( OutputIterator* outIterator, OutputStream::WriteType t
     }
     else
     {
+        // class names are always written in full to ascii and XML files
+        _useClassTable = false;
+
         std::string typeString("Unknown");
         switch ( type )
         {
@@ -723,3 +770,17 @@ unsigned int OutputStream::findOrCreateObjectID( const osg::Object* obj, bool& n
     newID = false;
     return itr->second;
 }
+
+unsigned int OutputStream::findOrCreateClassID( const std::string& className, bool& newID )
+{
+    ClassMap::iterator itr = _classMap.find( className );
+    if ( itr==_classMap.end() )
+    {
+        unsigned int id = _classMap.size();
+        _classMap[className] = id;
+        newID = true;
+        return id;
+    }
+    newID = false;
+    return itr->second;
+}
@@ -31,6 +31,8 @@
 #include <osgDB/fstream>
 #include <osgDB/Archive>
 
+#include <osgUtil/Optimizer>
+
 #include <algorithm>
 #include <set>
 #include <memory>
@@ -62,6 +64,8 @@ static osg::ApplicationUsageProxy Registry_e1(osg::ApplicationUsage::ENVIRONMENT
 #endif
 
 static osg::ApplicationUsageProxy Registry_e2(osg::ApplicationUsage::ENVIRONMENTAL_VARIABLE,"OSG_BUILD_KDTREES on/off","Enable/disable the automatic building of KdTrees for each loaded Geometry.");
+static osg::ApplicationUsageProxy Registry_e3(osg::ApplicationUsage::ENVIRONMENTAL_VARIABLE,"OSG_PROGRAM_BINARY_CACHE on/off","Enable/disable the caching of shader program binaries in the OSG_FILE_CACHE directory.");
+static osg::ApplicationUsageProxy Registry_e4(osg::ApplicationUsage::ENVIRONMENTAL_VARIABLE,"OSG_SPATIALIZE on/off","Enable/disable the automatic spatializing of each loaded model into a bounding volume hierarchy.");
 
 
 // from MimeTypes.cpp
@@ -232,6 +236,16 @@ Registry::Registry()
         else _buildKdTreesHint = Options::BUILD_KDTREES;
     }
 
+    _spatializeHint = Options::SPATIALIZE_NO_PREFERENCE;
+
+    const char* spatialize_str = getenv("OSG_SPATIALIZE");
+    if (spatialize_str)
+    {
+        bool switchOff = (strcmp(spatialize_str, "off")==0 || strcmp(spatialize_str, "OFF")==0 || strcmp(spatialize_str, "Off")==0 );
+        if (switchOff) _spatializeHint = Options::DO_NOT_SPATIALIZE;
+        else _spatializeHint = Options::SPATIALIZE_HIERARCHY;
+    }
+
     const char* ptr=0;
 
     _expiryDelay = 10.0;
@@ -245,6 +259,13 @@ Registry::Registry()
     if (fileCachePath)
     {
         _fileCache = new FileCache(fileCachePath);
+
+        const char* ptr = getenv("OSG_PROGRAM_BINARY_CACHE");
+        if (ptr && (strcmp(ptr,"ON")==0 || strcmp(ptr,"on")==0))
+        {
+            OSG_INFO<<"Registry : Program binaries cached in "<<fileCachePath<<std::endl;
+            osg::Program::setProgramBinaryCache(new ProgramBinaryFileCache(_fileCache.get()));
+        }
     }
 
     _createNodeFromImage = false;
@@ -463,7 +484,11 @@ void Registry::destruct()
     _sharedStateManager = 0;
 
 
-    // clean up the FileCache
+    // clean up the FileCache, along with any ProgramBinaryFileCache as it can't outlive the osgDB library.
+    if (dynamic_cast<ProgramBinaryFileCache*>(osg::Program::getProgramBinaryCache()))
+    {
+        osg::Program::setProgramBinaryCache(0);
+    }
     _fileCache = 0;
 
 
@@ -1309,6 +1334,9 @@ ReaderWriter::ReadResult Registry::readImplementation(const ReadFunctor& readFun
         ReaderWriter::ReadResult rr = read(readFunctor);
         if (rr.validObject())
         {
+            // spatialize before the model is shared through the cache, as later reads return it as it is.
+            _spatializeIfRequired(rr, readFunctor._options);
+
             // update cache with new entry.
             OSG_NOTIFY(INFO)<<"Adding to object cache "<<file<<std::endl;
             addEntryToObjectCache(file,rr.getObject());
@@ -1324,6 +1352,7 @@ ReaderWriter::ReadResult Registry::readImplementation(const ReadFunctor& readFun
     else
     {
         ReaderWriter::ReadResult rr = read(readFunctor);
+        _spatializeIfRequired(rr, readFunctor._options);
         return rr;
     }
 }
@@ -1522,6 +1551,29 @@ ReaderWriter::ReadResult Registry::readNodeImplementation(const std::string& fil
 #endif
 }
 
+void Registry::_spatializeIfRequired(ReaderWriter::ReadResult& result, const Options* options)
+{
+    bool doSpatialize = (options && options->getSpatializeHint()!=Options::SPATIALIZE_NO_PREFERENCE) ?
+        options->getSpatializeHint() == Options::SPATIALIZE_HIERARCHY :
+        _spatializeHint == Options::SPATIALIZE_HIERARCHY;
+
+    if (!doSpatialize || !result.validNode()) return;
+
+    // a cached model is spatialized before it's added to the cache, and may already be in the scene graph.
+    if (result.loadedFromCache()) return;
+
+    // place the model under a temporary Group so that a loaded Geode can be replaced by the Group it's divided into.
+    osg::ref_ptr<osg::Group> root = new osg::Group;
+    root->addChild(result.getNode());
+
+    osgUtil::Optimizer::SpatializeHierarchyVisitor shv;
+    root->accept(shv);
+    if (shv.spatialize() && root->getChild(0)!=result.getNode())
+    {
+        result = ReaderWriter::ReadResult(root->getChild(0), result.status());
+    }
+}
+
 ReaderWriter::WriteResult Registry::writeNodeImplementation(const Node& node,const std::string& fileName,const Options* options)
 {
     // record the errors reported by readerwriters.
@@ -145,6 +145,10 @@ void TerrainTile::read(DataInputStream* in)
 
     if (osgTerrain::TerrainTile::getTileLoadedCallback().valid())
         osgTerrain::TerrainTile::getTileLoadedCallback()->loaded(this, in->getOptions());
+
+    osgTerrain::Terrain* terrain = getTerrain();
+    if (terrain && terrain->getInitTilesOnLoad() && !terrain->getEqualizeBoundaries())
+        init(osgTerrain::TerrainTile::ALL_DIRTY, false);
 }
 
 void TerrainTile::writeTerrainTechnique(DataOutputStream* out, osgTerrain::TerrainTechnique* technique)
@@ -128,13 +128,17 @@ public:
         supportsOption( "XML", "Import/Export option: Force reading/writing XML file" );
         supportsOption( "ForceReadingImage", "Import option: Load an empty image instead if required file missed" );
         supportsOption( "SchemaData", "Export option: Record inbuilt schema data into a binary file" );
+        supportsOption( "ClassTable", "Export option: Refer to classes by number in a binary file, writing each class name only once, "
+                        "files written with it can't be read by versions of the plugin that predate it" );
         supportsOption( "SchemaFile=<file>", "Import/Export option: Use/Record an ascii schema file" );
-        supportsOption( "Compressor=<name>", "Export option: Use an inbuilt or user-defined compressor" );
+        supportsOption( "Compressor=<name>", "Export option: Use an inbuilt or user-defined compressor, such as zlib, or lz and zlib_blocks that compress blocks in parallel" );
         supportsOption( "WriteImageHint=<hint>", "Export option: Hint of writing image to stream: "
                         "<IncludeData> writes Image::data() directly; "
                         "<IncludeFile> writes the image file itself to stream; "
                         "<UseExternal> writes only the filename; "
                         "<WriteOut> writes Image::data() to disk as external file." );
+        supportsOption( "QuantizeVertexData", "Export option: Write Geometry normals as signed normalized bytes and colors as unsigned normalized bytes, "
+                        "vertices quantized in memory are always written with their decode matrix" );
     }
 
     virtual const char* className() const { return "OpenSceneGraph Native Format Reader/Writer"; }
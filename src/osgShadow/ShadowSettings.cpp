@@ -25,6 +25,8 @@ ShadowSettings::ShadowSettings():
     _perspectiveShadowMapCutOffAngle(2.0),
     _numShadowMapsPerLight(1),
     _multipleShadowMapHint(PARALLEL_SPLIT),
+    _numShadowCastingCullThreads(0),
+    _reuseShadowCastersAcrossSplits(false),
    _shaderHint(NO_SHADERS),
 //    _shaderHint(PROVIDE_FRAGMENT_SHADER),
     _debugDraw(false)
@@ -42,6 +44,8 @@ ShadowSettings::ShadowSettings(const ShadowSettings& ss, const osg::CopyOp& copy
     _perspectiveShadowMapCutOffAngle(ss._perspectiveShadowMapCutOffAngle),
     _numShadowMapsPerLight(ss._numShadowMapsPerLight),
     _multipleShadowMapHint(ss._multipleShadowMapHint),
+    _numShadowCastingCullThreads(ss._numShadowCastingCullThreads),
+    _reuseShadowCastersAcrossSplits(ss._reuseShadowCastersAcrossSplits),
     _shaderHint(ss._shaderHint),
     _debugDraw(ss._debugDraw)
 {
@@ -151,50 +151,142 @@ class VDSMCameraCullCallback : public osg::NodeCallback
 
         osg::RefMatrix* getProjectionMatrix() { return _projectionMatrix.get(); }
         osgUtil::RenderStage* getRenderStage() { return _renderStage.get(); }
+        osgUtil::StateGraph* getStateGraph() { return _stateGraph; }
+
+        /** Take the shadow casters from the RenderStage of another shadow camera of the same light,
+          * rather than traversing the shadowed scene again.*/
+        void setShadowCasters(VDSMCameraCullCallback* callback) { _shadowCasters = callback; }
 
     protected:
 
+        void addShadowCasters(osgUtil::CullVisitor* cv, osgUtil::RenderBin* renderBin);
+
         ViewDependentShadowMap*                 _vdsm;
         osg::ref_ptr<osg::RefMatrix>            _projectionMatrix;
         osg::ref_ptr<osgUtil::RenderStage>      _renderStage;
+        osgUtil::StateGraph*                    _stateGraph;
         osg::Polytope                           _polytope;
+        osg::ref_ptr<VDSMCameraCullCallback>    _shadowCasters;
 };
 
 VDSMCameraCullCallback::VDSMCameraCullCallback(ViewDependentShadowMap* vdsm, osg::Polytope& polytope):
     _vdsm(vdsm),
+    _stateGraph(0),
     _polytope(polytope)
 {
 }
 
+void VDSMCameraCullCallback::addShadowCasters(osgUtil::CullVisitor* cv, osgUtil::RenderBin* renderBin)
+{
+    osgUtil::RenderBin::RenderBinList& rbl = renderBin->getRenderBinList();
+    for(osgUtil::RenderBin::RenderBinList::iterator itr = rbl.begin();
+        itr != rbl.end();
+        ++itr)
+    {
+        addShadowCasters(cv, itr->second.get());
+    }
+
+    osgUtil::StateGraph* baseStateGraph = _shadowCasters->getStateGraph();
+
+    typedef std::vector<const osg::StateSet*> StateSetList;
+    StateSetList statesets;
+
+    osgUtil::RenderBin::StateGraphList& sgl = renderBin->getStateGraphList();
+    for(osgUtil::RenderBin::StateGraphList::iterator itr = sgl.begin();
+        itr != sgl.end();
+        ++itr)
+    {
+        osgUtil::StateGraph* sg = *itr;
+
+        // collect the StateSets applied between the top of the shadow casting subgraph and the leaves.
+        statesets.clear();
+        for(osgUtil::StateGraph* parent = sg; parent && parent!=baseStateGraph; parent = parent->_parent)
+        {
+            if (parent->getStateSet()) statesets.push_back(parent->getStateSet());
+        }
+
+        for(StateSetList::reverse_iterator sitr = statesets.rbegin();
+            sitr != statesets.rend();
+            ++sitr)
+        {
+            cv->pushStateSet(*sitr);
+        }
+
+        for(osgUtil::StateGraph::LeafList::iterator litr = sg->_leaves.begin();
+            litr != sg->_leaves.end();
+            ++litr)
+        {
+            osgUtil::RenderLeaf* leaf = litr->get();
+            osg::Drawable* drawable = const_cast<osg::Drawable*>(leaf->getDrawable());
+
+            const osg::BoundingBox& bb = drawable->getBound();
+            if (!bb.valid()) continue;
+
+            // the polytope is in the eye coords of the shadow camera, so test the drawable in eye coords
+            const osg::Matrix& matrix = *(leaf->_modelview);
+            osg::BoundingBox eye_bb;
+            for(unsigned int i=0; i<8; ++i)
+            {
+                eye_bb.expandBy(bb.corner(i) * matrix);
+            }
+
+            if (!_polytope.contains(eye_bb)) continue;
+
+            if (cv->getComputeNearFarMode() != osg::CullSettings::DO_NOT_COMPUTE_NEAR_FAR)
+            {
+                cv->updateCalculatedNearFar(matrix, *drawable, false);
+            }
+
+            cv->addDrawableAndDepth(drawable, leaf->_modelview.get(), leaf->_depth);
+        }
+
+        for(unsigned int i=0; i<statesets.size(); ++i)
+        {
+            cv->popStateSet();
+        }
+    }
+}
+
 void VDSMCameraCullCallback::operator()(osg::Node* node, osg::NodeVisitor* nv)
 {
     osgUtil::CullVisitor* cv = dynamic_cast<osgUtil::CullVisitor*>(nv);
     osg::Camera* camera = dynamic_cast<osg::Camera*>(node);
     OSG_INFO<<"VDSMCameraCullCallback::operator()(osg::Node* "<<camera<<", osg::NodeVisitor* "<<cv<<")"<<std::endl;
 
-#if 1
-    if (!_polytope.empty())
+    _stateGraph = cv->getCurrentStateGraph();
+
+    if (_shadowCasters.valid() && _shadowCasters->getRenderStage())
+    {
+        OSG_INFO<<"Reusing shadow casters of "<<_shadowCasters->getRenderStage()<<std::endl;
+
+        addShadowCasters(cv, _shadowCasters->getRenderStage());
+    }
+    else
     {
-        OSG_INFO<<"Pushing custom Polytope"<<std::endl;
+#if 1
+        if (!_polytope.empty())
+        {
+            OSG_INFO<<"Pushing custom Polytope"<<std::endl;
 
-        osg::CullingSet& cs = cv->getProjectionCullingStack().back();
+            osg::CullingSet& cs = cv->getProjectionCullingStack().back();
 
-        cs.setFrustum(_polytope);
+            cs.setFrustum(_polytope);
 
-        cv->pushCullingSet();
-    }
+            cv->pushCullingSet();
+        }
 #endif
-    if (_vdsm->getShadowedScene())
-    {
-        _vdsm->getShadowedScene()->osg::Group::traverse(*nv);
-    }
+        if (_vdsm->getShadowedScene())
+        {
+            _vdsm->getShadowedScene()->osg::Group::traverse(*nv);
+        }
 #if 1
-    if (!_polytope.empty())
-    {
-        OSG_INFO<<"Popping custom Polytope"<<std::endl;
-        cv->popCullingSet();
-    }
+        if (!_polytope.empty())
+        {
+            OSG_INFO<<"Popping custom Polytope"<<std::endl;
+            cv->popCullingSet();
+        }
 #endif
+    }
 
     _renderStage = cv->getCurrentRenderBin()->getStage();
 
@@ -248,6 +340,71 @@ void VDSMCameraCullCallback::operator()(osg::Node* node, osg::NodeVisitor* nv)
 }
 
 
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// ShadowCastingCull
+//
+struct ShadowCastingCull
+{
+    ShadowCastingCull():
+        lightData(0),
+        textureUnit(0) {}
+
+    osg::ref_ptr<ViewDependentShadowMap::ShadowData>    shadowData;
+    osg::ref_ptr<VDSMCameraCullCallback>                callback;
+    ViewDependentShadowMap::LightData*                  lightData;
+    unsigned int                                        textureUnit;
+};
+
+typedef std::vector<ShadowCastingCull> ShadowCastingCulls;
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+// ShadowCastingCullOperation culls the shadow casting scene of one or more shadow maps,
+// each on the CullVisitor of its ShadowData.
+//
+class ShadowCastingCullOperation : public osg::Operation
+{
+    public:
+
+        ShadowCastingCullOperation(const ViewDependentShadowMap* vdsm, ViewDependentShadowMap::LightData* lightData):
+            osg::Operation("ShadowCastingCull", false),
+            _vdsm(vdsm),
+            _lightData(lightData) {}
+
+        ViewDependentShadowMap::LightData* getLightData() { return _lightData; }
+
+        void addShadowData(ViewDependentShadowMap::ShadowData* sd) { _shadowDataList.push_back(sd); }
+
+        void setBlock(osg::RefBlockCount* block) { _block = block; }
+
+        virtual void operator () (osg::Object*)
+        {
+            for(ShadowDataList::iterator itr = _shadowDataList.begin();
+                itr != _shadowDataList.end();
+                ++itr)
+            {
+                _vdsm->cullShadowCastingScene((*itr)->_cullVisitor.get(), (*itr)->_camera.get());
+            }
+
+            if (_block.valid()) _block->completed();
+        }
+
+        virtual void release()
+        {
+            if (_block.valid()) _block->release();
+        }
+
+    protected:
+
+        typedef std::vector< osg::ref_ptr<ViewDependentShadowMap::ShadowData> > ShadowDataList;
+
+        const ViewDependentShadowMap*           _vdsm;
+        ViewDependentShadowMap::LightData*      _lightData;
+        ShadowDataList                          _shadowDataList;
+        osg::ref_ptr<osg::RefBlockCount>        _block;
+};
+
 class ComputeLightSpaceBounds : public osg::NodeVisitor, public osg::CullStack
 {
 public:
@@ -685,6 +842,12 @@ ViewDependentShadowMap::ViewDependentShadowMap(const ViewDependentShadowMap& vds
 
 ViewDependentShadowMap::~ViewDependentShadowMap()
 {
+    for(CullThreads::iterator itr = _cullThreads.begin();
+        itr != _cullThreads.end();
+        ++itr)
+    {
+        (*itr)->cancel();
+    }
 }
 
 
@@ -824,6 +987,10 @@ void ViewDependentShadowMap::cull(osgUtil::CullVisitor& cv)
         numShadowMapsPerLight = 2;
     }
 
+    bool reuseShadowCasters = numShadowMapsPerLight>1 && settings->getReuseShadowCastersAcrossSplits();
+
+    ShadowCastingCulls shadowCastingCulls;
+
     LightDataList& pll = vdd->getLightDataList();
     for(LightDataList::iterator itr = pll.begin();
         itr != pll.end();
@@ -834,6 +1001,8 @@ void ViewDependentShadowMap::cull(osgUtil::CullVisitor& cv)
 
         LightData& pl = **itr;
 
+        osg::ref_ptr<VDSMCameraCullCallback> lightShadowCasters;
+
         // 3.1 compute light space polytope
         //
         osg::Polytope polytope = computeLightViewFrustumPolytope(frustum, pl);
@@ -974,6 +1143,11 @@ void ViewDependentShadowMap::cull(osgUtil::CullVisitor& cv)
             osg::Polytope local_polytope(polytope);
             local_polytope.transformProvidingInverse(invertModelView);
 
+            // the first shadow map of a light collects the casters for the whole light space polytope when they are reused by the other shadow maps
+            bool collectShadowCasters = reuseShadowCasters && sm_i==0;
+            osg::Polytope light_polytope;
+            if (collectShadowCasters) light_polytope = local_polytope;
+
 
             if (numShadowMapsPerLight>1)
             {
@@ -1040,52 +1214,161 @@ void ViewDependentShadowMap::cull(osgUtil::CullVisitor& cv)
             }
 
 
-            osg::ref_ptr<VDSMCameraCullCallback> vdsmCallback = new VDSMCameraCullCallback(this, local_polytope);
+            osg::ref_ptr<VDSMCameraCullCallback> vdsmCallback = new VDSMCameraCullCallback(this, collectShadowCasters ? light_polytope : local_polytope);
             camera->setCullCallback(vdsmCallback.get());
 
-            // 4.3 traverse RTT camera
-            //
+            if (collectShadowCasters) lightShadowCasters = vdsmCallback;
+            else if (reuseShadowCasters) vdsmCallback->setShadowCasters(lightShadowCasters.get());
+
+            ShadowCastingCull scc;
+            scc.shadowData = sd;
+            scc.callback = vdsmCallback;
+            scc.lightData = &pl;
+            scc.textureUnit = textureUnit;
+            shadowCastingCulls.push_back(scc);
+
+            // increment counters.
+            ++textureUnit;
+        }
+    }
 
+    // 4.3 traverse RTT cameras
+    //
+    unsigned int numCullThreads = shadowCastingCulls.size()>1 ? settings->getNumShadowCastingCullThreads() : 0;
+    if (numCullThreads==0 && !reuseShadowCasters)
+    {
+        for(ShadowCastingCulls::iterator itr = shadowCastingCulls.begin();
+            itr != shadowCastingCulls.end();
+            ++itr)
+        {
             cv.pushStateSet(_shadowCastingStateSet.get());
 
-            cullShadowCastingScene(&cv, camera.get());
+            cullShadowCastingScene(&cv, itr->shadowData->_camera.get());
 
             cv.popStateSet();
+        }
+    }
+    else
+    {
+        // each shadow map is culled by a CullVisitor of its own so that it gets a StateGraph and RenderStage of its own,
+        // which allows the shadow maps to be culled concurrently, and the reused shadow casters to be kept apart.
+        if (numCullThreads>0)
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_cullThreadsMutex);
 
-            if (!orthographicViewFrustum && settings->getShadowMapProjectionHint()==ShadowSettings::PERSPECTIVE_SHADOW_MAP)
+            if (!_cullOperationQueue) _cullOperationQueue = new osg::OperationQueue;
+
+            while(_cullThreads.size()<numCullThreads)
             {
-                adjustPerspectiveShadowMapCameraSettings(vdsmCallback->getRenderStage(), frustum, pl, camera.get());
-                if (vdsmCallback->getProjectionMatrix())
-                {
-                    vdsmCallback->getProjectionMatrix()->set(camera->getProjectionMatrix());
-                }
+                osg::ref_ptr<osg::OperationThread> thread = new osg::OperationThread;
+                thread->setOperationQueue(_cullOperationQueue.get());
+                thread->startThread();
+                _cullThreads.push_back(thread);
             }
+        }
 
-            // 4.4 compute main scene graph TexGen + uniform settings + setup state
-            //
-            assignTexGenSettings(&cv, camera.get(), textureUnit, sd->_texgen.get());
+        // set up the CullVisitors up front as they all copy their state from the main CullVisitor.
+        for(ShadowCastingCulls::iterator itr = shadowCastingCulls.begin();
+            itr != shadowCastingCulls.end();
+            ++itr)
+        {
+            prepareShadowCastingCullVisitor(&cv, itr->shadowData.get());
+        }
 
-            // mark the light as one that has active shadows and requires shaders
-            pl.textureUnits.push_back(textureUnit);
+        // shadow maps that reuse shadow casters have to be culled after the shadow map that collects them,
+        // so all the shadow maps of a light are culled by one operation when reusing them.
+        typedef std::vector< osg::ref_ptr<ShadowCastingCullOperation> > ShadowCastingCullOperations;
+        ShadowCastingCullOperations operations;
+        for(ShadowCastingCulls::iterator itr = shadowCastingCulls.begin();
+            itr != shadowCastingCulls.end();
+            ++itr)
+        {
+            if (operations.empty() || !reuseShadowCasters || itr->lightData!=operations.back()->getLightData())
+            {
+                operations.push_back(new ShadowCastingCullOperation(this, itr->lightData));
+            }
+            operations.back()->addShadowData(itr->shadowData.get());
+        }
 
-            // pass on shadow data to ShadowDataList
-            sd->_textureUnit = textureUnit;
+        if (numCullThreads>0 && operations.size()>1)
+        {
+            osg::ref_ptr<osg::RefBlockCount> block = new osg::RefBlockCount(operations.size());
+            for(ShadowCastingCullOperations::iterator itr = operations.begin();
+                itr != operations.end();
+                ++itr)
+            {
+                (*itr)->setBlock(block.get());
+            }
 
-            if (textureUnit >= 8)
+            for(unsigned int i=1; i<operations.size(); ++i)
             {
-                OSG_NOTICE<<"Shadow texture unit is invalid for texgen, will not be used."<<std::endl;
+                _cullOperationQueue->add(operations[i].get());
             }
-            else
+
+            // the cull thread does its share of the work rather than just waiting.
+            (*operations.front())(0);
+
+            block->block();
+        }
+        else
+        {
+            for(ShadowCastingCullOperations::iterator itr = operations.begin();
+                itr != operations.end();
+                ++itr)
             {
-                sdl.push_back(sd);
+                (**itr)(0);
             }
+        }
 
-            // increment counters.
-            ++textureUnit;
-            ++numValidShadows ;
+        for(ShadowCastingCulls::iterator itr = shadowCastingCulls.begin();
+            itr != shadowCastingCulls.end();
+            ++itr)
+        {
+            mergeShadowCastingCullVisitor(&cv, itr->shadowData.get());
         }
     }
 
+    for(ShadowCastingCulls::iterator itr = shadowCastingCulls.begin();
+        itr != shadowCastingCulls.end();
+        ++itr)
+    {
+        ShadowData* sd = itr->shadowData.get();
+        LightData& pl = *(itr->lightData);
+        VDSMCameraCullCallback* vdsmCallback = itr->callback.get();
+        osg::Camera* camera = sd->_camera.get();
+        unsigned int textureUnit = itr->textureUnit;
+
+        if (!orthographicViewFrustum && settings->getShadowMapProjectionHint()==ShadowSettings::PERSPECTIVE_SHADOW_MAP)
+        {
+            adjustPerspectiveShadowMapCameraSettings(vdsmCallback->getRenderStage(), frustum, pl, camera);
+            if (vdsmCallback->getProjectionMatrix())
+            {
+                vdsmCallback->getProjectionMatrix()->set(camera->getProjectionMatrix());
+            }
+        }
+
+        // 4.4 compute main scene graph TexGen + uniform settings + setup state
+        //
+        assignTexGenSettings(&cv, camera, textureUnit, sd->_texgen.get());
+
+        // mark the light as one that has active shadows and requires shaders
+        pl.textureUnits.push_back(textureUnit);
+
+        // pass on shadow data to ShadowDataList
+        sd->_textureUnit = textureUnit;
+
+        if (textureUnit >= 8)
+        {
+            OSG_NOTICE<<"Shadow texture unit is invalid for texgen, will not be used."<<std::endl;
+        }
+        else
+        {
+            sdl.push_back(sd);
+        }
+
+        ++numValidShadows ;
+    }
+
     if (numValidShadows>0)
     {
         decoratorStateGraph->setStateSet(selectStateSetForRenderingShadow(*vdd));
@@ -2334,6 +2617,104 @@ void ViewDependentShadowMap::cullShadowCastingScene(osgUtil::CullVisitor* cv, os
     return;
 }
 
+void ViewDependentShadowMap::prepareShadowCastingCullVisitor(osgUtil::CullVisitor* cv, ShadowData* sd) const
+{
+    OSG_INFO<<"prepareShadowCastingCullVisitor()"<<std::endl;
+
+    if (!sd->_cullVisitor) sd->_cullVisitor = cv->clone();
+    if (!sd->_stateGraph) sd->_stateGraph = new osgUtil::StateGraph;
+    if (!sd->_renderStage) sd->_renderStage = new osgUtil::RenderStage;
+
+    osgUtil::CullVisitor* scv = sd->_cullVisitor.get();
+    osgUtil::RenderStage* stage = cv->getCurrentRenderBin()->getStage();
+
+    scv->reset();
+    scv->setFrameStamp(const_cast<osg::FrameStamp*>(cv->getFrameStamp()));
+    scv->setTraversalNumber(cv->getTraversalNumber());
+    scv->setTraversalMask(cv->getTraversalMask());
+    scv->setCullSettings(*cv);
+    scv->setDatabaseRequestHandler(cv->getDatabaseRequestHandler());
+    scv->setImageRequestHandler(cv->getImageRequestHandler());
+    scv->setRenderInfo(cv->getRenderInfo());
+
+    // detach the main RenderStage's PositionalStateContainer before the reset so that it isn't cleared.
+    sd->_renderStage->setPositionalStateContainer(0);
+
+    sd->_stateGraph->clean();
+    sd->_renderStage->reset();
+
+    scv->setStateGraph(sd->_stateGraph.get());
+    scv->setRenderStage(sd->_renderStage.get());
+
+    // the shadow camera's RenderStage inherits these from its parent RenderStage.
+    osgUtil::RenderStage* parentStage = sd->_renderStage.get();
+    parentStage->setViewport(stage->getViewport());
+    parentStage->setDrawBuffer(stage->getDrawBuffer(), stage->getDrawBufferApplyMask());
+    parentStage->setReadBuffer(stage->getReadBuffer(), stage->getReadBufferApplyMask());
+    parentStage->setClearColor(stage->getClearColor());
+    parentStage->setClearMask(stage->getClearMask());
+    parentStage->setColorMask(stage->getColorMask());
+    parentStage->setPositionalStateContainer(stage->getPositionalStateContainer());
+
+    // replicate the StateSets that the main CullVisitor has accumulated at this point in the scene graph.
+    typedef std::vector<const osg::StateSet*> StateSetList;
+    StateSetList statesets;
+    for(osgUtil::StateGraph* sg = cv->getCurrentStateGraph(); sg; sg = sg->_parent)
+    {
+        if (sg->getStateSet()) statesets.push_back(sg->getStateSet());
+    }
+
+    for(StateSetList::reverse_iterator itr = statesets.rbegin();
+        itr != statesets.rend();
+        ++itr)
+    {
+        scv->pushStateSet(*itr);
+    }
+
+    scv->pushStateSet(_shadowCastingStateSet.get());
+
+    if (cv->getViewport()) scv->pushViewport(cv->getViewport());
+    scv->pushProjectionMatrix(cv->getProjectionMatrix());
+    scv->pushModelViewMatrix(cv->getModelViewMatrix(), osg::Transform::ABSOLUTE_RF);
+}
+
+void ViewDependentShadowMap::mergeShadowCastingCullVisitor(osgUtil::CullVisitor* cv, ShadowData* sd) const
+{
+    OSG_INFO<<"mergeShadowCastingCullVisitor()"<<std::endl;
+
+    if (!sd->_cullVisitor || !sd->_renderStage) return;
+
+    osgUtil::CullVisitor* scv = sd->_cullVisitor.get();
+    scv->popModelViewMatrix();
+    scv->popProjectionMatrix();
+    if (cv->getViewport()) scv->popViewport();
+
+    sd->_stateGraph->prune();
+
+    // move the shadow camera's RenderStage across to the main CullVisitor's RenderStage.
+    osgUtil::RenderStage* stage = cv->getCurrentRenderBin()->getStage();
+
+    osgUtil::RenderStage::RenderStageList& preRenderList = sd->_renderStage->getPreRenderList();
+    for(osgUtil::RenderStage::RenderStageList::iterator itr = preRenderList.begin();
+        itr != preRenderList.end();
+        ++itr)
+    {
+        stage->addPreRenderStage(itr->second.get(), itr->first);
+    }
+    preRenderList.clear();
+
+    osgUtil::RenderStage::RenderStageList& postRenderList = sd->_renderStage->getPostRenderList();
+    for(osgUtil::RenderStage::RenderStageList::iterator itr = postRenderList.begin();
+        itr != postRenderList.end();
+        ++itr)
+    {
+        stage->addPostRenderStage(itr->second.get(), itr->first);
+    }
+    postRenderList.clear();
+
+    sd->_renderStage->setPositionalStateContainer(0);
+}
+
 osg::StateSet* ViewDependentShadowMap::selectStateSetForRenderingShadow(ViewDependentData& vdd) const
 {
     OSG_INFO<<"   selectStateSetForRenderingShadow() "<<vdd.getStateSet()<<std::endl;
@@ -22,6 +22,10 @@
 #include <osg/BlendFunc>
 #include <osg/Material>
 #include <osg/PointSprite>
+#include <osg/Depth>
+#include <osg/Program>
+
+#include <OpenThreads/ScopedLock>
 
 #include <osgUtil/CullVisitor>
 
@@ -43,13 +47,136 @@ osg::StateSet* getSingletonLightPointSystemSet()
     return s_stateset.get();
 }
 
+static const char* s_lightPointVertexShader =
+    "#version 120\n"
+    "uniform vec4 osgSim_EyeLocal;\n"             // eye point in local coordinates, simulation time
+    "uniform vec4 osgSim_PixelSizeVector;\n"
+    "uniform vec4 osgSim_PixelSizeLimits;\n"      // min pixel size, max pixel size, max visible distance squared
+    "uniform vec2 osgSim_LightPointSystem;\n"     // intensity or -1 when using the light point intensity, blink enabled
+    "uniform sampler2D osgSim_BlinkTexture;\n"
+    "varying vec4 lightColor;\n"
+    "varying float lightPixelSize;\n"
+    "\n"
+    "float azimSector(vec3 eyeLocal, vec4 c)\n"
+    "{\n"
+    "    float dotproduct = eyeLocal.x*c.x+eyeLocal.y*c.y;\n"
+    "    float len = sqrt(eyeLocal.x*eyeLocal.x+eyeLocal.y*eyeLocal.y);\n"
+    "    if (dotproduct<c.w*len) return 0.0;\n"
+    "    if (dotproduct>=c.z*len) return 1.0;\n"
+    "    return (dotproduct-c.w*len)/((c.z-c.w)*len);\n"
+    "}\n"
+    "\n"
+    "float elevationSector(vec3 eyeLocal, vec4 c)\n"
+    "{\n"
+    "    float dotproduct = eyeLocal.z;\n"
+    "    float len = length(eyeLocal);\n"
+    "    if (dotproduct>c.w*len) return 0.0;\n"
+    "    if (dotproduct<c.y*len) return 0.0;\n"
+    "    if (dotproduct>c.z*len) return (dotproduct-c.w*len)/((c.z-c.w)*len);\n"
+    "    if (dotproduct<c.x*len) return (dotproduct-c.y*len)/((c.x-c.y)*len);\n"
+    "    return 1.0;\n"
+    "}\n"
+    "\n"
+    "float coneSector(vec3 eyeLocal, vec4 axisAngle, float cosAngleFade)\n"
+    "{\n"
+    "    float dotproduct = dot(eyeLocal,axisAngle.xyz);\n"
+    "    float len = length(eyeLocal);\n"
+    "    if (dotproduct>axisAngle.w*len) return 1.0;\n"
+    "    if (dotproduct<cosAngleFade*len) return 0.0;\n"
+    "    return (dotproduct-cosAngleFade*len)/((axisAngle.w-cosAngleFade)*len);\n"
+    "}\n"
+    "\n"
+    "void cull()\n"
+    "{\n"
+    "    gl_Position = vec4(0.0,0.0,2.0,1.0);\n"
+    "    gl_PointSize = 1.0;\n"
+    "    lightColor = vec4(0.0);\n"
+    "    lightPixelSize = 1.0;\n"
+    "}\n"
+    "\n"
+    "void main()\n"
+    "{\n"
+    "    const float minimumIntensity = 1.0/256.0;\n"
+    "    vec3 dv = osgSim_EyeLocal.xyz-gl_Vertex.xyz;\n"
+    "    vec4 color = gl_Color;\n"
+    "    float intensity = (osgSim_LightPointSystem.x>=0.0) ? osgSim_LightPointSystem.x : gl_MultiTexCoord0.x;\n"
+    "\n"
+    "    float distanceFactor = 1.0;\n"
+    "    float distance2 = dot(dv,dv);\n"
+    "    if (distance2>osgSim_PixelSizeLimits.z) { cull(); return; }\n"
+    "    if (osgSim_PixelSizeLimits.z>0.0) distanceFactor = 1.0-pow(distance2/osgSim_PixelSizeLimits.z,2.0);\n"
+    "\n"
+    "    if (gl_MultiTexCoord1.y>1.5) intensity *= coneSector(dv,gl_MultiTexCoord2,gl_MultiTexCoord3.x);\n"
+    "    else if (gl_MultiTexCoord1.y>0.5) intensity *= min(azimSector(dv,gl_MultiTexCoord2),elevationSector(dv,gl_MultiTexCoord3));\n"
+    "    if (intensity<=minimumIntensity) { cull(); return; }\n"
+    "\n"
+    "    if (osgSim_LightPointSystem.y>0.5 && gl_MultiTexCoord0.w>0.0)\n"
+    "    {\n"
+    "        float phase = fract((osgSim_EyeLocal.w-gl_MultiTexCoord1.x)/gl_MultiTexCoord0.w);\n"
+    "        color *= texture2DLod(osgSim_BlinkTexture,vec2(phase,gl_MultiTexCoord0.z),0.0);\n"
+    "    }\n"
+    "    if (color.a<=minimumIntensity) { cull(); return; }\n"
+    "\n"
+    "    float pixelSize = gl_MultiTexCoord0.y/dot(vec4(gl_Vertex.xyz,1.0),osgSim_PixelSizeVector);\n"
+    "    pixelSize *= sqrt(intensity);\n"
+    "    color.a *= distanceFactor;\n"
+    "\n"
+    "    float orgPixelSize = pixelSize;\n"
+    "    pixelSize = max(pixelSize,osgSim_PixelSizeLimits.x);\n"
+    "    if (pixelSize<1.0)\n"
+    "    {\n"
+    "        color.a *= pixelSize;\n"
+    "        pixelSize = 1.0;\n"
+    "    }\n"
+    "    else if (pixelSize<osgSim_PixelSizeLimits.y)\n"
+    "    {\n"
+    "        if (orgPixelSize<osgSim_PixelSizeLimits.x) color.a *= (2.0/3.0)+(1.0/3.0)*sqrt(orgPixelSize/pixelSize);\n"
+    "    }\n"
+    "    else pixelSize = osgSim_PixelSizeLimits.y;\n"
+    "    if (color.a<=minimumIntensity) { cull(); return; }\n"
+    "\n"
+    "    lightColor = color;\n"
+    "    lightPixelSize = pixelSize;\n"
+    "    gl_PointSize = pixelSize;\n"
+    "    gl_Position = ftransform();\n"
+    "}\n";
+
+static const char* s_lightPointFragmentShader =
+    "#version 120\n"
+    "varying vec4 lightColor;\n"
+    "varying float lightPixelSize;\n"
+    "\n"
+    "void main()\n"
+    "{\n"
+    "    float r = length(gl_PointCoord*2.0-1.0);\n"
+    "    float coverage = clamp((1.0-r)*0.5*lightPixelSize+0.5,0.0,1.0);\n"
+    "    if (coverage<=0.0) discard;\n"
+    "    gl_FragColor = vec4(lightColor.rgb,lightColor.a*coverage);\n"
+    "}\n";
+
+static osg::Program* getSingletonLightPointProgram()
+{
+    static osg::ref_ptr<osg::Program> s_program = 0;
+    if (!s_program)
+    {
+        s_program = new osg::Program;
+        s_program->setName("osgSim::LightPointNode");
+        s_program->addShader(new osg::Shader(osg::Shader::VERTEX, s_lightPointVertexShader));
+        s_program->addShader(new osg::Shader(osg::Shader::FRAGMENT, s_lightPointFragmentShader));
+    }
+    return s_program.get();
+}
+
 
 LightPointNode::LightPointNode():
     _minPixelSize(0.0f),
     _maxPixelSize(30.0f),
     _maxVisibleDistance2(FLT_MAX),
     _lightSystem(0),
-    _pointSprites(false)
+    _pointSprites(false),
+    _useShaders(false),
+    _shaderDataDirty(true),
+    _shaderDataValid(false)
 {
     setStateSet(getSingletonLightPointSystemSet());
 }
@@ -62,7 +189,10 @@ LightPointNode::LightPointNode(const LightPointNode& lpn,const osg::CopyOp& copy
     _maxPixelSize(lpn._maxPixelSize),
     _maxVisibleDistance2(lpn._maxVisibleDistance2),
     _lightSystem(lpn._lightSystem),
-    _pointSprites(lpn._pointSprites)
+    _pointSprites(lpn._pointSprites),
+    _useShaders(lpn._useShaders),
+    _shaderDataDirty(true),
+    _shaderDataValid(false)
 {
 }
 
@@ -70,6 +200,7 @@ unsigned int LightPointNode::addLightPoint(const LightPoint& lp)
 {
     unsigned int num = _lightPointList.size();
     _lightPointList.push_back(lp);
+    dirtyLightPoints();
     dirtyBound();
     return num;
 }
@@ -79,6 +210,7 @@ void LightPointNode::removeLightPoint(unsigned int pos)
     if (pos<_lightPointList.size())
     {
         _lightPointList.erase(_lightPointList.begin()+pos);
+        dirtyLightPoints();
         dirtyBound();
     }
     dirtyBound();
@@ -120,6 +252,324 @@ osg::BoundingSphere LightPointNode::computeBound() const
     return bsphere;
 }
 
+void LightPointNode::resizeGLObjectBuffers(unsigned int maxSize)
+{
+    osg::Node::resizeGLObjectBuffers(maxSize);
+
+    if (_blendedGeometry.valid()) _blendedGeometry->resizeGLObjectBuffers(maxSize);
+    if (_additiveGeometry.valid()) _additiveGeometry->resizeGLObjectBuffers(maxSize);
+    if (_blinkTexture.valid()) _blinkTexture->resizeGLObjectBuffers(maxSize);
+}
+
+void LightPointNode::releaseGLObjects(osg::State* state) const
+{
+    osg::Node::releaseGLObjects(state);
+
+    if (_blendedGeometry.valid()) _blendedGeometry->releaseGLObjects(state);
+    if (_additiveGeometry.valid()) _additiveGeometry->releaseGLObjects(state);
+    if (_blinkTexture.valid()) _blinkTexture->releaseGLObjects(state);
+}
+
+static osg::Geometry* createLightPointGeometry(osg::BlendFunc* blendFunc, osg::Texture2D* blinkTexture)
+{
+    osg::Geometry* geometry = new osg::Geometry;
+    geometry->setUseDisplayList(false);
+    geometry->setUseVertexBufferObjects(true);
+    geometry->setVertexArray(new osg::Vec3Array);
+    geometry->setColorArray(new osg::Vec4Array);
+    geometry->setColorBinding(osg::Geometry::BIND_PER_VERTEX);
+    for(unsigned int i=0; i<4; ++i)
+    {
+        geometry->setTexCoordArray(i, new osg::Vec4Array);
+    }
+
+    osg::StateSet* stateset = geometry->getOrCreateStateSet();
+    stateset->setAttribute(getSingletonLightPointProgram());
+    stateset->setAttributeAndModes(blendFunc, osg::StateAttribute::ON);
+    stateset->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
+    stateset->setMode(GL_VERTEX_PROGRAM_POINT_SIZE, osg::StateAttribute::ON);
+    stateset->setTextureAttributeAndModes(0, new osg::PointSprite, osg::StateAttribute::ON);
+
+    osg::Depth* depth = new osg::Depth;
+    depth->setWriteMask(false);
+    stateset->setAttribute(depth);
+
+    if (blinkTexture)
+    {
+        stateset->setTextureAttribute(0, blinkTexture);
+        stateset->addUniform(new osg::Uniform("osgSim_BlinkTexture", 0));
+    }
+
+    return geometry;
+}
+
+static void addLightPointToGeometry(osg::Geometry& geometry, const LightPoint& lp, const osg::Vec4& blink, const osg::Vec4& sector,
+                                    const osg::Vec4& sectorCoefficients0, const osg::Vec4& sectorCoefficients1)
+{
+    static_cast<osg::Vec3Array*>(geometry.getVertexArray())->push_back(lp._position);
+    static_cast<osg::Vec4Array*>(geometry.getColorArray())->push_back(lp._color);
+    static_cast<osg::Vec4Array*>(geometry.getTexCoordArray(0))->push_back(blink);
+    static_cast<osg::Vec4Array*>(geometry.getTexCoordArray(1))->push_back(sector);
+    static_cast<osg::Vec4Array*>(geometry.getTexCoordArray(2))->push_back(sectorCoefficients0);
+    static_cast<osg::Vec4Array*>(geometry.getTexCoordArray(3))->push_back(sectorCoefficients1);
+}
+
+bool LightPointNode::updateShaderData()
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_shaderDataMutex);
+
+    if (!_shaderDataDirty) return _shaderDataValid;
+
+    _shaderDataDirty = false;
+    _shaderDataValid = false;
+    _blendedGeometry = 0;
+    _additiveGeometry = 0;
+    _blinkTexture = 0;
+
+    // assign a row of the blink texture to each of the blink sequences, and check that the shaders can evaluate the sectors.
+    typedef std::map<const BlinkSequence*, unsigned int> BlinkSequenceRowMap;
+    BlinkSequenceRowMap blinkSequenceRows;
+    for(LightPointList::const_iterator itr=_lightPointList.begin();
+        itr!=_lightPointList.end();
+        ++itr)
+    {
+        const LightPoint& lp = *itr;
+        if (!lp._on) continue;
+
+        const Sector* sector = lp._sector.get();
+        if (sector &&
+            !dynamic_cast<const AzimSector*>(sector) &&
+            !dynamic_cast<const ElevationSector*>(sector) &&
+            !dynamic_cast<const AzimElevationSector*>(sector) &&
+            !dynamic_cast<const ConeSector*>(sector))
+        {
+            OSG_INFO<<"LightPointNode::updateShaderData() "<<sector->className()<<" not supported by shaders, evaluating light points on the CPU."<<std::endl;
+            return false;
+        }
+
+        const BlinkSequence* blinkSequence = lp._blinkSequence.get();
+        if (blinkSequence && blinkSequence->getNumPulses()>0 && blinkSequence->getPulsePeriod()>0.0 &&
+            blinkSequenceRows.count(blinkSequence)==0)
+        {
+            unsigned int row = blinkSequenceRows.size();
+            blinkSequenceRows[blinkSequence] = row;
+        }
+    }
+
+    const unsigned int blinkTextureWidth = 256;
+    const unsigned int maxBlinkTextureHeight = 4096;
+    if (blinkSequenceRows.size()>maxBlinkTextureHeight)
+    {
+        OSG_INFO<<"LightPointNode::updateShaderData() too many blink sequences for the shaders, evaluating light points on the CPU."<<std::endl;
+        return false;
+    }
+
+    if (!blinkSequenceRows.empty())
+    {
+        // sample each blink sequence over its period, averaging the pulses across each texel.
+        unsigned int height = blinkSequenceRows.size();
+        osg::ref_ptr<osg::Image> image = new osg::Image;
+        image->allocateImage(blinkTextureWidth, height, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+        for(BlinkSequenceRowMap::const_iterator itr=blinkSequenceRows.begin();
+            itr!=blinkSequenceRows.end();
+            ++itr)
+        {
+            const BlinkSequence* blinkSequence = itr->first;
+            double period = blinkSequence->getPulsePeriod();
+            double texelPeriod = period/static_cast<double>(blinkTextureWidth);
+            double offset = blinkSequence->getPhaseShift() + (blinkSequence->getSequenceGroup() ? blinkSequence->getSequenceGroup()->getBaseTime() : 0.0);
+            unsigned char* data = image->data(0, itr->second);
+            for(unsigned int i=0; i<blinkTextureWidth; ++i)
+            {
+                osg::Vec4 color = blinkSequence->color(offset+texelPeriod*static_cast<double>(i), texelPeriod);
+                for(unsigned int c=0; c<4; ++c)
+                {
+                    *(data++) = static_cast<unsigned char>(osg::clampBetween(color[c], 0.0f, 1.0f)*255.0f+0.5f);
+                }
+            }
+        }
+
+        _blinkTexture = new osg::Texture2D(image.get());
+        _blinkTexture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::NEAREST);
+        _blinkTexture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::NEAREST);
+        _blinkTexture->setWrap(osg::Texture::WRAP_S, osg::Texture::REPEAT);
+        _blinkTexture->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+        _blinkTexture->setResizeNonPowerOfTwoHint(false);
+    }
+
+    osg::ref_ptr<osg::BlendFunc> blendOneMinusSrcAlpha = new osg::BlendFunc(osg::BlendFunc::SRC_ALPHA, osg::BlendFunc::ONE_MINUS_SRC_ALPHA);
+    osg::ref_ptr<osg::BlendFunc> blendOne = new osg::BlendFunc(osg::BlendFunc::SRC_ALPHA, osg::BlendFunc::ONE);
+    osg::ref_ptr<osg::Geometry> blendedGeometry = createLightPointGeometry(blendOneMinusSrcAlpha.get(), _blinkTexture.get());
+    osg::ref_ptr<osg::Geometry> additiveGeometry = createLightPointGeometry(blendOne.get(), _blinkTexture.get());
+
+    for(LightPointList::const_iterator itr=_lightPointList.begin();
+        itr!=_lightPointList.end();
+        ++itr)
+    {
+        const LightPoint& lp = *itr;
+        if (!lp._on) continue;
+
+        // intensity, radius, blink texture row and blink period.
+        osg::Vec4 blink(lp._intensity, lp._radius, 0.0f, 0.0f);
+        // blink phase, sector type.
+        osg::Vec4 sectorType(0.0f, 0.0f, 0.0f, 0.0f);
+        osg::Vec4 coefficients0(0.0f, 1.0f, -1.0f, -1.0f);
+        osg::Vec4 coefficients1(-1.0f, -1.0f, 1.0f, 1.0f);
+
+        BlinkSequenceRowMap::const_iterator bitr = blinkSequenceRows.find(lp._blinkSequence.get());
+        if (bitr!=blinkSequenceRows.end())
+        {
+            const BlinkSequence* blinkSequence = bitr->first;
+            blink[2] = (static_cast<float>(bitr->second)+0.5f)/static_cast<float>(blinkSequenceRows.size());
+            blink[3] = blinkSequence->getPulsePeriod();
+            sectorType[0] = blinkSequence->getPhaseShift() + (blinkSequence->getSequenceGroup() ? blinkSequence->getSequenceGroup()->getBaseTime() : 0.0);
+        }
+
+        if (const ConeSector* cone = dynamic_cast<const ConeSector*>(lp._sector.get()))
+        {
+            sectorType[1] = 2.0f;
+            coefficients0.set(cone->getAxis().x(), cone->getAxis().y(), cone->getAxis().z(), cosf(cone->getAngle()));
+            coefficients1.set(cosf(cone->getAngle()+cone->getFadeAngle()), 0.0f, 0.0f, 0.0f);
+        }
+        else if (const AzimRange* azimRange = dynamic_cast<const AzimRange*>(lp._sector.get()))
+        {
+            sectorType[1] = 1.0f;
+            coefficients0 = azimRange->getAzimuthCoefficients();
+            if (const ElevationRange* elevationRange = dynamic_cast<const ElevationRange*>(lp._sector.get()))
+            {
+                coefficients1 = elevationRange->getElevationCoefficients();
+            }
+        }
+        else if (const ElevationRange* elevationRange = dynamic_cast<const ElevationRange*>(lp._sector.get()))
+        {
+            sectorType[1] = 1.0f;
+            coefficients1 = elevationRange->getElevationCoefficients();
+        }
+
+        osg::Geometry& geometry = (lp._blendingMode==LightPoint::BLENDED) ? *blendedGeometry : *additiveGeometry;
+        addLightPointToGeometry(geometry, lp, blink, sectorType, coefficients0, coefficients1);
+    }
+
+    unsigned int numBlended = blendedGeometry->getVertexArray()->getNumElements();
+    if (numBlended>0)
+    {
+        blendedGeometry->addPrimitiveSet(new osg::DrawArrays(GL_POINTS, 0, numBlended));
+        _blendedGeometry = blendedGeometry;
+    }
+
+    unsigned int numAdditive = additiveGeometry->getVertexArray()->getNumElements();
+    if (numAdditive>0)
+    {
+        additiveGeometry->addPrimitiveSet(new osg::DrawArrays(GL_POINTS, 0, numAdditive));
+        _additiveGeometry = additiveGeometry;
+    }
+
+    _shaderDataValid = true;
+    return true;
+}
+
+osg::StateSet* LightPointNode::getShaderCullStateSet(osgUtil::CullVisitor& cv)
+{
+    ShaderCullData* scd = 0;
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_shaderCullDataMapMutex);
+        osg::ref_ptr<ShaderCullData>& data = _shaderCullDataMap[&cv];
+
+        // the CullVisitor is new, or has been allocated at the address of a deleted one.
+        if (!data || data->cullVisitor.get()!=&cv)
+        {
+            // remove the entries of deleted CullVisitors, so that recreating views and cameras doesn't accumulate them.
+            for(ShaderCullDataMap::iterator itr = _shaderCullDataMap.begin();
+                itr != _shaderCullDataMap.end();)
+            {
+                if (itr->first!=&cv && (!itr->second || !itr->second->cullVisitor.valid())) _shaderCullDataMap.erase(itr++);
+                else ++itr;
+            }
+
+            data = new ShaderCullData;
+            data->cullVisitor = &cv;
+        }
+
+        scd = data.get();
+    }
+
+    // each CullVisitor is used by a single thread, so its data needs no further locking.
+    if (scd->traversalNumber!=cv.getTraversalNumber())
+    {
+        scd->traversalNumber = cv.getTraversalNumber();
+        scd->numUsed = 0;
+    }
+
+    if (scd->numUsed==scd->stateSets.size())
+    {
+        // the StateSet is DYNAMIC so that the next frame's cull traversal doesn't update its uniforms
+        // while the draw traversal may still be applying them.
+        osg::StateSet* stateset = new osg::StateSet;
+        stateset->setDataVariance(osg::Object::DYNAMIC);
+
+        const char* names[] = { "osgSim_EyeLocal", "osgSim_PixelSizeVector", "osgSim_PixelSizeLimits", "osgSim_LightPointSystem" };
+        const osg::Uniform::Type types[] = { osg::Uniform::FLOAT_VEC4, osg::Uniform::FLOAT_VEC4, osg::Uniform::FLOAT_VEC4, osg::Uniform::FLOAT_VEC2 };
+        for(unsigned int i=0; i<4; ++i)
+        {
+            osg::Uniform* uniform = new osg::Uniform(types[i], names[i]);
+            uniform->setDataVariance(osg::Object::DYNAMIC);
+            stateset->addUniform(uniform);
+        }
+
+        scd->stateSets.push_back(stateset);
+    }
+
+    return scd->stateSets[scd->numUsed++].get();
+}
+
+void LightPointNode::cullWithShaders(osgUtil::CullVisitor& cv)
+{
+    // the bounding box of the light points is the only test done on the CPU.
+    getBound();
+    if (cv.isCulled(_bbox)) return;
+
+    osg::RefMatrix* matrix = cv.getModelViewMatrix();
+    if (cv.getComputeNearFarMode() != osgUtil::CullVisitor::DO_NOT_COMPUTE_NEAR_FAR)
+        cv.updateCalculatedNearFar(*matrix,_bbox);
+
+    float time = cv.getFrameStamp() ? static_cast<float>(cv.getFrameStamp()->getSimulationTime()) : 0.0f;
+
+    float systemIntensity = -1.0f;
+    float blinkEnabled = 1.0f;
+    if (_lightSystem.valid())
+    {
+        systemIntensity = _lightSystem->getIntensity();
+        blinkEnabled = (_lightSystem->getAnimationState()==LightPointSystem::ANIMATION_ON) ? 1.0f : 0.0f;
+    }
+
+    // the uniforms depend on the view, so are updated in a StateSet kept for this CullVisitor.
+    osg::StateSet* stateset = getShaderCullStateSet(cv);
+    stateset->getUniform("osgSim_EyeLocal")->set(osg::Vec4(cv.getEyeLocal(), time));
+    stateset->getUniform("osgSim_PixelSizeVector")->set(cv.getCurrentCullingSet().getPixelSizeVector());
+    stateset->getUniform("osgSim_PixelSizeLimits")->set(osg::Vec4(_minPixelSize, _maxPixelSize, _maxVisibleDistance2, 0.0f));
+    stateset->getUniform("osgSim_LightPointSystem")->set(osg::Vec2(systemIntensity, blinkEnabled));
+
+    float depth = cv.getDistanceFromEyePoint(_bbox.center(), false);
+
+    cv.pushStateSet(stateset);
+
+    if (_blendedGeometry.valid())
+    {
+        cv.pushStateSet(_blendedGeometry->getStateSet());
+        cv.addDrawableAndDepth(_blendedGeometry.get(), matrix, depth);
+        cv.popStateSet();
+    }
+
+    if (_additiveGeometry.valid())
+    {
+        cv.pushStateSet(_additiveGeometry->getStateSet());
+        cv.addDrawableAndDepth(_additiveGeometry.get(), matrix, depth);
+        cv.popStateSet();
+    }
+
+    cv.popStateSet();
+}
+
 
 void LightPointNode::traverse(osg::NodeVisitor& nv)
 {
@@ -146,6 +596,12 @@ void LightPointNode::traverse(osg::NodeVisitor& nv)
     t2 = timer.tick();
 #endif
 
+    if (cv && _useShaders && updateShaderData())
+    {
+        cullWithShaders(*cv);
+        return;
+    }
+
 
     // should we disable small feature culling here?
     if (cv /*&& !cv->isCulled(_bbox)*/)
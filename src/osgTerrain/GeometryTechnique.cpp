@@ -27,6 +27,8 @@
 #include <osg/Math>
 #include <osg/Timer>
 
+#include <OpenThreads/ScopedLock>
+
 using namespace osgTerrain;
 
 GeometryTechnique::GeometryTechnique()
@@ -748,6 +750,232 @@ void VertexNormalGenerator::computeNormals()
     }
 }
 
+/////////////////////////////////////////////////////////////////////////////////
+//
+// TileTopology
+//
+// Grid indices of the vertices along the bottom, right, top and left edges of a tile that has no invalid vertices,
+// in the order that the skirt vertices are added to the tile.
+static void computeSkirtEdgeIndices(int numRows, int numColumns, std::vector<unsigned int>& edgeIndices)
+{
+    int r,c;
+    for(c=0; c<numColumns; ++c) edgeIndices.push_back(c);
+    for(r=0; r<numRows; ++r) edgeIndices.push_back(r*numColumns + numColumns-1);
+    for(c=numColumns-1; c>=0; --c) edgeIndices.push_back((numRows-1)*numColumns + c);
+    for(r=numRows-1; r>=0; --r) edgeIndices.push_back(r*numColumns);
+}
+
+// DrawElements and master texture coordinates shared by all the tiles with the same dimensions, skirt and orientation
+// that have no invalid vertices.
+class TileTopology : public osg::Referenced
+{
+    public:
+
+        typedef std::vector< osg::ref_ptr<osg::DrawElements> > DrawElementsList;
+
+        TileTopology(int numRows, int numColumns, bool createSkirt, bool swapOrientation, bool smallTile);
+
+        bool isShared(const osg::BufferData* data) const
+        {
+            if (data==_texcoords.get()) return true;
+            for(DrawElementsList::const_iterator itr = _drawElementsList.begin();
+                itr != _drawElementsList.end();
+                ++itr)
+            {
+                if (data==itr->get()) return true;
+            }
+            return false;
+        }
+
+        DrawElementsList                    _drawElementsList;
+        osg::ref_ptr<osg::Vec2Array>        _texcoords;
+
+    protected:
+
+        virtual ~TileTopology() {}
+
+        osg::DrawElements* createDrawElements(GLenum mode, bool smallTile) const
+        {
+            return smallTile ?
+                static_cast<osg::DrawElements*>(new osg::DrawElementsUShort(mode)) :
+                static_cast<osg::DrawElements*>(new osg::DrawElementsUInt(mode));
+        }
+};
+
+TileTopology::TileTopology(int numRows, int numColumns, bool createSkirt, bool swapOrientation, bool smallTile)
+{
+    // the shared arrays get buffer objects of their own so that the Geometry that use them don't add them to their per tile buffer objects.
+    osg::ref_ptr<osg::ElementBufferObject> ebo = new osg::ElementBufferObject;
+
+    osg::ref_ptr<osg::DrawElements> elements = createDrawElements(GL_TRIANGLES, smallTile);
+    elements->reserveElements((numRows-1) * (numColumns-1) * 6);
+    elements->setElementBufferObject(ebo.get());
+    _drawElementsList.push_back(elements.get());
+
+    int i, j;
+    for(j=0; j<numRows-1; ++j)
+    {
+        for(i=0; i<numColumns-1; ++i)
+        {
+            int i00 = j*numColumns + i;
+            int i01 = (j+1)*numColumns + i;
+            int i10 = j*numColumns + i + 1;
+            int i11 = (j+1)*numColumns + i + 1;
+
+            if (swapOrientation)
+            {
+                std::swap(i00,i01);
+                std::swap(i10,i11);
+            }
+
+            elements->addElement(i01);
+            elements->addElement(i00);
+            elements->addElement(i11);
+
+            elements->addElement(i00);
+            elements->addElement(i10);
+            elements->addElement(i11);
+        }
+    }
+
+    std::vector<unsigned int> edgeIndices;
+    if (createSkirt) computeSkirtEdgeIndices(numRows, numColumns, edgeIndices);
+
+    unsigned int numVerticesInBody = numRows*numColumns;
+
+    if (createSkirt)
+    {
+        int sideLengths[4] = { numColumns, numRows, numColumns, numRows };
+        unsigned int k = 0;
+        for(unsigned int side=0; side<4; ++side)
+        {
+            osg::ref_ptr<osg::DrawElements> skirtDrawElements = createDrawElements(GL_QUAD_STRIP, smallTile);
+            skirtDrawElements->reserveElements(sideLengths[side]*2);
+            skirtDrawElements->setElementBufferObject(ebo.get());
+
+            for(int n=0; n<sideLengths[side]; ++n, ++k)
+            {
+                skirtDrawElements->addElement(edgeIndices[k]);
+                skirtDrawElements->addElement(numVerticesInBody+k);
+            }
+
+            _drawElementsList.push_back(skirtDrawElements.get());
+        }
+    }
+
+    _texcoords = new osg::Vec2Array;
+    _texcoords->reserve(numVerticesInBody + edgeIndices.size());
+    for(j=0; j<numRows; ++j)
+    {
+        for(i=0; i<numColumns; ++i)
+        {
+            _texcoords->push_back(osg::Vec2(((double)i)/(double)(numColumns-1), ((double)j)/(double)(numRows-1)));
+        }
+    }
+
+    for(std::vector<unsigned int>::iterator itr = edgeIndices.begin();
+        itr != edgeIndices.end();
+        ++itr)
+    {
+        _texcoords->push_back((*_texcoords)[*itr]);
+    }
+
+    _texcoords->setVertexBufferObject(new osg::VertexBufferObject);
+}
+
+struct TileTopologyKey
+{
+    TileTopologyKey(int numRows, int numColumns, bool createSkirt, bool swapOrientation, bool smallTile):
+        _numRows(numRows),
+        _numColumns(numColumns),
+        _createSkirt(createSkirt),
+        _swapOrientation(swapOrientation),
+        _smallTile(smallTile) {}
+
+    bool operator < (const TileTopologyKey& rhs) const
+    {
+        if (_numRows<rhs._numRows) return true;
+        if (_numRows>rhs._numRows) return false;
+        if (_numColumns<rhs._numColumns) return true;
+        if (_numColumns>rhs._numColumns) return false;
+        if (_createSkirt!=rhs._createSkirt) return rhs._createSkirt;
+        if (_swapOrientation!=rhs._swapOrientation) return rhs._swapOrientation;
+        return _smallTile<rhs._smallTile;
+    }
+
+    int     _numRows;
+    int     _numColumns;
+    bool    _createSkirt;
+    bool    _swapOrientation;
+    bool    _smallTile;
+};
+
+// the tiles hold their topology, so the map only observes it and a topology is freed, along with its buffer objects,
+// once the last tile using it is.
+typedef std::map< TileTopologyKey, osg::observer_ptr<TileTopology> > TileTopologyMap;
+
+static OpenThreads::Mutex s_tileTopologyMutex;
+static TileTopologyMap s_tileTopologyMap;
+
+// tiles may be generated concurrently by several DatabasePager threads so access to the shared topologies is serialized.
+static osg::ref_ptr<TileTopology> getOrCreateTileTopology(int numRows, int numColumns, bool createSkirt, bool swapOrientation, bool smallTile)
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(s_tileTopologyMutex);
+
+    // remove the entries of the topologies that have been freed.
+    for(TileTopologyMap::iterator itr = s_tileTopologyMap.begin();
+        itr != s_tileTopologyMap.end();)
+    {
+        if (!itr->second.valid()) s_tileTopologyMap.erase(itr++);
+        else ++itr;
+    }
+
+    osg::ref_ptr<TileTopology> topology;
+    osg::observer_ptr<TileTopology>& observer = s_tileTopologyMap[TileTopologyKey(numRows, numColumns, createSkirt, swapOrientation, smallTile)];
+    if (!observer.lock(topology))
+    {
+        topology = new TileTopology(numRows, numColumns, createSkirt, swapOrientation, smallTile);
+        observer = topology;
+    }
+    return topology;
+}
+
+// release the GL objects of a tile apart from those of the topology that it shares with other tiles,
+// which are released once the topology is freed or by the graphics context deleting all its GL objects.
+static void releaseTileGLObjects(osg::Node* transform, osg::Node* geode, osg::Geometry* geometry, const TileTopology* topology, osg::State* state)
+{
+    if (!transform) return;
+
+    if (!topology || !geode || !geometry)
+    {
+        transform->releaseGLObjects(state);
+        return;
+    }
+
+    if (transform->getStateSet()) transform->getStateSet()->releaseGLObjects(state);
+    if (geode->getStateSet()) geode->getStateSet()->releaseGLObjects(state);
+
+    geometry->osg::Drawable::releaseGLObjects(state);
+
+    osg::Geometry::ArrayList arrays;
+    geometry->getArrayList(arrays);
+    for(osg::Geometry::ArrayList::iterator itr = arrays.begin();
+        itr != arrays.end();
+        ++itr)
+    {
+        if (!topology->isShared(*itr)) (*itr)->releaseGLObjects(state);
+    }
+
+    osg::Geometry::DrawElementsList drawElements;
+    geometry->getDrawElementsList(drawElements);
+    for(osg::Geometry::DrawElementsList::iterator itr = drawElements.begin();
+        itr != drawElements.end();
+        ++itr)
+    {
+        if (!topology->isShared(*itr)) (*itr)->releaseGLObjects(state);
+    }
+}
+
 void GeometryTechnique::generateGeometry(BufferData& buffer, Locator* masterLocator, const osg::Vec3d& centerModel)
 {
     Terrain* terrain = _terrainTile->getTerrain();
@@ -805,6 +1033,8 @@ void GeometryTechnique::generateGeometry(BufferData& buffer, Locator* masterLoca
 
     float scaleHeight = terrain ? terrain->getVerticalScale() : 1.0f;
 
+    bool shareTileTopology = terrain && terrain->getShareTileTopology();
+
     // construct the VertexNormalGenerator which will manage the generation and the vertices and normals
     VertexNormalGenerator VNG(masterLocator, centerModel, numRows, numColumns, scaleHeight, createSkirt);
 
@@ -823,6 +1053,12 @@ void GeometryTechnique::generateGeometry(BufferData& buffer, Locator* masterLoca
     // typedef std::map< Layer*, TexCoordLocatorPair > LayerToTexCoordMap;
 
     VertexNormalGenerator::LayerToTexCoordMap layerToTexCoordMap;
+
+    // image layers that use the master locator have texture coordinates that only depend upon the dimensions of the tile,
+    // so when sharing the topology these are assigned once the validity of the vertices is known.
+    typedef std::vector<unsigned int> LayerNumList;
+    LayerNumList masterTexCoordLayers;
+
     for(unsigned int layerNum=0; layerNum<_terrainTile->getNumColorLayers(); ++layerNum)
     {
         osgTerrain::Layer* colorLayer = _terrainTile->getColorLayer(layerNum);
@@ -851,6 +1087,12 @@ void GeometryTechnique::generateGeometry(BufferData& buffer, Locator* masterLoca
                     }
                 }
 
+                if (shareTileTopology && (!locator || locator==masterLocator) && dynamic_cast<osgTerrain::ImageLayer*>(colorLayer))
+                {
+                    masterTexCoordLayers.push_back(layerNum);
+                    continue;
+                }
+
                 VertexNormalGenerator::TexCoordLocatorPair& tclp = layerToTexCoordMap[colorLayer];
                 tclp.first = new osg::Vec2Array;
                 tclp.first->reserve(numVertices);
@@ -1001,98 +1243,47 @@ void GeometryTechnique::generateGeometry(BufferData& buffer, Locator* masterLoca
 
     // OSG_NOTICE<<"smallTile = "<<smallTile<<std::endl;
 
-    osg::ref_ptr<osg::DrawElements> elements = smallTile ?
-        static_cast<osg::DrawElements*>(new osg::DrawElementsUShort(GL_TRIANGLES)) :
-        static_cast<osg::DrawElements*>(new osg::DrawElementsUInt(GL_TRIANGLES));
+    // tiles without invalid vertices have their vertices laid out in grid order so can share their topology.
+    bool allVerticesValid = VNG._vertices->size()==numRows*numColumns;
 
-    elements->reserveElements((numRows-1) * (numColumns-1) * 6);
+    unsigned int i, j;
 
-    geometry->addPrimitiveSet(elements.get());
+    osg::ref_ptr<TileTopology> topology = (shareTileTopology && allVerticesValid) ?
+        getOrCreateTileTopology(numRows, numColumns, createSkirt, swapOrientation, smallTile) : 0;
 
+    buffer._sharedTopology = topology.get();
 
-    unsigned int i, j;
-    for(j=0; j<numRows-1; ++j)
+    if (topology.valid())
     {
-        for(i=0; i<numColumns-1; ++i)
+        for(LayerNumList::iterator itr = masterTexCoordLayers.begin();
+            itr != masterTexCoordLayers.end();
+            ++itr)
         {
-            // remap indices to final vertex positions
-            int i00 = VNG.vertex_index(i,   j);
-            int i01 = VNG.vertex_index(i,   j+1);
-            int i10 = VNG.vertex_index(i+1, j);
-            int i11 = VNG.vertex_index(i+1, j+1);
-
-            if (swapOrientation)
-            {
-                std::swap(i00,i01);
-                std::swap(i10,i11);
-            }
-
-            unsigned int numValid = 0;
-            if (i00>=0) ++numValid;
-            if (i01>=0) ++numValid;
-            if (i10>=0) ++numValid;
-            if (i11>=0) ++numValid;
-
-            if (numValid==4)
-            {
-                // optimize which way to put the diagonal by choosing to
-                // place it between the two corners that have the least curvature
-                // relative to each other.
-                float dot_00_11 = (*VNG._normals)[i00] * (*VNG._normals)[i11];
-                float dot_01_10 = (*VNG._normals)[i01] * (*VNG._normals)[i10];
-                if (dot_00_11 > dot_01_10)
-                {
-                    elements->addElement(i01);
-                    elements->addElement(i00);
-                    elements->addElement(i11);
-
-                    elements->addElement(i00);
-                    elements->addElement(i10);
-                    elements->addElement(i11);
-                }
-                else
-                {
-                    elements->addElement(i01);
-                    elements->addElement(i00);
-                    elements->addElement(i10);
-
-                    elements->addElement(i01);
-                    elements->addElement(i10);
-                    elements->addElement(i11);
-                }
-            }
-            else if (numValid==3)
-            {
-                if (i00>=0) elements->addElement(i00);
-                if (i01>=0) elements->addElement(i01);
-                if (i11>=0) elements->addElement(i11);
-                if (i10>=0) elements->addElement(i10);
-            }
+            geometry->setTexCoordArray(*itr, topology->_texcoords.get());
         }
-    }
 
+        for(TileTopology::DrawElementsList::iterator itr = topology->_drawElementsList.begin();
+            itr != topology->_drawElementsList.end();
+            ++itr)
+        {
+            geometry->addPrimitiveSet(itr->get());
+        }
 
-    if (createSkirt)
-    {
-        osg::ref_ptr<osg::Vec3Array> vertices = VNG._vertices.get();
-        osg::ref_ptr<osg::Vec3Array> normals = VNG._normals.get();
+        if (createSkirt)
+        {
+            osg::Vec3Array* vertices = VNG._vertices.get();
+            osg::Vec3Array* normals = VNG._normals.get();
 
-        osg::ref_ptr<osg::DrawElements> skirtDrawElements = smallTile ?
-            static_cast<osg::DrawElements*>(new osg::DrawElementsUShort(GL_QUAD_STRIP)) :
-            static_cast<osg::DrawElements*>(new osg::DrawElementsUInt(GL_QUAD_STRIP));
+            std::vector<unsigned int> edgeIndices;
+            computeSkirtEdgeIndices(numRows, numColumns, edgeIndices);
 
-        // create bottom skirt vertices
-        int r,c;
-        r=0;
-        for(c=0;c<static_cast<int>(numColumns);++c)
-        {
-            int orig_i = VNG.vertex_index(c,r);
-            if (orig_i>=0)
+            for(std::vector<unsigned int>::iterator eitr = edgeIndices.begin();
+                eitr != edgeIndices.end();
+                ++eitr)
             {
-                unsigned int new_i = vertices->size(); // index of new index of added skirt point
-                osg::Vec3 new_v = (*vertices)[orig_i] - ((*skirtVectors)[orig_i])*skirtHeight;
-                (*vertices).push_back(new_v);
-                if (normals.valid()) (*normals).push_back((*normals)[orig_i]);
+                unsigned int orig_i = *eitr;
+                vertices->push_back((*vertices)[orig_i] - ((*skirtVectors)[orig_i])*skirtHeight);
+                normals->push_back((*normals)[orig_i]);
 
                 for(VertexNormalGenerator::LayerToTexCoordMap::iterator itr = layerToTexCoordMap.begin();
                     itr != layerToTexCoordMap.end();
@@ -1100,152 +1291,311 @@ void GeometryTechnique::generateGeometry(BufferData& buffer, Locator* masterLoca
                 {
                     itr->second.first->push_back((*itr->second.first)[orig_i]);
                 }
-
-                skirtDrawElements->addElement(orig_i);
-                skirtDrawElements->addElement(new_i);
             }
-            else
+        }
+
+        // keep the per tile arrays out of the buffer objects of the shared arrays.
+        osg::ref_ptr<osg::VertexBufferObject> vbo = new osg::VertexBufferObject;
+        osg::Geometry::ArrayList arrayList;
+        geometry->getArrayList(arrayList);
+        for(osg::Geometry::ArrayList::iterator itr = arrayList.begin();
+            itr != arrayList.end();
+            ++itr)
+        {
+            if (!(*itr)->getVertexBufferObject()) (*itr)->setVertexBufferObject(vbo.get());
+        }
+    }
+    else
+    {
+        if (!masterTexCoordLayers.empty())
+        {
+            // the tile has invalid vertices, so compute the texture coordinates of the master locator layers per tile.
+            osg::ref_ptr<osg::Vec2Array> texcoords = new osg::Vec2Array(VNG._vertices->size());
+            for(j=0; j<numRows; ++j)
             {
-                if (skirtDrawElements->getNumIndices()!=0)
+                for(i=0; i<numColumns; ++i)
                 {
-                    geometry->addPrimitiveSet(skirtDrawElements.get());
-                    skirtDrawElements = smallTile ?
-                        static_cast<osg::DrawElements*>(new osg::DrawElementsUShort(GL_QUAD_STRIP)) :
-                        static_cast<osg::DrawElements*>(new osg::DrawElementsUInt(GL_QUAD_STRIP));
+                    int vi = VNG.vertex_index(i, j);
+                    if (vi>=0) (*texcoords)[vi].set(((double)i)/(double)(numColumns-1), ((double)j)/(double)(numRows-1));
                 }
+            }
 
+            for(LayerNumList::iterator itr = masterTexCoordLayers.begin();
+                itr != masterTexCoordLayers.end();
+                ++itr)
+            {
+                geometry->setTexCoordArray(*itr, texcoords.get());
             }
-        }
 
-        if (skirtDrawElements->getNumIndices()!=0)
-        {
-            geometry->addPrimitiveSet(skirtDrawElements.get());
-            skirtDrawElements = smallTile ?
-                        static_cast<osg::DrawElements*>(new osg::DrawElementsUShort(GL_QUAD_STRIP)) :
-                        static_cast<osg::DrawElements*>(new osg::DrawElementsUInt(GL_QUAD_STRIP));
+            // add to the layer map so the skirt vertices get texture coordinates too.
+            VertexNormalGenerator::TexCoordLocatorPair& tclp = layerToTexCoordMap[_terrainTile->getColorLayer(masterTexCoordLayers.front())];
+            tclp.first = texcoords;
+            tclp.second = masterLocator;
         }
 
-        // create right skirt vertices
-        c=numColumns-1;
-        for(r=0;r<static_cast<int>(numRows);++r)
+        osg::ref_ptr<osg::DrawElements> elements = smallTile ?
+            static_cast<osg::DrawElements*>(new osg::DrawElementsUShort(GL_TRIANGLES)) :
+            static_cast<osg::DrawElements*>(new osg::DrawElementsUInt(GL_TRIANGLES));
+
+        elements->reserveElements((numRows-1) * (numColumns-1) * 6);
+
+        geometry->addPrimitiveSet(elements.get());
+
+
+        for(j=0; j<numRows-1; ++j)
         {
-            int orig_i = VNG.vertex_index(c,r); // index of original vertex of grid
-            if (orig_i>=0)
+            for(i=0; i<numColumns-1; ++i)
             {
-                unsigned int new_i = vertices->size(); // index of new index of added skirt point
-                osg::Vec3 new_v = (*vertices)[orig_i] - ((*skirtVectors)[orig_i])*skirtHeight;
-                (*vertices).push_back(new_v);
-                if (normals.valid()) (*normals).push_back((*normals)[orig_i]);
-                for(VertexNormalGenerator::LayerToTexCoordMap::iterator itr = layerToTexCoordMap.begin();
-                    itr != layerToTexCoordMap.end();
-                    ++itr)
+                // remap indices to final vertex positions
+                int i00 = VNG.vertex_index(i,   j);
+                int i01 = VNG.vertex_index(i,   j+1);
+                int i10 = VNG.vertex_index(i+1, j);
+                int i11 = VNG.vertex_index(i+1, j+1);
+
+                if (swapOrientation)
                 {
-                    itr->second.first->push_back((*itr->second.first)[orig_i]);
+                    std::swap(i00,i01);
+                    std::swap(i10,i11);
                 }
 
-                skirtDrawElements->addElement(orig_i);
-                skirtDrawElements->addElement(new_i);
-            }
-            else
-            {
-                if (skirtDrawElements->getNumIndices()!=0)
+                unsigned int numValid = 0;
+                if (i00>=0) ++numValid;
+                if (i01>=0) ++numValid;
+                if (i10>=0) ++numValid;
+                if (i11>=0) ++numValid;
+
+                if (numValid==4)
                 {
-                    geometry->addPrimitiveSet(skirtDrawElements.get());
-                    skirtDrawElements = smallTile ?
-                        static_cast<osg::DrawElements*>(new osg::DrawElementsUShort(GL_QUAD_STRIP)) :
-                        static_cast<osg::DrawElements*>(new osg::DrawElementsUInt(GL_QUAD_STRIP));
-                }
+                    // optimize which way to put the diagonal by choosing to
+                    // place it between the two corners that have the least curvature
+                    // relative to each other.
+                    float dot_00_11 = (*VNG._normals)[i00] * (*VNG._normals)[i11];
+                    float dot_01_10 = (*VNG._normals)[i01] * (*VNG._normals)[i10];
+                    if (dot_00_11 > dot_01_10)
+                    {
+                        elements->addElement(i01);
+                        elements->addElement(i00);
+                        elements->addElement(i11);
 
+                        elements->addElement(i00);
+                        elements->addElement(i10);
+                        elements->addElement(i11);
+                    }
+                    else
+                    {
+                        elements->addElement(i01);
+                        elements->addElement(i00);
+                        elements->addElement(i10);
+
+                        elements->addElement(i01);
+                        elements->addElement(i10);
+                        elements->addElement(i11);
+                    }
+                }
+                else if (numValid==3)
+                {
+                    if (i00>=0) elements->addElement(i00);
+                    if (i01>=0) elements->addElement(i01);
+                    if (i11>=0) elements->addElement(i11);
+                    if (i10>=0) elements->addElement(i10);
+                }
             }
         }
 
-        if (skirtDrawElements->getNumIndices()!=0)
-        {
-            geometry->addPrimitiveSet(skirtDrawElements.get());
-            skirtDrawElements = smallTile ?
-                        static_cast<osg::DrawElements*>(new osg::DrawElementsUShort(GL_QUAD_STRIP)) :
-                        static_cast<osg::DrawElements*>(new osg::DrawElementsUInt(GL_QUAD_STRIP));
-        }
 
-        // create top skirt vertices
-        r=numRows-1;
-        for(c=numColumns-1;c>=0;--c)
+        if (createSkirt)
         {
-            int orig_i = VNG.vertex_index(c,r); // index of original vertex of grid
-            if (orig_i>=0)
+            osg::ref_ptr<osg::Vec3Array> vertices = VNG._vertices.get();
+            osg::ref_ptr<osg::Vec3Array> normals = VNG._normals.get();
+
+            osg::ref_ptr<osg::DrawElements> skirtDrawElements = smallTile ?
+                static_cast<osg::DrawElements*>(new osg::DrawElementsUShort(GL_QUAD_STRIP)) :
+                static_cast<osg::DrawElements*>(new osg::DrawElementsUInt(GL_QUAD_STRIP));
+
+            // create bottom skirt vertices
+            int r,c;
+            r=0;
+            for(c=0;c<static_cast<int>(numColumns);++c)
             {
-                unsigned int new_i = vertices->size(); // index of new index of added skirt point
-                osg::Vec3 new_v = (*vertices)[orig_i] - ((*skirtVectors)[orig_i])*skirtHeight;
-                (*vertices).push_back(new_v);
-                if (normals.valid()) (*normals).push_back((*normals)[orig_i]);
-                for(VertexNormalGenerator::LayerToTexCoordMap::iterator itr = layerToTexCoordMap.begin();
-                    itr != layerToTexCoordMap.end();
-                    ++itr)
+                int orig_i = VNG.vertex_index(c,r);
+                if (orig_i>=0)
                 {
-                    itr->second.first->push_back((*itr->second.first)[orig_i]);
+                    unsigned int new_i = vertices->size(); // index of new index of added skirt point
+                    osg::Vec3 new_v = (*vertices)[orig_i] - ((*skirtVectors)[orig_i])*skirtHeight;
+                    (*vertices).push_back(new_v);
+                    if (normals.valid()) (*normals).push_back((*normals)[orig_i]);
+
+                    for(VertexNormalGenerator::LayerToTexCoordMap::iterator itr = layerToTexCoordMap.begin();
+                        itr != layerToTexCoordMap.end();
+                        ++itr)
+                    {
+                        itr->second.first->push_back((*itr->second.first)[orig_i]);
+                    }
+
+                    skirtDrawElements->addElement(orig_i);
+                    skirtDrawElements->addElement(new_i);
                 }
+                else
+                {
+                    if (skirtDrawElements->getNumIndices()!=0)
+                    {
+                        geometry->addPrimitiveSet(skirtDrawElements.get());
+                        skirtDrawElements = smallTile ?
+                            static_cast<osg::DrawElements*>(new osg::DrawElementsUShort(GL_QUAD_STRIP)) :
+                            static_cast<osg::DrawElements*>(new osg::DrawElementsUInt(GL_QUAD_STRIP));
+                    }
 
-                skirtDrawElements->addElement(orig_i);
-                skirtDrawElements->addElement(new_i);
+                }
             }
-            else
+
+            if (skirtDrawElements->getNumIndices()!=0)
             {
-                if (skirtDrawElements->getNumIndices()!=0)
+                geometry->addPrimitiveSet(skirtDrawElements.get());
+                skirtDrawElements = smallTile ?
+                            static_cast<osg::DrawElements*>(new osg::DrawElementsUShort(GL_QUAD_STRIP)) :
+                            static_cast<osg::DrawElements*>(new osg::DrawElementsUInt(GL_QUAD_STRIP));
+            }
+
+            // create right skirt vertices
+            c=numColumns-1;
+            for(r=0;r<static_cast<int>(numRows);++r)
+            {
+                int orig_i = VNG.vertex_index(c,r); // index of original vertex of grid
+                if (orig_i>=0)
                 {
-                    geometry->addPrimitiveSet(skirtDrawElements.get());
-                    skirtDrawElements = smallTile ?
-                        static_cast<osg::DrawElements*>(new osg::DrawElementsUShort(GL_QUAD_STRIP)) :
-                        static_cast<osg::DrawElements*>(new osg::DrawElementsUInt(GL_QUAD_STRIP));
+                    unsigned int new_i = vertices->size(); // index of new index of added skirt point
+                    osg::Vec3 new_v = (*vertices)[orig_i] - ((*skirtVectors)[orig_i])*skirtHeight;
+                    (*vertices).push_back(new_v);
+                    if (normals.valid()) (*normals).push_back((*normals)[orig_i]);
+                    for(VertexNormalGenerator::LayerToTexCoordMap::iterator itr = layerToTexCoordMap.begin();
+                        itr != layerToTexCoordMap.end();
+                        ++itr)
+                    {
+                        itr->second.first->push_back((*itr->second.first)[orig_i]);
+                    }
+
+                    skirtDrawElements->addElement(orig_i);
+                    skirtDrawElements->addElement(new_i);
                 }
+                else
+                {
+                    if (skirtDrawElements->getNumIndices()!=0)
+                    {
+                        geometry->addPrimitiveSet(skirtDrawElements.get());
+                        skirtDrawElements = smallTile ?
+                            static_cast<osg::DrawElements*>(new osg::DrawElementsUShort(GL_QUAD_STRIP)) :
+                            static_cast<osg::DrawElements*>(new osg::DrawElementsUInt(GL_QUAD_STRIP));
+                    }
 
+                }
             }
-        }
 
-        if (skirtDrawElements->getNumIndices()!=0)
-        {
-            geometry->addPrimitiveSet(skirtDrawElements.get());
-            skirtDrawElements = smallTile ?
-                        static_cast<osg::DrawElements*>(new osg::DrawElementsUShort(GL_QUAD_STRIP)) :
-                        static_cast<osg::DrawElements*>(new osg::DrawElementsUInt(GL_QUAD_STRIP));
-        }
+            if (skirtDrawElements->getNumIndices()!=0)
+            {
+                geometry->addPrimitiveSet(skirtDrawElements.get());
+                skirtDrawElements = smallTile ?
+                            static_cast<osg::DrawElements*>(new osg::DrawElementsUShort(GL_QUAD_STRIP)) :
+                            static_cast<osg::DrawElements*>(new osg::DrawElementsUInt(GL_QUAD_STRIP));
+            }
 
-        // create left skirt vertices
-        c=0;
-        for(r=numRows-1;r>=0;--r)
-        {
-            int orig_i = VNG.vertex_index(c,r); // index of original vertex of grid
-            if (orig_i>=0)
+            // create top skirt vertices
+            r=numRows-1;
+            for(c=numColumns-1;c>=0;--c)
             {
-                unsigned int new_i = vertices->size(); // index of new index of added skirt point
-                osg::Vec3 new_v = (*vertices)[orig_i] - ((*skirtVectors)[orig_i])*skirtHeight;
-                (*vertices).push_back(new_v);
-                if (normals.valid()) (*normals).push_back((*normals)[orig_i]);
-                for(VertexNormalGenerator::LayerToTexCoordMap::iterator itr = layerToTexCoordMap.begin();
-                    itr != layerToTexCoordMap.end();
-                    ++itr)
+                int orig_i = VNG.vertex_index(c,r); // index of original vertex of grid
+                if (orig_i>=0)
                 {
-                    itr->second.first->push_back((*itr->second.first)[orig_i]);
+                    unsigned int new_i = vertices->size(); // index of new index of added skirt point
+                    osg::Vec3 new_v = (*vertices)[orig_i] - ((*skirtVectors)[orig_i])*skirtHeight;
+                    (*vertices).push_back(new_v);
+                    if (normals.valid()) (*normals).push_back((*normals)[orig_i]);
+                    for(VertexNormalGenerator::LayerToTexCoordMap::iterator itr = layerToTexCoordMap.begin();
+                        itr != layerToTexCoordMap.end();
+                        ++itr)
+                    {
+                        itr->second.first->push_back((*itr->second.first)[orig_i]);
+                    }
+
+                    skirtDrawElements->addElement(orig_i);
+                    skirtDrawElements->addElement(new_i);
+                }
+                else
+                {
+                    if (skirtDrawElements->getNumIndices()!=0)
+                    {
+                        geometry->addPrimitiveSet(skirtDrawElements.get());
+                        skirtDrawElements = smallTile ?
+                            static_cast<osg::DrawElements*>(new osg::DrawElementsUShort(GL_QUAD_STRIP)) :
+                            static_cast<osg::DrawElements*>(new osg::DrawElementsUInt(GL_QUAD_STRIP));
+                    }
+
                 }
+            }
 
-                skirtDrawElements->addElement(orig_i);
-                skirtDrawElements->addElement(new_i);
+            if (skirtDrawElements->getNumIndices()!=0)
+            {
+                geometry->addPrimitiveSet(skirtDrawElements.get());
+                skirtDrawElements = smallTile ?
+                            static_cast<osg::DrawElements*>(new osg::DrawElementsUShort(GL_QUAD_STRIP)) :
+                            static_cast<osg::DrawElements*>(new osg::DrawElementsUInt(GL_QUAD_STRIP));
             }
-            else
+
+            // create left skirt vertices
+            c=0;
+            for(r=numRows-1;r>=0;--r)
             {
-                if (skirtDrawElements->getNumIndices()!=0)
+                int orig_i = VNG.vertex_index(c,r); // index of original vertex of grid
+                if (orig_i>=0)
                 {
-                    geometry->addPrimitiveSet(skirtDrawElements.get());
-                    skirtDrawElements = new osg::DrawElementsUShort(GL_QUAD_STRIP);
+                    unsigned int new_i = vertices->size(); // index of new index of added skirt point
+                    osg::Vec3 new_v = (*vertices)[orig_i] - ((*skirtVectors)[orig_i])*skirtHeight;
+                    (*vertices).push_back(new_v);
+                    if (normals.valid()) (*normals).push_back((*normals)[orig_i]);
+                    for(VertexNormalGenerator::LayerToTexCoordMap::iterator itr = layerToTexCoordMap.begin();
+                        itr != layerToTexCoordMap.end();
+                        ++itr)
+                    {
+                        itr->second.first->push_back((*itr->second.first)[orig_i]);
+                    }
+
+                    skirtDrawElements->addElement(orig_i);
+                    skirtDrawElements->addElement(new_i);
+                }
+                else
+                {
+                    if (skirtDrawElements->getNumIndices()!=0)
+                    {
+                        geometry->addPrimitiveSet(skirtDrawElements.get());
+                        skirtDrawElements = new osg::DrawElementsUShort(GL_QUAD_STRIP);
+                    }
                 }
             }
+
+            if (skirtDrawElements->getNumIndices()!=0)
+            {
+                geometry->addPrimitiveSet(skirtDrawElements.get());
+            }
         }
 
-        if (skirtDrawElements->getNumIndices()!=0)
+    }
+
+    if (terrain && terrain->getUseCompactNormals())
+    {
+        osg::Vec3Array* normals = VNG._normals.get();
+        osg::ref_ptr<osg::Vec3bArray> compactNormals = new osg::Vec3bArray;
+        compactNormals->reserve(normals->size());
+        for(osg::Vec3Array::iterator itr = normals->begin();
+            itr != normals->end();
+            ++itr)
         {
-            geometry->addPrimitiveSet(skirtDrawElements.get());
+            compactNormals->push_back(osg::Vec3b(static_cast<signed char>(osg::round(itr->x()*127.0f)),
+                                                 static_cast<signed char>(osg::round(itr->y()*127.0f)),
+                                                 static_cast<signed char>(osg::round(itr->z()*127.0f))));
         }
-    }
 
+        compactNormals->setVertexBufferObject(normals->getVertexBufferObject());
+        geometry->setNormalArray(compactNormals.get());
+    }
 
     geometry->setUseDisplayList(false);
     geometry->setUseVertexBufferObjects(true);
@@ -1496,7 +1846,15 @@ void GeometryTechnique::cleanSceneGraph()
 
 void GeometryTechnique::releaseGLObjects(osg::State* state) const
 {
-    if (_currentBufferData.valid() && _currentBufferData->_transform.valid()) _currentBufferData->_transform->releaseGLObjects(state);
-    if (_newBufferData.valid() && _newBufferData->_transform.valid()) _newBufferData->_transform->releaseGLObjects(state);
+    if (_currentBufferData.valid())
+    {
+        releaseTileGLObjects(_currentBufferData->_transform.get(), _currentBufferData->_geode.get(), _currentBufferData->_geometry.get(),
+                             static_cast<const TileTopology*>(_currentBufferData->_sharedTopology.get()), state);
+    }
+    if (_newBufferData.valid())
+    {
+        releaseTileGLObjects(_newBufferData->_transform.get(), _newBufferData->_geode.get(), _newBufferData->_geometry.get(),
+                             static_cast<const TileTopology*>(_newBufferData->_sharedTopology.get()), state);
+    }
 }
 
@@ -25,7 +25,10 @@ Terrain::Terrain():
     _sampleRatio(1.0),
     _verticalScale(1.0),
     _blendingPolicy(TerrainTile::INHERIT),
-    _equalizeBoundaries(false)
+    _equalizeBoundaries(false),
+    _shareTileTopology(false),
+    _useCompactNormals(false),
+    _initTilesOnLoad(false)
 {
     setNumChildrenRequiringUpdateTraversal(1);
 }
@@ -36,6 +39,9 @@ Terrain::Terrain(const Terrain& ts, const osg::CopyOp& copyop):
     _verticalScale(ts._verticalScale),
     _blendingPolicy(ts._blendingPolicy),
     _equalizeBoundaries(ts._equalizeBoundaries),
+    _shareTileTopology(ts._shareTileTopology),
+    _useCompactNormals(ts._useCompactNormals),
+    _initTilesOnLoad(ts._initTilesOnLoad),
     _terrainTechnique(ts._terrainTechnique)
 {
     setNumChildrenRequiringUpdateTraversal(getNumChildrenRequiringUpdateTraversal()+1);
@@ -78,6 +84,20 @@ void Terrain::setEqualizeBoundaries(bool equalizeBoundaries)
   dirtyRegisteredTiles();
 }
 
+void Terrain::setShareTileTopology(bool shareTileTopology)
+{
+    if (_shareTileTopology == shareTileTopology) return;
+    _shareTileTopology = shareTileTopology;
+    dirtyRegisteredTiles();
+}
+
+void Terrain::setUseCompactNormals(bool useCompactNormals)
+{
+    if (_useCompactNormals == useCompactNormals) return;
+    _useCompactNormals = useCompactNormals;
+    dirtyRegisteredTiles();
+}
+
 void Terrain::setBlendingPolicy(TerrainTile::BlendingPolicy policy)
 {
     if (_blendingPolicy == policy) return;
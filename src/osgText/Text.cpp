@@ -580,7 +580,7 @@ bool Text::computeAverageGlyphWidthAndHeight(float& avg_width, float& avg_height
 }
 
 
-void Text::computePositions(unsigned int contextID) const
+void Text::computeMatrix(osg::Matrix& matrix, const osg::Matrix& modelview, const osg::Matrix& projection, int width, int height) const
 {
     switch(_alignment)
     {
@@ -605,9 +605,6 @@ void Text::computePositions(unsigned int contextID) const
     case RIGHT_BOTTOM_BASE_LINE:  _offset.set(_textBB.xMax(),-_characterHeight*(1.0 + _lineSpacing)*(_lineCount-1),0.0f); break;
     }
 
-    AutoTransformCache& atc = _autoTransformCache[contextID];
-    osg::Matrix& matrix = atc._matrix;
-
     if (_characterSizeMode!=OBJECT_COORDS || _autoRotateToScreen)
     {
 
@@ -616,12 +613,10 @@ void Text::computePositions(unsigned int contextID) const
         osg::Matrix rotate_matrix;
         if (_autoRotateToScreen)
         {
-            osg::Vec3d trans(atc._modelview.getTrans());
-            atc._modelview.setTrans(0.0f,0.0f,0.0f);
-
-            rotate_matrix.invert(atc._modelview);
+            osg::Matrix rotation(modelview);
+            rotation.setTrans(0.0f,0.0f,0.0f);
 
-            atc._modelview.setTrans(trans);
+            rotate_matrix.invert(rotation);
         }
 
         matrix.postMultRotate(_rotation);
@@ -631,8 +626,8 @@ void Text::computePositions(unsigned int contextID) const
 
             osg::Matrix M(rotate_matrix);
             M.postMultTranslate(_position);
-            M.postMult(atc._modelview);
-            osg::Matrix& P = atc._projection;
+            M.postMult(modelview);
+            const osg::Matrix& P = projection;
 
             // compute the pixel size vector.
 
@@ -642,15 +637,15 @@ void Text::computePositions(unsigned int contextID) const
             // Robert Osfield, June 2002.
 
             // scaling for horizontal pixels
-            float P00 = P(0,0)*atc._width*0.5f;
-            float P20_00 = P(2,0)*atc._width*0.5f + P(2,3)*atc._width*0.5f;
+            float P00 = P(0,0)*width*0.5f;
+            float P20_00 = P(2,0)*width*0.5f + P(2,3)*width*0.5f;
             osg::Vec3 scale_00(M(0,0)*P00 + M(0,2)*P20_00,
                                M(1,0)*P00 + M(1,2)*P20_00,
                                M(2,0)*P00 + M(2,2)*P20_00);
 
             // scaling for vertical pixels
-            float P10 = P(1,1)*atc._height*0.5f;
-            float P20_10 = P(2,1)*atc._height*0.5f + P(2,3)*atc._height*0.5f;
+            float P10 = P(1,1)*height*0.5f;
+            float P20_10 = P(2,1)*height*0.5f + P(2,3)*height*0.5f;
             osg::Vec3 scale_10(M(0,1)*P10 + M(0,2)*P20_10,
                                M(1,1)*P10 + M(1,2)*P20_10,
                                M(2,1)*P10 + M(2,2)*P20_10);
@@ -703,6 +698,14 @@ void Text::computePositions(unsigned int contextID) const
     {
         matrix.makeTranslate(_position-_offset);
     }
+}
+
+void Text::computePositions(unsigned int contextID) const
+{
+    AutoTransformCache& atc = _autoTransformCache[contextID];
+    osg::Matrix& matrix = atc._matrix;
+
+    computeMatrix(matrix, atc._modelview, atc._projection, atc._width, atc._height);
 
     // now apply matrix to the glyphs.
     for(TextureGlyphQuadMap::iterator titr=_textureGlyphQuadMap.begin();
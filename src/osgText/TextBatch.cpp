@@ -0,0 +1,496 @@
+/* -*-c++-*- OpenSceneGraph - Copyright (C) 1998-2006 Robert Osfield
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+*/
+
+#include <osgText/TextBatch>
+
+#include <osg/GL>
+#include <osg/Notify>
+#include <osg/TexEnv>
+#include <OpenThreads/ScopedLock>
+
+using namespace osgText;
+
+TextBatch::TextBatch():
+    _dirty(false),
+    _numViewDependentLabels(0),
+    _revision(1)
+{
+    setStateSet(Font::getDefaultFont()->getStateSet());
+    setUseDisplayList(false);
+    setSupportsDisplayList(false);
+    setUpdateCallback(new TextBatchUpdateCallback);
+}
+
+TextBatch::TextBatch(const TextBatch& batch,const osg::CopyOp& copyop):
+    osg::Drawable(batch,copyop),
+    _dirty(false),
+    _numViewDependentLabels(0),
+    _revision(1)
+{
+    for(Labels::const_iterator itr = batch._labels.begin();
+        itr != batch._labels.end();
+        ++itr)
+    {
+        Text* text = itr->_text.get();
+        if (text && (copyop.getCopyFlags() & osg::CopyOp::DEEP_COPY_DRAWABLES))
+        {
+            text = osg::clone(text, copyop);
+        }
+        addText(text);
+    }
+}
+
+TextBatch::~TextBatch()
+{
+}
+
+unsigned int TextBatch::addText(Text* text)
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+    unsigned int i;
+    if (!_freeSlots.empty())
+    {
+        i = _freeSlots.back();
+        _freeSlots.pop_back();
+    }
+    else
+    {
+        i = static_cast<unsigned int>(_labels.size());
+        _labels.push_back(Label());
+    }
+
+    setTextImplementation(i, text);
+    return i;
+}
+
+void TextBatch::setText(unsigned int i, Text* text)
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+    setTextImplementation(i, text);
+}
+
+void TextBatch::setTextImplementation(unsigned int i, Text* text)
+{
+    if (i>=_labels.size()) return;
+
+    _labels[i]._text = text;
+    dirtyTextImplementation(i);
+}
+
+void TextBatch::removeText(unsigned int i)
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+    if (i>=_labels.size() || !_labels[i]._text) return;
+
+    setTextImplementation(i, 0);
+    _freeSlots.push_back(i);
+}
+
+void TextBatch::removeAllTexts()
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+    _labels.clear();
+    _freeSlots.clear();
+    _textureGlyphBatchMap.clear();
+    _numViewDependentLabels = 0;
+    _dirty = false;
+    _glyphBound.init();
+    ++_revision;
+
+    dirtyBound();
+}
+
+void TextBatch::dirtyText(unsigned int i)
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+    dirtyTextImplementation(i);
+}
+
+void TextBatch::dirtyTextImplementation(unsigned int i)
+{
+    if (i>=_labels.size()) return;
+
+    _labels[i]._dirty = true;
+    _dirty = true;
+}
+
+void TextBatch::dirtyAllTexts()
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+    for(unsigned int i=0; i<_labels.size(); ++i)
+    {
+        dirtyTextImplementation(i);
+    }
+}
+
+void TextBatch::update()
+{
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+        if (!_dirty) return;
+
+        for(unsigned int i=0; i<_labels.size(); ++i)
+        {
+            if (_labels[i]._dirty) updateLabel(i);
+        }
+
+        TextureGlyphBatchMap::iterator titr = _textureGlyphBatchMap.begin();
+        while(titr != _textureGlyphBatchMap.end())
+        {
+            GlyphBatch& glyphBatch = titr->second;
+            if (glyphBatch._needsRepack) repack(titr->first.get(), glyphBatch);
+
+            if (glyphBatch._coords.empty())
+            {
+                _textureGlyphBatchMap.erase(titr++);
+            }
+            else
+            {
+                ++titr;
+            }
+        }
+
+        computeObjectCoords();
+
+        _dirty = false;
+        ++_revision;
+    }
+
+    dirtyBound();
+}
+
+void TextBatch::updateLabel(unsigned int i)
+{
+    Label& label = _labels[i];
+    label._dirty = false;
+
+    if (label._viewDependent) --_numViewDependentLabels;
+    label._viewDependent = false;
+
+    const Text* text = label._text.get();
+    const Text::TextureGlyphQuadMap* glyphQuadMap = text ? &(text->getTextureGlyphQuadMap()) : 0;
+
+    // glyph textures no longer used by the label need their range removing.
+    for(TextureGlyphBatchMap::iterator titr = _textureGlyphBatchMap.begin();
+        titr != _textureGlyphBatchMap.end();
+        ++titr)
+    {
+        GlyphBatch& glyphBatch = titr->second;
+        if (i<glyphBatch._ranges.size() && glyphBatch._ranges[i]._count>0)
+        {
+            if (!glyphQuadMap || glyphQuadMap->find(titr->first)==glyphQuadMap->end())
+            {
+                glyphBatch._needsRepack = true;
+            }
+        }
+    }
+
+    if (!text) return;
+
+    label._viewDependent = text->getCharacterSizeMode()!=TextBase::OBJECT_COORDS || text->getAutoRotateToScreen();
+    if (label._viewDependent) ++_numViewDependentLabels;
+
+    // placement of the label without a view, exact for labels that don't depend on the view.
+    text->computeMatrix(label._matrix, osg::Matrix::identity(), osg::Matrix::identity(), 2, 2);
+
+    const osg::Vec4& color = text->getColor();
+
+    for(Text::TextureGlyphQuadMap::const_iterator gitr = glyphQuadMap->begin();
+        gitr != glyphQuadMap->end();
+        ++gitr)
+    {
+        const Text::GlyphQuads& glyphquad = gitr->second;
+
+        GlyphBatch& glyphBatch = _textureGlyphBatchMap[gitr->first];
+        if (!glyphBatch._font && !glyphquad._glyphs.empty()) glyphBatch._font = glyphquad._glyphs.front()->getFont();
+
+        if (glyphBatch._ranges.size()<_labels.size()) glyphBatch._ranges.resize(_labels.size());
+
+        LabelRange& range = glyphBatch._ranges[i];
+        unsigned int count = static_cast<unsigned int>(glyphquad._coords.size());
+        if (glyphBatch._needsRepack || count!=range._count)
+        {
+            // size of label has changed so the shared arrays need to be repacked.
+            glyphBatch._needsRepack = true;
+            continue;
+        }
+
+        // same number of vertices as before so just update them in place.
+        for(unsigned int v=0; v<count; ++v)
+        {
+            glyphBatch._coords[range._first+v] = glyphquad._coords[v];
+            glyphBatch._texcoords[range._first+v] = glyphquad._texcoords[v];
+            glyphBatch._colorCoords[range._first+v] = color;
+        }
+    }
+}
+
+void TextBatch::repack(GlyphTexture* texture, GlyphBatch& glyphBatch)
+{
+    glyphBatch._needsRepack = false;
+    glyphBatch._ranges.clear();
+    glyphBatch._ranges.resize(_labels.size());
+    glyphBatch._labelIndices.clear();
+    glyphBatch._coords.clear();
+    glyphBatch._texcoords.clear();
+    glyphBatch._colorCoords.clear();
+
+    for(unsigned int i=0; i<_labels.size(); ++i)
+    {
+        const Text* text = _labels[i]._text.get();
+        if (!text) continue;
+
+        const Text::GlyphQuads* glyphquad = text->getGlyphQuads(texture);
+        if (!glyphquad) continue;
+
+        LabelRange& range = glyphBatch._ranges[i];
+        range._first = static_cast<unsigned int>(glyphBatch._coords.size());
+        range._count = static_cast<unsigned int>(glyphquad->_coords.size());
+
+        glyphBatch._coords.insert(glyphBatch._coords.end(), glyphquad->_coords.begin(), glyphquad->_coords.end());
+        glyphBatch._texcoords.insert(glyphBatch._texcoords.end(), glyphquad->_texcoords.begin(), glyphquad->_texcoords.end());
+        glyphBatch._colorCoords.insert(glyphBatch._colorCoords.end(), range._count, text->getColor());
+        glyphBatch._labelIndices.insert(glyphBatch._labelIndices.end(), range._count, i);
+    }
+}
+
+void TextBatch::computeObjectCoords()
+{
+    unsigned int numLabels = static_cast<unsigned int>(_labels.size());
+    std::vector<float> radii(numLabels, 0.0f);
+
+    _glyphBound.init();
+
+    for(TextureGlyphBatchMap::iterator titr = _textureGlyphBatchMap.begin();
+        titr != _textureGlyphBatchMap.end();
+        ++titr)
+    {
+        GlyphBatch& glyphBatch = titr->second;
+        const Text::GlyphQuads::Coords2& coords2 = glyphBatch._coords;
+        Text::GlyphQuads::Coords3& objectCoords = glyphBatch._objectCoords;
+
+        unsigned int numCoords = static_cast<unsigned int>(coords2.size());
+        objectCoords.resize(numCoords);
+
+        for(unsigned int v=0; v<numCoords; ++v)
+        {
+            unsigned int i = glyphBatch._labelIndices[v];
+            const Label& label = _labels[i];
+            objectCoords[v] = osg::Vec3(coords2[v].x(),coords2[v].y(),0.0f)*label._matrix;
+
+            if (label._viewDependent)
+            {
+                float radius = (objectCoords[v]-label._text->getPosition()).length();
+                if (radius>radii[i]) radii[i] = radius;
+            }
+            else
+            {
+                _glyphBound.expandBy(objectCoords[v]);
+            }
+        }
+    }
+
+    // labels that rotate or scale with the view can take any orientation about their position.
+    for(unsigned int i=0; i<numLabels; ++i)
+    {
+        if (_labels[i]._viewDependent && _labels[i]._text.valid())
+        {
+            _glyphBound.expandBy(osg::BoundingSphere(_labels[i]._text->getPosition(), radii[i]));
+        }
+    }
+}
+
+bool TextBatch::computePositions(ContextCache& cache, bool viewChanged, unsigned int contextID) const
+{
+    unsigned int numLabels = static_cast<unsigned int>(_labels.size());
+    bool recomputeAll = cache._revision!=_revision || cache._matrices.size()!=numLabels;
+
+    if (!recomputeAll && !(viewChanged && _numViewDependentLabels>0)) return false;
+
+    cache._matrices.resize(numLabels);
+    for(unsigned int i=0; i<numLabels; ++i)
+    {
+        const Label& label = _labels[i];
+        if (label._text.valid() && label._viewDependent)
+        {
+            label._text->computeMatrix(cache._matrices[i], cache._modelview, cache._projection, cache._width, cache._height);
+        }
+    }
+
+    for(TextureGlyphBatchMap::const_iterator titr = _textureGlyphBatchMap.begin();
+        titr != _textureGlyphBatchMap.end();
+        ++titr)
+    {
+        const GlyphBatch& glyphBatch = titr->second;
+        const Text::GlyphQuads::Coords2& coords2 = glyphBatch._coords;
+        Text::GlyphQuads::Coords3& transformedCoords = glyphBatch._transformedCoords[contextID];
+
+        if (recomputeAll) transformedCoords = glyphBatch._objectCoords;
+
+        unsigned int numCoords = static_cast<unsigned int>(coords2.size());
+        for(unsigned int v=0; v<numCoords; ++v)
+        {
+            unsigned int i = glyphBatch._labelIndices[v];
+            if (_labels[i]._viewDependent)
+            {
+                transformedCoords[v] = osg::Vec3(coords2[v].x(),coords2[v].y(),0.0f)*cache._matrices[i];
+            }
+        }
+    }
+
+    cache._revision = _revision;
+
+    return true;
+}
+
+void TextBatch::drawImplementation(osg::RenderInfo& renderInfo) const
+{
+    osg::State& state = *renderInfo.getState();
+    unsigned int contextID = state.getContextID();
+
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+    if (_textureGlyphBatchMap.empty()) return;
+
+    ContextCache& cache = _contextCache[contextID];
+
+    unsigned int frameNumber = state.getFrameStamp()?state.getFrameStamp()->getFrameNumber():0;
+    const osg::Matrix& modelview = state.getModelViewMatrix();
+    const osg::Matrix& projection = state.getProjectionMatrix();
+
+    int width = cache._width;
+    int height = cache._height;
+
+    const osg::Viewport* viewport = state.getCurrentViewport();
+    if (viewport)
+    {
+        width = static_cast<int>(viewport->width());
+        height = static_cast<int>(viewport->height());
+    }
+
+    bool viewChanged = cache._traversalNumber==-1 ||
+                       cache._modelview!=modelview ||
+                       cache._projection!=projection ||
+                       width!=cache._width ||
+                       height!=cache._height;
+
+    cache._traversalNumber = frameNumber;
+    cache._width = width;
+    cache._height = height;
+    cache._modelview = modelview;
+    cache._projection = projection;
+
+    computePositions(cache, viewChanged, contextID);
+
+    state.applyMode(GL_BLEND,true);
+#if defined(OSG_GL_FIXED_FUNCTION_AVAILABLE)
+    state.applyTextureMode(0,GL_TEXTURE_2D,osg::StateAttribute::ON);
+#endif
+
+    state.Normal(0.0f,0.0f,1.0f);
+
+    for(TextureGlyphBatchMap::const_iterator titr = _textureGlyphBatchMap.begin();
+        titr != _textureGlyphBatchMap.end();
+        ++titr)
+    {
+        const GlyphBatch& glyphBatch = titr->second;
+        const Text::GlyphQuads::Coords3& transformedCoords = glyphBatch._transformedCoords[contextID];
+        if (transformedCoords.empty()) continue;
+
+#if defined(OSG_GL_FIXED_FUNCTION_AVAILABLE)
+        if (glyphBatch._font.valid()) state.applyTextureAttribute(0,glyphBatch._font->getTexEnv());
+#endif
+        state.applyTextureAttribute(0,titr->first.get());
+
+        state.setVertexPointer( 3, GL_FLOAT, 0, &(transformedCoords.front()));
+        state.setTexCoordPointer( 0, 2, GL_FLOAT, 0, &(glyphBatch._texcoords.front()));
+        state.setColorPointer( 4, GL_FLOAT, 0, &(glyphBatch._colorCoords.front()));
+
+        state.drawQuads(0,transformedCoords.size());
+    }
+
+    state.disableColorPointer();
+}
+
+osg::BoundingBox TextBatch::computeBound() const
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+    return _glyphBound;
+}
+
+void TextBatch::accept(osg::Drawable::ConstAttributeFunctor& af) const
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+    for(TextureGlyphBatchMap::const_iterator titr = _textureGlyphBatchMap.begin();
+        titr != _textureGlyphBatchMap.end();
+        ++titr)
+    {
+        const GlyphBatch& glyphBatch = titr->second;
+        if (glyphBatch._objectCoords.empty()) continue;
+
+        af.apply(osg::Drawable::VERTICES,glyphBatch._objectCoords.size(),&(glyphBatch._objectCoords.front()));
+        af.apply(osg::Drawable::TEXTURE_COORDS_0,glyphBatch._texcoords.size(),&(glyphBatch._texcoords.front()));
+    }
+}
+
+void TextBatch::accept(osg::PrimitiveFunctor& pf) const
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+    for(TextureGlyphBatchMap::const_iterator titr = _textureGlyphBatchMap.begin();
+        titr != _textureGlyphBatchMap.end();
+        ++titr)
+    {
+        const GlyphBatch& glyphBatch = titr->second;
+        if (glyphBatch._objectCoords.empty()) continue;
+
+        pf.setVertexArray(glyphBatch._objectCoords.size(),&(glyphBatch._objectCoords.front()));
+        pf.drawArrays(GL_QUADS,0,glyphBatch._objectCoords.size());
+    }
+}
+
+void TextBatch::resizeGLObjectBuffers(unsigned int maxSize)
+{
+    osg::Drawable::resizeGLObjectBuffers(maxSize);
+
+    for(TextureGlyphBatchMap::iterator titr = _textureGlyphBatchMap.begin();
+        titr != _textureGlyphBatchMap.end();
+        ++titr)
+    {
+        titr->second._transformedCoords.resize(maxSize);
+        if (titr->second._font.valid()) titr->second._font->resizeGLObjectBuffers(maxSize);
+    }
+
+    _contextCache.resize(maxSize);
+}
+
+void TextBatch::releaseGLObjects(osg::State* state) const
+{
+    osg::Drawable::releaseGLObjects(state);
+
+    for(TextureGlyphBatchMap::const_iterator titr = _textureGlyphBatchMap.begin();
+        titr != _textureGlyphBatchMap.end();
+        ++titr)
+    {
+        if (titr->second._font.valid()) titr->second._font->releaseGLObjects(state);
+    }
+}
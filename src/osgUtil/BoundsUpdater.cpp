@@ -0,0 +1,203 @@
+/* -*-c++-*- OpenSceneGraph - Copyright (C) 1998-2006 Robert Osfield
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+*/
+
+#include <osgUtil/BoundsUpdater>
+
+#include <osg/Geode>
+#include <osg/Group>
+#include <osg/Notify>
+
+#include <OpenThreads/Thread>
+
+#include <algorithm>
+
+using namespace osgUtil;
+
+namespace
+{
+
+// computes the bounds of a contiguous range of the nodes, or drawables, of a level
+template<class T>
+class ComputeBoundsThread : public OpenThreads::Thread
+{
+    public:
+
+        ComputeBoundsThread():
+            _objects(0),
+            _begin(0),
+            _end(0),
+            _updateBoundingBoxes(false) {}
+
+        void set(const std::vector<const T*>& objects, unsigned int begin, unsigned int end, bool updateBoundingBoxes)
+        {
+            _objects = &objects;
+            _begin = begin;
+            _end = end;
+            _updateBoundingBoxes = updateBoundingBoxes;
+        }
+
+        virtual void run() { compute(*_objects, _begin, _end, _updateBoundingBoxes); }
+
+        static void compute(const std::vector<const T*>& objects, unsigned int begin, unsigned int end, bool updateBoundingBoxes);
+
+    protected:
+
+        const std::vector<const T*>*    _objects;
+        unsigned int                    _begin;
+        unsigned int                    _end;
+        bool                            _updateBoundingBoxes;
+};
+
+template<>
+void ComputeBoundsThread<osg::Node>::compute(const std::vector<const osg::Node*>& nodes, unsigned int begin, unsigned int end, bool updateBoundingBoxes)
+{
+    for(unsigned int i=begin; i<end; ++i)
+    {
+        nodes[i]->getBound();
+        if (updateBoundingBoxes) nodes[i]->getAxisAlignedBound();
+    }
+}
+
+template<>
+void ComputeBoundsThread<osg::Drawable>::compute(const std::vector<const osg::Drawable*>& drawables, unsigned int begin, unsigned int end, bool)
+{
+    for(unsigned int i=begin; i<end; ++i)
+    {
+        drawables[i]->getBound();
+    }
+}
+
+template<class T>
+void computeBounds(const std::vector<const T*>& objects, unsigned int maximumNumThreads, unsigned int minimumPerThread, bool updateBoundingBoxes)
+{
+    unsigned int numThreads = osg::minimum(maximumNumThreads, static_cast<unsigned int>(objects.size())/osg::maximum(minimumPerThread, 1u));
+    if (numThreads<=1)
+    {
+        ComputeBoundsThread<T>::compute(objects, 0, objects.size(), updateBoundingBoxes);
+        return;
+    }
+
+    std::vector<ComputeBoundsThread<T>*> threads;
+    for(unsigned int i=1; i<numThreads; ++i)
+    {
+        unsigned int begin = (objects.size()*i)/numThreads;
+        unsigned int end = (objects.size()*(i+1))/numThreads;
+        ComputeBoundsThread<T>* thread = new ComputeBoundsThread<T>;
+        thread->set(objects, begin, end, updateBoundingBoxes);
+        if (thread->startThread()==0) threads.push_back(thread);
+        else
+        {
+            thread->run();
+            delete thread;
+        }
+    }
+
+    ComputeBoundsThread<T>::compute(objects, 0, objects.size()/numThreads, updateBoundingBoxes);
+
+    for(unsigned int i=0; i<threads.size(); ++i)
+    {
+        threads[i]->join();
+        delete threads[i];
+    }
+}
+
+}
+
+BoundsUpdater::BoundsUpdater():
+    _updateBoundingBoxes(false),
+    _maximumNumThreads(0),
+    _minimumNumNodesPerThread(512),
+    _numNodesUpdated(0),
+    _numLevelsUpdated(0)
+{
+}
+
+bool BoundsUpdater::isDirty(const osg::Node& node) const
+{
+    return node.isBoundDirty() || (_updateBoundingBoxes && node.isAxisAlignedBoundDirty());
+}
+
+unsigned int BoundsUpdater::collect(const osg::Node& node)
+{
+    // a node with several parents is reached once for each of them, so look up whether it's already been placed
+    if (node.getNumParents()>1)
+    {
+        LevelMap::iterator itr = _levelMap.find(&node);
+        if (itr!=_levelMap.end()) return itr->second;
+    }
+
+    unsigned int level = 0;
+    if (const osg::Group* group = node.asGroup())
+    {
+        for(unsigned int i=0; i<group->getNumChildren(); ++i)
+        {
+            const osg::Node* child = group->getChild(i);
+            if (isDirty(*child)) level = osg::maximum(level, collect(*child)+1);
+        }
+    }
+    else if (const osg::Geode* geode = node.asGeode())
+    {
+        for(unsigned int i=0; i<geode->getNumDrawables(); ++i)
+        {
+            _drawables.push_back(geode->getDrawable(i));
+        }
+    }
+
+    if (level>=_levels.size()) _levels.resize(level+1);
+    _levels[level].push_back(&node);
+
+    if (node.getNumParents()>1) _levelMap[&node] = level;
+
+    return level;
+}
+
+void BoundsUpdater::update(const osg::Node& node)
+{
+    _numNodesUpdated = 0;
+    _numLevelsUpdated = 0;
+
+    if (!isDirty(node)) return;
+
+    for(Levels::iterator itr = _levels.begin();
+        itr != _levels.end();
+        ++itr)
+    {
+        itr->clear();
+    }
+    _drawables.clear();
+    _levelMap.clear();
+
+    collect(node);
+
+    unsigned int maximumNumThreads = _maximumNumThreads;
+    if (maximumNumThreads==0) maximumNumThreads = osg::maximum(OpenThreads::GetNumberOfProcessors(), 1);
+
+    // drawables may be shared between geodes, so remove the duplicates before computing them concurrently
+    if (!_drawables.empty())
+    {
+        std::sort(_drawables.begin(), _drawables.end());
+        _drawables.erase(std::unique(_drawables.begin(), _drawables.end()), _drawables.end());
+        computeBounds(_drawables, maximumNumThreads, _minimumNumNodesPerThread, false);
+    }
+
+    for(Levels::iterator itr = _levels.begin();
+        itr != _levels.end() && !itr->empty();
+        ++itr)
+    {
+        computeBounds(*itr, maximumNumThreads, _minimumNumNodesPerThread, _updateBoundingBoxes);
+        _numNodesUpdated += itr->size();
+        ++_numLevelsUpdated;
+    }
+
+    OSG_DEBUG<<"BoundsUpdater::update() computed "<<_numNodesUpdated<<" nodes in "<<_numLevelsUpdated<<" levels and "<<_drawables.size()<<" drawables"<<std::endl;
+}
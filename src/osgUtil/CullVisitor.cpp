@@ -1700,10 +1700,15 @@ void CullVisitor::apply(osg::OccluderNode& node)
     StateSet* node_state = node.getStateSet();
     if (node_state) pushStateSet(node_state);
 
-
+    // the occluder geometry approximates the children, so they mustn't be culled against it.
+    osg::OcclusionBuffer* occlusionBuffer = getOcclusionBuffer();
+    bool suspendOcclusionBuffer = occlusionBuffer && occlusionBuffer->getActive();
+    if (suspendOcclusionBuffer) occlusionBuffer->setActive(false);
 
     handle_cull_callbacks_and_traverse(node);
 
+    if (suspendOcclusionBuffer) occlusionBuffer->setActive(true);
+
     // pop the node's state off the render graph stack.
     if (node_state) popStateSet();
 
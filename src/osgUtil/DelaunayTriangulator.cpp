@@ -19,6 +19,10 @@
 #include <osg/Vec3>
 #include <osg/Array>
 #include <osg/Notify>
+#include <osg/Vec2d>
+#include <osg/BoundingBox>
+
+#include <OpenThreads/Thread>
 
 #include <algorithm>
 #include <set>
@@ -26,6 +30,7 @@
 #include <osgUtil/Tessellator> // tessellator triangulates the constrained triangles
 #include <stdlib.h>
 #include <iterator>
+#include <float.h>
 
 namespace osgUtil
 {
@@ -385,20 +390,31 @@ bool Sample_point_compare(const osg::Vec3 &p1, const osg::Vec3 &p2)
     return p1.z() < p2.z(); // never get here unless 2 points coincide
 }
 
+// comparison function for finding a sample point by its X and Y coordinates
+bool Sample_point_xy_compare(const osg::Vec3 &p1, const osg::Vec3 &p2)
+{
+    if (p1.x() != p2.x()) return p1.x() < p2.x();
+    return p1.y() < p2.y();
+}
+
 
 // container types
 typedef std::set<Edge, Edge::Less> Edge_set;
 
 
 DelaunayTriangulator::DelaunayTriangulator():
-    osg::Referenced()
+    osg::Referenced(),
+    engine_(LIST_ENGINE),
+    num_regions_(1)
 {
 }
 
 DelaunayTriangulator::DelaunayTriangulator(osg::Vec3Array *points, osg::Vec3Array *normals):
     osg::Referenced(),
     points_(points),
-    normals_(normals)
+    normals_(normals),
+    engine_(LIST_ENGINE),
+    num_regions_(1)
 {
 }
 
@@ -406,7 +422,9 @@ DelaunayTriangulator::DelaunayTriangulator(const DelaunayTriangulator &copy, con
     osg::Referenced(copy),
     points_(static_cast<osg::Vec3Array *>(copyop(copy.points_.get()))),
     normals_(static_cast<osg::Vec3Array *>(copyop(copy.normals_.get()))),
-    prim_tris_(static_cast<osg::DrawElementsUInt *>(copyop(copy.prim_tris_.get())))
+    prim_tris_(static_cast<osg::DrawElementsUInt *>(copyop(copy.prim_tris_.get()))),
+    engine_(copy.engine_),
+    num_regions_(copy.num_regions_)
 {
 }
 
@@ -769,6 +787,1162 @@ osgUtil::DelaunayConstraint *getconvexhull(osg::Vec3Array *points)
     return dcconvexhull.release();
 }
 
+//////////////////////////////////////////////////////////////////////////////////////
+// ARRAY ENGINE
+//
+// DelaunayMesh keeps the triangles and their adjacency in flat arrays and inserts points with the
+// Bowyer-Watson algorithm, locating each point by walking from the last triangle created and only
+// visiting the triangles whose circumcircle contains the point. Points are inserted in a biased
+// randomized order of rounds, each sorted along a Hilbert curve, so that the walks stay short.
+
+static const GLuint INVALID_VERTEX = 0xffffffff;
+
+// orientation of c relative to the directed line a-b, positive if c lies to the left.
+inline double orient2d(const osg::Vec2d& a, const osg::Vec2d& b, const osg::Vec2d& c)
+{
+    return (b.x()-a.x())*(c.y()-a.y()) - (b.y()-a.y())*(c.x()-a.x());
+}
+
+// positive if d lies inside the circumcircle of the counter clockwise triangle a, b, c.
+inline double incircle2d(const osg::Vec2d& a, const osg::Vec2d& b, const osg::Vec2d& c, const osg::Vec2d& d)
+{
+    double adx = a.x()-d.x(), ady = a.y()-d.y();
+    double bdx = b.x()-d.x(), bdy = b.y()-d.y();
+    double cdx = c.x()-d.x(), cdy = c.y()-d.y();
+    double ad = adx*adx + ady*ady;
+    double bd = bdx*bdx + bdy*bdy;
+    double cd = cdx*cdx + cdy*cdy;
+    return adx*(bdy*cd - bd*cdy) - ady*(bdx*cd - bd*cdx) + ad*(bdx*cdy - bdy*cdx);
+}
+
+// index along a Hilbert curve of order 16 of the cell x, y.
+inline unsigned int hilbert_index(unsigned int x, unsigned int y)
+{
+    unsigned int d = 0;
+    for (unsigned int s=1u<<15; s>0; s>>=1)
+    {
+        unsigned int rx = (x & s) ? 1 : 0;
+        unsigned int ry = (y & s) ? 1 : 0;
+        d += s * s * ((3 * rx) ^ ry);
+        if (ry == 0)
+        {
+            if (rx == 1)
+            {
+                x = s-1 - x;
+                y = s-1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+class DelaunayMesh
+{
+public:
+
+    struct Tri
+    {
+        GLuint  v[3];   // counter clockwise vertices, v[0]==INVALID_VERTEX for a deleted triangle
+        GLint   n[3];   // neighbour across the edge opposite v[i], -1 on the boundary
+    };
+
+    typedef std::vector<Tri> Tris;
+
+    DelaunayMesh(const osg::Vec3Array* points, const osg::Vec2d& origin):
+        _points(points),
+        _numPoints(points->size()),
+        _origin(origin),
+        _stamp(0),
+        _lastTri(-1),
+        _numSkipped(0) {}
+
+    inline osg::Vec2d coord(GLuint i) const
+    {
+        if (i>=_numPoints) return _super[i-_numPoints];
+        const osg::Vec3& p = (*_points)[i];
+        return osg::Vec2d(double(p.x())-_origin.x(), double(p.y())-_origin.y());
+    }
+
+    inline bool isAlive(GLint t) const { return _tris[t].v[0]!=INVALID_VERTEX; }
+
+    inline double orient(const Tri& tri) const { return orient2d(coord(tri.v[0]), coord(tri.v[1]), coord(tri.v[2])); }
+
+    /** Triangulate the points with the specified indices, removing the super triangle and filling
+      * any concavities left along the convex hull.*/
+    bool triangulate(const std::vector<GLuint>& indices);
+
+    /** Insert the edge between two vertices of the triangulation, retriangulating the triangles it crosses.
+      * Requires buildVertexTriangles() to have been called.*/
+    bool insertConstraint(GLuint p1, GLuint p2);
+
+    /** Find the triangle with the directed edge a-b, returning -1 if there is none.*/
+    GLint findEdge(GLuint a, GLuint b, int& edge) const;
+
+    void buildVertexTriangles();
+
+    /** Compute the x extent of the circumcircle of a triangle.*/
+    void computeCircumcircleExtent(const Tri& tri, double& minx, double& maxx) const;
+
+    GLint allocTri();
+    void deleteTri(GLint t);
+
+    bool isHullFill(GLint t) const { return _hullFill[t]!=0; }
+
+    unsigned int getNumSkipped() const { return _numSkipped; }
+
+    Tris _tris;
+
+protected:
+
+    struct BoundaryEdge
+    {
+        GLuint a, b;
+        GLint outer;
+    };
+
+    GLint locate(const osg::Vec2d& p);
+    bool insertPoint(GLuint pi);
+    void fillHull();
+    void link(GLint t, GLuint a, GLuint b, GLint neighbour);
+    void triangulatePseudoPolygon(GLuint a, GLuint b, const GLuint* chain, unsigned int size, std::vector<Tri>& tris) const;
+
+    const osg::Vec3Array*       _points;
+    GLuint                      _numPoints;
+    osg::Vec2d                  _origin;
+    osg::Vec2d                  _super[3];
+
+    std::vector<GLint>          _free;
+    std::vector<unsigned int>   _marks;
+    std::vector<unsigned char>  _hullFill;
+    std::vector<GLint>          _vertexTriangles;
+    unsigned int                _stamp;
+    GLint                       _lastTri;
+    unsigned int                _numSkipped;
+
+    std::vector<GLint>          _cavity;
+    std::vector<GLint>          _stack;
+    std::vector<BoundaryEdge>   _boundary;
+    std::vector< std::pair<GLuint, GLint> > _fan;
+};
+
+GLint DelaunayMesh::allocTri()
+{
+    if (!_free.empty())
+    {
+        GLint t = _free.back();
+        _free.pop_back();
+        _hullFill[t] = 0;
+        return t;
+    }
+
+    _tris.push_back(Tri());
+    _marks.push_back(0);
+    _hullFill.push_back(0);
+    return _tris.size()-1;
+}
+
+void DelaunayMesh::deleteTri(GLint t)
+{
+    Tri& tri = _tris[t];
+    for (int e=0; e<3; ++e)
+    {
+        GLint nt = tri.n[e];
+        if (nt<0) continue;
+        for (int k=0; k<3; ++k)
+        {
+            if (_tris[nt].n[k]==t) _tris[nt].n[k] = -1;
+        }
+    }
+    tri.v[0] = tri.v[1] = tri.v[2] = INVALID_VERTEX;
+    tri.n[0] = tri.n[1] = tri.n[2] = -1;
+    _free.push_back(t);
+}
+
+void DelaunayMesh::link(GLint t, GLuint a, GLuint b, GLint neighbour)
+{
+    // set the neighbour of t across its directed edge a-b
+    Tri& tri = _tris[t];
+    for (int k=0; k<3; ++k)
+    {
+        if (tri.v[(k+1)%3]==a && tri.v[(k+2)%3]==b)
+        {
+            tri.n[k] = neighbour;
+            return;
+        }
+    }
+}
+
+GLint DelaunayMesh::locate(const osg::Vec2d& p)
+{
+    GLint t = _lastTri;
+    if (t<0 || !isAlive(t))
+    {
+        for (t=0; t<(GLint)_tris.size() && !isAlive(t); ++t) {}
+        if (t==(GLint)_tris.size()) return -1;
+    }
+
+    // visibility walk, rotating the first edge tested to avoid cycling on near degenerate triangles.
+    unsigned int maxSteps = _tris.size()+16;
+    for (unsigned int step=0; step<maxSteps; ++step)
+    {
+        const Tri& tri = _tris[t];
+        bool moved = false;
+        for (int k=0; k<3; ++k)
+        {
+            int e = (k+step)%3;
+            if (orient2d(coord(tri.v[(e+1)%3]), coord(tri.v[(e+2)%3]), p)<0.0)
+            {
+                if (tri.n[e]<0) return -1;
+                t = tri.n[e];
+                moved = true;
+                break;
+            }
+        }
+        if (!moved) return t;
+    }
+
+    // fall back to testing every triangle
+    for (t=0; t<(GLint)_tris.size(); ++t)
+    {
+        if (!isAlive(t)) continue;
+        const Tri& tri = _tris[t];
+        if (orient2d(coord(tri.v[0]), coord(tri.v[1]), p)>=0.0 &&
+            orient2d(coord(tri.v[1]), coord(tri.v[2]), p)>=0.0 &&
+            orient2d(coord(tri.v[2]), coord(tri.v[0]), p)>=0.0) return t;
+    }
+    return -1;
+}
+
+bool DelaunayMesh::insertPoint(GLuint pi)
+{
+    osg::Vec2d p = coord(pi);
+
+    GLint t0 = locate(p);
+    if (t0<0)
+    {
+        ++_numSkipped;
+        return false;
+    }
+
+    // collect the cavity of triangles whose circumcircle contains the point, along with any triangle beyond an edge
+    // the point lies on or outside of, so that the cavity is star shaped from the point.
+    ++_stamp;
+    _cavity.clear();
+    _stack.clear();
+    _marks[t0] = _stamp;
+    _stack.push_back(t0);
+    while (!_stack.empty())
+    {
+        GLint t = _stack.back();
+        _stack.pop_back();
+        _cavity.push_back(t);
+
+        const Tri& tri = _tris[t];
+        for (int e=0; e<3; ++e)
+        {
+            GLint nt = tri.n[e];
+            if (nt<0 || _marks[nt]==_stamp) continue;
+
+            const Tri& ntri = _tris[nt];
+            if (incircle2d(coord(ntri.v[0]), coord(ntri.v[1]), coord(ntri.v[2]), p)>0.0 ||
+                orient2d(coord(tri.v[(e+1)%3]), coord(tri.v[(e+2)%3]), p)<=0.0)
+            {
+                _marks[nt] = _stamp;
+                _stack.push_back(nt);
+            }
+        }
+    }
+
+    _boundary.clear();
+    for (std::vector<GLint>::iterator itr=_cavity.begin(); itr!=_cavity.end(); ++itr)
+    {
+        const Tri& tri = _tris[*itr];
+        for (int e=0; e<3; ++e)
+        {
+            GLint nt = tri.n[e];
+            if (nt>=0 && _marks[nt]==_stamp) continue;
+
+            BoundaryEdge be;
+            be.a = tri.v[(e+1)%3];
+            be.b = tri.v[(e+2)%3];
+            be.outer = nt;
+            if (orient2d(coord(be.a), coord(be.b), p)<=0.0)
+            {
+                // the point lies on the outer boundary of the triangulation, which only happens with
+                // near coincident points, so leave it out rather than create degenerate triangles.
+                ++_numSkipped;
+                return false;
+            }
+            _boundary.push_back(be);
+        }
+    }
+
+    for (std::vector<GLint>::iterator itr=_cavity.begin(); itr!=_cavity.end(); ++itr)
+    {
+        Tri& tri = _tris[*itr];
+        tri.v[0] = tri.v[1] = tri.v[2] = INVALID_VERTEX;
+        _free.push_back(*itr);
+    }
+
+    // fan the boundary of the cavity around the point
+    _fan.clear();
+    for (std::vector<BoundaryEdge>::iterator itr=_boundary.begin(); itr!=_boundary.end(); ++itr)
+    {
+        GLint t = allocTri();
+        Tri& tri = _tris[t];
+        tri.v[0] = pi;
+        tri.v[1] = itr->a;
+        tri.v[2] = itr->b;
+        tri.n[0] = itr->outer;
+        tri.n[1] = -1;
+        tri.n[2] = -1;
+        if (itr->outer>=0) link(itr->outer, itr->b, itr->a, t);
+        _fan.push_back(std::pair<GLuint, GLint>(itr->a, t));
+    }
+
+    std::sort(_fan.begin(), _fan.end());
+    for (std::vector< std::pair<GLuint, GLint> >::iterator itr=_fan.begin(); itr!=_fan.end(); ++itr)
+    {
+        Tri& tri = _tris[itr->second];
+        std::vector< std::pair<GLuint, GLint> >::iterator next = std::lower_bound(_fan.begin(), _fan.end(), std::pair<GLuint, GLint>(tri.v[2], -1));
+        if (next!=_fan.end() && next->first==tri.v[2])
+        {
+            tri.n[1] = next->second;
+            _tris[next->second].n[2] = itr->second;
+        }
+    }
+
+    _lastTri = _fan.back().second;
+    return true;
+}
+
+// a directed boundary edge of the triangulation, keyed by its start vertex
+struct HullEdge
+{
+    GLuint  b;
+    GLint   t;
+    int     e;
+};
+
+void DelaunayMesh::fillHull()
+{
+    // collect the boundary as directed edges with the triangulation on their left
+    std::map<GLuint, HullEdge> boundary;
+    for (GLint t=0; t<(GLint)_tris.size(); ++t)
+    {
+        if (!isAlive(t)) continue;
+        const Tri& tri = _tris[t];
+        for (int e=0; e<3; ++e)
+        {
+            if (tri.n[e]>=0) continue;
+            HullEdge edge;
+            edge.b = tri.v[(e+2)%3];
+            edge.t = t;
+            edge.e = e;
+            // a vertex shared by two parts of the boundary, leave the hull as it is
+            if (!boundary.insert(std::map<GLuint, HullEdge>::value_type(tri.v[(e+1)%3], edge)).second) return;
+        }
+    }
+    if (boundary.size()<3) return;
+
+    // walk the boundary into a loop
+    std::vector<GLuint> verts;
+    std::vector<GLint> edgeTris;
+    std::vector<int> edgeIndices;
+    GLuint start = boundary.begin()->first;
+    GLuint v = start;
+    do
+    {
+        std::map<GLuint, HullEdge>::iterator itr = boundary.find(v);
+        if (itr==boundary.end() || verts.size()>boundary.size()) return;
+        verts.push_back(v);
+        edgeTris.push_back(itr->second.t);
+        edgeIndices.push_back(itr->second.e);
+        v = itr->second.b;
+    } while (v!=start);
+    if (verts.size()!=boundary.size()) return;
+
+    unsigned int size = verts.size();
+    std::vector<unsigned int> prev(size), next(size);
+    for (unsigned int i=0; i<size; ++i)
+    {
+        prev[i] = (i+size-1)%size;
+        next[i] = (i+1)%size;
+    }
+    std::vector<unsigned char> removed(size, 0);
+
+    // fill each reflex vertex of the boundary with a triangle to its neighbours, these only arise where the
+    // supertriangle vertices weren't far enough away for the hull edges to be Delaunay.
+    std::vector<unsigned int> queue;
+    for (unsigned int i=0; i<size; ++i) queue.push_back(i);
+    unsigned int remaining = size;
+    while (!queue.empty() && remaining>3)
+    {
+        unsigned int i = queue.back();
+        queue.pop_back();
+        if (removed[i]) continue;
+
+        unsigned int ip = prev[i];
+        unsigned int in = next[i];
+        osg::Vec2d a = coord(verts[ip]);
+        osg::Vec2d b = coord(verts[in]);
+        osg::Vec2d c = coord(verts[i]);
+        if (orient2d(a, c, b)>=0.0) continue;
+
+        // don't fill across any other part of the boundary
+        bool overlaps = false;
+        for (unsigned int j=next[in]; j!=ip && !overlaps; j=next[j])
+        {
+            osg::Vec2d v = coord(verts[j]);
+            overlaps = orient2d(a, b, v)>=0.0 && orient2d(b, c, v)>=0.0 && orient2d(c, a, v)>=0.0;
+        }
+        if (overlaps) continue;
+
+        GLint t = allocTri();
+        Tri& tri = _tris[t];
+        tri.v[0] = verts[ip];
+        tri.v[1] = verts[in];
+        tri.v[2] = verts[i];
+        tri.n[0] = edgeTris[i];
+        tri.n[1] = edgeTris[ip];
+        tri.n[2] = -1;
+        _tris[edgeTris[i]].n[edgeIndices[i]] = t;
+        _tris[edgeTris[ip]].n[edgeIndices[ip]] = t;
+        _hullFill[t] = 1;
+
+        edgeTris[ip] = t;
+        edgeIndices[ip] = 2;
+        next[ip] = in;
+        prev[in] = ip;
+        removed[i] = 1;
+        --remaining;
+
+        queue.push_back(ip);
+        queue.push_back(in);
+    }
+}
+
+bool DelaunayMesh::triangulate(const std::vector<GLuint>& indices)
+{
+    _tris.clear();
+    _free.clear();
+    _marks.clear();
+    _hullFill.clear();
+    _lastTri = -1;
+    _numSkipped = 0;
+
+    if (indices.size()<3) return false;
+
+    osg::Vec2d minp = coord(indices.front());
+    osg::Vec2d maxp = minp;
+    for (std::vector<GLuint>::const_iterator itr=indices.begin(); itr!=indices.end(); ++itr)
+    {
+        osg::Vec2d p = coord(*itr);
+        minp.x() = osg::minimum(minp.x(), p.x());
+        minp.y() = osg::minimum(minp.y(), p.y());
+        maxp.x() = osg::maximum(maxp.x(), p.x());
+        maxp.y() = osg::maximum(maxp.y(), p.y());
+    }
+
+    double size = osg::maximum(maxp.x()-minp.x(), maxp.y()-minp.y());
+    if (size<=0.0) size = 1.0;
+    osg::Vec2d centre = (minp+maxp)*0.5;
+    _super[0] = centre + osg::Vec2d(-100.0*size, -100.0*size);
+    _super[1] = centre + osg::Vec2d( 100.0*size, -100.0*size);
+    _super[2] = centre + osg::Vec2d(   0.0,       100.0*size);
+
+    GLint t = allocTri();
+    Tri& super = _tris[t];
+    super.v[0] = _numPoints;
+    super.v[1] = _numPoints+1;
+    super.v[2] = _numPoints+2;
+    super.n[0] = super.n[1] = super.n[2] = -1;
+    _lastTri = t;
+
+    _tris.reserve(indices.size()*2+8);
+    _marks.reserve(indices.size()*2+8);
+    _hullFill.reserve(indices.size()*2+8);
+
+    // biased randomized insertion order: each point is assigned to a round with the probability halving from the
+    // last round to the first, then the points of each round are sorted along a Hilbert curve.
+    std::vector< std::pair<unsigned long long, GLuint> > order;
+    order.reserve(indices.size());
+    double scale = 65535.0/size;
+    unsigned int seed = 12345;
+    for (std::vector<GLuint>::const_iterator itr=indices.begin(); itr!=indices.end(); ++itr)
+    {
+        unsigned int round = 0;
+        for (; round<31; ++round)
+        {
+            seed = seed*1103515245u + 12345u;
+            if ((seed>>16)&1) break;
+        }
+        osg::Vec2d p = coord(*itr);
+        unsigned int hx = osg::minimum((unsigned int)((p.x()-minp.x())*scale), 65535u);
+        unsigned int hy = osg::minimum((unsigned int)((p.y()-minp.y())*scale), 65535u);
+        unsigned long long key = ((unsigned long long)(31-round)<<32) | hilbert_index(hx, hy);
+        order.push_back(std::pair<unsigned long long, GLuint>(key, *itr));
+    }
+    std::sort(order.begin(), order.end());
+
+    for (std::vector< std::pair<unsigned long long, GLuint> >::iterator itr=order.begin(); itr!=order.end(); ++itr)
+    {
+        insertPoint(itr->second);
+    }
+
+    // remove the supertriangle
+    for (t=0; t<(GLint)_tris.size(); ++t)
+    {
+        if (!isAlive(t)) continue;
+        const Tri& tri = _tris[t];
+        if (tri.v[0]>=_numPoints || tri.v[1]>=_numPoints || tri.v[2]>=_numPoints) deleteTri(t);
+    }
+
+    fillHull();
+
+    if (_numSkipped>0)
+    {
+        OSG_INFO << "DelaunayTriangulator: "<<_numSkipped<<" near coincident points left out of the triangulation"<<std::endl;
+    }
+
+    return _free.size()<_tris.size();
+}
+
+void DelaunayMesh::buildVertexTriangles()
+{
+    _vertexTriangles.assign(_numPoints, -1);
+    for (GLint t=0; t<(GLint)_tris.size(); ++t)
+    {
+        if (!isAlive(t)) continue;
+        const Tri& tri = _tris[t];
+        for (int k=0; k<3; ++k) _vertexTriangles[tri.v[k]] = t;
+    }
+}
+
+GLint DelaunayMesh::findEdge(GLuint a, GLuint b, int& edge) const
+{
+    GLint start = a<_vertexTriangles.size() ? _vertexTriangles[a] : -1;
+    if (start<0) return -1;
+
+    // rotate around a in both directions from the starting triangle
+    for (int direction=0; direction<2; ++direction)
+    {
+        GLint t = start;
+        do
+        {
+            const Tri& tri = _tris[t];
+            int i = tri.v[0]==a ? 0 : (tri.v[1]==a ? 1 : 2);
+            if (tri.v[(i+1)%3]==b)
+            {
+                edge = (i+2)%3;
+                return t;
+            }
+            t = direction==0 ? tri.n[(i+1)%3] : tri.n[(i+2)%3];
+        } while (t>=0 && t!=start);
+        if (t==start) break;
+    }
+    return -1;
+}
+
+void DelaunayMesh::computeCircumcircleExtent(const Tri& tri, double& minx, double& maxx) const
+{
+    osg::Vec2d a = coord(tri.v[0]);
+    osg::Vec2d b = coord(tri.v[1]) - a;
+    osg::Vec2d c = coord(tri.v[2]) - a;
+    double d = 2.0*(b.x()*c.y() - b.y()*c.x());
+    if (d==0.0)
+    {
+        minx = -DBL_MAX;
+        maxx = DBL_MAX;
+        return;
+    }
+    double b2 = b.length2();
+    double c2 = c.length2();
+    osg::Vec2d centre((c.y()*b2 - b.y()*c2)/d, (b.x()*c2 - c.x()*b2)/d);
+    double r = centre.length();
+    minx = a.x() + centre.x() - r;
+    maxx = a.x() + centre.x() + r;
+}
+
+void DelaunayMesh::triangulatePseudoPolygon(GLuint a, GLuint b, const GLuint* chain, unsigned int size, std::vector<Tri>& tris) const
+{
+    // chain runs from the a side to the b side of the edge a-b and lies to its left, pick the vertex c whose
+    // circle through a, b and c contains none of the other chain vertices and recurse either side of it.
+    if (size==0) return;
+
+    unsigned int ci = 0;
+    for (unsigned int k=1; k<size; ++k)
+    {
+        if (incircle2d(coord(a), coord(b), coord(chain[ci]), coord(chain[k]))>0.0) ci = k;
+    }
+
+    triangulatePseudoPolygon(a, chain[ci], chain, ci, tris);
+    triangulatePseudoPolygon(chain[ci], b, chain+ci+1, size-ci-1, tris);
+
+    Tri tri;
+    tri.v[0] = a;
+    tri.v[1] = b;
+    tri.v[2] = chain[ci];
+    tri.n[0] = tri.n[1] = tri.n[2] = -1;
+    tris.push_back(tri);
+}
+
+bool DelaunayMesh::insertConstraint(GLuint p1, GLuint p2)
+{
+    unsigned int maxSegments = _tris.size();
+    while (p1!=p2 && maxSegments-->0)
+    {
+        osg::Vec2d P1 = coord(p1);
+        osg::Vec2d P2 = coord(p2);
+
+        GLint start = _vertexTriangles[p1];
+        if (start<0) return false;
+
+        // find the triangle around p1 that the segment leaves p1 through
+        GLint t = -1;
+        GLuint right = INVALID_VERTEX, left = INVALID_VERTEX;
+        GLuint through = INVALID_VERTEX;
+        for (int direction=0; direction<2 && t<0 && through==INVALID_VERTEX; ++direction)
+        {
+            GLint r = start;
+            do
+            {
+                const Tri& tri = _tris[r];
+                int i = tri.v[0]==p1 ? 0 : (tri.v[1]==p1 ? 1 : 2);
+                GLuint a = tri.v[(i+1)%3];
+                GLuint b = tri.v[(i+2)%3];
+                if (a==p2 || b==p2) return true;
+
+                double oa = orient2d(P1, P2, coord(a));
+                double ob = orient2d(P1, P2, coord(b));
+                if (oa==0.0 && (coord(a)-P1)*(P2-P1)>0.0) { through = a; break; }
+                if (ob==0.0 && (coord(b)-P1)*(P2-P1)>0.0) { through = b; break; }
+                if (oa<0.0 && ob>0.0)
+                {
+                    t = r;
+                    right = a;
+                    left = b;
+                    break;
+                }
+                r = direction==0 ? tri.n[(i+1)%3] : tri.n[(i+2)%3];
+            } while (r>=0 && r!=start);
+            if (r==start) break;
+        }
+
+        if (through!=INVALID_VERTEX)
+        {
+            // the segment passes through a vertex, so the edge to it is already part of the triangulation
+            p1 = through;
+            continue;
+        }
+        if (t<0) return false;
+
+        // walk the triangles crossed by the segment, collecting the vertices either side of it
+        std::vector<GLint> crossed;
+        std::vector<GLuint> leftChain, rightChain;
+        crossed.push_back(t);
+        leftChain.push_back(left);
+        rightChain.push_back(right);
+        GLuint end = INVALID_VERTEX;
+        while (end==INVALID_VERTEX)
+        {
+            const Tri& tri = _tris[t];
+            int e = 0;
+            for (; e<3; ++e)
+            {
+                if (tri.v[(e+1)%3]==right && tri.v[(e+2)%3]==left) break;
+            }
+            if (e==3 || tri.n[e]<0) return false;
+
+            t = tri.n[e];
+            if (std::find(crossed.begin(), crossed.end(), t)!=crossed.end()) return false;
+            crossed.push_back(t);
+
+            const Tri& ntri = _tris[t];
+            GLuint w = ntri.v[0]!=left && ntri.v[0]!=right ? ntri.v[0] : (ntri.v[1]!=left && ntri.v[1]!=right ? ntri.v[1] : ntri.v[2]);
+            if (w==p2)
+            {
+                end = w;
+                break;
+            }
+
+            double ow = orient2d(P1, P2, coord(w));
+            if (ow>0.0)
+            {
+                leftChain.push_back(w);
+                left = w;
+            }
+            else if (ow<0.0)
+            {
+                rightChain.push_back(w);
+                right = w;
+            }
+            else
+            {
+                end = w;
+            }
+        }
+
+        // record the edges around the crossed triangles along with the triangles beyond them
+        std::map< std::pair<GLuint, GLuint>, GLint > outerEdges;
+        for (std::vector<GLint>::iterator itr=crossed.begin(); itr!=crossed.end(); ++itr)
+        {
+            const Tri& tri = _tris[*itr];
+            for (int e=0; e<3; ++e)
+            {
+                if (tri.n[e]>=0 && std::find(crossed.begin(), crossed.end(), tri.n[e])!=crossed.end()) continue;
+                outerEdges[std::pair<GLuint, GLuint>(tri.v[(e+1)%3], tri.v[(e+2)%3])] = tri.n[e];
+            }
+        }
+
+        // retriangulate the polygons either side of the segment
+        std::vector<Tri> newTris;
+        triangulatePseudoPolygon(p1, end, &leftChain.front(), leftChain.size(), newTris);
+        std::reverse(rightChain.begin(), rightChain.end());
+        triangulatePseudoPolygon(end, p1, &rightChain.front(), rightChain.size(), newTris);
+        if (newTris.size()!=crossed.size()) return false;
+
+        for (unsigned int i=0; i<newTris.size(); ++i)
+        {
+            _tris[crossed[i]] = newTris[i];
+            _hullFill[crossed[i]] = 0;
+        }
+
+        // link the new triangles to each other and to the triangles around them
+        std::map< std::pair<GLuint, GLuint>, std::pair<GLint, int> > innerEdges;
+        for (std::vector<GLint>::iterator itr=crossed.begin(); itr!=crossed.end(); ++itr)
+        {
+            Tri& tri = _tris[*itr];
+            for (int e=0; e<3; ++e)
+            {
+                GLuint a = tri.v[(e+1)%3];
+                GLuint b = tri.v[(e+2)%3];
+                std::map< std::pair<GLuint, GLuint>, GLint >::iterator oitr = outerEdges.find(std::pair<GLuint, GLuint>(a, b));
+                if (oitr!=outerEdges.end())
+                {
+                    tri.n[e] = oitr->second;
+                    if (oitr->second>=0) link(oitr->second, b, a, *itr);
+                    continue;
+                }
+
+                std::map< std::pair<GLuint, GLuint>, std::pair<GLint, int> >::iterator iitr = innerEdges.find(std::pair<GLuint, GLuint>(b, a));
+                if (iitr!=innerEdges.end())
+                {
+                    tri.n[e] = iitr->second.first;
+                    _tris[iitr->second.first].n[iitr->second.second] = *itr;
+                }
+                else
+                {
+                    innerEdges[std::pair<GLuint, GLuint>(a, b)] = std::pair<GLint, int>(*itr, e);
+                }
+            }
+            for (int k=0; k<3; ++k) _vertexTriangles[tri.v[k]] = *itr;
+        }
+
+        p1 = end;
+    }
+    return p1==p2;
+}
+
+// DelaunayRegion triangulates one of the strips of sorted points that are triangulated in parallel.
+struct DelaunayRegion
+{
+    DelaunayRegion(const osg::Vec3Array* points, const osg::Vec2d& origin):
+        mesh(points, origin),
+        leftBound(-DBL_MAX),
+        rightBound(DBL_MAX),
+        valid(false) {}
+
+    void triangulate() { valid = mesh.triangulate(indices); }
+
+    DelaunayMesh        mesh;
+    std::vector<GLuint> indices;
+    double              leftBound;
+    double              rightBound;
+    bool                valid;
+};
+
+class DelaunayRegionThread : public OpenThreads::Thread
+{
+public:
+    DelaunayRegionThread(DelaunayRegion* region) : _region(region) {}
+    virtual void run() { _region->triangulate(); }
+protected:
+    DelaunayRegion* _region;
+};
+
+// Triangulate the points in parallel strips, then stitch the strips together by triangulating the vertices of the
+// triangles that may not be Delaunay across the strips, with the edges bordering the triangles that are as constraints.
+static bool triangulateRegions(const osg::Vec3Array* points, const osg::Vec2d& origin, unsigned int numRegions, DelaunayMesh& merged)
+{
+    GLuint numPoints = points->size();
+
+    // split the points, which are sorted by x, into strips that don't share an x coordinate
+    std::vector<DelaunayRegion*> regions;
+    GLuint begin = 0;
+    for (unsigned int r=0; r<numRegions && begin<numPoints; ++r)
+    {
+        GLuint end = r+1==numRegions ? numPoints : (GLuint)(((unsigned long long)numPoints*(r+1))/numRegions);
+        while (end<numPoints && end>begin && (*points)[end].x()==(*points)[end-1].x()) ++end;
+        if (end<=begin) continue;
+
+        DelaunayRegion* region = new DelaunayRegion(points, origin);
+        region->indices.reserve(end-begin);
+        for (GLuint i=begin; i<end; ++i) region->indices.push_back(i);
+        if (begin>0) region->leftBound = double((*points)[begin-1].x())-origin.x();
+        if (end<numPoints) region->rightBound = double((*points)[end].x())-origin.x();
+        regions.push_back(region);
+        begin = end;
+    }
+
+    std::vector<DelaunayRegionThread*> threads;
+    for (unsigned int r=1; r<regions.size(); ++r)
+    {
+        DelaunayRegionThread* thread = new DelaunayRegionThread(regions[r]);
+        if (thread->startThread()==0) threads.push_back(thread);
+        else
+        {
+            delete thread;
+            regions[r]->triangulate();
+        }
+    }
+    if (!regions.empty()) regions[0]->triangulate();
+    for (std::vector<DelaunayRegionThread*>::iterator itr=threads.begin(); itr!=threads.end(); ++itr)
+    {
+        (*itr)->join();
+        delete *itr;
+    }
+
+    // a triangle is final if its circumcircle lies within the x range of its strip, as then no point of
+    // another strip can lie inside it, the vertices of all the other triangles and of the strip hulls are stitched.
+    std::vector< std::vector<unsigned char> > finals(regions.size());
+    std::vector<unsigned char> stitch(numPoints, 0);
+    for (unsigned int r=0; r<regions.size(); ++r)
+    {
+        DelaunayRegion& region = *regions[r];
+        DelaunayMesh& mesh = region.mesh;
+        if (!region.valid)
+        {
+            for (std::vector<GLuint>::iterator itr=region.indices.begin(); itr!=region.indices.end(); ++itr) stitch[*itr] = 1;
+            continue;
+        }
+
+        finals[r].assign(mesh._tris.size(), 0);
+        for (GLint t=0; t<(GLint)mesh._tris.size(); ++t)
+        {
+            if (!mesh.isAlive(t)) continue;
+            const DelaunayMesh::Tri& tri = mesh._tris[t];
+            double minx, maxx;
+            mesh.computeCircumcircleExtent(tri, minx, maxx);
+            if (!mesh.isHullFill(t) && minx>region.leftBound && maxx<region.rightBound) finals[r][t] = 1;
+            else stitch[tri.v[0]] = stitch[tri.v[1]] = stitch[tri.v[2]] = 1;
+        }
+        for (GLint t=0; t<(GLint)mesh._tris.size(); ++t)
+        {
+            if (!mesh.isAlive(t)) continue;
+            const DelaunayMesh::Tri& tri = mesh._tris[t];
+            for (int e=0; e<3; ++e)
+            {
+                if (tri.n[e]<0) stitch[tri.v[(e+1)%3]] = stitch[tri.v[(e+2)%3]] = 1;
+            }
+        }
+    }
+
+    // the edges between the final and the other triangles, directed with the final triangle on their left
+    typedef std::pair<GLuint, GLuint> EdgeKey;
+    std::vector<EdgeKey> borderEdges;
+    std::set<EdgeKey> borderEdgeSet;
+    for (unsigned int r=0; r<regions.size(); ++r)
+    {
+        if (!regions[r]->valid) continue;
+        DelaunayMesh& mesh = regions[r]->mesh;
+        for (GLint t=0; t<(GLint)mesh._tris.size(); ++t)
+        {
+            if (!finals[r][t]) continue;
+            const DelaunayMesh::Tri& tri = mesh._tris[t];
+            for (int e=0; e<3; ++e)
+            {
+                if (tri.n[e]>=0 && finals[r][tri.n[e]]) continue;
+                GLuint a = tri.v[(e+1)%3];
+                GLuint b = tri.v[(e+2)%3];
+                borderEdges.push_back(EdgeKey(a, b));
+                borderEdgeSet.insert(EdgeKey(osg::minimum(a, b), osg::maximum(a, b)));
+            }
+        }
+    }
+
+    std::vector<GLuint> stitchIndices;
+    for (GLuint i=0; i<numPoints; ++i)
+    {
+        if (stitch[i]) stitchIndices.push_back(i);
+    }
+    std::vector<unsigned char>().swap(stitch);
+
+    OSG_INFO << "DelaunayTriangulator: stitching "<<regions.size()<<" regions with "<<stitchIndices.size()<<" points"<<std::endl;
+
+    DelaunayMesh seam(points, origin);
+    bool result = seam.triangulate(stitchIndices);
+    std::vector<unsigned char> covered;
+    if (result)
+    {
+        seam.buildVertexTriangles();
+        for (std::vector<EdgeKey>::iterator itr=borderEdges.begin(); itr!=borderEdges.end() && result; ++itr)
+        {
+            result = seam.insertConstraint(itr->first, itr->second);
+        }
+    }
+
+    if (result)
+    {
+        // flood fill the seam triangles covered by the final triangles, starting from the final side of each border edge
+        covered.assign(seam._tris.size(), 0);
+        std::vector<GLint> stack;
+        for (std::vector<EdgeKey>::iterator itr=borderEdges.begin(); itr!=borderEdges.end() && result; ++itr)
+        {
+            int e;
+            GLint t = seam.findEdge(itr->first, itr->second, e);
+            if (t<0)
+            {
+                result = false;
+                break;
+            }
+            if (!covered[t])
+            {
+                covered[t] = 1;
+                stack.push_back(t);
+            }
+        }
+
+        while (!stack.empty() && result)
+        {
+            GLint t = stack.back();
+            stack.pop_back();
+            const DelaunayMesh::Tri& tri = seam._tris[t];
+            for (int e=0; e<3; ++e)
+            {
+                GLint nt = tri.n[e];
+                if (nt<0 || covered[nt]) continue;
+                GLuint a = tri.v[(e+1)%3];
+                GLuint b = tri.v[(e+2)%3];
+                if (borderEdgeSet.count(EdgeKey(osg::minimum(a, b), osg::maximum(a, b)))) continue;
+                covered[nt] = 1;
+                stack.push_back(nt);
+            }
+        }
+    }
+
+    if (result)
+    {
+        // merge the final triangles of the strips with the uncovered seam triangles
+        merged._tris.clear();
+        std::vector< std::vector<GLint> > remaps(regions.size());
+        for (unsigned int r=0; r<regions.size(); ++r)
+        {
+            if (!regions[r]->valid) continue;
+            DelaunayMesh& mesh = regions[r]->mesh;
+            remaps[r].assign(mesh._tris.size(), -1);
+            for (GLint t=0; t<(GLint)mesh._tris.size(); ++t)
+            {
+                if (finals[r][t]) remaps[r][t] = merged.allocTri();
+            }
+        }
+        std::vector<GLint> seamRemap(seam._tris.size(), -1);
+        for (GLint t=0; t<(GLint)seam._tris.size(); ++t)
+        {
+            if (seam.isAlive(t) && !covered[t]) seamRemap[t] = merged.allocTri();
+        }
+
+        std::map<EdgeKey, std::pair<GLint, int> > pending;
+        for (unsigned int r=0; r<regions.size(); ++r)
+        {
+            if (!regions[r]->valid) continue;
+            DelaunayMesh& mesh = regions[r]->mesh;
+            for (GLint t=0; t<(GLint)mesh._tris.size(); ++t)
+            {
+                GLint mt = remaps[r][t];
+                if (mt<0) continue;
+                DelaunayMesh::Tri& tri = merged._tris[mt];
+                tri = mesh._tris[t];
+                for (int e=0; e<3; ++e)
+                {
+                    tri.n[e] = tri.n[e]>=0 ? remaps[r][tri.n[e]] : -1;
+                    if (tri.n[e]<0) pending[EdgeKey(tri.v[(e+1)%3], tri.v[(e+2)%3])] = std::pair<GLint, int>(mt, e);
+                }
+            }
+        }
+        for (GLint t=0; t<(GLint)seam._tris.size(); ++t)
+        {
+            GLint mt = seamRemap[t];
+            if (mt<0) continue;
+            DelaunayMesh::Tri& tri = merged._tris[mt];
+            tri = seam._tris[t];
+            for (int e=0; e<3; ++e)
+            {
+                tri.n[e] = tri.n[e]>=0 ? seamRemap[tri.n[e]] : -1;
+                if (tri.n[e]>=0) continue;
+                std::map<EdgeKey, std::pair<GLint, int> >::iterator itr = pending.find(EdgeKey(tri.v[(e+2)%3], tri.v[(e+1)%3]));
+                if (itr!=pending.end())
+                {
+                    tri.n[e] = itr->second.first;
+                    merged._tris[itr->second.first].n[itr->second.second] = mt;
+                }
+            }
+        }
+    }
+
+    for (std::vector<DelaunayRegion*>::iterator itr=regions.begin(); itr!=regions.end(); ++itr)
+    {
+        delete *itr;
+    }
+
+    return result;
+}
+
+bool DelaunayTriangulator::_triangulateArrays()
+{
+    // Eliminate duplicate lat/lon points from input coordinates.
+    _uniqueifyPoints();
+
+    osg::Vec3Array *points = points_.get();
+
+    // add the constraint vertices that aren't already sample points
+    osg::ref_ptr<osg::Vec3Array> constraintPoints = new osg::Vec3Array;
+    for (linelist::iterator linitr=constraint_lines.begin(); linitr!=constraint_lines.end(); ++linitr)
+    {
+        const osg::Vec3Array* vercon = dynamic_cast<const osg::Vec3Array*>((*linitr)->getVertexArray());
+        if (vercon) constraintPoints->insert(constraintPoints->end(), vercon->begin(), vercon->end());
+    }
+    if (!constraintPoints->empty())
+    {
+        std::sort(constraintPoints->begin(), constraintPoints->end(), Sample_point_compare);
+        unsigned int numSamplePoints = points->size();
+        for (osg::Vec3Array::iterator itr=constraintPoints->begin(); itr!=constraintPoints->end(); ++itr)
+        {
+            if (itr!=constraintPoints->begin() && itr->x()==(itr-1)->x() && itr->y()==(itr-1)->y()) continue;
+            osg::Vec3Array::iterator pitr = std::lower_bound(points->begin(), points->begin()+numSamplePoints, *itr, Sample_point_xy_compare);
+            if (pitr!=points->begin()+numSamplePoints && pitr->x()==itr->x() && pitr->y()==itr->y())
+            {
+                OSG_INFO << "DelaunayTriangulator: constraint point at "<< itr->x()<< " " << itr->y() << " is a sample point" << std::endl;
+                continue;
+            }
+            points->push_back(*itr);
+        }
+    }
+
+    // sort the points by x and y, which the parallel triangulation relies on to split the points into strips.
+    std::sort(points->begin(), points->end(), Sample_point_compare);
+
+    GLuint numPoints = points->size();
+    if (numPoints<3)
+    {
+        OSG_WARN << "Warning: DelaunayTriangulator::triangulate(): too few sample points" << std::endl;
+        return false;
+    }
+
+    // triangulate relative to the centre of the points to minimize the loss of precision
+    osg::BoundingBox bb;
+    for (osg::Vec3Array::const_iterator itr=points->begin(); itr!=points->end(); ++itr) bb.expandBy(*itr);
+    osg::Vec2d origin(bb.center().x(), bb.center().y());
+
+    unsigned int numRegions = num_regions_>0 ? num_regions_ : OpenThreads::GetNumberOfProcessors();
+    numRegions = osg::maximum(osg::minimum(numRegions, numPoints/4096), 1u);
+
+    DelaunayMesh mesh(points, origin);
+    bool result = false;
+    if (numRegions>1)
+    {
+        OSG_INFO << "DelaunayTriangulator: triangulating " << numPoints << " points in " << numRegions << " regions" << std::endl;
+        result = triangulateRegions(points, origin, numRegions, mesh);
+        if (!result) OSG_INFO << "DelaunayTriangulator: stitching regions failed, triangulating points in one region" << std::endl;
+    }
+    if (!result)
+    {
+        OSG_INFO << "DelaunayTriangulator: triangulating " << numPoints << " points" << std::endl;
+        std::vector<GLuint> indices(numPoints);
+        for (GLuint i=0; i<numPoints; ++i) indices[i] = i;
+        result = mesh.triangulate(indices);
+    }
+
+    if (!result)
+    {
+        OSG_WARN << "Warning: DelaunayTriangulator::triangulate(): no triangle generated" << std::endl;
+        return false;
+    }
+
+    // insert the edges of the constraint loops and strips
+    if (!constraint_lines.empty())
+    {
+        mesh.buildVertexTriangles();
+        for (linelist::iterator dcitr=constraint_lines.begin(); dcitr!=constraint_lines.end(); ++dcitr)
+        {
+            const osg::Vec3Array* vercon = dynamic_cast<const osg::Vec3Array*>((*dcitr)->getVertexArray());
+            if (!vercon) continue;
+
+            for (unsigned int ipr=0; ipr<(*dcitr)->getNumPrimitiveSets(); ipr++)
+            {
+                const osg::PrimitiveSet* prset=(*dcitr)->getPrimitiveSet(ipr);
+                if (prset->getNumIndices()<2 ||
+                    (prset->getMode()!=osg::PrimitiveSet::LINE_LOOP && prset->getMode()!=osg::PrimitiveSet::LINE_STRIP)) continue;
+
+                int ip1 = -1;
+                if (prset->getMode()==osg::PrimitiveSet::LINE_LOOP)
+                {
+                    osg::Vec3Array::iterator pitr = std::lower_bound(points->begin(), points->end(), (*vercon)[prset->index(prset->getNumIndices()-1)], Sample_point_xy_compare);
+                    ip1 = pitr-points->begin();
+                }
+                for (unsigned int i=0; i<prset->getNumIndices(); i++)
+                {
+                    const osg::Vec3& p = (*vercon)[prset->index(i)];
+                    osg::Vec3Array::iterator pitr = std::lower_bound(points->begin(), points->end(), p, Sample_point_xy_compare);
+                    int ip2 = pitr-points->begin();
+                    if (ip1>=0 && ip1!=ip2 && !mesh.insertConstraint(ip1, ip2))
+                    {
+                        OSG_WARN << "DelaunayTriangulator: unable to insert constraint edge from "<<(*points)[ip1].x()<<" "<<(*points)[ip1].y()
+                                 <<" to "<<p.x()<<" "<<p.y()<<std::endl;
+                    }
+                    ip1 = ip2;
+                }
+            }
+        }
+    }
+
+    // build osg primitive
+    OSG_INFO << "DelaunayTriangulator: building primitive(s)\n";
+    osg::ref_ptr<osg::DrawElementsUInt> prim_tris = new osg::DrawElementsUInt(GL_TRIANGLES);
+    prim_tris->reserve(mesh._tris.size()*3);
+    for (GLint t=0; t<(GLint)mesh._tris.size(); ++t)
+    {
+        if (!mesh.isAlive(t)) continue;
+        const DelaunayMesh::Tri& tri = mesh._tris[t];
+
+        // Don't add degenerate triangles
+        if (mesh.orient(tri)<=0.0) continue;
+
+        if (normals_.valid())
+        {
+            osg::Vec3 N = ((*points)[tri.v[1]] - (*points)[tri.v[0]]) ^ ((*points)[tri.v[2]] - (*points)[tri.v[0]]);
+            normals_->push_back(N / N.length());
+        }
+
+        prim_tris->push_back(tri.v[0]);
+        prim_tris->push_back(tri.v[1]);
+        prim_tris->push_back(tri.v[2]);
+    }
+
+    if (prim_tris->empty())
+    {
+        OSG_WARN << "Warning: DelaunayTriangulator::triangulate(): no triangle generated" << std::endl;
+        return false;
+    }
+
+    prim_tris_ = prim_tris;
+
+    OSG_INFO << "DelaunayTriangulator: process done, " << prim_tris_->getNumPrimitives() << " triangles remain\n";
+
+    return true;
+}
+
 bool DelaunayTriangulator::triangulate()
 {
     // check validity of input array
@@ -786,6 +1960,8 @@ bool DelaunayTriangulator::triangulate()
         return false;
     }
 
+    if (engine_==ARRAY_ENGINE) return _triangulateArrays();
+
     // Eliminate duplicate lat/lon points from input coordinates.
     _uniqueifyPoints();
 
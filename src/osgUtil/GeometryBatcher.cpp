@@ -0,0 +1,905 @@
+/* -*-c++-*- OpenSceneGraph - Copyright (C) 1998-2006 Robert Osfield
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+*/
+#include <osgUtil/GeometryBatcher>
+#include <osgUtil/StateGraph>
+
+#include <osg/GLExtensions>
+#include <osg/TriangleIndexFunctor>
+#include <osg/Notify>
+
+#include <algorithm>
+#include <limits.h>
+#include <typeinfo>
+
+#ifndef GL_DRAW_INDIRECT_BUFFER
+    #define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+using namespace osgUtil;
+
+namespace
+{
+
+class CopyArrayVisitor : public osg::ConstArrayVisitor
+{
+    public:
+
+        CopyArrayVisitor(osg::Array& target, unsigned int offset, unsigned int numElements, unsigned int capacity):
+            _target(target),
+            _offset(offset),
+            _numElements(numElements),
+            _capacity(capacity) {}
+
+        template<class ArrayType>
+        void copy(const ArrayType& source)
+        {
+            ArrayType& target = static_cast<ArrayType&>(_target);
+            if (target.size()<_capacity) target.resize(_capacity);
+            std::copy(source.begin(), source.begin()+_numElements, target.begin()+_offset);
+        }
+
+        virtual void apply(const osg::ByteArray& array) { copy(array); }
+        virtual void apply(const osg::ShortArray& array) { copy(array); }
+        virtual void apply(const osg::IntArray& array) { copy(array); }
+        virtual void apply(const osg::UByteArray& array) { copy(array); }
+        virtual void apply(const osg::UShortArray& array) { copy(array); }
+        virtual void apply(const osg::UIntArray& array) { copy(array); }
+        virtual void apply(const osg::FloatArray& array) { copy(array); }
+        virtual void apply(const osg::DoubleArray& array) { copy(array); }
+
+        virtual void apply(const osg::Vec2Array& array) { copy(array); }
+        virtual void apply(const osg::Vec3Array& array) { copy(array); }
+        virtual void apply(const osg::Vec4Array& array) { copy(array); }
+
+        virtual void apply(const osg::Vec4ubArray& array) { copy(array); }
+
+        virtual void apply(const osg::Vec2bArray& array) { copy(array); }
+        virtual void apply(const osg::Vec3bArray& array) { copy(array); }
+        virtual void apply(const osg::Vec4bArray& array) { copy(array); }
+
+        virtual void apply(const osg::Vec2sArray& array) { copy(array); }
+        virtual void apply(const osg::Vec3sArray& array) { copy(array); }
+        virtual void apply(const osg::Vec4sArray& array) { copy(array); }
+
+        virtual void apply(const osg::Vec2dArray& array) { copy(array); }
+        virtual void apply(const osg::Vec3dArray& array) { copy(array); }
+        virtual void apply(const osg::Vec4dArray& array) { copy(array); }
+
+    protected:
+
+        CopyArrayVisitor& operator = (const CopyArrayVisitor&) { return *this; }
+
+        osg::Array&     _target;
+        unsigned int    _offset;
+        unsigned int    _numElements;
+        unsigned int    _capacity;
+};
+
+/** Allocates ranges of elements from the start of a buffer, keeping a list of the ranges that have been released
+  * so that they can be reused.*/
+class RangeAllocator
+{
+    public:
+
+        RangeAllocator():
+            _end(0) {}
+
+        /** Allocate count elements, from the first free range large enough or else from the end of the buffer,
+          * returning false if the end of the buffer would pass maximum.*/
+        bool allocate(unsigned int count, unsigned int maximum, unsigned int& first)
+        {
+            for(Ranges::iterator itr = _freeRanges.begin();
+                itr != _freeRanges.end();
+                ++itr)
+            {
+                if (itr->second>=count)
+                {
+                    first = itr->first;
+                    itr->first += count;
+                    itr->second -= count;
+                    if (itr->second==0) _freeRanges.erase(itr);
+                    return true;
+                }
+            }
+
+            if (_end+count>maximum) return false;
+
+            first = _end;
+            _end += count;
+            return true;
+        }
+
+        /** Release a range, merging it with its neighbours.*/
+        void release(unsigned int first, unsigned int count)
+        {
+            if (count==0) return;
+
+            Ranges::iterator itr = _freeRanges.insert(std::lower_bound(_freeRanges.begin(), _freeRanges.end(), Range(first, 0)), Range(first, count));
+
+            Ranges::iterator next = itr+1;
+            if (next!=_freeRanges.end() && itr->first+itr->second==next->first)
+            {
+                itr->second += next->second;
+                _freeRanges.erase(next);
+            }
+
+            if (itr!=_freeRanges.begin())
+            {
+                Ranges::iterator previous = itr-1;
+                if (previous->first+previous->second==itr->first)
+                {
+                    previous->second += itr->second;
+                    _freeRanges.erase(itr);
+                    itr = previous;
+                }
+            }
+
+            if (itr->first+itr->second==_end)
+            {
+                _end = itr->first;
+                _freeRanges.erase(itr);
+            }
+        }
+
+        /** Get the end of the last allocated range.*/
+        unsigned int getEnd() const { return _end; }
+
+    protected:
+
+        typedef std::pair<unsigned int, unsigned int> Range;
+        typedef std::vector<Range> Ranges;
+
+        Ranges          _freeRanges;
+        unsigned int    _end;
+};
+
+/** Range of elements that have been modified since they were last uploaded.*/
+struct DirtyRange
+{
+    DirtyRange():
+        begin(0),
+        end(0) {}
+
+    void expand(unsigned int first, unsigned int count)
+    {
+        if (count==0) return;
+        if (begin==end) { begin = first; end = first+count; }
+        else { begin = osg::minimum(begin, first); end = osg::maximum(end, first+count); }
+    }
+
+    bool empty() const { return begin==end; }
+    void clear() { begin = end = 0; }
+
+    unsigned int begin;
+    unsigned int end;
+};
+
+// upload the range of the buffer data that has been modified, with the buffer object already bound.
+inline void uploadRange(const osg::GLBufferObject::Extensions* extensions, GLenum target, const osg::GLBufferObject* glBufferObject,
+                        const osg::BufferData* data, unsigned int elementSize, const DirtyRange& range)
+{
+    GLintptrARB offset = range.begin*elementSize;
+    extensions->glBufferSubData(target,
+                                glBufferObject->getOffset(data->getBufferIndex()) + offset,
+                                (range.end-range.begin)*elementSize,
+                                static_cast<const char*>(data->getDataPointer()) + offset);
+}
+
+inline void uploadArrayRange(const osg::GLBufferObject::Extensions* extensions, const osg::GLBufferObject* vbo, const osg::Array* array, const DirtyRange& range)
+{
+    if (!array || array->getNumElements()==0) return;
+
+    uploadRange(extensions, GL_ARRAY_BUFFER_ARB, vbo, array, array->getTotalDataSize()/array->getNumElements(), range);
+}
+
+struct CollectTriangleIndices
+{
+    CollectTriangleIndices():
+        _indices(0) {}
+
+    inline void operator()(unsigned int p1, unsigned int p2, unsigned int p3)
+    {
+        _indices->push_back(p1);
+        _indices->push_back(p2);
+        _indices->push_back(p3);
+    }
+
+    std::vector<GLuint>* _indices;
+};
+
+typedef osg::TriangleIndexFunctor<CollectTriangleIndices> CollectTriangleIndicesFunctor;
+
+inline bool isBatchableArrayType(const osg::Array* array)
+{
+    return array->getType()>=osg::Array::ByteArrayType && array->getType()<=osg::Array::Vec4dArrayType;
+}
+
+// return the array if it is bound per vertex, or NULL if it's off, setting valid to false if it can't be batched.
+inline const osg::Array* getPerVertexArray(const osg::Array* array, osg::Geometry::AttributeBinding binding, unsigned int numVertices, bool& valid)
+{
+    if (!array || binding==osg::Geometry::BIND_OFF) return 0;
+    if (binding!=osg::Geometry::BIND_PER_VERTEX || array->getNumElements()<numVertices || !isBatchableArrayType(array)) valid = false;
+    return array;
+}
+
+inline const osg::Array* perVertexArray(const osg::Array* array, osg::Geometry::AttributeBinding binding)
+{
+    return (binding==osg::Geometry::BIND_PER_VERTEX) ? array : 0;
+}
+
+inline void addToFormat(std::vector<int>& format, const osg::Array* array)
+{
+    format.push_back(array ? static_cast<int>(array->getType()) : -1);
+}
+
+inline bool isTriangleMode(GLenum mode)
+{
+    switch(mode)
+    {
+        case(GL_TRIANGLES):
+        case(GL_TRIANGLE_STRIP):
+        case(GL_TRIANGLE_FAN):
+        case(GL_QUADS):
+        case(GL_QUAD_STRIP):
+        case(GL_POLYGON):
+            return true;
+        default:
+            return false;
+    }
+}
+
+inline void addToSignature(GeometryBatcher::Signature& signature, const osg::BufferData* data)
+{
+    signature.push_back(GeometryBatcher::Signature::value_type(data, data ? data->getModifiedCount() : 0));
+}
+
+// the arrays and primitive sets are recorded along with their modified counts so that replacing any of them is detected
+// as well as modifying them.
+inline void computeSignature(const osg::Geometry& geometry, GeometryBatcher::Signature& signature)
+{
+    signature.clear();
+    addToSignature(signature, geometry.getVertexArray());
+    addToSignature(signature, geometry.getNormalArray());
+    addToSignature(signature, geometry.getColorArray());
+    addToSignature(signature, geometry.getSecondaryColorArray());
+    addToSignature(signature, geometry.getFogCoordArray());
+    for(unsigned int unit=0; unit<geometry.getNumTexCoordArrays(); ++unit)
+    {
+        addToSignature(signature, geometry.getTexCoordArray(unit));
+    }
+    for(unsigned int index=0; index<geometry.getNumVertexAttribArrays(); ++index)
+    {
+        addToSignature(signature, geometry.getVertexAttribArray(index));
+    }
+    for(unsigned int i=0; i<geometry.getNumPrimitiveSets(); ++i)
+    {
+        addToSignature(signature, geometry.getPrimitiveSet(i));
+    }
+}
+
+inline bool equivalent(const osg::RefMatrix* lhs, const osg::RefMatrix* rhs)
+{
+    if (lhs==rhs) return true;
+    if (!lhs || !rhs) return false;
+    return *lhs==*rhs;
+}
+
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// GeometryBatcher::Extensions
+//
+struct GeometryBatcher::Extensions : public osg::Referenced
+{
+    typedef void (GL_APIENTRY * MultiDrawElementsProc) (GLenum mode, const GLsizei* count, GLenum type, const GLvoid* const* indices, GLsizei drawcount);
+    typedef void (GL_APIENTRY * MultiDrawElementsIndirectProc) (GLenum mode, GLenum type, const GLvoid* indirect, GLsizei drawcount, GLsizei stride);
+
+    Extensions(unsigned int contextID):
+        glMultiDrawElements(0),
+        glMultiDrawElementsIndirect(0)
+    {
+        if (osg::isGLExtensionOrVersionSupported(contextID, "GL_ARB_multi_draw_indirect", 4.3f))
+        {
+            osg::setGLExtensionFuncPtr(glMultiDrawElementsIndirect, "glMultiDrawElementsIndirect", "glMultiDrawElementsIndirectARB");
+        }
+
+        if (osg::isGLExtensionOrVersionSupported(contextID, "GL_EXT_multi_draw_arrays", 1.4f))
+        {
+            osg::setGLExtensionFuncPtr(glMultiDrawElements, "glMultiDrawElements", "glMultiDrawElementsEXT");
+        }
+    }
+
+    MultiDrawElementsProc           glMultiDrawElements;
+    MultiDrawElementsIndirectProc   glMultiDrawElementsIndirect;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// GeometryBatcher::Pool
+//
+struct GeometryBatcher::Pool : public osg::Referenced
+{
+    Pool(const std::vector<int>* f, const osg::Geometry& geometry, unsigned int capacity):
+        format(f),
+        vertexCapacity(0),
+        maximumNumVertices(capacity)
+    {
+        osg::VertexBufferObject* vbo = new osg::VertexBufferObject;
+
+        vertices = createArray(geometry.getVertexArray(), vbo);
+        normals = createArray(perVertexArray(geometry.getNormalArray(), geometry.getNormalBinding()), vbo);
+        colors = createArray(perVertexArray(geometry.getColorArray(), geometry.getColorBinding()), vbo);
+        secondaryColors = createArray(perVertexArray(geometry.getSecondaryColorArray(), geometry.getSecondaryColorBinding()), vbo);
+        fogCoords = createArray(perVertexArray(geometry.getFogCoordArray(), geometry.getFogCoordBinding()), vbo);
+
+        texCoords.resize(geometry.getNumTexCoordArrays());
+        for(unsigned int unit=0; unit<texCoords.size(); ++unit)
+        {
+            texCoords[unit] = createArray(geometry.getTexCoordArray(unit), vbo);
+        }
+
+        vertexAttribs.resize(geometry.getNumVertexAttribArrays());
+        vertexAttribNormalize.resize(geometry.getNumVertexAttribArrays(), GL_FALSE);
+        for(unsigned int index=0; index<vertexAttribs.size(); ++index)
+        {
+            vertexAttribs[index] = createArray(perVertexArray(geometry.getVertexAttribArray(index), geometry.getVertexAttribBinding(index)), vbo);
+            vertexAttribNormalize[index] = geometry.getVertexAttribNormalize(index);
+        }
+
+        indices = new osg::DrawElementsUInt(GL_TRIANGLES);
+        indices->setElementBufferObject(new osg::ElementBufferObject);
+    }
+
+    static osg::Array* createArray(const osg::Array* source, osg::VertexBufferObject* vbo)
+    {
+        if (!source) return 0;
+
+        osg::Array* array = dynamic_cast<osg::Array*>(source->cloneType());
+        if (array) array->setVertexBufferObject(vbo);
+        return array;
+    }
+
+    void copy(osg::Array* target, const osg::Array* source, unsigned int firstVertex, unsigned int numVertices)
+    {
+        if (!target || !source) return;
+
+        CopyArrayVisitor cav(*target, firstVertex, numVertices, vertexCapacity);
+        source->accept(cav);
+    }
+
+    /** Copy the vertices and triangles of the geometry into free space in the pool, returning false if there isn't room for them.*/
+    bool append(const osg::Geometry& geometry, const std::vector<GLuint>& triangles, Allocation& allocation)
+    {
+        unsigned int numGeometryVertices = geometry.getVertexArray()->getNumElements();
+        unsigned int numGeometryIndices = triangles.size();
+
+        unsigned int firstVertex = 0;
+        if (!vertexAllocator.allocate(numGeometryVertices, maximumNumVertices, firstVertex)) return false;
+
+        unsigned int firstIndex = 0;
+        indexAllocator.allocate(numGeometryIndices, UINT_MAX, firstIndex);
+
+        // grow the arrays when the allocations pass their end, the whole of the grown buffers being uploaded when next drawn.
+        bool growVertices = vertexAllocator.getEnd()>vertexCapacity;
+        if (growVertices)
+        {
+            vertexCapacity = osg::minimum(osg::maximum(vertexCapacity*2, vertexAllocator.getEnd()), maximumNumVertices);
+        }
+
+        copy(vertices.get(), geometry.getVertexArray(), firstVertex, numGeometryVertices);
+        copy(normals.get(), geometry.getNormalArray(), firstVertex, numGeometryVertices);
+        copy(colors.get(), geometry.getColorArray(), firstVertex, numGeometryVertices);
+        copy(secondaryColors.get(), geometry.getSecondaryColorArray(), firstVertex, numGeometryVertices);
+        copy(fogCoords.get(), geometry.getFogCoordArray(), firstVertex, numGeometryVertices);
+
+        for(unsigned int unit=0; unit<texCoords.size(); ++unit)
+        {
+            copy(texCoords[unit].get(), geometry.getTexCoordArray(unit), firstVertex, numGeometryVertices);
+        }
+
+        for(unsigned int index=0; index<vertexAttribs.size(); ++index)
+        {
+            copy(vertexAttribs[index].get(), geometry.getVertexAttribArray(index), firstVertex, numGeometryVertices);
+        }
+
+        if (growVertices) dirtyArrays();
+        else dirtyVertices.expand(firstVertex, numGeometryVertices);
+
+        if (indexAllocator.getEnd()>indices->size())
+        {
+            indices->resize(osg::maximum(static_cast<unsigned int>(indices->size())*2, indexAllocator.getEnd()));
+            indices->dirty();
+        }
+        else
+        {
+            dirtyIndices.expand(firstIndex, numGeometryIndices);
+        }
+
+        for(unsigned int i=0; i<numGeometryIndices; ++i)
+        {
+            (*indices)[firstIndex+i] = firstVertex + triangles[i];
+        }
+
+        allocation.pool = this;
+        allocation.firstVertex = firstVertex;
+        allocation.numVertices = numGeometryVertices;
+        allocation.firstIndex = firstIndex;
+        allocation.numIndices = numGeometryIndices;
+
+        return true;
+    }
+
+    /** Return the space of the allocation to the pool so that it can be reused.*/
+    void release(const Allocation& allocation)
+    {
+        vertexAllocator.release(allocation.firstVertex, allocation.numVertices);
+        indexAllocator.release(allocation.firstIndex, allocation.numIndices);
+    }
+
+    void dirtyArrays()
+    {
+        vertices->dirty();
+        if (normals.valid()) normals->dirty();
+        if (colors.valid()) colors->dirty();
+        if (secondaryColors.valid()) secondaryColors->dirty();
+        if (fogCoords.valid()) fogCoords->dirty();
+        for(unsigned int unit=0; unit<texCoords.size(); ++unit)
+        {
+            if (texCoords[unit].valid()) texCoords[unit]->dirty();
+        }
+        for(unsigned int index=0; index<vertexAttribs.size(); ++index)
+        {
+            if (vertexAttribs[index].valid()) vertexAttribs[index]->dirty();
+        }
+    }
+
+    /** Upload the ranges that have been modified since the pool was last drawn with glBufferSubData.
+      * Buffer objects that are dirty are skipped as they upload all of their data when next bound.*/
+    void uploadModifiedRanges(osg::State& state)
+    {
+        unsigned int contextID = state.getContextID();
+        const osg::GLBufferObject::Extensions* extensions = osg::GLBufferObject::getExtensions(contextID, true);
+
+        if (!dirtyVertices.empty())
+        {
+            osg::GLBufferObject* vbo = vertices->getOrCreateGLBufferObject(contextID);
+            if (vbo && !vbo->isDirty())
+            {
+                state.bindVertexBufferObject(vbo);
+
+                uploadArrayRange(extensions, vbo, vertices.get(), dirtyVertices);
+                uploadArrayRange(extensions, vbo, normals.get(), dirtyVertices);
+                uploadArrayRange(extensions, vbo, colors.get(), dirtyVertices);
+                uploadArrayRange(extensions, vbo, secondaryColors.get(), dirtyVertices);
+                uploadArrayRange(extensions, vbo, fogCoords.get(), dirtyVertices);
+                for(unsigned int unit=0; unit<texCoords.size(); ++unit)
+                {
+                    uploadArrayRange(extensions, vbo, texCoords[unit].get(), dirtyVertices);
+                }
+                for(unsigned int index=0; index<vertexAttribs.size(); ++index)
+                {
+                    uploadArrayRange(extensions, vbo, vertexAttribs[index].get(), dirtyVertices);
+                }
+            }
+            dirtyVertices.clear();
+        }
+
+        if (!dirtyIndices.empty())
+        {
+            osg::GLBufferObject* ebo = indices->getOrCreateGLBufferObject(contextID);
+            if (ebo && !ebo->isDirty())
+            {
+                state.bindElementBufferObject(ebo);
+                uploadRange(extensions, GL_ELEMENT_ARRAY_BUFFER_ARB, ebo, indices.get(), sizeof(GLuint), dirtyIndices);
+            }
+            dirtyIndices.clear();
+        }
+    }
+
+    const std::vector<int>*                 format;
+    unsigned int                            vertexCapacity;
+    unsigned int                            maximumNumVertices;
+    RangeAllocator                          vertexAllocator;
+    RangeAllocator                          indexAllocator;
+    DirtyRange                              dirtyVertices;
+    DirtyRange                              dirtyIndices;
+
+    osg::ref_ptr<osg::Array>                vertices;
+    osg::ref_ptr<osg::Array>                normals;
+    osg::ref_ptr<osg::Array>                colors;
+    osg::ref_ptr<osg::Array>                secondaryColors;
+    osg::ref_ptr<osg::Array>                fogCoords;
+    std::vector< osg::ref_ptr<osg::Array> > texCoords;
+    std::vector< osg::ref_ptr<osg::Array> > vertexAttribs;
+    std::vector<GLboolean>                  vertexAttribNormalize;
+    osg::ref_ptr<osg::DrawElementsUInt>     indices;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// GeometryBatcher
+//
+GeometryBatcher::ContextData::ContextData():
+    numBatches(0),
+    numBatchedGeometries(0)
+{
+}
+
+GeometryBatcher::GeometryBatcher():
+    _maximumNumVerticesPerGeometry(4096),
+    _numVerticesPerPool(262144)
+{
+}
+
+GeometryBatcher::~GeometryBatcher()
+{
+}
+
+bool GeometryBatcher::isBatchable(const RenderLeaf& leaf) const
+{
+    if (leaf._dynamic) return false;
+
+    // subclasses of Geometry may draw differently so only plain Geometry is batched.
+    const osg::Drawable* drawable = leaf.getDrawable();
+    if (!drawable || typeid(*drawable)!=typeid(osg::Geometry)) return false;
+
+    const osg::Geometry* geometry = drawable->asGeometry();
+    if (!geometry ||
+        geometry->getVertexDecodeMatrix() ||
+        geometry->getDrawCallback() ||
+        geometry->getInternalOptimizedGeometry() ||
+        !geometry->areFastPathsUsed()) return false;
+
+    const osg::Array* vertices = geometry->getVertexArray();
+    if (!vertices || !isBatchableArrayType(vertices)) return false;
+
+    unsigned int numVertices = vertices->getNumElements();
+    if (numVertices==0 ||
+        numVertices>_maximumNumVerticesPerGeometry ||
+        numVertices>_numVerticesPerPool) return false;
+
+    bool valid = true;
+    getPerVertexArray(geometry->getNormalArray(), geometry->getNormalBinding(), numVertices, valid);
+    getPerVertexArray(geometry->getColorArray(), geometry->getColorBinding(), numVertices, valid);
+    getPerVertexArray(geometry->getSecondaryColorArray(), geometry->getSecondaryColorBinding(), numVertices, valid);
+    getPerVertexArray(geometry->getFogCoordArray(), geometry->getFogCoordBinding(), numVertices, valid);
+    for(unsigned int unit=0; unit<geometry->getNumTexCoordArrays(); ++unit)
+    {
+        getPerVertexArray(geometry->getTexCoordArray(unit), osg::Geometry::BIND_PER_VERTEX, numVertices, valid);
+    }
+    for(unsigned int index=0; index<geometry->getNumVertexAttribArrays(); ++index)
+    {
+        getPerVertexArray(geometry->getVertexAttribArray(index), geometry->getVertexAttribBinding(index), numVertices, valid);
+    }
+    if (!valid) return false;
+
+    for(unsigned int i=0; i<geometry->getNumPrimitiveSets(); ++i)
+    {
+        const osg::PrimitiveSet* primitiveSet = geometry->getPrimitiveSet(i);
+        if (!isTriangleMode(primitiveSet->getMode()) || primitiveSet->getNumInstances()!=0) return false;
+    }
+
+    return true;
+}
+
+bool GeometryBatcher::canBatch(const RenderLeaf& lhs, const RenderLeaf& rhs) const
+{
+    return lhs._parent==rhs._parent &&
+           equivalent(lhs._modelview.get(), rhs._modelview.get()) &&
+           equivalent(lhs._projection.get(), rhs._projection.get());
+}
+
+const GeometryBatcher::Allocation* GeometryBatcher::getOrCreateAllocation(ContextData& cd, const osg::Geometry& geometry)
+{
+    Signature& signature = cd.signature;
+    computeSignature(geometry, signature);
+
+    Allocation& allocation = cd.allocations[&geometry];
+    if (allocation.geometry.get()==&geometry &&
+        allocation.signature==signature)
+    {
+        return allocation.pool ? &allocation : 0;
+    }
+
+    // the geometry hasn't been seen before, has been modified, or a new geometry has been allocated at the address of a deleted one,
+    // so any space held by the previous allocation can be reused.
+    if (allocation.pool) allocation.pool->release(allocation);
+
+    allocation = Allocation();
+    allocation.geometry = const_cast<osg::Geometry*>(&geometry);
+    allocation.signature = signature;
+
+    std::vector<GLuint> triangles;
+    CollectTriangleIndicesFunctor collectTriangles;
+    collectTriangles._indices = &triangles;
+    geometry.accept(collectTriangles);
+
+    unsigned int numVertices = geometry.getVertexArray()->getNumElements();
+    for(std::vector<GLuint>::const_iterator itr = triangles.begin();
+        itr != triangles.end();
+        ++itr)
+    {
+        if (*itr>=numVertices)
+        {
+            OSG_INFO<<"GeometryBatcher: Geometry has indices outside of its vertex array, so it can't be batched."<<std::endl;
+            triangles.clear();
+            break;
+        }
+    }
+
+    // leave the allocation without a pool so the geometry is drawn as normal without being rechecked.
+    if (triangles.empty()) return 0;
+
+    std::vector<int> format;
+    addToFormat(format, geometry.getVertexArray());
+    addToFormat(format, perVertexArray(geometry.getNormalArray(), geometry.getNormalBinding()));
+    addToFormat(format, perVertexArray(geometry.getColorArray(), geometry.getColorBinding()));
+    addToFormat(format, perVertexArray(geometry.getSecondaryColorArray(), geometry.getSecondaryColorBinding()));
+    addToFormat(format, perVertexArray(geometry.getFogCoordArray(), geometry.getFogCoordBinding()));
+    format.push_back(geometry.getNumTexCoordArrays());
+    for(unsigned int unit=0; unit<geometry.getNumTexCoordArrays(); ++unit)
+    {
+        addToFormat(format, geometry.getTexCoordArray(unit));
+    }
+    format.push_back(geometry.getNumVertexAttribArrays());
+    for(unsigned int index=0; index<geometry.getNumVertexAttribArrays(); ++index)
+    {
+        addToFormat(format, perVertexArray(geometry.getVertexAttribArray(index), geometry.getVertexAttribBinding(index)));
+        format.push_back(geometry.getVertexAttribNormalize(index));
+    }
+
+    PoolMap::iterator pitr = cd.pools.insert(PoolMap::value_type(format, PoolList())).first;
+    PoolList& pools = pitr->second;
+    for(unsigned int attempt=0; attempt<2; ++attempt)
+    {
+        for(PoolList::iterator itr = pools.begin();
+            itr != pools.end();
+            ++itr)
+        {
+            if ((*itr)->append(geometry, triangles, allocation)) return &allocation;
+        }
+
+        // reclaim the space of deleted geometries before growing the number of pools.
+        if (attempt==0) releaseDeletedAllocations(cd);
+    }
+
+    pools.push_back(new Pool(&(pitr->first), geometry, _numVerticesPerPool));
+    pools.back()->append(geometry, triangles, allocation);
+
+    return &allocation;
+}
+
+void GeometryBatcher::releaseDeletedAllocations(ContextData& cd)
+{
+    AllocationMap::iterator itr = cd.allocations.begin();
+    while(itr != cd.allocations.end())
+    {
+        if (!itr->second.geometry.valid())
+        {
+            if (itr->second.pool) itr->second.pool->release(itr->second);
+            cd.allocations.erase(itr++);
+        }
+        else
+        {
+            ++itr;
+        }
+    }
+}
+
+void GeometryBatcher::draw(osg::RenderInfo& renderInfo, RenderLeaf* leaf, RenderLeaf*& previous)
+{
+    osg::State& state = *renderInfo.getState();
+    ContextData& cd = _contextData[state.getContextID()];
+
+    const Allocation* allocation = 0;
+    if (state.isVertexBufferObjectSupported() && isBatchable(*leaf))
+    {
+        allocation = getOrCreateAllocation(cd, *(leaf->getDrawable()->asGeometry()));
+    }
+
+    if (!allocation)
+    {
+        drawPending(renderInfo, cd, previous);
+
+        leaf->render(renderInfo, previous);
+        previous = leaf;
+        return;
+    }
+
+    if (!cd.pendingLeaves.empty() &&
+        (cd.pendingAllocations.back()->pool->format!=allocation->pool->format || !canBatch(*cd.pendingLeaves.back(), *leaf)))
+    {
+        drawPending(renderInfo, cd, previous);
+    }
+
+    cd.pendingLeaves.push_back(leaf);
+    cd.pendingAllocations.push_back(allocation);
+}
+
+void GeometryBatcher::flush(osg::RenderInfo& renderInfo, RenderLeaf*& previous)
+{
+    drawPending(renderInfo, _contextData[renderInfo.getState()->getContextID()], previous);
+}
+
+void GeometryBatcher::drawPending(osg::RenderInfo& renderInfo, ContextData& cd, RenderLeaf*& previous)
+{
+    if (cd.pendingLeaves.empty()) return;
+
+    if (cd.pendingLeaves.size()==1)
+    {
+        // nothing to be gained from batching a single leaf.
+        RenderLeaf* leaf = cd.pendingLeaves.front();
+        leaf->render(renderInfo, previous);
+        previous = leaf;
+    }
+    else
+    {
+        osg::State& state = *renderInfo.getState();
+        if (!state.getAbortRendering())
+        {
+            RenderLeaf* leaf = cd.pendingLeaves.front();
+            leaf->applyState(renderInfo, previous);
+
+            // draw each run of allocations that share the same pool with a single call.
+            unsigned int first = 0;
+            for(unsigned int i=1; i<=cd.pendingAllocations.size(); ++i)
+            {
+                if (i==cd.pendingAllocations.size() || cd.pendingAllocations[i]->pool!=cd.pendingAllocations[first]->pool)
+                {
+                    drawPool(state, cd, *(cd.pendingAllocations[first]->pool), first, i);
+                    first = i;
+                }
+            }
+
+            ++cd.numBatches;
+            cd.numBatchedGeometries += cd.pendingLeaves.size();
+        }
+
+        previous = cd.pendingLeaves.back();
+    }
+
+    cd.pendingLeaves.clear();
+    cd.pendingAllocations.clear();
+}
+
+void GeometryBatcher::drawPool(osg::State& state, ContextData& cd, const Pool& pool, unsigned int first, unsigned int last)
+{
+    unsigned int contextID = state.getContextID();
+
+    if (!cd.extensions.valid()) cd.extensions = new Extensions(contextID);
+    const Extensions* extensions = cd.extensions.get();
+
+    const_cast<Pool&>(pool).uploadModifiedRanges(state);
+
+    // set up the arrays of the pool.
+    state.lazyDisablingOfVertexAttributes();
+
+    state.setVertexPointer(pool.vertices.get());
+    if (pool.normals.valid()) state.setNormalPointer(pool.normals.get());
+    if (pool.colors.valid()) state.setColorPointer(pool.colors.get());
+    if (pool.secondaryColors.valid()) state.setSecondaryColorPointer(pool.secondaryColors.get());
+    if (pool.fogCoords.valid()) state.setFogCoordPointer(pool.fogCoords.get());
+
+    for(unsigned int unit=0; unit<pool.texCoords.size(); ++unit)
+    {
+        if (pool.texCoords[unit].valid()) state.setTexCoordPointer(unit, pool.texCoords[unit].get());
+    }
+
+    for(unsigned int index=0; index<pool.vertexAttribs.size(); ++index)
+    {
+        if (pool.vertexAttribs[index].valid()) state.setVertexAttribPointer(index, pool.vertexAttribs[index].get(), pool.vertexAttribNormalize[index]);
+    }
+
+    state.applyDisablingOfVertexAttributes();
+
+    osg::GLBufferObject* ebo = pool.indices->getOrCreateGLBufferObject(contextID);
+    if (!ebo) return;
+
+    state.bindElementBufferObject(ebo);
+
+    GLsizeiptrARB baseOffset = ebo->getOffset(pool.indices->getBufferIndex());
+    GLsizei numDraws = last-first;
+
+    if (extensions->glMultiDrawElementsIndirect)
+    {
+        if (!cd.commands.valid())
+        {
+            osg::VertexBufferObject* bufferObject = new osg::VertexBufferObject;
+            bufferObject->setTarget(GL_DRAW_INDIRECT_BUFFER);
+            bufferObject->setUsage(GL_STREAM_DRAW_ARB);
+
+            cd.commands = new osg::UIntArray;
+            cd.commands->setVertexBufferObject(bufferObject);
+        }
+
+        // DrawElementsIndirectCommand : count, instanceCount, firstIndex, baseVertex, baseInstance
+        osg::UIntArray& commands = *cd.commands;
+        commands.resize(numDraws*5);
+        for(unsigned int i=first, c=0; i<last; ++i, c+=5)
+        {
+            const Allocation* allocation = cd.pendingAllocations[i];
+            commands[c] = allocation->numIndices;
+            commands[c+1] = 1;
+            commands[c+2] = baseOffset/sizeof(GLuint) + allocation->firstIndex;
+            commands[c+3] = 0;
+            commands[c+4] = 0;
+        }
+        commands.dirty();
+
+        osg::GLBufferObject* commandBuffer = commands.getOrCreateGLBufferObject(contextID);
+        if (commandBuffer->isDirty()) commandBuffer->compileBuffer();
+        else commandBuffer->bindBuffer();
+
+        extensions->glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const GLvoid*)(commandBuffer->getOffset(commands.getBufferIndex())), numDraws, 0);
+
+        commandBuffer->unbindBuffer();
+    }
+    else
+    {
+        cd.counts.resize(numDraws);
+        cd.offsets.resize(numDraws);
+        for(unsigned int i=first, d=0; i<last; ++i, ++d)
+        {
+            const Allocation* allocation = cd.pendingAllocations[i];
+            cd.counts[d] = allocation->numIndices;
+            cd.offsets[d] = (const GLvoid*)(baseOffset + allocation->firstIndex*sizeof(GLuint));
+        }
+
+        if (extensions->glMultiDrawElements)
+        {
+            extensions->glMultiDrawElements(GL_TRIANGLES, &cd.counts.front(), GL_UNSIGNED_INT, &cd.offsets.front(), numDraws);
+        }
+        else
+        {
+            for(GLsizei d=0; d<numDraws; ++d)
+            {
+                glDrawElements(GL_TRIANGLES, cd.counts[d], GL_UNSIGNED_INT, cd.offsets[d]);
+            }
+        }
+    }
+
+    state.unbindVertexBufferObject();
+    state.unbindElementBufferObject();
+}
+
+unsigned int GeometryBatcher::getNumBatches(unsigned int contextID) const
+{
+    return _contextData[contextID].numBatches;
+}
+
+unsigned int GeometryBatcher::getNumBatchedGeometries(unsigned int contextID) const
+{
+    return _contextData[contextID].numBatchedGeometries;
+}
+
+void GeometryBatcher::resetStats(unsigned int contextID)
+{
+    _contextData[contextID].numBatches = 0;
+    _contextData[contextID].numBatchedGeometries = 0;
+}
+
+void GeometryBatcher::releaseGLObjects(osg::State* state) const
+{
+    if (state)
+    {
+        _contextData[state->getContextID()] = ContextData();
+    }
+    else
+    {
+        for(unsigned int i=0; i<_contextData.size(); ++i)
+        {
+            _contextData[i] = ContextData();
+        }
+    }
+}
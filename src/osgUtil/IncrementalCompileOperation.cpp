@@ -19,6 +19,7 @@
 #include <osg/Depth>
 #include <osg/ColorMask>
 #include <osg/ApplicationUsage>
+#include <osg/TextureCubeMap>
 
 #include <OpenThreads/ScopedLock>
 
@@ -218,17 +219,146 @@ void StateToCompile::apply(osg::Texture& texture)
     _textures.insert(&texture);
 }
 
+/////////////////////////////////////////////////////////////////
+//
+// CompileCostModel
+//
+CompileCostModel::CompileCostModel():
+    _decay(0.98),
+    _minimumNumSamples(4)
+{
+}
+
+void CompileCostModel::addSample(Type type, double size, double time)
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+    Model& model = _models[type];
+    model.weight = model.weight*_decay + 1.0;
+    model.sumSize = model.sumSize*_decay + size;
+    model.sumTime = model.sumTime*_decay + time;
+    model.sumSizeSize = model.sumSizeSize*_decay + size*size;
+    model.sumSizeTime = model.sumSizeTime*_decay + size*time;
+    ++model.numSamples;
+}
+
+bool CompileCostModel::estimate(Type type, double size, double& time) const
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+    const Model& model = _models[type];
+    if (model.numSamples<_minimumNumSamples || model.weight<=0.0) return false;
+
+    double meanSize = model.sumSize/model.weight;
+    double meanTime = model.sumTime/model.weight;
+    double varianceSize = model.sumSizeSize/model.weight - meanSize*meanSize;
+
+    // least squares fit of time = intercept + slope*size, falling back to the mean time when all the
+    // samples have had the same size, the slope and intercept are clamped to be non negative so that
+    // noisy samples can't lead to negative estimates.
+    double slope = 0.0;
+    if (varianceSize>meanSize*meanSize*1e-6)
+    {
+        slope = osg::maximum((model.sumSizeTime/model.weight - meanSize*meanTime)/varianceSize, 0.0);
+    }
+    double intercept = osg::maximum(meanTime - slope*meanSize, 0.0);
+
+    time = intercept + slope*size;
+    return true;
+}
+
+unsigned int CompileCostModel::getNumSamples(Type type) const
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+    return _models[type].numSamples;
+}
+
+void CompileCostModel::reset()
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+    for(unsigned int i=0; i<NUM_TYPES; ++i)
+    {
+        _models[i] = Model();
+    }
+}
+
+double CompileCostModel::computeCompileSize(const osg::Drawable* drawable)
+{
+    const osg::Geometry* geometry = drawable->asGeometry();
+    if (!geometry) return 0.0;
+
+    double size = 0.0;
+
+    osg::Geometry::ArrayList arrays;
+    const_cast<osg::Geometry*>(geometry)->getArrayList(arrays);
+    for(osg::Geometry::ArrayList::const_iterator itr = arrays.begin();
+        itr != arrays.end();
+        ++itr)
+    {
+        size += (*itr)->getTotalDataSize();
+    }
+
+    for(osg::Geometry::PrimitiveSetList::const_iterator itr = geometry->getPrimitiveSetList().begin();
+        itr != geometry->getPrimitiveSetList().end();
+        ++itr)
+    {
+        size += (*itr)->getTotalDataSize();
+    }
+
+    return size;
+}
+
+double CompileCostModel::computeCompileSize(const osg::Texture* texture)
+{
+    double size = 0.0;
+    for(unsigned int i=0; i<texture->getNumImages(); ++i)
+    {
+        const osg::Image* image = texture->getImage(i);
+        if (image) size += image->getTotalSizeInBytesIncludingMipmaps();
+    }
+    return size;
+}
+
+double CompileCostModel::computeCompileSize(const osg::Program* program)
+{
+    double size = 0.0;
+    for(unsigned int i=0; i<program->getNumShaders(); ++i)
+    {
+        const osg::Shader* shader = program->getShader(i);
+        if (shader) size += shader->getShaderSource().size();
+    }
+    return size;
+}
+
 /////////////////////////////////////////////////////////////////
 //
 // CompileOps
 //
+static bool estimateCompileCostFromModel(IncrementalCompileOperation::CompileInfo& compileInfo, CompileCostModel::Type type, double size, double& time)
+{
+    const CompileCostModel* model = compileInfo.incrementalCompileOperation ? compileInfo.incrementalCompileOperation->getCompileCostModel() : 0;
+    return model && model->estimate(type, size, time);
+}
+
 IncrementalCompileOperation::CompileDrawableOp::CompileDrawableOp(osg::Drawable* drawable):
-    _drawable(drawable)
+    _drawable(drawable),
+    _compileSize(CompileCostModel::computeCompileSize(drawable))
 {
 }
 
+bool IncrementalCompileOperation::CompileDrawableOp::getCompileCost(CompileCostModel::Type& type, double& size) const
+{
+    if (!_drawable->asGeometry()) return false;
+    type = CompileCostModel::DRAWABLE;
+    size = _compileSize;
+    return true;
+}
+
 double IncrementalCompileOperation::CompileDrawableOp::estimatedTimeForCompile(CompileInfo& compileInfo) const
 {
+    double time = 0.0;
+    if (_drawable->asGeometry() && estimateCompileCostFromModel(compileInfo, CompileCostModel::DRAWABLE, _compileSize, time)) return time;
+
     osg::GraphicsCostEstimator* gce = compileInfo.getState()->getGraphicsCostEstimator();
     osg::Geometry* geometry = _drawable->asGeometry();
     if (gce && geometry)
@@ -246,12 +376,23 @@ bool IncrementalCompileOperation::CompileDrawableOp::compile(CompileInfo& compil
 }
 
 IncrementalCompileOperation::CompileTextureOp::CompileTextureOp(osg::Texture* texture):
-    _texture(texture)
+    _texture(texture),
+    _compileSize(CompileCostModel::computeCompileSize(texture))
 {
 }
 
+bool IncrementalCompileOperation::CompileTextureOp::getCompileCost(CompileCostModel::Type& type, double& size) const
+{
+    type = CompileCostModel::TEXTURE;
+    size = _compileSize;
+    return true;
+}
+
 double IncrementalCompileOperation::CompileTextureOp::estimatedTimeForCompile(CompileInfo& compileInfo) const
 {
+    double time = 0.0;
+    if (estimateCompileCostFromModel(compileInfo, CompileCostModel::TEXTURE, _compileSize, time)) return time;
+
     osg::GraphicsCostEstimator* gce = compileInfo.getState()->getGraphicsCostEstimator();
     if (gce) return gce->estimateCompileCost(_texture.get()).first;
     else return 0.0;
@@ -283,12 +424,23 @@ bool IncrementalCompileOperation::CompileTextureOp::compile(CompileInfo& compile
 }
 
 IncrementalCompileOperation::CompileProgramOp::CompileProgramOp(osg::Program* program):
-    _program(program)
+    _program(program),
+    _compileSize(CompileCostModel::computeCompileSize(program))
+{
+}
+
+bool IncrementalCompileOperation::CompileProgramOp::getCompileCost(CompileCostModel::Type& type, double& size) const
 {
+    type = CompileCostModel::PROGRAM;
+    size = _compileSize;
+    return true;
 }
 
 double IncrementalCompileOperation::CompileProgramOp::estimatedTimeForCompile(CompileInfo& compileInfo) const
 {
+    double time = 0.0;
+    if (estimateCompileCostFromModel(compileInfo, CompileCostModel::PROGRAM, _compileSize, time)) return time;
+
     osg::GraphicsCostEstimator* gce = compileInfo.getState()->getGraphicsCostEstimator();
     if (gce) return gce->estimateCompileCost(_program.get()).first;
     else return 0.0;
@@ -304,6 +456,7 @@ bool IncrementalCompileOperation::CompileProgramOp::compile(CompileInfo& compile
 IncrementalCompileOperation::CompileInfo::CompileInfo(osg::GraphicsContext* context, IncrementalCompileOperation* ico):
     compileAll(false),
     maxNumObjectsToCompile(0),
+    numObjectsCompiled(0),
     allocatedTime(0)
 {
     setState(context->getState());
@@ -332,7 +485,7 @@ double IncrementalCompileOperation::CompileList::estimatedTimeForCompile(Compile
 {
     double estimateTime = 0.0;
     for(CompileOps::const_iterator itr = _compileOps.begin();
-        itr != _compileOps.begin();
+        itr != _compileOps.end();
         ++itr)
     {
         estimateTime += (*itr)->estimatedTimeForCompile(compileInfo);
@@ -342,35 +495,37 @@ double IncrementalCompileOperation::CompileList::estimatedTimeForCompile(Compile
 
 bool IncrementalCompileOperation::CompileList::compile(CompileInfo& compileInfo)
 {
-//#define USE_TIME_ESTIMATES
+    CompileCostModel* model = compileInfo.incrementalCompileOperation ? compileInfo.incrementalCompileOperation->getCompileCostModel() : 0;
 
     for(CompileOps::iterator itr = _compileOps.begin();
         itr != _compileOps.end() && compileInfo.okToCompile();
     )
     {
-        #ifdef USE_TIME_ESTIMATES
-        double estimatedCompileCost = (*itr)->estimatedTimeForCompile(compileInfo);
-        #endif
+        // defer compiles predicted to overrun the time remaining to a later frame, unless nothing has been
+        // compiled yet this frame, so that objects too expensive to ever fit in the time available still get compiled.
+        if (!compileInfo.compileAll && compileInfo.numObjectsCompiled>0 &&
+            !compileInfo.okToCompile((*itr)->estimatedTimeForCompile(compileInfo)))
+        {
+            ++itr;
+            continue;
+        }
 
         --compileInfo.maxNumObjectsToCompile;
+        ++compileInfo.numObjectsCompiled;
+
+        CompileCostModel::Type type;
+        double size = 0.0;
+        bool measure = model && (*itr)->getCompileCost(type, size);
 
-        #ifdef USE_TIME_ESTIMATES
         osg::ElapsedTime timer;
-        #endif
 
         CompileOps::iterator saved_itr(itr);
         ++itr;
         if ((*saved_itr)->compile(compileInfo))
         {
+            if (measure) model->addSample(type, size, timer.elapsedTime());
             _compileOps.erase(saved_itr);
         }
-
-        #ifdef USE_TIME_ESTIMATES
-        double actualCompileCost = timer.elapsedTime();
-        OSG_NOTICE<<"IncrementalCompileOperation::CompileList::compile() estimatedTimForCompile = "<<estimatedCompileCost*1000.0<<"ms, actual = "<<actualCompileCost*1000.0<<"ms";
-        if (estimatedCompileCost>0.0) OSG_NOTICE<<", ratio="<<(actualCompileCost/estimatedCompileCost);
-        OSG_NOTICE<<std::endl;
-        #endif
     }
     return empty();
 }
@@ -413,6 +568,32 @@ void IncrementalCompileOperation::CompileSet::buildCompileMap(ContextSet& contex
         {
             cl.add(*pitr);
         }
+
+        stageTextureImages(*itr, stc);
+    }
+}
+
+void IncrementalCompileOperation::CompileSet::stageTextureImages(osg::GraphicsContext* context, StateToCompile& stc)
+{
+    if (!context->getState() || stc._textures.empty()) return;
+
+    osg::TextureStagingBuffer* stagingBuffer = osg::Texture::getTextureObjectManager(context->getState()->getContextID())->getTextureStagingBuffer();
+    if (!stagingBuffer || !stagingBuffer->isRealized()) return;
+
+    // copy the image data into the TextureStagingBuffer on the calling thread, typically a DatabasePager thread,
+    // so that the texture compiles on the draw thread only have to issue the upload from it.
+    for(StateToCompile::TextureSet::iterator titr = stc._textures.begin();
+        titr != stc._textures.end();
+        ++titr)
+    {
+        osg::Texture* texture = *titr;
+        if (texture->getTextureTarget()!=GL_TEXTURE_2D && texture->getTextureTarget()!=GL_TEXTURE_CUBE_MAP) continue;
+
+        for(unsigned int i=0; i<texture->getNumImages(); ++i)
+        {
+            const osg::Image* image = texture->getImage(i);
+            if (image && !image->getBufferObject()) stagingBuffer->stage(image);
+        }
     }
 }
 
@@ -453,6 +634,12 @@ IncrementalCompileOperation::IncrementalCompileOperation():
 {
     _targetFrameRate = 100.0;
     _minimumTimeAvailableForGLCompileAndDeletePerFrame = 0.001; // 1ms.
+    _compileCostModel = new CompileCostModel;
+    _adaptiveTimeRatio = 1.0;
+    _compileBacklog = 0;
+    _compileBacklogTime = 0.0;
+    _allocatedCompileTime = 0.0;
+    _compileTime = 0.0;
     _maximumNumOfObjectsToCompilePerFrame = 20;
     const char* ptr = 0;
     if( (ptr = getenv("OSG_MINIMUM_COMPILE_TIME_PER_FRAME")) != 0)
@@ -673,16 +860,16 @@ void IncrementalCompileOperation::operator () (osg::GraphicsContext* context)
     OSG_NOTIFY(level)<<"    currentTime = "<<currentTime<<std::endl;
     OSG_NOTIFY(level)<<"    currentElapsedFrameTime = "<<currentElapsedFrameTime<<std::endl;
 
-    double _flushTimeRatio(0.5);
-    double _conservativeTimeRatio(0.5);
+    updateAdaptiveTimeRatio(context, targetFrameTime);
 
-    double availableTime = std::max((targetFrameTime - currentElapsedFrameTime)*_conservativeTimeRatio,
+    double availableTime = std::max((targetFrameTime - currentElapsedFrameTime)*_conservativeTimeRatio*_adaptiveTimeRatio,
                                     minimumTimeAvailableForGLCompileAndDeletePerFrame);
 
     double flushTime = availableTime * _flushTimeRatio;
     double compileTime = availableTime - flushTime;
 
 #if 1
+    OSG_NOTIFY(level)<<"    adaptiveTimeRatio = "<<_adaptiveTimeRatio<<std::endl;
     OSG_NOTIFY(level)<<"    availableTime = "<<availableTime*1000.0<<std::endl;
     OSG_NOTIFY(level)<<"    flushTime     = "<<flushTime*1000.0<<std::endl;
     OSG_NOTIFY(level)<<"    compileTime   = "<<compileTime*1000.0<<std::endl;
@@ -720,11 +907,70 @@ void IncrementalCompileOperation::operator () (osg::GraphicsContext* context)
         }
     }
 
+    computeCompileBacklog(toCompileCopy, compileInfo);
+
+    _allocatedCompileTime = availableTime;
+    _compileTime = compileInfo.timer.elapsedTime();
+
+    if (compileInfo.numObjectsCompiled>0)
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_frameTimingMutex);
+        _frameTimings[context].compiled = true;
+    }
+
     //glFush();
     //glFinish();
 }
 
-void IncrementalCompileOperation::compileSets(CompileSets& toCompile, CompileInfo compileInfo)
+void IncrementalCompileOperation::updateAdaptiveTimeRatio(osg::GraphicsContext* context, double targetFrameTime)
+{
+    const osg::FrameStamp* fs = context->getState()->getFrameStamp();
+    if (!fs) return;
+
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_frameTimingMutex);
+
+    FrameTiming& frameTiming = _frameTimings[context];
+    double currentTime = fs->getReferenceTime();
+    if (frameTiming.previousTime>=0.0 && currentTime>frameTiming.previousTime)
+    {
+        double frameTime = currentTime - frameTiming.previousTime;
+        if (frameTiming.compiled && frameTime>targetFrameTime)
+        {
+            // the previous frame compiled objects and overran the target frame time so be more conservative.
+            _adaptiveTimeRatio = osg::maximum(_adaptiveTimeRatio*0.8, 0.1);
+        }
+        else
+        {
+            _adaptiveTimeRatio = osg::minimum(_adaptiveTimeRatio+0.05, 1.0);
+        }
+    }
+    frameTiming.previousTime = currentTime;
+    frameTiming.compiled = false;
+}
+
+void IncrementalCompileOperation::computeCompileBacklog(CompileSets& toCompile, CompileInfo& compileInfo)
+{
+    unsigned int backlog = 0;
+    double backlogTime = 0.0;
+
+    osg::GraphicsContext* context = compileInfo.getState()->getGraphicsContext();
+    for(CompileSets::iterator itr = toCompile.begin();
+        itr != toCompile.end();
+        ++itr)
+    {
+        CompileSet::CompileMap::iterator cl_itr = (*itr)->_compileMap.find(context);
+        if (cl_itr != (*itr)->_compileMap.end())
+        {
+            backlog += cl_itr->second.size();
+            backlogTime += cl_itr->second.estimatedTimeForCompile(compileInfo);
+        }
+    }
+
+    _compileBacklog = backlog;
+    _compileBacklogTime = backlogTime;
+}
+
+void IncrementalCompileOperation::compileSets(CompileSets& toCompile, CompileInfo& compileInfo)
 {
     osg::NotifySeverity level = osg::INFO;
 
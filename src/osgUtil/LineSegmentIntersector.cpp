@@ -407,20 +407,22 @@ void LineSegmentIntersector::intersect(osgUtil::IntersectionVisitor& iv, osg::Dr
             if (geometry)
             {
                 osg::Vec3Array* vertices = dynamic_cast<osg::Vec3Array*>(geometry->getVertexArray());
-                if (vertices)
+                if (vertices && !vertices->empty())
                 {
+                    // decoded and instanced vertices are passed on as copies, so have no index into the vertex array.
                     osg::Vec3* first = &(vertices->front());
-                    if (triHit._v1)
+                    osg::Vec3* last = first + vertices->size();
+                    if (triHit._v1 && triHit._v1>=first && triHit._v1<last)
                     {
                         hit.indexList.push_back(triHit._v1-first);
                         hit.ratioList.push_back(triHit._r1);
                     }
-                    if (triHit._v2)
+                    if (triHit._v2 && triHit._v2>=first && triHit._v2<last)
                     {
                         hit.indexList.push_back(triHit._v2-first);
                         hit.ratioList.push_back(triHit._r2);
                     }
-                    if (triHit._v3)
+                    if (triHit._v3 && triHit._v3>=first && triHit._v3<last)
                     {
                         hit.indexList.push_back(triHit._v3-first);
                         hit.ratioList.push_back(triHit._r3);
@@ -16,17 +16,20 @@
 #include <limits>
 
 #include <algorithm>
+#include <map>
 #include <utility>
 #include <vector>
 
 #include <iostream>
 
 #include <osg/Geometry>
+#include <osg/KdTree>
 #include <osg/Math>
 #include <osg/PrimitiveSet>
 #include <osg/TriangleIndexFunctor>
 
 #include <osgUtil/MeshOptimizers>
+#include <osgUtil/RangeOperation>
 
 using namespace std;
 using namespace osg;
@@ -898,7 +901,8 @@ void VertexCacheVisitor::optimizeVertices()
 
 VertexCacheMissVisitor::VertexCacheMissVisitor(unsigned cacheSize)
     : osg::NodeVisitor(NodeVisitor::TRAVERSE_ALL_CHILDREN), misses(0),
-      triangles(0), _cacheSize(cacheSize)
+      triangles(0), vertices(0), vertexBytes(0), fetchedBytes(0),
+      _cacheSize(cacheSize)
 {
 }
 
@@ -906,6 +910,24 @@ void VertexCacheMissVisitor::reset()
 {
     misses = 0;
     triangles = 0;
+    vertices = 0;
+    vertexBytes = 0;
+    fetchedBytes = 0;
+}
+
+double VertexCacheMissVisitor::getACMR() const
+{
+    return triangles > 0 ? (double)misses / (double)triangles : 0.0;
+}
+
+double VertexCacheMissVisitor::getATVR() const
+{
+    return vertices > 0 ? (double)misses / (double)vertices : 0.0;
+}
+
+double VertexCacheMissVisitor::getOverfetch() const
+{
+    return vertexBytes > 0 ? (double)fetchedBytes / (double)vertexBytes : 0.0;
 }
 
 void VertexCacheMissVisitor::apply(Geode& geode)
@@ -957,6 +979,8 @@ struct CacheRecordOperator
     FIFOCache* cache;
     unsigned misses;
     unsigned triangles;
+    // The vertices transformed, in order, for the fetch statistics
+    vector<unsigned> missedVertices;
     void operator()(unsigned p1, unsigned p2, unsigned p3)
     {
         unsigned verts[3];
@@ -964,14 +988,52 @@ struct CacheRecordOperator
         verts[1] = p2;
         verts[2] = p3;
         triangles++;
+        // Only the vertices that miss enter a FIFO cache
+        unsigned missed[3];
+        unsigned numMissed = 0;
         for (int i = 0; i < 3; ++i)
         {
             if (find(cache->entries.begin(), cache->entries.end(), verts[i])
-                == cache->entries.end())
+                == cache->entries.end()
+                && find(&missed[0], &missed[numMissed], verts[i])
+                == &missed[numMissed])
+            {
                 misses++;
+                missedVertices.push_back(verts[i]);
+                missed[numMissed++] = verts[i];
+            }
+        }
+        cache->addEntries(&missed[0], &missed[numMissed]);
+    }
+};
+
+// A direct mapped cache of the 64 byte lines of the vertex arrays,
+// approximating the GPU's vertex fetch cache.
+struct FetchCache
+{
+    static const unsigned lineSize = 64;
+    static const unsigned numLines = 256;
+
+    FetchCache() : lines(numLines, ~0ull), fetchedBytes(0) {}
+
+    void fetch(unsigned array, unsigned long long begin, unsigned long long end)
+    {
+        for (unsigned long long line = begin / lineSize;
+             line <= (end - 1) / lineSize;
+             ++line)
+        {
+            unsigned long long tag = (line << 5) | array;
+            unsigned slot = (unsigned)((line * 31 + array) % numLines);
+            if (lines[slot] != tag)
+            {
+                lines[slot] = tag;
+                fetchedBytes += lineSize;
+            }
         }
-        cache->addEntries(&verts[0], &verts[3]);
     }
+
+    vector<unsigned long long> lines;
+    unsigned long long fetchedBytes;
 };
 
 struct CacheRecorder : public TriangleIndexFunctor<CacheRecordOperator>
@@ -1004,6 +1066,43 @@ void VertexCacheMissVisitor::doGeometry(Geometry& geom)
     }
     misses += recorder.misses;
     triangles += recorder.triangles;
+
+    // Simulate fetching the vertex data of each transformed vertex.
+    GeometryArrayGatherer gatherer(geom);
+    vector<unsigned> elementSizes;
+    unsigned vertexSize = 0;
+    for (GeometryArrayGatherer::ArrayList::iterator itr = gatherer._arrayList.begin(),
+             end = gatherer._arrayList.end();
+         itr != end;
+         ++itr)
+    {
+        unsigned numElements = (*itr)->getNumElements();
+        elementSizes.push_back(numElements > 0 ? (*itr)->getTotalDataSize() / numElements : 0);
+        vertexSize += elementSizes.back();
+    }
+    vector<bool> referenced(vertArray->getNumElements(), false);
+    FetchCache fetchCache;
+    for (vector<unsigned>::iterator itr = recorder.missedVertices.begin(),
+             end = recorder.missedVertices.end();
+         itr != end;
+         ++itr)
+    {
+        unsigned vert = *itr;
+        if (vert < referenced.size() && !referenced[vert])
+        {
+            referenced[vert] = true;
+            ++vertices;
+            vertexBytes += vertexSize;
+        }
+        for (unsigned i = 0; i < elementSizes.size(); ++i)
+        {
+            if (elementSizes[i] == 0 || vert >= gatherer._arrayList[i]->getNumElements())
+                continue;
+            unsigned long long begin = (unsigned long long)vert * elementSizes[i];
+            fetchCache.fetch(i, begin, begin + elementSizes[i]);
+        }
+    }
+    fetchedBytes += fetchCache.fetchedBytes;
 }
 
 namespace
@@ -1178,4 +1277,535 @@ void VertexAccessOrderVisitor::optimizeOrder(Geometry& geom)
     }
     geom.dirtyDisplayList();
 }
+
+namespace
+{
+const unsigned invalidVertex = std::numeric_limits<unsigned>::max();
+
+// Collect the vertex indices of the non degenerate triangles.
+struct TriangleListOperator
+{
+    TriangleListOperator() : indices(0) {}
+    vector<unsigned>* indices;
+    void operator()(unsigned p1, unsigned p2, unsigned p3)
+    {
+        if (p1 == p2 || p2 == p3 || p1 == p3)
+            return;
+        indices->push_back(p1);
+        indices->push_back(p2);
+        indices->push_back(p3);
+    }
+};
+
+typedef TriangleIndexFunctor<TriangleListOperator> TriangleListCollector;
+
+// Reorder the triangles for a post-transform cache of cacheSize
+// entries, in time linear in the number of triangles. The triangles
+// are emitted in fans around a vertex, choosing the next vertex to fan
+// around from the vertices of the last fan that will still be in the
+// cache once its remaining triangles are emitted. clusterStarts
+// receives the position in triangleOrder of the first triangle after
+// every jump to a vertex that wasn't one of those candidates.
+void tipsify(const vector<unsigned>& indices, unsigned numVertices,
+             unsigned cacheSize, vector<unsigned>& triangleOrder,
+             vector<unsigned>& clusterStarts)
+{
+    unsigned numTriangles = indices.size() / 3;
+
+    // The triangles that use each vertex
+    vector<unsigned> liveTriangles(numVertices, 0);
+    for (vector<unsigned>::const_iterator itr = indices.begin(),
+             end = indices.end();
+         itr != end;
+         ++itr)
+        ++liveTriangles[*itr];
+    vector<unsigned> offsets(numVertices + 1, 0);
+    for (unsigned v = 0; v < numVertices; ++v)
+        offsets[v + 1] = offsets[v] + liveTriangles[v];
+    vector<unsigned> adjacency(indices.size());
+    vector<unsigned> fill(offsets.begin(), offsets.end() - 1);
+    for (unsigned t = 0; t < numTriangles; ++t)
+        for (unsigned c = 0; c < 3; ++c)
+            adjacency[fill[indices[t * 3 + c]]++] = t;
+
+    // A vertex is in the cache while timeStamp - cacheTime[v] <= cacheSize
+    vector<unsigned> cacheTime(numVertices, 0);
+    unsigned timeStamp = cacheSize + 1;
+    vector<bool> emitted(numTriangles, false);
+    vector<unsigned> deadEnd;
+    deadEnd.reserve(indices.size());
+    vector<unsigned> candidates;
+    unsigned cursor = 0;
+
+    triangleOrder.clear();
+    triangleOrder.reserve(numTriangles);
+    clusterStarts.clear();
+    clusterStarts.push_back(0);
+
+    while (cursor < numVertices && liveTriangles[cursor] == 0)
+        ++cursor;
+    unsigned fanning = cursor < numVertices ? cursor : invalidVertex;
+    while (fanning != invalidVertex)
+    {
+        candidates.clear();
+        for (unsigned a = offsets[fanning]; a < offsets[fanning + 1]; ++a)
+        {
+            unsigned t = adjacency[a];
+            if (emitted[t])
+                continue;
+            emitted[t] = true;
+            triangleOrder.push_back(t);
+            for (unsigned c = 0; c < 3; ++c)
+            {
+                unsigned v = indices[t * 3 + c];
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                --liveTriangles[v];
+                if (timeStamp - cacheTime[v] > cacheSize)
+                    cacheTime[v] = timeStamp++;
+            }
+        }
+
+        // Prefer the oldest candidate that will stay in the cache
+        unsigned next = invalidVertex;
+        int bestPriority = -1;
+        for (vector<unsigned>::iterator itr = candidates.begin(),
+                 end = candidates.end();
+             itr != end;
+             ++itr)
+        {
+            unsigned v = *itr;
+            if (liveTriangles[v] == 0)
+                continue;
+            int priority = 0;
+            if (timeStamp - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+                priority = timeStamp - cacheTime[v];
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                next = v;
+            }
+        }
+
+        if (next == invalidVertex)
+        {
+            // Dead end: try the most recently used vertices, then the
+            // remaining vertices in order.
+            while (!deadEnd.empty() && next == invalidVertex)
+            {
+                unsigned v = deadEnd.back();
+                deadEnd.pop_back();
+                if (liveTriangles[v] > 0)
+                    next = v;
+            }
+            while (next == invalidVertex && cursor < numVertices)
+            {
+                if (liveTriangles[cursor] > 0)
+                    next = cursor;
+                else
+                    ++cursor;
+            }
+            if (next != invalidVertex)
+                clusterStarts.push_back(triangleOrder.size());
+        }
+        fanning = next;
+    }
+}
+
+// Simulate a FIFO cache of cacheSize entries, returning the misses.
+// cacheTime and timeStamp carry the state of the cache from triangle to
+// triangle: a vertex is in the cache while timeStamp - cacheTime[v] <=
+// cacheSize.
+inline unsigned simulateFIFO(const vector<unsigned>& indices, unsigned t,
+                             unsigned cacheSize, vector<unsigned>& cacheTime,
+                             unsigned& timeStamp)
+{
+    unsigned misses = 0;
+    for (unsigned c = 0; c < 3; ++c)
+    {
+        unsigned v = indices[t * 3 + c];
+        if (timeStamp - cacheTime[v] > cacheSize)
+        {
+            cacheTime[v] = timeStamp++;
+            ++misses;
+        }
+    }
+    return misses;
+}
+
+// Split the clusters further, ending a cluster once its average cache
+// miss ratio, simulated from an empty cache, is within threshold times
+// the ratio of the whole order. Each cluster is then large enough that
+// drawing it after any other cluster costs few extra cache misses.
+void splitClusters(const vector<unsigned>& indices,
+                   const vector<unsigned>& triangleOrder, unsigned numVertices,
+                   unsigned cacheSize, float threshold,
+                   const vector<unsigned>& hardStarts,
+                   vector<unsigned>& clusterStarts)
+{
+    vector<unsigned> cacheTime(numVertices, 0);
+    unsigned timeStamp = cacheSize + 1;
+    unsigned misses = 0;
+    for (unsigned i = 0; i < triangleOrder.size(); ++i)
+        misses += simulateFIFO(indices, triangleOrder[i], cacheSize, cacheTime, timeStamp);
+    float targetRatio = threshold * misses / osg::maximum(triangleOrder.size(), size_t(1));
+
+    misses = 0;
+    unsigned triangles = 0;
+    timeStamp += cacheSize + 1;
+    vector<unsigned>::const_iterator hardItr = hardStarts.begin();
+    clusterStarts.clear();
+    for (unsigned i = 0; i < triangleOrder.size(); ++i)
+    {
+        bool hard = hardItr != hardStarts.end() && *hardItr == i;
+        if (hard)
+            ++hardItr;
+        if (hard || (triangles > 0 && misses <= targetRatio * triangles))
+        {
+            clusterStarts.push_back(i);
+            // Flush the cache
+            timeStamp += cacheSize + 1;
+            misses = 0;
+            triangles = 0;
+        }
+        misses += simulateFIFO(indices, triangleOrder[i], cacheSize, cacheTime, timeStamp);
+        ++triangles;
+    }
+}
+
+struct CompareClusters
+{
+    bool operator()(const pair<float, unsigned>& lhs,
+                    const pair<float, unsigned>& rhs) const
+    {
+        return lhs.first > rhs.first;
+    }
+};
+
+// Sort the clusters so that those on the outside of the mesh, facing
+// away from its centroid, are drawn first and occlude the rest.
+void sortClusters(const vector<unsigned>& indices, const Vec3Array& coords,
+                  vector<unsigned>& triangleOrder,
+                  const vector<unsigned>& clusterStarts)
+{
+    unsigned numClusters = clusterStarts.size();
+    vector<Vec3> clusterNormals(numClusters);
+    vector<Vec3> clusterCentroids(numClusters);
+    vector<float> clusterAreas(numClusters, 0.0f);
+    Vec3 meshCentroid;
+    float meshArea = 0.0f;
+    for (unsigned c = 0; c < numClusters; ++c)
+    {
+        unsigned end = c + 1 < numClusters ? clusterStarts[c + 1] : triangleOrder.size();
+        for (unsigned i = clusterStarts[c]; i < end; ++i)
+        {
+            unsigned t = triangleOrder[i];
+            const Vec3& v0 = coords[indices[t * 3]];
+            const Vec3& v1 = coords[indices[t * 3 + 1]];
+            const Vec3& v2 = coords[indices[t * 3 + 2]];
+            Vec3 normal = (v1 - v0) ^ (v2 - v0);
+            float area = normal.length() * 0.5f;
+            clusterNormals[c] += normal;
+            clusterCentroids[c] += (v0 + v1 + v2) * (area / 3.0f);
+            clusterAreas[c] += area;
+        }
+        meshCentroid += clusterCentroids[c];
+        meshArea += clusterAreas[c];
+    }
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    vector<pair<float, unsigned> > keys(numClusters);
+    for (unsigned c = 0; c < numClusters; ++c)
+    {
+        float key = 0.0f;
+        if (clusterAreas[c] > 0.0f)
+        {
+            clusterNormals[c].normalize();
+            key = (clusterCentroids[c] / clusterAreas[c] - meshCentroid) * clusterNormals[c];
+        }
+        keys[c] = make_pair(key, c);
+    }
+    stable_sort(keys.begin(), keys.end(), CompareClusters());
+
+    vector<unsigned> sortedOrder;
+    sortedOrder.reserve(triangleOrder.size());
+    for (unsigned k = 0; k < numClusters; ++k)
+    {
+        unsigned c = keys[k].second;
+        unsigned end = c + 1 < numClusters ? clusterStarts[c + 1] : triangleOrder.size();
+        sortedOrder.insert(sortedOrder.end(), triangleOrder.begin() + clusterStarts[c],
+                           triangleOrder.begin() + end);
+    }
+    triangleOrder.swap(sortedOrder);
+}
+
+inline GLshort quantizeSNorm16(float value)
+{
+    return static_cast<GLshort>(floorf(clampBetween(value, -1.0f, 1.0f) * 32767.0f + 0.5f));
+}
+
+template<class ARRAY>
+bool isWithinRange(const ARRAY& array, float minimum, float maximum)
+{
+    for (typename ARRAY::const_iterator itr = array.begin(), end = array.end();
+         itr != end;
+         ++itr)
+    {
+        for (unsigned i = 0; i < ARRAY::ElementDataType::num_components; ++i)
+        {
+            if (!((*itr)[i] >= minimum && (*itr)[i] <= maximum))
+                return false;
+        }
+    }
+    return true;
+}
+
+template<class SRC, class DST>
+DST* quantizeToSNorm16(const SRC& array)
+{
+    DST* quantized = new DST(array.size());
+    for (unsigned i = 0; i < array.size(); ++i)
+        for (unsigned c = 0; c < SRC::ElementDataType::num_components; ++c)
+            (*quantized)[i][c] = quantizeSNorm16(array[i][c]);
+    return quantized;
+}
+
+Array* quantizeVertexAttribArray(Array* array)
+{
+    switch (array->getType())
+    {
+    case Array::Vec2ArrayType:
+        if (isWithinRange(*static_cast<Vec2Array*>(array), -1.0f, 1.0f))
+            return quantizeToSNorm16<Vec2Array, Vec2sArray>(*static_cast<Vec2Array*>(array));
+        break;
+    case Array::Vec3ArrayType:
+        if (isWithinRange(*static_cast<Vec3Array*>(array), -1.0f, 1.0f))
+            return quantizeToSNorm16<Vec3Array, Vec3sArray>(*static_cast<Vec3Array*>(array));
+        break;
+    case Array::Vec4ArrayType:
+        if (isWithinRange(*static_cast<Vec4Array*>(array), -1.0f, 1.0f))
+            return quantizeToSNorm16<Vec4Array, Vec4sArray>(*static_cast<Vec4Array*>(array));
+        break;
+    default:
+        break;
+    }
+    return 0;
+}
+
+void quantizeArrays(Geometry& geom, unsigned flags)
+{
+    if (!geom.areFastPathsUsed())
+        return;
+
+    if ((flags & MeshOptimizerVisitor::QUANTIZE_VERTICES) && !geom.getVertexDecodeMatrix())
+    {
+        Matrixd decodeMatrix;
+        ref_ptr<Vec3sArray> quantized = quantizeVertexArray(geom.getVertexArray(), decodeMatrix);
+        if (quantized.valid())
+        {
+            geom.setVertexArray(quantized.get());
+            geom.setVertexDecodeMatrix(new RefMatrix(decodeMatrix));
+        }
+    }
+
+    if (flags & MeshOptimizerVisitor::QUANTIZE_NORMALS)
+    {
+        ref_ptr<Vec3bArray> quantized = quantizeNormalArray(geom.getNormalArray());
+        if (quantized.valid()) geom.setNormalArray(quantized.get());
+    }
+
+    if (flags & MeshOptimizerVisitor::QUANTIZE_COLORS)
+    {
+        ref_ptr<Vec4ubArray> quantized = quantizeColorArray(geom.getColorArray());
+        if (quantized.valid()) geom.setColorArray(quantized.get());
+    }
+
+    if (flags & MeshOptimizerVisitor::QUANTIZE_VERTEX_ATTRIBS)
+    {
+        for (unsigned i = 0; i < geom.getNumVertexAttribArrays(); ++i)
+        {
+            Array* array = geom.getVertexAttribArray(i);
+            if (!array || geom.getVertexAttribBinding(i) != Geometry::BIND_PER_VERTEX)
+                continue;
+            ref_ptr<Array> quantized = quantizeVertexAttribArray(array);
+            if (quantized.valid())
+            {
+                geom.setVertexAttribArray(i, quantized.get());
+                geom.setVertexAttribNormalize(i, GL_TRUE);
+            }
+        }
+    }
+}
+
+// Optimize a range of the geometries, on one of several threads.
+class OptimizeMeshOperation : public RangeOperation
+{
+public:
+    OptimizeMeshOperation(MeshOptimizerVisitor& visitor,
+                          const vector<Geometry*>& geometries,
+                          const vector<bool>& shared)
+        : _visitor(visitor), _geometries(geometries), _shared(shared)
+    {
+    }
+
+    virtual void operator()(unsigned begin, unsigned end)
+    {
+        for (unsigned i = begin; i < end; ++i)
+            _visitor.optimizeMesh(*_geometries[i], !_shared[i]);
+    }
+
+protected:
+    OptimizeMeshOperation& operator = (const OptimizeMeshOperation&) { return *this; }
+
+    MeshOptimizerVisitor& _visitor;
+    const vector<Geometry*>& _geometries;
+    const vector<bool>& _shared;
+};
+}
+
+MeshOptimizerVisitor::MeshOptimizerVisitor(Optimizer* optimizer)
+    : GeometryCollector(optimizer, Optimizer::OPTIMIZE_MESH),
+      _cacheSize(16), _overdrawThreshold(1.05f),
+      _quantization(QUANTIZE_NONE), _numThreads(0)
+{
+}
+
+void MeshOptimizerVisitor::optimizeMesh(Geometry& geom, bool modifyArrays)
+{
+    Array* vertArray = geom.getVertexArray();
+    if (!vertArray)
+        return;
+    unsigned numVertices = vertArray->getNumElements();
+
+    // Only indexed polygons can be reordered, as for VertexCacheVisitor.
+    bool reorder = numVertices > _cacheSize;
+    Geometry::PrimitiveSetList& primSets = geom.getPrimitiveSetList();
+    for (Geometry::PrimitiveSetList::iterator itr = primSets.begin(),
+             end = primSets.end();
+         itr != end && reorder;
+         ++itr)
+    {
+        switch ((*itr)->getMode())
+        {
+        case(PrimitiveSet::TRIANGLES):
+        case(PrimitiveSet::TRIANGLE_STRIP):
+        case(PrimitiveSet::TRIANGLE_FAN):
+        case(PrimitiveSet::QUADS):
+        case(PrimitiveSet::QUAD_STRIP):
+        case(PrimitiveSet::POLYGON):
+            break;
+        default:
+            reorder = false;
+        }
+        PrimitiveSet::Type type = (*itr)->getType();
+        if (type != PrimitiveSet::DrawElementsUBytePrimitiveType
+            && type != PrimitiveSet::DrawElementsUShortPrimitiveType
+            && type != PrimitiveSet::DrawElementsUIntPrimitiveType)
+            reorder = false;
+    }
+
+    vector<unsigned> indices;
+    if (reorder)
+    {
+        TriangleListCollector collector;
+        collector.indices = &indices;
+        for (Geometry::PrimitiveSetList::iterator itr = primSets.begin(),
+                 end = primSets.end();
+             itr != end;
+             ++itr)
+            (*itr)->accept(collector);
+    }
+
+    if (!indices.empty())
+    {
+        vector<unsigned> triangleOrder;
+        vector<unsigned> hardStarts;
+        tipsify(indices, numVertices, _cacheSize, triangleOrder, hardStarts);
+
+        Vec3Array* coords = dynamic_cast<Vec3Array*>(vertArray);
+        if (coords && _overdrawThreshold >= 0.0f)
+        {
+            vector<unsigned> clusterStarts;
+            splitClusters(indices, triangleOrder, numVertices, _cacheSize,
+                          _overdrawThreshold, hardStarts, clusterStarts);
+            sortClusters(indices, *coords, triangleOrder, clusterStarts);
+        }
+
+        DrawElements* elements;
+        if (numVertices < 65536)
+            elements = new DrawElementsUShort(GL_TRIANGLES);
+        else
+            elements = new DrawElementsUInt(GL_TRIANGLES);
+        elements->reserveElements(indices.size());
+        for (vector<unsigned>::iterator itr = triangleOrder.begin(),
+                 end = triangleOrder.end();
+             itr != end;
+             ++itr)
+        {
+            elements->addElement(indices[*itr * 3]);
+            elements->addElement(indices[*itr * 3 + 1]);
+            elements->addElement(indices[*itr * 3 + 2]);
+        }
+        if (geom.getUseVertexBufferObjects())
+        {
+            elements->setElementBufferObject(new ElementBufferObject);
+        }
+        Geometry::PrimitiveSetList newPrims;
+        newPrims.push_back(elements);
+        geom.setPrimitiveSetList(newPrims);
+
+        // A KdTree built for the old triangle order is no longer valid
+        if (dynamic_cast<KdTree*>(geom.getShape()))
+            geom.setShape(0);
+
+        if (modifyArrays)
+        {
+            VertexAccessOrderVisitor vaov;
+            vaov.optimizeOrder(geom);
+        }
+    }
+
+    if (modifyArrays && _quantization != QUANTIZE_NONE)
+        quantizeArrays(geom, _quantization);
+
+    geom.dirtyDisplayList();
+}
+
+void MeshOptimizerVisitor::optimizeMesh()
+{
+    vector<Geometry*> geometries(_geometryList.begin(), _geometryList.end());
+
+    // Arrays shared between geometries can't be reordered or replaced
+    // for one geometry without breaking the others.
+    typedef std::map<Array*, unsigned> ArrayUseCount;
+    ArrayUseCount arrayUseCount;
+    for (vector<Geometry*>::iterator itr = geometries.begin(),
+             end = geometries.end();
+         itr != end;
+         ++itr)
+    {
+        GeometryArrayGatherer gatherer(*(*itr));
+        for (GeometryArrayGatherer::ArrayList::iterator aitr = gatherer._arrayList.begin(),
+                 aend = gatherer._arrayList.end();
+             aitr != aend;
+             ++aitr)
+            ++arrayUseCount[*aitr];
+    }
+    vector<bool> shared(geometries.size(), false);
+    for (unsigned i = 0; i < geometries.size(); ++i)
+    {
+        GeometryArrayGatherer gatherer(*geometries[i]);
+        for (GeometryArrayGatherer::ArrayList::iterator aitr = gatherer._arrayList.begin(),
+                 aend = gatherer._arrayList.end();
+             aitr != aend;
+             ++aitr)
+            if (arrayUseCount[*aitr] > 1)
+                shared[i] = true;
+    }
+
+    // The geometries are taken one at a time as their cost varies widely.
+    OptimizeMeshOperation operation(*this, geometries, shared);
+    runInParallel(operation, geometries.size(), _numThreads, 1, 1);
+}
 }
@@ -23,6 +23,7 @@
 #include <osg/Billboard>
 #include <osg/CameraView>
 #include <osg/Geometry>
+#include <osg/KdTree>
 #include <osg/Notify>
 #include <osg/OccluderNode>
 #include <osg/Sequence>
@@ -33,6 +34,7 @@
 #include <osg/ImageStream>
 #include <osg/Timer>
 #include <osg/TexMat>
+#include <osg/TriangleIndexFunctor>
 #include <osg/io_utils>
 
 #include <osgUtil/TransformAttributeFunctor>
@@ -40,6 +42,7 @@
 #include <osgUtil/Tessellator>
 #include <osgUtil/Statistics>
 #include <osgUtil/MeshOptimizers>
+#include <osgUtil/RangeOperation>
 
 #include <typeinfo>
 #include <algorithm>
@@ -55,7 +58,7 @@ void Optimizer::reset()
 {
 }
 
-static osg::ApplicationUsageProxy Optimizer_e0(osg::ApplicationUsage::ENVIRONMENTAL_VARIABLE,"OSG_OPTIMIZER \"<type> [<type>]\"","OFF | DEFAULT | FLATTEN_STATIC_TRANSFORMS | FLATTEN_STATIC_TRANSFORMS_DUPLICATING_SHARED_SUBGRAPHS | REMOVE_REDUNDANT_NODES | COMBINE_ADJACENT_LODS | SHARE_DUPLICATE_STATE | MERGE_GEOMETRY | MERGE_GEODES | SPATIALIZE_GROUPS  | COPY_SHARED_NODES  | TRISTRIP_GEOMETRY | OPTIMIZE_TEXTURE_SETTINGS | REMOVE_LOADED_PROXY_NODES | TESSELLATE_GEOMETRY | CHECK_GEOMETRY |  FLATTEN_BILLBOARDS | TEXTURE_ATLAS_BUILDER | STATIC_OBJECT_DETECTION | INDEX_MESH | VERTEX_POSTTRANSFORM | VERTEX_PRETRANSFORM");
+static osg::ApplicationUsageProxy Optimizer_e0(osg::ApplicationUsage::ENVIRONMENTAL_VARIABLE,"OSG_OPTIMIZER \"<type> [<type>]\"","OFF | DEFAULT | FLATTEN_STATIC_TRANSFORMS | FLATTEN_STATIC_TRANSFORMS_DUPLICATING_SHARED_SUBGRAPHS | REMOVE_REDUNDANT_NODES | COMBINE_ADJACENT_LODS | SHARE_DUPLICATE_STATE | MERGE_GEOMETRY | MERGE_GEODES | SPATIALIZE_GROUPS  | COPY_SHARED_NODES  | TRISTRIP_GEOMETRY | OPTIMIZE_TEXTURE_SETTINGS | REMOVE_LOADED_PROXY_NODES | TESSELLATE_GEOMETRY | CHECK_GEOMETRY |  FLATTEN_BILLBOARDS | TEXTURE_ATLAS_BUILDER | STATIC_OBJECT_DETECTION | INDEX_MESH | VERTEX_POSTTRANSFORM | VERTEX_PRETRANSFORM | SPATIALIZE_HIERARCHY | OPTIMIZE_MESH");
 
 void Optimizer::optimize(osg::Node* node)
 {
@@ -135,6 +138,12 @@ void Optimizer::optimize(osg::Node* node)
         if(str.find("~VERTEX_PRETRANSFORM")!=std::string::npos) options ^= VERTEX_PRETRANSFORM;
         else if(str.find("VERTEX_PRETRANSFORM")!=std::string::npos) options |= VERTEX_PRETRANSFORM;
 
+        if(str.find("~SPATIALIZE_HIERARCHY")!=std::string::npos) options ^= SPATIALIZE_HIERARCHY;
+        else if(str.find("SPATIALIZE_HIERARCHY")!=std::string::npos) options |= SPATIALIZE_HIERARCHY;
+
+        if(str.find("~OPTIMIZE_MESH")!=std::string::npos) options ^= OPTIMIZE_MESH;
+        else if(str.find("OPTIMIZE_MESH")!=std::string::npos) options |= OPTIMIZE_MESH;
+
     }
     else
     {
@@ -357,6 +366,15 @@ void Optimizer::optimize(osg::Node* node, unsigned int options)
         sv.divide();
     }
 
+    if (options & SPATIALIZE_HIERARCHY)
+    {
+        OSG_INFO<<"Optimizer::optimize() doing SPATIALIZE_HIERARCHY"<<std::endl;
+
+        SpatializeHierarchyVisitor shv(this);
+        node->accept(shv);
+        shv.spatialize();
+    }
+
     if (options & INDEX_MESH)
     {
         OSG_INFO<<"Optimizer::optimize() doing INDEX_MESH"<<std::endl;
@@ -365,6 +383,14 @@ void Optimizer::optimize(osg::Node* node, unsigned int options)
         imv.makeMesh();
     }
 
+    if (options & OPTIMIZE_MESH)
+    {
+        OSG_INFO<<"Optimizer::optimize() doing OPTIMIZE_MESH"<<std::endl;
+        MeshOptimizerVisitor mov(this);
+        node->accept(mov);
+        mov.optimizeMesh();
+    }
+
     if (options & VERTEX_POSTTRANSFORM)
     {
         OSG_INFO<<"Optimizer::optimize() doing VERTEX_POSTTRANSFORM"<<std::endl;
@@ -922,11 +948,24 @@ class CollectLowestTransformsVisitor : public BaseOptimizerVisitor
 };
 
 
+// Geometry with quantized vertices has the matrix folded into its vertex decode matrix rather than its arrays
+// rewritten, the decode matrix is applied to the modelview matrix when drawing so transforms the normals too.
+static bool foldIntoVertexDecodeMatrix(osg::Drawable* drawable, const osg::Matrix& matrix)
+{
+    osg::Geometry* geometry = drawable->asGeometry();
+    if (!geometry || !geometry->getVertexDecodeMatrix()) return false;
+
+    geometry->setVertexDecodeMatrix(new osg::RefMatrix((*geometry->getVertexDecodeMatrix()) * matrix));
+    return true;
+}
+
 void CollectLowestTransformsVisitor::doTransform(osg::Object* obj,osg::Matrix& matrix)
 {
     osg::Drawable* drawable = dynamic_cast<osg::Drawable*>(obj);
     if (drawable)
     {
+        if (foldIntoVertexDecodeMatrix(drawable, matrix)) return;
+
         osgUtil::TransformAttributeFunctor tf(matrix);
         drawable->accept(tf);
         drawable->dirtyBound();
@@ -978,6 +1017,8 @@ void CollectLowestTransformsVisitor::doTransform(osg::Object* obj,osg::Matrix& m
         for(unsigned int i=0;i<billboard->getNumDrawables();++i)
         {
             billboard->setPosition(i,billboard->getPosition(i)*matrix);
+            if (foldIntoVertexDecodeMatrix(billboard->getDrawable(i), matrix_no_trans)) continue;
+
             billboard->getDrawable(i)->accept(tf);
             billboard->getDrawable(i)->dirtyBound();
         }
@@ -1676,6 +1717,17 @@ void Optimizer::CombineLODsVisitor::combineLODs()
 // code to merge geometry object which share, state, and attribute bindings.
 ////////////////////////////////////////////////////////////////////////////
 
+// compare the vertex decode matrices of quantized geometries, geometries without one coming first.
+static int compareVertexDecodeMatrix(const osg::Geometry& lhs, const osg::Geometry& rhs)
+{
+    const osg::RefMatrix* lhsMatrix = lhs.getVertexDecodeMatrix();
+    const osg::RefMatrix* rhsMatrix = rhs.getVertexDecodeMatrix();
+    if (lhsMatrix==rhsMatrix) return 0;
+    if (!lhsMatrix) return -1;
+    if (!rhsMatrix) return 1;
+    return lhsMatrix->compare(*rhsMatrix);
+}
+
 struct LessGeometry
 {
     bool operator() (const osg::Geometry* lhs,const osg::Geometry* rhs) const
@@ -1683,6 +1735,10 @@ struct LessGeometry
         if (lhs->getStateSet()<rhs->getStateSet()) return true;
         if (rhs->getStateSet()<lhs->getStateSet()) return false;
 
+        int decodeMatrixCompare = compareVertexDecodeMatrix(*lhs, *rhs);
+        if (decodeMatrixCompare<0) return true;
+        if (decodeMatrixCompare>0) return false;
+
         if (rhs->getVertexIndices()) { if (!lhs->getVertexIndices()) return true; }
         else if (lhs->getVertexIndices()) return false;
 
@@ -1870,6 +1926,9 @@ bool isArrayCompatible(unsigned int numVertice1, unsigned int numVertice2, const
 /// Return true only if both geometries have same array type and if arrays (such as TexCoords) are compatible (i.e. both empty or both filled)
 bool isAbleToMerge(const osg::Geometry& g1, const osg::Geometry& g2)
 {
+    // quantized vertices can only be merged with those that decode the same way
+    if (compareVertexDecodeMatrix(g1, g2)!=0) return false;
+
     unsigned int numVertice1( getSize(g1.getVertexArray()) );
     unsigned int numVertice2( getSize(g2.getVertexArray()) );
 
@@ -3033,239 +3092,738 @@ bool Optimizer::SpatializeGroupsVisitor::divide(osg::Geode* geode, unsigned int
 
 ////////////////////////////////////////////////////////////////////////////////////////////
 //
-//  Duplicated subgraphs which are shared
+//  Spatialize flat scene graphs into a bounding volume hierarchy
 //
 
-void Optimizer::CopySharedSubgraphsVisitor::apply(osg::Node& node)
+struct SpatializeEntry
 {
-    if (node.getNumParents()>1 && isOperationPermissibleForObject(&node))
+    SpatializeEntry(): index(0) {}
+    SpatializeEntry(const osg::Vec3& c, unsigned int i): center(c), index(i) {}
+
+    osg::Vec3       center;
+    unsigned int    index;
+};
+
+typedef std::vector<SpatializeEntry> SpatializeEntries;
+typedef std::pair<SpatializeEntries::iterator, SpatializeEntries::iterator> SpatializeRange;
+typedef std::vector<SpatializeRange> SpatializeRanges;
+
+struct LessSpatializeEntry
+{
+    LessSpatializeEntry(unsigned int axis): _axis(axis) {}
+
+    bool operator() (const SpatializeEntry& lhs, const SpatializeEntry& rhs) const
     {
-        _sharedNodeList.insert(&node);
+        return lhs.center[_axis] < rhs.center[_axis];
     }
-    traverse(node);
-}
 
-void Optimizer::CopySharedSubgraphsVisitor::copySharedNodes()
+    unsigned int _axis;
+};
+
+// recursively split the entries at the median of the longest axis of their centers until
+// there are numRanges ranges, or each range has no more than maxNumEntriesPerRange entries.
+static void partitionSpatializeEntries(SpatializeEntries::iterator begin, SpatializeEntries::iterator end,
+                                       unsigned int numRanges, unsigned int maxNumEntriesPerRange,
+                                       SpatializeRanges& ranges)
 {
-    OSG_INFO<<"Shared node "<<_sharedNodeList.size()<<std::endl;
-    for(SharedNodeList::iterator itr=_sharedNodeList.begin();
-        itr!=_sharedNodeList.end();
-        ++itr)
+    unsigned int numEntries = end-begin;
+    if (numRanges<=1 || numEntries<=maxNumEntriesPerRange)
     {
-        OSG_INFO<<"   No parents "<<(*itr)->getNumParents()<<std::endl;
-        osg::Node* node = *itr;
-        for(unsigned int i=node->getNumParents()-1;i>0;--i)
-        {
-            // create a clone.
-            osg::ref_ptr<osg::Object> new_object = node->clone(osg::CopyOp::DEEP_COPY_NODES |
-                                                          osg::CopyOp::DEEP_COPY_DRAWABLES);
-            // cast it to node.
-            osg::Node* new_node = dynamic_cast<osg::Node*>(new_object.get());
+        ranges.push_back(SpatializeRange(begin, end));
+        return;
+    }
 
-            // replace the node by new_new
-            if (new_node) node->getParent(i)->replaceChild(node,new_node);
-        }
+    osg::BoundingBox bb;
+    for(SpatializeEntries::iterator itr=begin; itr!=end; ++itr)
+    {
+        bb.expandBy(itr->center);
     }
-}
 
+    unsigned int axis = 0;
+    osg::Vec3 extents = bb._max-bb._min;
+    if (extents.y()>extents[axis]) axis = 1;
+    if (extents.z()>extents[axis]) axis = 2;
 
-////////////////////////////////////////////////////////////////////////////////////////////
-//
-//  Set the attributes of textures up.
-//
+    SpatializeEntries::iterator mid = begin + numEntries/2;
+    std::nth_element(begin, mid, end, LessSpatializeEntry(axis));
+
+    partitionSpatializeEntries(begin, mid, numRanges/2, maxNumEntriesPerRange, ranges);
+    partitionSpatializeEntries(mid, end, numRanges-numRanges/2, maxNumEntriesPerRange, ranges);
+}
 
+typedef std::vector< osg::ref_ptr<osg::Node> > SpatializeNodeList;
 
-void Optimizer::TextureVisitor::apply(osg::Node& node)
+static void buildSpatialHierarchy(osg::Group* group, const SpatializeNodeList& nodes,
+                                  SpatializeEntries::iterator begin, SpatializeEntries::iterator end,
+                                  unsigned int maxNumChildrenPerGroup)
 {
+    SpatializeRanges ranges;
+    partitionSpatializeEntries(begin, end, maxNumChildrenPerGroup, maxNumChildrenPerGroup, ranges);
 
-    osg::StateSet* ss = node.getStateSet();
-    if (ss &&
-        isOperationPermissibleForObject(&node) &&
-        isOperationPermissibleForObject(ss))
+    for(SpatializeRanges::iterator itr=ranges.begin(); itr!=ranges.end(); ++itr)
     {
-        apply(*ss);
+        unsigned int numEntries = itr->second-itr->first;
+        if (numEntries==1 || ranges.size()==1)
+        {
+            for(SpatializeEntries::iterator eitr=itr->first; eitr!=itr->second; ++eitr)
+            {
+                group->addChild(nodes[eitr->index].get());
+            }
+        }
+        else
+        {
+            osg::Group* childGroup = new osg::Group;
+            group->addChild(childGroup);
+            buildSpatialHierarchy(childGroup, nodes, itr->first, itr->second, maxNumChildrenPerGroup);
+        }
     }
-
-    traverse(node);
 }
 
-void Optimizer::TextureVisitor::apply(osg::Geode& geode)
+struct CollectTriangleIndices
 {
-    if (!isOperationPermissibleForObject(&geode)) return;
+    CollectTriangleIndices(): _indices(0) {}
 
-    osg::StateSet* ss = geode.getStateSet();
-
-    if (ss && isOperationPermissibleForObject(ss))
+    void operator() (unsigned int p1, unsigned int p2, unsigned int p3)
     {
-        apply(*ss);
+        _indices->push_back(p1);
+        _indices->push_back(p2);
+        _indices->push_back(p3);
     }
 
-    for(unsigned int i=0;i<geode.getNumDrawables();++i)
-    {
-        osg::Drawable* drawable = geode.getDrawable(i);
-        if (drawable)
+    std::vector<unsigned int>* _indices;
+};
+
+class CopyArrayElementsVisitor : public osg::ArrayVisitor
+{
+    public:
+
+        CopyArrayElementsVisitor(const std::vector<unsigned int>& indices): _indices(indices) {}
+
+        template<class ARRAY>
+        void copyElements(ARRAY& array)
         {
-            ss = drawable->getStateSet();
-            if (ss &&
-               isOperationPermissibleForObject(drawable) &&
-               isOperationPermissibleForObject(ss))
+            osg::ref_ptr<ARRAY> newArray = new ARRAY;
+            newArray->reserve(_indices.size());
+            for(std::vector<unsigned int>::const_iterator itr=_indices.begin(); itr!=_indices.end(); ++itr)
             {
-                apply(*ss);
+                newArray->push_back(array[*itr]);
             }
+            _newArray = newArray.get();
         }
-    }
+
+        virtual void apply(osg::Array&) {}
+        virtual void apply(osg::ByteArray& array) { copyElements(array); }
+        virtual void apply(osg::ShortArray& array) { copyElements(array); }
+        virtual void apply(osg::IntArray& array) { copyElements(array); }
+        virtual void apply(osg::UByteArray& array) { copyElements(array); }
+        virtual void apply(osg::UShortArray& array) { copyElements(array); }
+        virtual void apply(osg::UIntArray& array) { copyElements(array); }
+        virtual void apply(osg::FloatArray& array) { copyElements(array); }
+        virtual void apply(osg::DoubleArray& array) { copyElements(array); }
+
+        virtual void apply(osg::Vec2Array& array) { copyElements(array); }
+        virtual void apply(osg::Vec3Array& array) { copyElements(array); }
+        virtual void apply(osg::Vec4Array& array) { copyElements(array); }
+
+        virtual void apply(osg::Vec4ubArray& array) { copyElements(array); }
+
+        virtual void apply(osg::Vec2bArray& array) { copyElements(array); }
+        virtual void apply(osg::Vec3bArray& array) { copyElements(array); }
+        virtual void apply(osg::Vec4bArray& array) { copyElements(array); }
+
+        virtual void apply(osg::Vec2sArray& array) { copyElements(array); }
+        virtual void apply(osg::Vec3sArray& array) { copyElements(array); }
+        virtual void apply(osg::Vec4sArray& array) { copyElements(array); }
+
+        virtual void apply(osg::Vec2dArray& array) { copyElements(array); }
+        virtual void apply(osg::Vec3dArray& array) { copyElements(array); }
+        virtual void apply(osg::Vec4dArray& array) { copyElements(array); }
+
+        virtual void apply(osg::MatrixfArray& array) { copyElements(array); }
+
+        osg::Array* copy(osg::Array* array)
+        {
+            _newArray = 0;
+            array->accept(*this);
+            return _newArray.release();
+        }
+
+        const std::vector<unsigned int>&    _indices;
+        osg::ref_ptr<osg::Array>            _newArray;
+
+    protected:
+
+        CopyArrayElementsVisitor& operator = (const CopyArrayElementsVisitor&) { return *this; }
+};
+
+static bool isPerVertexArrayCopyable(const osg::Array* array, osg::Geometry::AttributeBinding binding, unsigned int numVertices)
+{
+    if (!array || binding!=osg::Geometry::BIND_PER_VERTEX) return true;
+    return array->getNumElements()>=numVertices;
 }
 
-void Optimizer::TextureVisitor::apply(osg::StateSet& stateset)
+void Optimizer::SpatializeHierarchyVisitor::apply(osg::Group& group)
 {
-    for(unsigned int i=0;i<stateset.getTextureAttributeList().size();++i)
+    if (typeid(group)==typeid(osg::Group) || group.asTransform())
     {
-        osg::StateAttribute* sa = stateset.getTextureAttribute(i,osg::StateAttribute::TEXTURE);
-        osg::Texture* texture = dynamic_cast<osg::Texture*>(sa);
-        if (texture && isOperationPermissibleForObject(texture))
+        if (isOperationPermissibleForObject(&group))
         {
-            apply(*texture);
+            _groupsToDivideList.insert(&group);
         }
     }
+    traverse(group);
 }
 
-void Optimizer::TextureVisitor::apply(osg::Texture& texture)
+void Optimizer::SpatializeHierarchyVisitor::apply(osg::Geode& geode)
 {
-    if (_changeAutoUnRef)
+    if (typeid(geode)==typeid(osg::Geode))
     {
-        unsigned numImageStreams = 0;
-        for (unsigned int i=0; i<texture.getNumImages(); ++i)
+        if (isOperationPermissibleForObject(&geode))
         {
-            osg::ImageStream* is = dynamic_cast<osg::ImageStream*>(texture.getImage(i));
-            if (is) ++numImageStreams;
+            _geodesToDivideList.insert(&geode);
         }
 
-        if (numImageStreams==0)
+        if (_maximumNumTrianglesPerGeometry>0)
         {
-            texture.setUnRefImageDataAfterApply(_valueAutoUnRef);
+            for(unsigned int i=0; i<geode.getNumDrawables(); ++i)
+            {
+                osg::Geometry* geometry = geode.getDrawable(i)->asGeometry();
+                if (geometry && isOperationPermissibleForObject(geometry))
+                {
+                    _geometriesToSplitList.insert(geometry);
+                }
+            }
         }
     }
+    traverse(geode);
+}
 
-    if (_changeClientImageStorage)
+bool Optimizer::SpatializeHierarchyVisitor::spatialize()
+{
+    bool modified = false;
+
+    // split the geometries first so that their chunks are distributed by the division of their geodes.
+    for(GeometriesToSplitList::iterator geom_itr=_geometriesToSplitList.begin();
+        geom_itr!=_geometriesToSplitList.end();
+        ++geom_itr)
     {
-        texture.setClientStorageHint(_valueClientImageStorage);
+        if (split(*geom_itr)) modified = true;
     }
 
-    if (_changeAnisotropy)
+    for(GeodesToDivideList::iterator geode_itr=_geodesToDivideList.begin();
+        geode_itr!=_geodesToDivideList.end();
+        ++geode_itr)
     {
-        texture.setMaxAnisotropy(_valueAnisotropy);
+        if (divide(*geode_itr)) modified = true;
     }
 
-}
+    for(GroupsToDivideList::iterator itr=_groupsToDivideList.begin();
+        itr!=_groupsToDivideList.end();
+        ++itr)
+    {
+        if (divide(*itr)) modified = true;
+    }
 
-////////////////////////////////////////////////////////////////////////////
-// Merge geodes
-////////////////////////////////////////////////////////////////////////////
+    _geometriesToSplitList.clear();
+    _geodesToDivideList.clear();
+    _groupsToDivideList.clear();
 
-void Optimizer::MergeGeodesVisitor::apply(osg::Group& group)
-{
-    if (typeid(group)==typeid(osg::Group)) mergeGeodes(group);
-    traverse(group);
+    return modified;
 }
 
-struct LessGeode
-{
-    bool operator() (const osg::Geode* lhs,const osg::Geode* rhs) const
-    {
-        if (lhs->getNodeMask()<rhs->getNodeMask()) return true;
-        if (lhs->getNodeMask()>rhs->getNodeMask()) return false;
-
-        return (lhs->getStateSet()<rhs->getStateSet());
-    }
-};
-
-bool Optimizer::MergeGeodesVisitor::mergeGeodes(osg::Group& group)
+bool Optimizer::SpatializeHierarchyVisitor::divide(osg::Group* group)
 {
-    if (!isOperationPermissibleForObject(&group)) return false;
-
-    typedef std::vector< osg::Geode* >                      DuplicateList;
-    typedef std::map<osg::Geode*,DuplicateList,LessGeode>   GeodeDuplicateMap;
+    unsigned int maxNumChildrenPerGroup = osg::maximum(_maximumNumChildrenPerGroup, 2u);
+    if (group->getNumChildren()<=maxNumChildrenPerGroup) return false;
 
+    // children without a valid bound can't be placed, so are kept as direct children of the group.
+    SpatializeNodeList nodes;
+    SpatializeNodeList unassignedList;
+    SpatializeEntries entries;
     unsigned int i;
-    osg::NodeList children;
-    children.resize(group.getNumChildren());
-    for (i=0; i<group.getNumChildren(); ++i)
-    {
-        // keep a reference to this child so we can safely clear the group of all children
-        // this is done so we don't have to do a search and remove from the list later on.
-        children[i] = group.getChild(i);
-    }
-
-    // remove all children
-    group.removeChildren(0,group.getNumChildren());
-
-    GeodeDuplicateMap geodeDuplicateMap;
-    for (i=0; i<children.size(); ++i)
+    for(i=0; i<group->getNumChildren(); ++i)
     {
-        osg::Node* child = children[i].get();
-
-        if (typeid(*child)==typeid(osg::Geode))
+        osg::Node* child = group->getChild(i);
+        const osg::BoundingSphere& bs = child->getBound();
+        if (bs.valid())
         {
-            osg::Geode* geode = static_cast<osg::Geode*>(child);
-            geodeDuplicateMap[geode].push_back(geode);
+            entries.push_back(SpatializeEntry(bs.center(), nodes.size()));
+            nodes.push_back(child);
         }
         else
         {
-            // not a geode so just add back into group as its a normal child
-            group.addChild(child);
+            unassignedList.push_back(child);
         }
     }
 
-    // if no geodes then just return.
-    if (geodeDuplicateMap.empty()) return false;
-
-    OSG_INFO<<"mergeGeodes in group '"<<group.getName()<<"' "<<geodeDuplicateMap.size()<<std::endl;
+    if (entries.size()<=maxNumChildrenPerGroup) return false;
 
-    // merge
-    for(GeodeDuplicateMap::iterator itr=geodeDuplicateMap.begin();
-        itr!=geodeDuplicateMap.end();
-        ++itr)
-    {
-        if (itr->second.size()>1)
-        {
-            osg::Geode* lhs = itr->second[0];
+    OSG_INFO<<"Spatializing "<<group->className()<<"  num children = "<<group->getNumChildren()<<std::endl;
 
-            // add geode back into group
-            group.addChild(lhs);
+    group->removeChildren(0, group->getNumChildren());
 
-            for(DuplicateList::iterator dupItr=itr->second.begin()+1;
-                dupItr!=itr->second.end();
-                ++dupItr)
-            {
-                osg::Geode* rhs = *dupItr;
-                mergeGeode(*lhs,*rhs);
-            }
-        }
-        else
-        {
-            osg::Geode* lhs = itr->second[0];
+    buildSpatialHierarchy(group, nodes, entries.begin(), entries.end(), maxNumChildrenPerGroup);
 
-            // add geode back into group
-            group.addChild(lhs);
-        }
+    for(SpatializeNodeList::iterator nitr=unassignedList.begin();
+        nitr!=unassignedList.end();
+        ++nitr)
+    {
+        group->addChild(nitr->get());
     }
 
     return true;
 }
 
-bool Optimizer::MergeGeodesVisitor::mergeGeode(osg::Geode& lhs, osg::Geode& rhs)
+bool Optimizer::SpatializeHierarchyVisitor::divide(osg::Geode* geode)
 {
-    for (unsigned int i=0; i<rhs.getNumDrawables(); ++i)
+    if (geode->getNumDrawables()<=osg::maximum(_maximumNumChildrenPerGroup, 2u)) return false;
+
+    osg::Node::ParentList parents = geode->getParents();
+    if (parents.empty())
     {
-        lhs.addDrawable(rhs.getDrawable(i));
+        OSG_INFO<<"  Cannot perform spatialize on root Geode, add a Group above it to allow subdivision."<<std::endl;
+        return false;
     }
 
-    return true;
-}
+    // carry across everything the Geode holds apart from its drawables.
+    osg::ref_ptr<osg::Group> group = new osg::Group;
+    group->setName(geode->getName());
+    group->setDescriptions(geode->getDescriptions());
+    group->setUserDataContainer(geode->getUserDataContainer());
+    group->setStateSet(geode->getStateSet());
+    group->setNodeMask(geode->getNodeMask());
+    group->setDataVariance(geode->getDataVariance());
+    group->setUpdateCallback(geode->getUpdateCallback());
+    group->setEventCallback(geode->getEventCallback());
+    group->setCullCallback(geode->getCullCallback());
+    group->setCullingActive(geode->getCullingActive());
+    group->setComputeBoundingSphereCallback(geode->getComputeBoundingSphereCallback());
+    for(unsigned int i=0; i<geode->getNumDrawables(); ++i)
+    {
+        osg::Geode* newGeode = new osg::Geode;
+        newGeode->addDrawable(geode->getDrawable(i));
+        group->addChild(newGeode);
+    }
 
+    divide(group.get());
 
+    // keep reference around to prevent it being deleted.
+    osg::ref_ptr<osg::Geode> keepRefGeode = geode;
 
-////////////////////////////////////////////////////////////////////////////
+    for(osg::Node::ParentList::iterator itr = parents.begin();
+        itr != parents.end();
+        ++itr)
+    {
+        (*itr)->replaceChild(geode, group.get());
+    }
+
+    return true;
+}
+
+bool Optimizer::SpatializeHierarchyVisitor::split(osg::Geometry* geometry)
+{
+    if (_maximumNumTrianglesPerGeometry==0) return false;
+
+    // subclasses draw more than their primitives, and callbacks and dynamic data may rely on the geometry being kept.
+    if (typeid(*geometry)!=typeid(osg::Geometry)) return false;
+    if (geometry->getDataVariance()==osg::Object::DYNAMIC) return false;
+    if (geometry->getUpdateCallback() || geometry->getEventCallback() || geometry->getCullCallback() ||
+        geometry->getDrawCallback() || geometry->getComputeBoundingBoxCallback()) return false;
+
+    osg::Vec3Array* vertices = dynamic_cast<osg::Vec3Array*>(geometry->getVertexArray());
+    if (!vertices || geometry->getParents().empty()) return false;
+
+    // indexed arrays and per primitive bindings can't be carried across to the chunks.
+    if (geometry->suitableForOptimization()) return false;
+    if (geometry->getNormalBinding()==osg::Geometry::BIND_PER_PRIMITIVE ||
+        geometry->getNormalBinding()==osg::Geometry::BIND_PER_PRIMITIVE_SET ||
+        geometry->getColorBinding()==osg::Geometry::BIND_PER_PRIMITIVE ||
+        geometry->getColorBinding()==osg::Geometry::BIND_PER_PRIMITIVE_SET ||
+        geometry->getSecondaryColorBinding()==osg::Geometry::BIND_PER_PRIMITIVE ||
+        geometry->getSecondaryColorBinding()==osg::Geometry::BIND_PER_PRIMITIVE_SET ||
+        geometry->getFogCoordBinding()==osg::Geometry::BIND_PER_PRIMITIVE ||
+        geometry->getFogCoordBinding()==osg::Geometry::BIND_PER_PRIMITIVE_SET) return false;
+
+    unsigned int numVertices = vertices->size();
+    unsigned int i;
+    for(i=0; i<geometry->getNumVertexAttribArrays(); ++i)
+    {
+        osg::Geometry::AttributeBinding binding = geometry->getVertexAttribBinding(i);
+        if (binding==osg::Geometry::BIND_PER_PRIMITIVE || binding==osg::Geometry::BIND_PER_PRIMITIVE_SET) return false;
+        if (!isPerVertexArrayCopyable(geometry->getVertexAttribArray(i), binding, numVertices)) return false;
+    }
+    for(i=0; i<geometry->getNumTexCoordArrays(); ++i)
+    {
+        if (!isPerVertexArrayCopyable(geometry->getTexCoordArray(i), osg::Geometry::BIND_PER_VERTEX, numVertices)) return false;
+    }
+    if (!isPerVertexArrayCopyable(geometry->getNormalArray(), geometry->getNormalBinding(), numVertices) ||
+        !isPerVertexArrayCopyable(geometry->getColorArray(), geometry->getColorBinding(), numVertices) ||
+        !isPerVertexArrayCopyable(geometry->getSecondaryColorArray(), geometry->getSecondaryColorBinding(), numVertices) ||
+        !isPerVertexArrayCopyable(geometry->getFogCoordArray(), geometry->getFogCoordBinding(), numVertices)) return false;
+
+    // only surfaces are split, points, lines, adjacency primitives and patches are left as they are,
+    // as are primitive sets drawn with differing numbers of instances.
+    if (geometry->getNumPrimitiveSets()==0) return false;
+    int numInstances = geometry->getPrimitiveSet(0)->getNumInstances();
+    for(i=0; i<geometry->getNumPrimitiveSets(); ++i)
+    {
+        const osg::PrimitiveSet* primitiveSet = geometry->getPrimitiveSet(i);
+        if (primitiveSet->getMode()<GL_TRIANGLES || primitiveSet->getMode()>GL_POLYGON) return false;
+        if (primitiveSet->getNumInstances()!=numInstances) return false;
+    }
+
+    osg::TriangleIndexFunctor<CollectTriangleIndices> collectTriangles;
+    std::vector<unsigned int> triangleIndices;
+    collectTriangles._indices = &triangleIndices;
+    geometry->accept(collectTriangles);
+
+    unsigned int numTriangles = triangleIndices.size()/3;
+    if (numTriangles<=_maximumNumTrianglesPerGeometry) return false;
+
+    SpatializeEntries entries;
+    entries.reserve(numTriangles);
+    for(i=0; i<numTriangles; ++i)
+    {
+        unsigned int p1 = triangleIndices[i*3];
+        unsigned int p2 = triangleIndices[i*3+1];
+        unsigned int p3 = triangleIndices[i*3+2];
+        if (p1>=numVertices || p2>=numVertices || p3>=numVertices) return false;
+        entries.push_back(SpatializeEntry(((*vertices)[p1]+(*vertices)[p2]+(*vertices)[p3])/3.0f, i));
+    }
+
+    SpatializeRanges ranges;
+    partitionSpatializeEntries(entries.begin(), entries.end(), numTriangles, _maximumNumTrianglesPerGeometry, ranges);
+
+    OSG_INFO<<"Splitting "<<geometry->className()<<"  num triangles = "<<numTriangles<<" into "<<ranges.size()<<" chunks"<<std::endl;
+
+    typedef std::vector< osg::ref_ptr<osg::Geometry> > GeometryList;
+    GeometryList chunks;
+
+    const unsigned int invalidIndex = ~0u;
+    std::vector<unsigned int> remapping(numVertices, invalidIndex);
+    for(SpatializeRanges::iterator itr=ranges.begin(); itr!=ranges.end(); ++itr)
+    {
+        std::vector<unsigned int> chunkVertices;
+        std::vector<unsigned int> chunkIndices;
+        chunkIndices.reserve((itr->second-itr->first)*3);
+        for(SpatializeEntries::iterator eitr=itr->first; eitr!=itr->second; ++eitr)
+        {
+            for(unsigned int c=0; c<3; ++c)
+            {
+                unsigned int vi = triangleIndices[eitr->index*3+c];
+                if (remapping[vi]==invalidIndex)
+                {
+                    remapping[vi] = chunkVertices.size();
+                    chunkVertices.push_back(vi);
+                }
+                chunkIndices.push_back(remapping[vi]);
+            }
+        }
+
+        for(std::vector<unsigned int>::iterator vitr=chunkVertices.begin(); vitr!=chunkVertices.end(); ++vitr)
+        {
+            remapping[*vitr] = invalidIndex;
+        }
+
+        osg::ref_ptr<osg::Geometry> chunk = new osg::Geometry(*geometry, osg::CopyOp::SHALLOW_COPY);
+        chunk->removePrimitiveSet(0, chunk->getNumPrimitiveSets());
+
+        // a KdTree built for the whole geometry doesn't apply to the chunk.
+        if (dynamic_cast<osg::KdTree*>(chunk->getShape())) chunk->setShape(0);
+
+        CopyArrayElementsVisitor cav(chunkVertices);
+        chunk->setVertexArray(cav.copy(vertices));
+        if (geometry->getNormalBinding()==osg::Geometry::BIND_PER_VERTEX) chunk->setNormalArray(cav.copy(geometry->getNormalArray()));
+        if (geometry->getColorBinding()==osg::Geometry::BIND_PER_VERTEX) chunk->setColorArray(cav.copy(geometry->getColorArray()));
+        if (geometry->getSecondaryColorBinding()==osg::Geometry::BIND_PER_VERTEX) chunk->setSecondaryColorArray(cav.copy(geometry->getSecondaryColorArray()));
+        if (geometry->getFogCoordBinding()==osg::Geometry::BIND_PER_VERTEX) chunk->setFogCoordArray(cav.copy(geometry->getFogCoordArray()));
+        for(i=0; i<geometry->getNumTexCoordArrays(); ++i)
+        {
+            if (geometry->getTexCoordArray(i)) chunk->setTexCoordArray(i, cav.copy(geometry->getTexCoordArray(i)));
+        }
+        for(i=0; i<geometry->getNumVertexAttribArrays(); ++i)
+        {
+            if (geometry->getVertexAttribArray(i) && geometry->getVertexAttribBinding(i)==osg::Geometry::BIND_PER_VERTEX)
+            {
+                chunk->setVertexAttribArray(i, cav.copy(geometry->getVertexAttribArray(i)));
+            }
+        }
+
+        if (chunkVertices.size()<=65536)
+        {
+            osg::DrawElementsUShort* elements = new osg::DrawElementsUShort(GL_TRIANGLES);
+            elements->setNumInstances(numInstances);
+            elements->reserve(chunkIndices.size());
+            for(std::vector<unsigned int>::iterator iitr=chunkIndices.begin(); iitr!=chunkIndices.end(); ++iitr)
+            {
+                elements->push_back(static_cast<GLushort>(*iitr));
+            }
+            chunk->addPrimitiveSet(elements);
+        }
+        else
+        {
+            chunk->addPrimitiveSet(new osg::DrawElementsUInt(GL_TRIANGLES, chunkIndices.size(), &chunkIndices.front(), numInstances));
+        }
+
+        chunks.push_back(chunk);
+    }
+
+    // keep reference around to prevent it being deleted.
+    osg::ref_ptr<osg::Geometry> keepRefGeometry = geometry;
+
+    osg::Drawable::ParentList parents = geometry->getParents();
+    for(osg::Drawable::ParentList::iterator itr = parents.begin();
+        itr != parents.end();
+        ++itr)
+    {
+        osg::Geode* geode = (*itr)->asGeode();
+        if (!geode) continue;
+
+        geode->removeDrawable(geometry);
+        for(GeometryList::iterator citr=chunks.begin(); citr!=chunks.end(); ++citr)
+        {
+            geode->addDrawable(citr->get());
+        }
+    }
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Duplicated subgraphs which are shared
+//
+
+void Optimizer::CopySharedSubgraphsVisitor::apply(osg::Node& node)
+{
+    if (node.getNumParents()>1 && isOperationPermissibleForObject(&node))
+    {
+        _sharedNodeList.insert(&node);
+    }
+    traverse(node);
+}
+
+void Optimizer::CopySharedSubgraphsVisitor::copySharedNodes()
+{
+    OSG_INFO<<"Shared node "<<_sharedNodeList.size()<<std::endl;
+    for(SharedNodeList::iterator itr=_sharedNodeList.begin();
+        itr!=_sharedNodeList.end();
+        ++itr)
+    {
+        OSG_INFO<<"   No parents "<<(*itr)->getNumParents()<<std::endl;
+        osg::Node* node = *itr;
+        for(unsigned int i=node->getNumParents()-1;i>0;--i)
+        {
+            // create a clone.
+            osg::ref_ptr<osg::Object> new_object = node->clone(osg::CopyOp::DEEP_COPY_NODES |
+                                                          osg::CopyOp::DEEP_COPY_DRAWABLES);
+            // cast it to node.
+            osg::Node* new_node = dynamic_cast<osg::Node*>(new_object.get());
+
+            // replace the node by new_new
+            if (new_node) node->getParent(i)->replaceChild(node,new_node);
+        }
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Set the attributes of textures up.
+//
+
+
+void Optimizer::TextureVisitor::apply(osg::Node& node)
+{
+
+    osg::StateSet* ss = node.getStateSet();
+    if (ss &&
+        isOperationPermissibleForObject(&node) &&
+        isOperationPermissibleForObject(ss))
+    {
+        apply(*ss);
+    }
+
+    traverse(node);
+}
+
+void Optimizer::TextureVisitor::apply(osg::Geode& geode)
+{
+    if (!isOperationPermissibleForObject(&geode)) return;
+
+    osg::StateSet* ss = geode.getStateSet();
+
+    if (ss && isOperationPermissibleForObject(ss))
+    {
+        apply(*ss);
+    }
+
+    for(unsigned int i=0;i<geode.getNumDrawables();++i)
+    {
+        osg::Drawable* drawable = geode.getDrawable(i);
+        if (drawable)
+        {
+            ss = drawable->getStateSet();
+            if (ss &&
+               isOperationPermissibleForObject(drawable) &&
+               isOperationPermissibleForObject(ss))
+            {
+                apply(*ss);
+            }
+        }
+    }
+}
+
+void Optimizer::TextureVisitor::apply(osg::StateSet& stateset)
+{
+    for(unsigned int i=0;i<stateset.getTextureAttributeList().size();++i)
+    {
+        osg::StateAttribute* sa = stateset.getTextureAttribute(i,osg::StateAttribute::TEXTURE);
+        osg::Texture* texture = dynamic_cast<osg::Texture*>(sa);
+        if (texture && isOperationPermissibleForObject(texture))
+        {
+            apply(*texture);
+        }
+    }
+}
+
+void Optimizer::TextureVisitor::apply(osg::Texture& texture)
+{
+    if (_changeAutoUnRef)
+    {
+        unsigned numImageStreams = 0;
+        for (unsigned int i=0; i<texture.getNumImages(); ++i)
+        {
+            osg::ImageStream* is = dynamic_cast<osg::ImageStream*>(texture.getImage(i));
+            if (is) ++numImageStreams;
+        }
+
+        if (numImageStreams==0)
+        {
+            texture.setUnRefImageDataAfterApply(_valueAutoUnRef);
+        }
+    }
+
+    if (_changeClientImageStorage)
+    {
+        texture.setClientStorageHint(_valueClientImageStorage);
+    }
+
+    if (_changeAnisotropy)
+    {
+        texture.setMaxAnisotropy(_valueAnisotropy);
+    }
+
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Merge geodes
+////////////////////////////////////////////////////////////////////////////
+
+void Optimizer::MergeGeodesVisitor::apply(osg::Group& group)
+{
+    if (typeid(group)==typeid(osg::Group)) mergeGeodes(group);
+    traverse(group);
+}
+
+struct LessGeode
+{
+    bool operator() (const osg::Geode* lhs,const osg::Geode* rhs) const
+    {
+        if (lhs->getNodeMask()<rhs->getNodeMask()) return true;
+        if (lhs->getNodeMask()>rhs->getNodeMask()) return false;
+
+        return (lhs->getStateSet()<rhs->getStateSet());
+    }
+};
+
+bool Optimizer::MergeGeodesVisitor::mergeGeodes(osg::Group& group)
+{
+    if (!isOperationPermissibleForObject(&group)) return false;
+
+    typedef std::vector< osg::Geode* >                      DuplicateList;
+    typedef std::map<osg::Geode*,DuplicateList,LessGeode>   GeodeDuplicateMap;
+
+    unsigned int i;
+    osg::NodeList children;
+    children.resize(group.getNumChildren());
+    for (i=0; i<group.getNumChildren(); ++i)
+    {
+        // keep a reference to this child so we can safely clear the group of all children
+        // this is done so we don't have to do a search and remove from the list later on.
+        children[i] = group.getChild(i);
+    }
+
+    // remove all children
+    group.removeChildren(0,group.getNumChildren());
+
+    GeodeDuplicateMap geodeDuplicateMap;
+    for (i=0; i<children.size(); ++i)
+    {
+        osg::Node* child = children[i].get();
+
+        if (typeid(*child)==typeid(osg::Geode))
+        {
+            osg::Geode* geode = static_cast<osg::Geode*>(child);
+            geodeDuplicateMap[geode].push_back(geode);
+        }
+        else
+        {
+            // not a geode so just add back into group as its a normal child
+            group.addChild(child);
+        }
+    }
+
+    // if no geodes then just return.
+    if (geodeDuplicateMap.empty()) return false;
+
+    OSG_INFO<<"mergeGeodes in group '"<<group.getName()<<"' "<<geodeDuplicateMap.size()<<std::endl;
+
+    // merge
+    for(GeodeDuplicateMap::iterator itr=geodeDuplicateMap.begin();
+        itr!=geodeDuplicateMap.end();
+        ++itr)
+    {
+        if (itr->second.size()>1)
+        {
+            osg::Geode* lhs = itr->second[0];
+
+            // add geode back into group
+            group.addChild(lhs);
+
+            for(DuplicateList::iterator dupItr=itr->second.begin()+1;
+                dupItr!=itr->second.end();
+                ++dupItr)
+            {
+                osg::Geode* rhs = *dupItr;
+                mergeGeode(*lhs,*rhs);
+            }
+        }
+        else
+        {
+            osg::Geode* lhs = itr->second[0];
+
+            // add geode back into group
+            group.addChild(lhs);
+        }
+    }
+
+    return true;
+}
+
+bool Optimizer::MergeGeodesVisitor::mergeGeode(osg::Geode& lhs, osg::Geode& rhs)
+{
+    for (unsigned int i=0; i<rhs.getNumDrawables(); ++i)
+    {
+        lhs.addDrawable(rhs.getDrawable(i));
+    }
+
+    return true;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////
 // FlattenBillboardVisitor
 ////////////////////////////////////////////////////////////////////////////
 void Optimizer::FlattenBillboardVisitor::reset()
@@ -3353,40 +3911,137 @@ void Optimizer::FlattenBillboardVisitor::process()
                 mts.insert(mt);
             }
 
-            for(MatrixTransformSet::iterator mitr = mts.begin();
-                mitr != mts.end();
-                ++mitr)
-            {
-                osg::MatrixTransform* mt = *mitr;
-                for(unsigned int i=0; i<billboard->getNumDrawables(); ++i)
-                {
-                    new_billboard->addDrawable(billboard->getDrawable(i),
-                                               billboard->getPosition(i)*mt->getMatrix());
-                }
-                mainGroup->removeChild(mt);
-            }
+            for(MatrixTransformSet::iterator mitr = mts.begin();
+                mitr != mts.end();
+                ++mitr)
+            {
+                osg::MatrixTransform* mt = *mitr;
+                for(unsigned int i=0; i<billboard->getNumDrawables(); ++i)
+                {
+                    new_billboard->addDrawable(billboard->getDrawable(i),
+                                               billboard->getPosition(i)*mt->getMatrix());
+                }
+                mainGroup->removeChild(mt);
+            }
+        }
+    }
+
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////
+// TextureAtlasBuilder
+////////////////////////////////////////////////////////////////////////////
+
+/** Return the size in bytes of the 4x4 blocks of the block compressed pixel formats that can be copied into an atlas, or 0.*/
+static unsigned int getAtlasBlockSizeInBytes(GLenum pixelFormat)
+{
+    switch(pixelFormat)
+    {
+        case(GL_COMPRESSED_RGB_S3TC_DXT1_EXT):
+        case(GL_COMPRESSED_RGBA_S3TC_DXT1_EXT):
+        case(GL_COMPRESSED_SIGNED_RED_RGTC1_EXT):
+        case(GL_COMPRESSED_RED_RGTC1_EXT):
+            return 8;
+        case(GL_COMPRESSED_RGBA_S3TC_DXT3_EXT):
+        case(GL_COMPRESSED_RGBA_S3TC_DXT5_EXT):
+        case(GL_COMPRESSED_SIGNED_RED_GREEN_RGTC2_EXT):
+        case(GL_COMPRESSED_RED_GREEN_RGTC2_EXT):
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+/** The copy of one source image into its padded rectangle of an atlas image, in units of blocks.*/
+struct AtlasImageCopy
+{
+    const osg::Image*   source;
+    osg::Image*         atlas;
+    unsigned int        blockSizeInBytes;
+    unsigned int        sourceRowSizeInBytes;
+    unsigned int        atlasRowSizeInBytes;
+    int                 sourceColumns;
+    int                 sourceRows;
+    int                 column;         ///< first column of the padded rectangle in the atlas
+    int                 row;            ///< first row of the padded rectangle in the atlas
+    int                 columns;        ///< columns of the padded rectangle
+    int                 rows;           ///< rows of the padded rectangle
+    int                 marginColumns;
+    int                 marginRows;
+};
+
+/** Copy the source into the atlas, filling the rest of its padded rectangle with copies of the edge blocks
+  * of the source so that filtering and mipmapping near the edges only blends in the source's own pixels.*/
+static void copyAtlasImage(const AtlasImageCopy& copy)
+{
+    const unsigned char* sourceData = copy.source->data();
+    unsigned char* atlasData = copy.atlas->data();
+    unsigned int blockSize = copy.blockSizeInBytes;
+    unsigned int sourceSpanSize = copy.sourceColumns*blockSize;
+
+    for(int r=0; r<copy.rows; ++r)
+    {
+        int sourceRow = osg::clampBetween(r-copy.marginRows, 0, copy.sourceRows-1);
+        const unsigned char* sourcePtr = sourceData + sourceRow*copy.sourceRowSizeInBytes;
+        const unsigned char* lastBlockPtr = sourcePtr + sourceSpanSize - blockSize;
+        unsigned char* destPtr = atlasData + (copy.row+r)*copy.atlasRowSizeInBytes + copy.column*blockSize;
+
+        int c = 0;
+        for(; c<copy.marginColumns; ++c, destPtr += blockSize)
+        {
+            memcpy(destPtr, sourcePtr, blockSize);
+        }
+
+        memcpy(destPtr, sourcePtr, sourceSpanSize);
+        destPtr += sourceSpanSize;
+        c += copy.sourceColumns;
+
+        for(; c<copy.columns; ++c, destPtr += blockSize)
+        {
+            memcpy(destPtr, lastBlockPtr, blockSize);
         }
     }
-
 }
 
+struct CopyAtlasImagesOperation : public osgUtil::RangeOperation
+{
+    CopyAtlasImagesOperation(const std::vector<AtlasImageCopy>& copies): _copies(copies) {}
+
+    virtual void operator() (unsigned int begin, unsigned int end)
+    {
+        for(unsigned int i=begin; i<end; ++i) copyAtlasImage(_copies[i]);
+    }
 
+    const std::vector<AtlasImageCopy>& _copies;
 
-////////////////////////////////////////////////////////////////////////////
-// TextureAtlasBuilder
-////////////////////////////////////////////////////////////////////////////
+protected:
+
+    CopyAtlasImagesOperation& operator = (const CopyAtlasImagesOperation&) { return *this; }
+};
+
+static unsigned int computeAtlasRowSizeInBytes(const osg::Image* image, int blockWidth, unsigned int blockSizeInBytes)
+{
+    if (blockWidth>1) return (image->s()/blockWidth)*blockSizeInBytes;
+    return image->getRowSizeInBytes();
+}
 
 Optimizer::TextureAtlasBuilder::TextureAtlasBuilder():
     _maximumAtlasWidth(2048),
     _maximumAtlasHeight(2048),
-    _margin(8)
+    _margin(8),
+    _numThreads(0)
 {
 }
 
 void Optimizer::TextureAtlasBuilder::reset()
 {
     _sourceList.clear();
+    _imageSourceMap.clear();
+    _textureSourceMap.clear();
     _atlasList.clear();
+    _statistics = Statistics();
 }
 
 void Optimizer::TextureAtlasBuilder::setMaximumAtlasSize(int width, int height)
@@ -3402,160 +4057,67 @@ void Optimizer::TextureAtlasBuilder::setMargin(int margin)
 
 void Optimizer::TextureAtlasBuilder::addSource(const osg::Image* image)
 {
-    if (!getSource(image)) _sourceList.push_back(new Source(image));
+    if (!getSource(image))
+    {
+        Source* source = new Source(image);
+        _sourceList.push_back(source);
+        _imageSourceMap[image] = source;
+    }
 }
 
 void Optimizer::TextureAtlasBuilder::addSource(const osg::Texture2D* texture)
 {
-    if (!getSource(texture)) _sourceList.push_back(new Source(texture));
-}
-
-
-void Optimizer::TextureAtlasBuilder::completeRow(unsigned int indexAtlas)
-{
-    AtlasList::iterator aitr = _atlasList.begin() + indexAtlas;
-    //SourceList::iterator sitr = _sourceList.begin() + indexSource;
-    Atlas * atlas = aitr->get();
-    if(atlas->_indexFirstOfRow < atlas->_sourceList.size())
+    if (!getSource(texture))
     {
-        //Try to fill the row with smaller images.
-        int x_max = atlas->_width  - _margin;
-        int y_max = atlas->_height - _margin;
-        //int x_max = atlas->_maximumAtlasWidth  - _margin;
-        //int y_max = atlas->_maximumAtlasHeight - _margin;
-
-        // Fill last Row
-        for(SourceList::iterator sitr3 = _sourceList.begin(); sitr3 != _sourceList.end(); ++sitr3)
-        {
-            int x_min = atlas->_x + _margin;
-            int y_min = atlas->_y + _margin;
-            if (y_min >= y_max || x_min >= x_max) continue;
-
-            Source * source = sitr3->get();
-            if (source->_atlas || atlas->_image->getPixelFormat() != source->_image->getPixelFormat() ||
-                atlas->_image->getDataType() != source->_image->getDataType())
-            {
-                continue;
-            }
-
-            int image_s = source->_image->s();
-            int image_t = source->_image->t();
-            if (x_min + image_s <= x_max && y_min + image_t <= y_max)        // Test if the image can fit in the empty space.
-            {
-                source->_x = x_min;
-                source->_y = y_min;
-                //assert(source->_x + source->_image->s()+_margin <= atlas->_maximumAtlasWidth );        // "+_margin" and not "+2*_margin" because _x already takes the margin into account
-                //assert(source->_y + source->_image->t()+_margin <= atlas->_maximumAtlasHeight);
-                //assert(source->_x >= _margin);
-                //assert(source->_y >= _margin);
-                atlas->_x += image_s + 2*_margin;
-                //assert(atlas->_x <= atlas->_maximumAtlasWidth);
-                source->_atlas = atlas;
-                atlas->_sourceList.push_back(source);
-            }
-        }
-
-        // Fill the last column
-        SourceList srcListTmp;
-        for(SourceList::iterator sitr4 = atlas->_sourceList.begin() + atlas->_indexFirstOfRow;
-            sitr4 != atlas->_sourceList.end(); ++sitr4)
-        {
-            Source * srcAdded = sitr4->get();
-            int y_min = srcAdded->_y + srcAdded->_image->t() + 2 * _margin;
-            int x_min = srcAdded->_x;
-            int x_max = x_min + srcAdded->_image->s();        // Hides upper block's x_max
-            if (y_min >= y_max || x_min >= x_max) continue;
-
-            Source * maxWidthSource = NULL;
-            for(SourceList::iterator sitr2 = _sourceList.begin(); sitr2 != _sourceList.end(); ++sitr2)
-            {
-                Source * source = sitr2->get();
-                if (source->_atlas || atlas->_image->getPixelFormat() != source->_image->getPixelFormat() ||
-                    atlas->_image->getDataType() != source->_image->getDataType())
-                {
-                    continue;
-                }
-                int image_s = source->_image->s();
-                int image_t = source->_image->t();
-                if(x_min + image_s <= x_max && y_min + image_t <= y_max)        // Test if the image can fit in the empty space.
-                {
-                    if (maxWidthSource == NULL || maxWidthSource->_image->s() < source->_image->s())
-                    {
-                        maxWidthSource = source; //Keep the maximum width for source.
-                    }
-                }
-            }
-            if (maxWidthSource)
-            {
-                // Add the source with the max width to the atlas
-                maxWidthSource->_x = x_min;
-                maxWidthSource->_y = y_min;
-                maxWidthSource->_atlas = atlas;
-                srcListTmp.push_back(maxWidthSource); //Store the mawWidth source in the temporary vector.
-            }
-        }
-        for(SourceList::iterator itTmp = srcListTmp.begin(); itTmp != srcListTmp.end(); ++itTmp)
-        {
-            //Add the sources to the general list (wasn't possible in the loop using the iterator on the same list)
-            atlas->_sourceList.push_back(*itTmp);
-        }
-        atlas->_indexFirstOfRow = atlas->_sourceList.size();
+        Source* source = new Source(texture);
+        _sourceList.push_back(source);
+        _textureSourceMap[texture] = source;
+        if (source->_image.valid()) _imageSourceMap.insert(ImageSourceMap::value_type(source->_image.get(), source));
     }
 }
 
 void Optimizer::TextureAtlasBuilder::buildAtlas()
 {
-    std::sort(_sourceList.begin(), _sourceList.end(), CompareSrc());        // Sort using the height of images
+    std::sort(_sourceList.begin(), _sourceList.end(), CompareSrc());        // Sort using the area of images, largest first
     _atlasList.clear();
+    _statistics = Statistics();
+
+    for(SourceList::iterator sitr = _sourceList.begin();
+        sitr != _sourceList.end();
+        ++sitr)
+    {
+        (*sitr)->_atlas = 0;
+    }
+
     for(SourceList::iterator sitr = _sourceList.begin();
         sitr != _sourceList.end();
         ++sitr)
     {
         Source * source = sitr->get();
-        if (!source->_atlas && source->suitableForAtlas(_maximumAtlasWidth,_maximumAtlasHeight,_margin))
+        if (source->suitableForAtlas(_maximumAtlasWidth,_maximumAtlasHeight,_margin))
         {
             bool addedSourceToAtlas = false;
             for(AtlasList::iterator aitr = _atlasList.begin();
                 aitr != _atlasList.end() && !addedSourceToAtlas;
                 ++aitr)
             {
-                if(!(*aitr)->_image ||
-                    ((*aitr)->_image->getPixelFormat() == (*sitr)->_image->getPixelFormat() &&
-                    (*aitr)->_image->getPacking() == (*sitr)->_image->getPacking()))
-                {
-                    OSG_INFO<<"checking source "<<source->_image->getFileName()<<" to see it it'll fit in atlas "<<aitr->get()<<std::endl;
-                    Optimizer::TextureAtlasBuilder::Atlas::FitsIn fitsIn = (*aitr)->doesSourceFit(source);
-                    if (fitsIn == Optimizer::TextureAtlasBuilder::Atlas::FITS_IN_CURRENT_ROW)
-                    {
-                        addedSourceToAtlas = true;
-                        (*aitr)->addSource(source); // Add in the currentRow.
-                    }
-                    else if(fitsIn == Optimizer::TextureAtlasBuilder::Atlas::IN_NEXT_ROW)
-                    {
-                        completeRow(aitr - _atlasList.begin()); //Fill Empty spaces.
-                        addedSourceToAtlas = true;
-                        (*aitr)->addSource(source); // Add the source in the new row.
-                    }
-                    else
-                    {
-                        completeRow(aitr - _atlasList.begin()); //Fill Empty spaces before creating a new atlas.
-                    }
-                }
+                OSG_INFO<<"checking source "<<source->_image->getFileName()<<" to see it it'll fit in atlas "<<aitr->get()<<std::endl;
+                addedSourceToAtlas = (*aitr)->addSource(source);
             }
 
             if (!addedSourceToAtlas)
             {
                 OSG_INFO<<"creating new Atlas for "<<source->_image->getFileName()<<std::endl;
 
-                osg::ref_ptr<Atlas> atlas = new Atlas(_maximumAtlasWidth,_maximumAtlasHeight,_margin);
-                _atlasList.push_back(atlas);
-                if (!source->_atlas) atlas->addSource(source);
+                osg::ref_ptr<Atlas> atlas = new Atlas(_maximumAtlasWidth,_maximumAtlasHeight,_margin,source->_image.get());
+                if (atlas->addSource(source)) _atlasList.push_back(atlas);
             }
         }
     }
 
     // build the atlas which are suitable for use, and discard the rest.
     AtlasList activeAtlasList;
+    std::vector<AtlasImageCopy> copies;
     for(AtlasList::iterator aitr = _atlasList.begin();
         aitr != _atlasList.end();
         ++aitr)
@@ -3573,17 +4135,73 @@ void Optimizer::TextureAtlasBuilder::buildAtlas()
 
         if (!(atlas->_sourceList.empty()))
         {
+            osg::Image* atlasImage = atlas->_image.get();
+
             std::stringstream ostr;
-            ostr<<"atlas_"<<activeAtlasList.size()<<".rgb";
-            atlas->_image->setFileName(ostr.str());
+            ostr<<"atlas_"<<activeAtlasList.size()<<(atlas->_blockWidth>1 ? ".dds" : ".rgb");
+            atlasImage->setFileName(ostr.str());
             activeAtlasList.push_back(atlas);
             atlas->clampToNearestPowerOfTwoSize();
-            atlas->copySources();
+
+            OSG_INFO<<"Allocated to "<<atlas->_width<<","<<atlas->_height<<std::endl;
+            atlasImage->allocateImage(atlas->_width, atlas->_height, 1,
+                                      atlasImage->getPixelFormat(), atlasImage->getDataType(),
+                                      atlasImage->getPacking());
+
+            // clear the space not covered by sources
+            memset(atlasImage->data(), 0, atlasImage->getTotalSizeInBytes());
+
+            unsigned int atlasRowSizeInBytes = computeAtlasRowSizeInBytes(atlasImage, atlas->_blockWidth, atlas->_blockSizeInBytes);
+
+            unsigned long long sourcePixels = 0;
+            for(SourceList::iterator sitr = atlas->_sourceList.begin();
+                sitr != atlas->_sourceList.end();
+                ++sitr)
+            {
+                Source* source = sitr->get();
+                const osg::Image* sourceImage = source->_image.get();
+
+                int paddedWidth, paddedHeight;
+                atlas->computePaddedSize(sourceImage, paddedWidth, paddedHeight);
+
+                AtlasImageCopy copy;
+                copy.source = sourceImage;
+                copy.atlas = atlasImage;
+                copy.blockSizeInBytes = atlas->_blockSizeInBytes;
+                copy.sourceRowSizeInBytes = computeAtlasRowSizeInBytes(sourceImage, atlas->_blockWidth, atlas->_blockSizeInBytes);
+                copy.atlasRowSizeInBytes = atlasRowSizeInBytes;
+                copy.sourceColumns = sourceImage->s()/atlas->_blockWidth;
+                copy.sourceRows = sourceImage->t()/atlas->_blockHeight;
+                copy.column = (source->_x-atlas->_margin)/atlas->_blockWidth;
+                copy.row = (source->_y-atlas->_margin)/atlas->_blockHeight;
+                copy.columns = paddedWidth/atlas->_blockWidth;
+                copy.rows = paddedHeight/atlas->_blockHeight;
+                copy.marginColumns = atlas->_margin/atlas->_blockWidth;
+                copy.marginRows = atlas->_margin/atlas->_blockHeight;
+                copies.push_back(copy);
+
+                sourcePixels += sourceImage->s()*sourceImage->t();
+                _statistics.paddedPixels += paddedWidth*paddedHeight;
+            }
+
+            unsigned long long atlasPixels = atlas->_width*atlas->_height;
+            OSG_INFO<<"atlas "<<atlasImage->getFileName()<<" "<<atlas->_width<<"x"<<atlas->_height<<" contains "<<atlas->_sourceList.size()
+                    <<" sources, occupancy "<<double(sourcePixels)/double(atlasPixels)<<std::endl;
+
+            ++_statistics.numAtlases;
+            _statistics.numSourcesInAtlases += atlas->_sourceList.size();
+            _statistics.sourcePixels += sourcePixels;
+            _statistics.atlasPixels += atlasPixels;
         }
     }
     // keep only the active atlas'
     _atlasList.swap(activeAtlasList);
 
+    _statistics.numSourcesNotInAtlases = _sourceList.size() - _statistics.numSourcesInAtlases;
+
+    // the padded rectangles of the sources don't overlap, so the sources can be copied concurrently.
+    CopyAtlasImagesOperation copyOperation(copies);
+    osgUtil::runInParallel(copyOperation, copies.size(), _numThreads, 1, 1);
 }
 
 osg::Image* Optimizer::TextureAtlasBuilder::getImageAtlas(unsigned int i)
@@ -3648,24 +4266,14 @@ osg::Matrix Optimizer::TextureAtlasBuilder::getTextureMatrix(const osg::Texture2
 
 Optimizer::TextureAtlasBuilder::Source* Optimizer::TextureAtlasBuilder::getSource(const osg::Image* image)
 {
-    for(SourceList::iterator itr = _sourceList.begin();
-        itr != _sourceList.end();
-        ++itr)
-    {
-        if ((*itr)->_image == image) return itr->get();
-    }
-    return 0;
+    ImageSourceMap::iterator itr = _imageSourceMap.find(image);
+    return itr != _imageSourceMap.end() ? itr->second : 0;
 }
 
 Optimizer::TextureAtlasBuilder::Source* Optimizer::TextureAtlasBuilder::getSource(const osg::Texture2D* texture)
 {
-    for(SourceList::iterator itr = _sourceList.begin();
-        itr != _sourceList.end();
-        ++itr)
-    {
-        if ((*itr)->_texture == texture) return itr->get();
-    }
-    return 0;
+    TextureSourceMap::iterator itr = _textureSourceMap.find(texture);
+    return itr != _textureSourceMap.end() ? itr->second : 0;
 }
 
 bool Optimizer::TextureAtlasBuilder::Source::suitableForAtlas(int maximumAtlasWidth, int maximumAtlasHeight, int margin)
@@ -3676,29 +4284,26 @@ bool Optimizer::TextureAtlasBuilder::Source::suitableForAtlas(int maximumAtlasWi
     if (_image->s()+margin*2 > maximumAtlasWidth) return false;
     if (_image->t()+margin*2 > maximumAtlasHeight) return false;
 
-    switch(_image->getPixelFormat())
+    if (_image->isCompressed())
     {
-        case(GL_COMPRESSED_ALPHA_ARB):
-        case(GL_COMPRESSED_INTENSITY_ARB):
-        case(GL_COMPRESSED_LUMINANCE_ALPHA_ARB):
-        case(GL_COMPRESSED_LUMINANCE_ARB):
-        case(GL_COMPRESSED_RGBA_ARB):
-        case(GL_COMPRESSED_RGB_ARB):
-        case(GL_COMPRESSED_RGB_S3TC_DXT1_EXT):
-        case(GL_COMPRESSED_RGBA_S3TC_DXT1_EXT):
-        case(GL_COMPRESSED_RGBA_S3TC_DXT3_EXT):
-        case(GL_COMPRESSED_RGBA_S3TC_DXT5_EXT):
-            // can't handle compressed textures inside an atlas
+        if (getAtlasBlockSizeInBytes(_image->getPixelFormat())==0)
+        {
+            // can't handle this compressed format inside an atlas
             return false;
-        default:
-            break;
-    }
+        }
 
-    if ((_image->getPixelSizeInBits() % 8) != 0)
+        if ((_image->s() % 4)!=0 || (_image->t() % 4)!=0)
+        {
+            // only whole blocks can be copied into an atlas
+            return false;
+        }
+    }
+    else if ((_image->getPixelSizeInBits() % 8) != 0)
     {
         // pixel size not byte aligned so report as not suitable to prevent other atlas code from having problems with byte boundaries.
         return false;
     }
+
     if (_texture.valid())
     {
 
@@ -3737,17 +4342,53 @@ osg::Matrix Optimizer::TextureAtlasBuilder::Source::computeTextureMatrix() const
            osg::Matrix::translate(Float(_x)/Float(_atlas->_image->s()), Float(_y)/Float(_atlas->_image->t()), 0.0);
 }
 
-Optimizer::TextureAtlasBuilder::Atlas::FitsIn Optimizer::TextureAtlasBuilder::Atlas::doesSourceFit(Source* source)
+Optimizer::TextureAtlasBuilder::Atlas::Atlas(int width, int height, int margin, const osg::Image* image):
+    _maximumAtlasWidth(width),
+    _maximumAtlasHeight(height),
+    _margin(osg::maximum(margin, 0)),
+    _blockWidth(1),
+    _blockHeight(1),
+    _blockSizeInBytes(image->getPixelSizeInBits()/8),
+    _alignment(1),
+    _width(0),
+    _height(0)
+{
+    unsigned int blockSizeInBytes = getAtlasBlockSizeInBytes(image->getPixelFormat());
+    if (blockSizeInBytes>0)
+    {
+        // block compressed sources are copied a block at a time, so margins are whole blocks.
+        _blockWidth = 4;
+        _blockHeight = 4;
+        _blockSizeInBytes = blockSizeInBytes;
+        _margin = ((_margin+3)/4)*4;
+    }
+
+    // aligning the sources to 2^n keeps them from sharing texels in the first n mipmap levels,
+    // with a margin of at least one texel down to the last of these levels.
+    while (_alignment*2<=_margin) _alignment *= 2;
+    _alignment = osg::maximum(_alignment, _blockWidth);
+
+    _freeRectangles.push_back(Rectangle(0, 0, _maximumAtlasWidth, _maximumAtlasHeight));
+}
+
+bool Optimizer::TextureAtlasBuilder::Atlas::isCompatible(Source* source) const
 {
     // does the source have a valid image?
     const osg::Image* sourceImage = source->_image.get();
-    if (!sourceImage) return DOES_NOT_FIT_IN_ANY_ROW;
+    if (!sourceImage) return false;
 
     // does pixel format match?
     if (_image.valid())
     {
-        if (_image->getPixelFormat() != sourceImage->getPixelFormat()) return DOES_NOT_FIT_IN_ANY_ROW;
-        if (_image->getDataType() != sourceImage->getDataType()) return DOES_NOT_FIT_IN_ANY_ROW;
+        if (_image->getPixelFormat() != sourceImage->getPixelFormat()) return false;
+        if (_image->getDataType() != sourceImage->getDataType()) return false;
+        if (_image->getPacking() != sourceImage->getPacking()) return false;
+    }
+
+    if ((sourceImage->s() % _blockWidth)!=0 || (sourceImage->t() % _blockHeight)!=0)
+    {
+        // only whole blocks can be copied
+        return false;
     }
 
     const osg::Texture2D* sourceTexture = source->_texture.get();
@@ -3757,20 +4398,20 @@ Optimizer::TextureAtlasBuilder::Atlas::FitsIn Optimizer::TextureAtlasBuilder::At
             sourceTexture->getWrap(osg::Texture2D::WRAP_S)==osg::Texture2D::MIRROR)
         {
             // can't support repeating textures in texture atlas
-            return DOES_NOT_FIT_IN_ANY_ROW;
+            return false;
         }
 
         if (sourceTexture->getWrap(osg::Texture2D::WRAP_T)==osg::Texture2D::REPEAT ||
             sourceTexture->getWrap(osg::Texture2D::WRAP_T)==osg::Texture2D::MIRROR)
         {
             // can't support repeating textures in texture atlas
-            return DOES_NOT_FIT_IN_ANY_ROW;
+            return false;
         }
 
         if (sourceTexture->getReadPBuffer()!=0)
         {
             // pbuffer textures not suitable
-            return DOES_NOT_FIT_IN_ANY_ROW;
+            return false;
         }
 
         if (_texture.valid())
@@ -3779,113 +4420,198 @@ Optimizer::TextureAtlasBuilder::Atlas::FitsIn Optimizer::TextureAtlasBuilder::At
             bool sourceUsesBorder = sourceTexture->getWrap(osg::Texture2D::WRAP_S)==osg::Texture2D::CLAMP_TO_BORDER ||
                                     sourceTexture->getWrap(osg::Texture2D::WRAP_T)==osg::Texture2D::CLAMP_TO_BORDER;
 
-            bool atlasUsesBorder = sourceTexture->getWrap(osg::Texture2D::WRAP_S)==osg::Texture2D::CLAMP_TO_BORDER ||
-                                   sourceTexture->getWrap(osg::Texture2D::WRAP_T)==osg::Texture2D::CLAMP_TO_BORDER;
+            bool atlasUsesBorder = _texture->getWrap(osg::Texture2D::WRAP_S)==osg::Texture2D::CLAMP_TO_BORDER ||
+                                   _texture->getWrap(osg::Texture2D::WRAP_T)==osg::Texture2D::CLAMP_TO_BORDER;
 
             if (sourceUsesBorder!=atlasUsesBorder)
             {
                 // border wrapping does not match
-                return DOES_NOT_FIT_IN_ANY_ROW;
+                return false;
             }
 
             if (sourceUsesBorder)
             {
                 // border colours don't match
-                if (_texture->getBorderColor() != sourceTexture->getBorderColor()) return DOES_NOT_FIT_IN_ANY_ROW;
+                if (_texture->getBorderColor() != sourceTexture->getBorderColor()) return false;
             }
 
             if (_texture->getFilter(osg::Texture2D::MIN_FILTER) != sourceTexture->getFilter(osg::Texture2D::MIN_FILTER))
             {
                 // inconsitent min filters
-                return DOES_NOT_FIT_IN_ANY_ROW;
+                return false;
             }
 
             if (_texture->getFilter(osg::Texture2D::MAG_FILTER) != sourceTexture->getFilter(osg::Texture2D::MAG_FILTER))
             {
                 // inconsitent mag filters
-                return DOES_NOT_FIT_IN_ANY_ROW;
+                return false;
             }
 
             if (_texture->getMaxAnisotropy() != sourceTexture->getMaxAnisotropy())
             {
                 // anisotropy different.
-                return DOES_NOT_FIT_IN_ANY_ROW;
+                return false;
             }
 
             if (_texture->getInternalFormat() != sourceTexture->getInternalFormat())
             {
                 // internal formats inconistent
-                return DOES_NOT_FIT_IN_ANY_ROW;
+                return false;
             }
 
             if (_texture->getShadowCompareFunc() != sourceTexture->getShadowCompareFunc())
             {
                 // shadow functions inconsitent
-                return DOES_NOT_FIT_IN_ANY_ROW;
+                return false;
             }
 
             if (_texture->getShadowTextureMode() != sourceTexture->getShadowTextureMode())
             {
                 // shadow texture mode inconsitent
-                return DOES_NOT_FIT_IN_ANY_ROW;
+                return false;
             }
 
             if (_texture->getShadowAmbient() != sourceTexture->getShadowAmbient())
             {
                 // shadow ambient inconsitent
-                return DOES_NOT_FIT_IN_ANY_ROW;
+                return false;
             }
         }
     }
 
-    if (sourceImage->s() + 2*_margin > _maximumAtlasWidth)
-    {
-        // image too big for Atlas
-        return DOES_NOT_FIT_IN_ANY_ROW;
-    }
+    return true;
+}
 
-    if (sourceImage->t() + 2*_margin > _maximumAtlasHeight)
-    {
-        // image too big for Atlas
-        return DOES_NOT_FIT_IN_ANY_ROW;
-    }
+void Optimizer::TextureAtlasBuilder::Atlas::computePaddedSize(const osg::Image* image, int& width, int& height) const
+{
+    width = ((image->s() + 2*_margin + _alignment - 1)/_alignment)*_alignment;
+    height = ((image->t() + 2*_margin + _alignment - 1)/_alignment)*_alignment;
+}
 
-    if ((_y + sourceImage->t() + 2*_margin) > _maximumAtlasHeight)
+bool Optimizer::TextureAtlasBuilder::Atlas::findPosition(int width, int height, Rectangle& position) const
+{
+    // choose the free rectangle that least enlarges the area in use, so that few sources make a small atlas,
+    // then the one which the rectangle fits most tightly along its shorter leftover side.
+    bool found = false;
+    long long bestArea = 0;
+    int bestShortSide = 0;
+    int bestLongSide = 0;
+    for(RectangleList::const_iterator itr = _freeRectangles.begin();
+        itr != _freeRectangles.end();
+        ++itr)
     {
-        // image doesn't have up space in height axis.
-        return DOES_NOT_FIT_IN_ANY_ROW;
+        const Rectangle& freeRectangle = *itr;
+        if (width>freeRectangle.width || height>freeRectangle.height) continue;
+
+        long long area = (long long)osg::maximum(_width, freeRectangle.x+width) * (long long)osg::maximum(_height, freeRectangle.y+height);
+        int leftoverWidth = freeRectangle.width - width;
+        int leftoverHeight = freeRectangle.height - height;
+        int shortSide = osg::minimum(leftoverWidth, leftoverHeight);
+        int longSide = osg::maximum(leftoverWidth, leftoverHeight);
+
+        if (!found ||
+            area<bestArea ||
+            (area==bestArea && (shortSide<bestShortSide || (shortSide==bestShortSide && longSide<bestLongSide))))
+        {
+            found = true;
+            bestArea = area;
+            bestShortSide = shortSide;
+            bestLongSide = longSide;
+            position = Rectangle(freeRectangle.x, freeRectangle.y, width, height);
+        }
     }
+    return found;
+}
 
-    // does the source fit in the current row?
-    if ((_x + sourceImage->s() + 2*_margin) <= _maximumAtlasWidth)
+void Optimizer::TextureAtlasBuilder::Atlas::placeRectangle(const Rectangle& rectangle)
+{
+    // split the free rectangles overlapped by the new rectangle into the maximal rectangles around it.
+    RectangleList freeRectangles;
+    RectangleList splitRectangles;
+    for(RectangleList::iterator itr = _freeRectangles.begin();
+        itr != _freeRectangles.end();
+        ++itr)
     {
-        // yes it fits :-)
-        OSG_INFO<<"Fits in current row"<<std::endl;
-        return FITS_IN_CURRENT_ROW;
+        const Rectangle& freeRectangle = *itr;
+        if (!freeRectangle.intersects(rectangle))
+        {
+            freeRectangles.push_back(freeRectangle);
+            continue;
+        }
+
+        if (rectangle.x > freeRectangle.x)
+        {
+            splitRectangles.push_back(Rectangle(freeRectangle.x, freeRectangle.y, rectangle.x-freeRectangle.x, freeRectangle.height));
+        }
+        if (rectangle.x+rectangle.width < freeRectangle.x+freeRectangle.width)
+        {
+            splitRectangles.push_back(Rectangle(rectangle.x+rectangle.width, freeRectangle.y,
+                                                freeRectangle.x+freeRectangle.width-(rectangle.x+rectangle.width), freeRectangle.height));
+        }
+        if (rectangle.y > freeRectangle.y)
+        {
+            splitRectangles.push_back(Rectangle(freeRectangle.x, freeRectangle.y, freeRectangle.width, rectangle.y-freeRectangle.y));
+        }
+        if (rectangle.y+rectangle.height < freeRectangle.y+freeRectangle.height)
+        {
+            splitRectangles.push_back(Rectangle(freeRectangle.x, rectangle.y+rectangle.height,
+                                                freeRectangle.width, freeRectangle.y+freeRectangle.height-(rectangle.y+rectangle.height)));
+        }
     }
 
-    // does the source fit in the new row up?
-    if ((_height + sourceImage->t() + 2*_margin) <= _maximumAtlasHeight)
+    // keep only the split rectangles that aren't contained by another, the untouched free rectangles
+    // can't be contained by a split rectangle as they weren't contained by the rectangle it was split from.
+    unsigned int numUntouched = freeRectangles.size();
+    for(unsigned int i=0; i<splitRectangles.size(); ++i)
     {
-        // yes it fits :-)
-        OSG_INFO<<"Fits in next row"<<std::endl;
-        return IN_NEXT_ROW;
+        const Rectangle& splitRectangle = splitRectangles[i];
+        bool contained = false;
+        for(unsigned int j=0; j<numUntouched && !contained; ++j)
+        {
+            contained = freeRectangles[j].contains(splitRectangle);
+        }
+        for(unsigned int j=0; j<splitRectangles.size() && !contained; ++j)
+        {
+            if (j==i || !splitRectangles[j].contains(splitRectangle)) continue;
+            // of identical rectangles keep the first
+            contained = j<i || !splitRectangle.contains(splitRectangles[j]);
+        }
+        if (!contained) freeRectangles.push_back(splitRectangle);
     }
 
-    // no space for the texture
-    return DOES_NOT_FIT_IN_ANY_ROW;
+    _freeRectangles.swap(freeRectangles);
+
+    _width = osg::maximum(_width, rectangle.x+rectangle.width);
+    _height = osg::maximum(_height, rectangle.y+rectangle.height);
+}
+
+bool Optimizer::TextureAtlasBuilder::Atlas::doesSourceFit(Source* source)
+{
+    if (!isCompatible(source)) return false;
+
+    int width, height;
+    computePaddedSize(source->_image.get(), width, height);
+
+    Rectangle position;
+    return findPosition(width, height, position);
 }
 
 bool Optimizer::TextureAtlasBuilder::Atlas::addSource(Source* source)
 {
-    // double check source is compatible
-    if (!doesSourceFit(source))
+    if (!isCompatible(source)) return false;
+
+    const osg::Image* sourceImage = source->_image.get();
+    const osg::Texture2D* sourceTexture = source->_texture.get();
+
+    int width, height;
+    computePaddedSize(sourceImage, width, height);
+
+    Rectangle position;
+    if (!findPosition(width, height, position))
     {
         OSG_INFO<<"source "<<source->_image->getFileName()<<" does not fit in atlas "<<this<<std::endl;
         return false;
     }
-    const osg::Image* sourceImage = source->_image.get();
-    const osg::Texture2D* sourceTexture = source->_texture.get();
 
     if (!_image)
     {
@@ -3919,63 +4645,19 @@ bool Optimizer::TextureAtlasBuilder::Atlas::addSource(Source* source)
 
     }
 
-    // now work out where to fit it, first try current row.
-    if ((_x + sourceImage->s() + 2*_margin) <= _maximumAtlasWidth)
-    {
-        // yes it fits, so add the source to the atlas's list of sources it contains
-        _sourceList.push_back(source);
-
-        OSG_INFO<<"current row insertion, source "<<source->_image->getFileName()<<" "<<_x<<","<<_y<<" fits in row of atlas "<<this<<std::endl;
-
-        // set up the source so it knows where it is in the atlas
-        source->_x = _x + _margin;
-        source->_y = _y + _margin;
-        source->_atlas = this;
-
-        // move the atlas' cursor along to the right
-        _x += sourceImage->s() + 2*_margin;
-
-        if (_x > _width) _width = _x;
-
-        int localTop = _y + sourceImage->t() + 2*_margin;
-        if ( localTop > _height) _height = localTop;
-
-        return true;
-    }
-
-    // does the source fit in the new row up?
-    if ((_height + sourceImage->t() + 2*_margin) <= _maximumAtlasHeight)
-    {
-        // now row so first need to reset the atlas cursor
-        _x = 0;
-        _y = _height;
-
-        // yes it fits, so add the source to the atlas' list of sources it contains
-        _sourceList.push_back(source);
-
-        OSG_INFO<<"next row insertion, source "<<source->_image->getFileName()<<" "<<_x<<","<<_y<<" fits in row of atlas "<<this<<std::endl;
-
-        // set up the source so it knows where it is in the atlas
-        source->_x = _x + _margin;
-        source->_y = _y + _margin;
-        source->_atlas = this;
+    placeRectangle(position);
 
-        // move the atlas' cursor along to the right
-        _x += sourceImage->s() + 2*_margin;
+    // add the source to the atlas's list of sources it contains
+    _sourceList.push_back(source);
 
-        if (_x > _width) _width = _x;
+    // set up the source so it knows where it is in the atlas
+    source->_x = position.x + _margin;
+    source->_y = position.y + _margin;
+    source->_atlas = this;
 
-        _height = _y + sourceImage->t() + 2*_margin;
+    OSG_INFO<<"source "<<source->_image->getFileName()<<" placed at "<<source->_x<<","<<source->_y<<" in atlas "<<this<<std::endl;
 
-        OSG_INFO<<"source "<<source->_image->getFileName()<<" "<<_x<<","<<_y<<" fits in row of atlas "<<this<<std::endl;
-
-        return true;
-    }
-
-    OSG_INFO<<"source "<<source->_image->getFileName()<<" does not fit in atlas "<<this<<std::endl;
-
-    // shouldn't get here, unless doesSourceFit isn't working...
-    return false;
+    return true;
 }
 
 void Optimizer::TextureAtlasBuilder::Atlas::clampToNearestPowerOfTwoSize()
@@ -3993,178 +4675,32 @@ void Optimizer::TextureAtlasBuilder::Atlas::clampToNearestPowerOfTwoSize()
 }
 
 
-void Optimizer::TextureAtlasBuilder::Atlas::copySources()
-{
-    GLenum pixelFormat = _image->getPixelFormat();
-    GLenum dataType = _image->getDataType();
-    GLenum packing = _image->getPacking();
-    OSG_INFO<<"Allocated to "<<_width<<","<<_height<<std::endl;
-    _image->allocateImage(_width,_height,1,
-                          pixelFormat, dataType,
-                          packing);
-
-    {
-        // clear memory
-        unsigned int size = _image->getTotalSizeInBytes();
-        unsigned char* str = _image->data();
-        for(unsigned int i=0; i<size; ++i) *(str++) = 0;
-    }
+typedef std::map<osg::Vec2Array*, osg::Matrix> TexCoordRemapMap;
 
-    OSG_INFO<<"Atlas::copySources() "<<std::endl;
+struct RemapTexCoordsOperation : public osgUtil::RangeOperation
+{
+    RemapTexCoordsOperation(const TexCoordRemapMap& remaps): _remaps(remaps.begin(), remaps.end()) {}
 
-    for(SourceList::iterator itr = _sourceList.begin();
-        itr !=_sourceList.end();
-        ++itr)
+    virtual void operator() (unsigned int begin, unsigned int end)
     {
-        Source* source = itr->get();
-        Atlas* atlas = source->_atlas;
-
-        if (atlas == this)
+        for(unsigned int i=begin; i<end; ++i)
         {
-            OSG_INFO<<"Copying image "<<source->_image->getFileName()<<" to "<<source->_x<<" ,"<<source->_y<<std::endl;
-            OSG_INFO<<"        image size "<<source->_image->s()<<","<<source->_image->t()<<std::endl;
-
-            const osg::Image* sourceImage = source->_image.get();
-            osg::Image* atlasImage = atlas->_image.get();
-            //assert(sourceImage->getPacking() == atlasImage->getPacking()); //Test if packings are equals.
-            unsigned int rowSize = sourceImage->getRowSizeInBytes();
-            unsigned int pixelSizeInBits = sourceImage->getPixelSizeInBits();
-            unsigned int pixelSizeInBytes = pixelSizeInBits/8;
-            unsigned int marginSizeInBytes = pixelSizeInBytes*_margin;
-
-            //assert(atlas->_width  == static_cast<int>(atlasImage->s()));
-            //assert(atlas->_height == static_cast<int>(atlasImage->t()));
-            //assert(source->_x + static_cast<int>(source->_image->s())+_margin <= static_cast<int>(atlas->_image->s()));        // "+_margin" and not "+2*_margin" because _x already takes the margin into account
-            //assert(source->_y + static_cast<int>(source->_image->t())+_margin <= static_cast<int>(atlas->_image->t()));
-            //assert(source->_x >= _margin);
-            //assert(source->_y >= _margin);
-            int x = source->_x;
-            int y = source->_y;
-
-            int t;
-            for(t=0; t<sourceImage->t(); ++t, ++y)
-            {
-                unsigned char* destPtr = atlasImage->data(x, y);
-                const unsigned char* sourcePtr = sourceImage->data(0, t);
-                for(unsigned int i=0; i<rowSize; i++)
-                {
-                    *(destPtr++) = *(sourcePtr++);
-                }
-            }
-
-            // copy top row margin
-            y = source->_y + sourceImage->t();
-            int m;
-            for(m=0; m<_margin; ++m, ++y)
-            {
-                unsigned char* destPtr = atlasImage->data(x, y);
-                const unsigned char* sourcePtr = sourceImage->data(0, sourceImage->t()-1);
-                for(unsigned int i=0; i<rowSize; i++)
-                {
-                    *(destPtr++) = *(sourcePtr++);
-                }
-
-            }
-
-
-
-            // copy bottom row margin
-            y = source->_y-1;
-            for(m=0; m<_margin; ++m, --y)
-            {
-                unsigned char* destPtr = atlasImage->data(x, y);
-                const unsigned char* sourcePtr = sourceImage->data(0, 0);
-                for(unsigned int i=0; i<rowSize; i++)
-                {
-                    *(destPtr++) = *(sourcePtr++);
-                }
-
-            }
-
-            // copy left column margin
-            y = source->_y;
-            for(t=0; t<sourceImage->t(); ++t, ++y)
-            {
-                x = source->_x-1;
-                for(m=0; m<_margin; ++m, --x)
-                {
-                    unsigned char* destPtr = atlasImage->data(x, y);
-                    const unsigned char* sourcePtr = sourceImage->data(0, t);
-                    for(unsigned int i=0; i<pixelSizeInBytes; i++)
-                    {
-                        *(destPtr++) = *(sourcePtr++);
-                    }
-                }
-            }
-
-            // copy right column margin
-            y = source->_y;
-            for(t=0; t<sourceImage->t(); ++t, ++y)
-            {
-                x = source->_x + sourceImage->s();
-                for(m=0; m<_margin; ++m, ++x)
-                {
-                    unsigned char* destPtr = atlasImage->data(x, y);
-                    const unsigned char* sourcePtr = sourceImage->data(sourceImage->s()-1, t);
-                    for(unsigned int i=0; i<pixelSizeInBytes; i++)
-                    {
-                        *(destPtr++) = *(sourcePtr++);
-                    }
-                }
-            }
-
-            // copy top left corner margin
-            y = source->_y + sourceImage->t();
-            for(m=0; m<_margin; ++m, ++y)
-            {
-                unsigned char* destPtr = atlasImage->data(source->_x - _margin, y);
-                unsigned char* sourcePtr = atlasImage->data(source->_x - _margin, y-1); // copy from row below
-                for(unsigned int i=0; i<marginSizeInBytes; i++)
-                {
-                    *(destPtr++) = *(sourcePtr++);
-                }
-            }
-
-            // copy top right corner margin
-            y = source->_y + sourceImage->t();
-            for(m=0; m<_margin; ++m, ++y)
-            {
-                unsigned char* destPtr = atlasImage->data(source->_x + sourceImage->s(), y);
-                unsigned char* sourcePtr = atlasImage->data(source->_x + sourceImage->s(), y-1); // copy from row below
-                for(unsigned int i=0; i<marginSizeInBytes; i++)
-                {
-                    *(destPtr++) = *(sourcePtr++);
-                }
-            }
-
-            // copy bottom left corner margin
-            y = source->_y - 1;
-            for(m=0; m<_margin; ++m, --y)
-            {
-                unsigned char* destPtr = atlasImage->data(source->_x - _margin, y);
-                unsigned char* sourcePtr = atlasImage->data(source->_x - _margin, y+1); // copy from row below
-                for(unsigned int i=0; i<marginSizeInBytes; i++)
-                {
-                    *(destPtr++) = *(sourcePtr++);
-                }
-            }
-
-            // copy bottom right corner margin
-            y = source->_y - 1;
-            for(m=0; m<_margin; ++m, --y)
+            osg::Vec2Array* texcoords = _remaps[i].first;
+            const osg::Matrix& matrix = _remaps[i].second;
+            for(osg::Vec2Array::iterator titr = texcoords->begin();
+                titr != texcoords->end();
+                ++titr)
             {
-                unsigned char* destPtr = atlasImage->data(source->_x + sourceImage->s(), y);
-                unsigned char* sourcePtr = atlasImage->data(source->_x + sourceImage->s(), y+1); // copy from row below
-                for(unsigned int i=0; i<marginSizeInBytes; i++)
-                {
-                    *(destPtr++) = *(sourcePtr++);
-                }
+                osg::Vec2 tc = *titr;
+                (*titr).set(tc[0]*matrix(0,0) + tc[1]*matrix(1,0) + matrix(3,0),
+                          tc[0]*matrix(0,1) + tc[1]*matrix(1,1) + matrix(3,1));
             }
-
+            texcoords->dirty();
         }
     }
-}
 
+    std::vector< std::pair<osg::Vec2Array*, osg::Matrix> > _remaps;
+};
 
 void Optimizer::TextureAtlasVisitor::reset()
 {
@@ -4475,7 +5011,8 @@ void Optimizer::TextureAtlasVisitor::optimize()
         }
     }
 
-    // remap the textures in the StateSet's
+    // remap the textures in the StateSet's, collecting the texcoord arrays to remap into their atlas'
+    TexCoordRemapMap texCoordRemaps;
     for(sitr = _statesetMap.begin();
         sitr != _statesetMap.end();
         ++sitr)
@@ -4538,14 +5075,8 @@ void Optimizer::TextureAtlasVisitor::optimize()
                             osg::Vec2Array* texcoords = geom ? dynamic_cast<osg::Vec2Array*>(geom->getTexCoordArray(unit)) : 0;
                             if (texcoords)
                             {
-                                for(osg::Vec2Array::iterator titr = texcoords->begin();
-                                    titr != texcoords->end();
-                                    ++titr)
-                                {
-                                    osg::Vec2 tc = *titr;
-                                    (*titr).set(tc[0]*matrix(0,0) + tc[1]*matrix(1,0) + matrix(3,0),
-                                              tc[0]*matrix(0,1) + tc[1]*matrix(1,1) + matrix(3,1));
-                                }
+                                // texcoord arrays shared between drawables are only remapped once
+                                texCoordRemaps.insert(TexCoordRemapMap::value_type(texcoords, matrix));
                             }
                             else
                             {
@@ -4563,6 +5094,13 @@ void Optimizer::TextureAtlasVisitor::optimize()
         }
 
     }
+
+    RemapTexCoordsOperation remapOperation(texCoordRemaps);
+    osgUtil::runInParallel(remapOperation, remapOperation._remaps.size(), _builder.getNumThreads(), 1, 1);
+
+    const TextureAtlasBuilder::Statistics& stats = _builder.getStatistics();
+    OSG_INFO<<"TextureAtlasVisitor packed "<<stats.numSourcesInAtlases<<" of "<<_builder.getNumSources()<<" textures into "
+            <<stats.numAtlases<<" atlas', occupancy "<<stats.getOccupancy()<<", remapped "<<texCoordRemaps.size()<<" texcoord arrays"<<std::endl;
 }
 
 
@@ -4808,6 +5346,8 @@ void Optimizer::FlattenStaticTransformsDuplicatingSharedSubgraphsVisitor::transf
 
 void Optimizer::FlattenStaticTransformsDuplicatingSharedSubgraphsVisitor::transformDrawable(osg::Drawable& drawable)
 {
+    if (foldIntoVertexDecodeMatrix(&drawable, _matrixStack.back())) return;
+
     osg::Geometry* geometry = drawable.asGeometry();
     if(geometry)
     {
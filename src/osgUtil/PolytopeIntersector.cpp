@@ -19,6 +19,8 @@
 #include <osg/io_utils>
 #include <osg/TemplatePrimitiveFunctor>
 
+#include <algorithm>
+
 using namespace osgUtil;
 
 
@@ -356,8 +358,26 @@ namespace PolytopeIntersectorUtils
             this->operator()(v1,v3,v4,treatVertexDataAsTemporary);
         }
 
+        /// add a primitive whose vertices all lie inside the polytope volume, as the operators above would
+        void addContainedPrimitive(unsigned int dimension, const Vec3_type* vertices, unsigned int numVertices)
+        {
+            ++_index;
+            if ((_dimensionMask & dimension) == 0) return;
+
+            if (_limitOneIntersection && !intersections.empty()) return;
+
+            _candidates.clear();
+            for (unsigned int i=0; i<numVertices; ++i)
+            {
+                _candidates.push_back( CandList_t::value_type(_plane_mask, vertices[i]) );
+            }
+            addIntersection(_index, _candidates);
+        }
+
         void setDimensionMask(unsigned int dimensionMask) { _dimensionMask = dimensionMask; }
 
+        unsigned int getDimensionMask() const { return _dimensionMask; }
+
         void setLimitOneIntersection(bool limit) { _limitOneIntersection = limit; }
 
         void setPolytope(osg::Polytope& polytope, osg::Plane& referencePlane)
@@ -426,6 +446,8 @@ namespace PolytopeIntersectorUtils
 
         unsigned int getNumPlanes() const { return _planes.size(); }
 
+        const PlaneList& getPlanes() const { return _planes; }
+
         Intersections intersections;
         osg::Plane _referencePlane;
 
@@ -440,6 +462,225 @@ namespace PolytopeIntersectorUtils
         CandList_t _candidates;
     }; // class PolytopePrimitiveIntersector
 
+
+    /** Intersects the primitives of a Geometry with a Vec3Array by vertex index, first classifying all the vertices
+      * against each plane of the polytope in a single pass over the vertex array, so that primitives with all their
+      * vertices outside of a plane are rejected, and those with all their vertices inside every plane are accepted,
+      * without computing any plane distances per primitive. Only the remaining primitives, those straddling a plane,
+      * are passed to the PolytopePrimitiveIntersector. Primitives are visited in the same order, and so get the same
+      * primitive indices, as with TemplatePrimitiveFunctor. */
+    class PolytopeIndexIntersector : public osg::PrimitiveIndexFunctor
+    {
+    public:
+
+        PolytopeIndexIntersector(PolytopePrimitiveIntersector& intersector, std::vector<PlaneMask>& outsideMasks):
+            _intersector(intersector),
+            _outsideMasks(outsideMasks),
+            _vertices(0),
+            _modeCache(0) {}
+
+        virtual void setVertexArray(unsigned int,const osg::Vec2*) { _vertices = 0; }
+
+        virtual void setVertexArray(unsigned int count,const osg::Vec3* vertices)
+        {
+            _vertices = vertices;
+
+            // classify the vertices against one plane at a time, keeping the inner loop free of branches
+            // so that it can be vectorized
+            _outsideMasks.assign(count, 0);
+            PlaneMask* masks = _outsideMasks.empty() ? 0 : &_outsideMasks.front();
+
+            const PolytopePrimitiveIntersector::PlaneList& planes = _intersector.getPlanes();
+            PlaneMask selector_mask = 0x1;
+            for (PolytopePrimitiveIntersector::PlaneList::const_iterator it=planes.begin(); it!=planes.end(); ++it, selector_mask <<= 1)
+            {
+                const value_type a = (*it)[0];
+                const value_type b = (*it)[1];
+                const value_type c = (*it)[2];
+                const value_type d = (*it)[3];
+                for (unsigned int i=0; i<count; ++i)
+                {
+                    const osg::Vec3& v = vertices[i];
+                    const value_type distance = a*value_type(v.x())+b*value_type(v.y())+c*value_type(v.z())+d;
+                    masks[i] |= (distance<0.0f) ? selector_mask : 0;
+                }
+            }
+        }
+
+        virtual void setVertexArray(unsigned int,const osg::Vec4*) { _vertices = 0; }
+        virtual void setVertexArray(unsigned int,const osg::Vec2d*) { _vertices = 0; }
+        virtual void setVertexArray(unsigned int,const osg::Vec3d*) { _vertices = 0; }
+        virtual void setVertexArray(unsigned int,const osg::Vec4d*) { _vertices = 0; }
+
+        virtual void drawArrays(GLenum mode,GLint first,GLsizei count)
+        {
+            drawPrimitives(mode, count, SequentialIndices(first));
+        }
+
+        virtual void drawElements(GLenum mode,GLsizei count,const GLubyte* indices)
+        {
+            if (indices) drawPrimitives(mode, count, indices);
+        }
+
+        virtual void drawElements(GLenum mode,GLsizei count,const GLushort* indices)
+        {
+            if (indices) drawPrimitives(mode, count, indices);
+        }
+
+        virtual void drawElements(GLenum mode,GLsizei count,const GLuint* indices)
+        {
+            if (indices) drawPrimitives(mode, count, indices);
+        }
+
+        virtual void begin(GLenum mode)
+        {
+            _modeCache = mode;
+            _indexCache.clear();
+        }
+
+        virtual void vertex(unsigned int vert)
+        {
+            _indexCache.push_back(vert);
+        }
+
+        virtual void end()
+        {
+            if (!_indexCache.empty())
+            {
+                drawElements(_modeCache,_indexCache.size(),&_indexCache.front());
+            }
+        }
+
+    protected:
+
+        PolytopeIndexIntersector& operator = (const PolytopeIndexIntersector&) { return *this; }
+
+        struct SequentialIndices
+        {
+            SequentialIndices(GLint first): _first(first) {}
+            inline unsigned int operator[] (GLsizei i) const { return _first+i; }
+            GLint _first;
+        };
+
+        void point(unsigned int i1)
+        {
+            if (_outsideMasks[i1]==0)
+            {
+                Vec3_type v(_vertices[i1]);
+                _intersector.addContainedPrimitive(PolytopeIntersector::DimZero, &v, 1);
+            }
+            else
+            {
+                ++_intersector._index;
+            }
+        }
+
+        void line(unsigned int i1, unsigned int i2)
+        {
+            const PlaneMask m1 = _outsideMasks[i1];
+            const PlaneMask m2 = _outsideMasks[i2];
+            if ((m1 & m2)!=0)
+            {
+                ++_intersector._index;
+            }
+            else if ((m1 | m2)==0)
+            {
+                Vec3_type v[2] = { Vec3_type(_vertices[i1]), Vec3_type(_vertices[i2]) };
+                _intersector.addContainedPrimitive(PolytopeIntersector::DimOne, v, 2);
+            }
+            else
+            {
+                _intersector(_vertices[i1], _vertices[i2], false);
+            }
+        }
+
+        void triangle(unsigned int i1, unsigned int i2, unsigned int i3)
+        {
+            const PlaneMask m1 = _outsideMasks[i1];
+            const PlaneMask m2 = _outsideMasks[i2];
+            const PlaneMask m3 = _outsideMasks[i3];
+            if ((m1 & m2 & m3)!=0)
+            {
+                ++_intersector._index;
+            }
+            else if ((m1 | m2 | m3)==0)
+            {
+                Vec3_type v[3] = { Vec3_type(_vertices[i1]), Vec3_type(_vertices[i2]), Vec3_type(_vertices[i3]) };
+                _intersector.addContainedPrimitive(PolytopeIntersector::DimTwo, v, 3);
+            }
+            else
+            {
+                _intersector(_vertices[i1], _vertices[i2], _vertices[i3], false);
+            }
+        }
+
+        void quad(unsigned int i1, unsigned int i2, unsigned int i3, unsigned int i4)
+        {
+            if ((_intersector.getDimensionMask() & PolytopeIntersector::DimTwo) == 0)
+            {
+                ++_intersector._index;
+                return;
+            }
+
+            triangle(i1, i2, i3);
+
+            --_intersector._index;
+
+            triangle(i1, i3, i4);
+        }
+
+        template<class Indices>
+        void drawPrimitives(GLenum mode, GLsizei count, const Indices& indices)
+        {
+            if (_vertices==0 || count==0) return;
+
+            switch(mode)
+            {
+                case(GL_TRIANGLES):
+                    for(GLsizei i=2; i<count; i+=3) triangle(indices[i-2], indices[i-1], indices[i]);
+                    break;
+                case(GL_TRIANGLE_STRIP):
+                    for(GLsizei i=2; i<count; ++i)
+                    {
+                        if ((i%2)) triangle(indices[i-2], indices[i], indices[i-1]);
+                        else       triangle(indices[i-2], indices[i-1], indices[i]);
+                    }
+                    break;
+                case(GL_QUADS):
+                    for(GLsizei i=3; i<count; i+=4) quad(indices[i-3], indices[i-2], indices[i-1], indices[i]);
+                    break;
+                case(GL_QUAD_STRIP):
+                    for(GLsizei i=3; i<count; i+=2) quad(indices[i-3], indices[i-2], indices[i], indices[i-1]);
+                    break;
+                case(GL_POLYGON): // treat polygons as GL_TRIANGLE_FAN
+                case(GL_TRIANGLE_FAN):
+                    for(GLsizei i=2; i<count; ++i) triangle(indices[0], indices[i-1], indices[i]);
+                    break;
+                case(GL_POINTS):
+                    for(GLsizei i=0; i<count; ++i) point(indices[i]);
+                    break;
+                case(GL_LINES):
+                    for(GLsizei i=1; i<count; i+=2) line(indices[i-1], indices[i]);
+                    break;
+                case(GL_LINE_STRIP):
+                    for(GLsizei i=1; i<count; ++i) line(indices[i-1], indices[i]);
+                    break;
+                case(GL_LINE_LOOP):
+                    for(GLsizei i=1; i<count; ++i) line(indices[i-1], indices[i]);
+                    line(indices[count-1], indices[0]);
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        PolytopePrimitiveIntersector&   _intersector;
+        std::vector<PlaneMask>&         _outsideMasks;
+        const osg::Vec3*                _vertices;
+        GLenum                          _modeCache;
+        std::vector<GLuint>             _indexCache;
+    }; // class PolytopeIndexIntersector
+
 } // namespace PolytopeIntersectorUtils
 
 
@@ -450,7 +691,8 @@ namespace PolytopeIntersectorUtils
 PolytopeIntersector::PolytopeIntersector(const osg::Polytope& polytope):
     _parent(0),
     _polytope(polytope),
-    _dimensionMask( AllDims )
+    _dimensionMask( AllDims ),
+    _useHitRecords(false)
 {
     if (!_polytope.getPlaneList().empty())
     {
@@ -462,7 +704,8 @@ PolytopeIntersector::PolytopeIntersector(CoordinateFrame cf, const osg::Polytope
     Intersector(cf),
     _parent(0),
     _polytope(polytope),
-    _dimensionMask( AllDims )
+    _dimensionMask( AllDims ),
+    _useHitRecords(false)
 {
     if (!_polytope.getPlaneList().empty())
     {
@@ -473,7 +716,8 @@ PolytopeIntersector::PolytopeIntersector(CoordinateFrame cf, const osg::Polytope
 PolytopeIntersector::PolytopeIntersector(CoordinateFrame cf, double xMin, double yMin, double xMax, double yMax):
     Intersector(cf),
     _parent(0),
-    _dimensionMask( AllDims )
+    _dimensionMask( AllDims ),
+    _useHitRecords(false)
 {
     double zNear = 0.0;
     switch(cf)
@@ -502,6 +746,7 @@ Intersector* PolytopeIntersector::clone(osgUtil::IntersectionVisitor& iv)
         pi->_intersectionLimit = this->_intersectionLimit;
         pi->_dimensionMask = this->_dimensionMask;
         pi->_referencePlane = this->_referencePlane;
+        pi->_useHitRecords = this->_useHitRecords;
         return pi.release();
     }
 
@@ -538,6 +783,7 @@ Intersector* PolytopeIntersector::clone(osgUtil::IntersectionVisitor& iv)
     pi->_intersectionLimit = this->_intersectionLimit;
     pi->_dimensionMask = this->_dimensionMask;
     pi->_referencePlane = this->_referencePlane;
+    pi->_useHitRecords = this->_useHitRecords;
     pi->_referencePlane.transformProvidingInverse(matrix);
     return pi.release();
 }
@@ -561,18 +807,56 @@ void PolytopeIntersector::intersect(osgUtil::IntersectionVisitor& iv, osg::Drawa
 
     if ( !_polytope.contains( drawable->getBound() ) ) return;
 
-    osg::TemplatePrimitiveFunctor<PolytopeIntersectorUtils::PolytopePrimitiveIntersector> func;
-    func.setPolytope( _polytope, _referencePlane );
-    func.setDimensionMask( _dimensionMask );
-    func.setLimitOneIntersection( _intersectionLimit == LIMIT_ONE_PER_DRAWABLE || _intersectionLimit == LIMIT_ONE );
+    PolytopeIntersectorUtils::Intersections intersections;
 
-    drawable->accept(func);
+    const osg::Geometry* geometry = drawable->asGeometry();
+    if (geometry && dynamic_cast<const osg::Vec3Array*>(geometry->getVertexArray()) && !geometry->getVertexIndices())
+    {
+        PolytopeIntersectorUtils::PolytopePrimitiveIntersector intersector;
+        intersector.setPolytope( _polytope, _referencePlane );
+        intersector.setDimensionMask( _dimensionMask );
+        intersector.setLimitOneIntersection( _intersectionLimit == LIMIT_ONE_PER_DRAWABLE || _intersectionLimit == LIMIT_ONE );
 
-    if (func.intersections.empty()) return;
+        PolytopeIntersectorUtils::PolytopeIndexIntersector func(intersector, _outsideMasks);
+        geometry->accept(func);
 
+        intersector.intersections.swap(intersections);
+    }
+    else
+    {
+        osg::TemplatePrimitiveFunctor<PolytopeIntersectorUtils::PolytopePrimitiveIntersector> func;
+        func.setPolytope( _polytope, _referencePlane );
+        func.setDimensionMask( _dimensionMask );
+        func.setLimitOneIntersection( _intersectionLimit == LIMIT_ONE_PER_DRAWABLE || _intersectionLimit == LIMIT_ONE );
+
+        drawable->accept(func);
+
+        func.intersections.swap(intersections);
+    }
+
+    if (intersections.empty()) return;
+
+    if (_useHitRecords)
+    {
+        HitDrawables& hitDrawables = getHitDrawables();
+        unsigned int drawableIndex = hitDrawables.size();
+        hitDrawables.push_back(HitDrawable());
+        hitDrawables.back().nodePath = iv.getNodePath();
+        hitDrawables.back().drawable = drawable;
+        hitDrawables.back().matrix = iv.getModelMatrix();
+
+        Hits& hits = getHits();
+        for(PolytopeIntersectorUtils::Intersections::const_iterator it=intersections.begin();
+            it!=intersections.end();
+            ++it)
+        {
+            hits.push_back(Hit(drawableIndex, it->_index, it->_distance));
+        }
+        return;
+    }
 
-    for(PolytopeIntersectorUtils::Intersections::const_iterator it=func.intersections.begin();
-        it!=func.intersections.end();
+    for(PolytopeIntersectorUtils::Intersections::const_iterator it=intersections.begin();
+        it!=intersections.end();
         ++it)
     {
         const PolytopeIntersectorUtils::PolytopeIntersection& intersection = *it;
@@ -607,5 +891,13 @@ void PolytopeIntersector::reset()
     Intersector::reset();
 
     _intersections.clear();
+    _hits.clear();
+    _hitDrawables.clear();
+}
+
+void PolytopeIntersector::sortHits()
+{
+    Hits& hits = getHits();
+    std::sort(hits.begin(), hits.end());
 }
 
@@ -0,0 +1,105 @@
+/* -*-c++-*- OpenSceneGraph - Copyright (C) 1998-2006 Robert Osfield
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+*/
+
+#include <osgUtil/RangeOperation>
+
+#include <osg/Math>
+
+#include <OpenThreads/Mutex>
+#include <OpenThreads/ScopedLock>
+#include <OpenThreads/Thread>
+
+#include <vector>
+
+using namespace osgUtil;
+
+namespace
+{
+
+class RangeOperationThread : public OpenThreads::Thread
+{
+    public:
+
+        RangeOperationThread(RangeOperation& operation, unsigned int numItems, unsigned int chunkSize, OpenThreads::Mutex& mutex, unsigned int& next):
+            _operation(operation),
+            _numItems(numItems),
+            _chunkSize(chunkSize),
+            _mutex(mutex),
+            _next(next) {}
+
+        virtual void run()
+        {
+            for(;;)
+            {
+                unsigned int begin, end;
+                {
+                    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+                    if (_next>=_numItems) return;
+                    begin = _next;
+                    end = (_numItems-begin>_chunkSize) ? begin+_chunkSize : _numItems;
+                    _next = end;
+                }
+                _operation(begin, end);
+            }
+        }
+
+    protected:
+
+        RangeOperationThread& operator = (const RangeOperationThread&) { return *this; }
+
+        RangeOperation&         _operation;
+        unsigned int            _numItems;
+        unsigned int            _chunkSize;
+        OpenThreads::Mutex&     _mutex;
+        unsigned int&           _next;
+};
+
+}
+
+void osgUtil::runInParallel(RangeOperation& operation, unsigned int numItems, unsigned int numThreads, unsigned int minItemsPerThread, unsigned int chunkSize)
+{
+    if (numItems==0) return;
+
+    if (numThreads==0) numThreads = static_cast<unsigned int>(osg::maximum(OpenThreads::GetNumberOfProcessors(), 1));
+    numThreads = osg::minimum(numThreads, osg::maximum(numItems/osg::maximum(minItemsPerThread, 1u), 1u));
+
+    if (numThreads==1)
+    {
+        operation(0, numItems);
+        return;
+    }
+
+    // a single contiguous range per thread.
+    if (chunkSize==0) chunkSize = (numItems+numThreads-1)/numThreads;
+
+    OpenThreads::Mutex mutex;
+    unsigned int next = 0;
+    std::vector<RangeOperationThread*> threads;
+    for(unsigned int i=1; i<numThreads; ++i)
+    {
+        RangeOperationThread* thread = new RangeOperationThread(operation, numItems, chunkSize, mutex, next);
+        if (thread->startThread()==0) threads.push_back(thread);
+        else delete thread;
+    }
+
+    // this thread works through the items too, along with any left by threads that failed to start.
+    RangeOperationThread(operation, numItems, chunkSize, mutex, next).run();
+
+    for(std::vector<RangeOperationThread*>::iterator itr = threads.begin();
+        itr != threads.end();
+        ++itr)
+    {
+        (*itr)->join();
+        delete *itr;
+    }
+}
@@ -16,6 +16,7 @@
 #include <osgUtil/RenderBin>
 #include <osgUtil/RenderStage>
 #include <osgUtil/Statistics>
+#include <osgUtil/GeometryBatcher>
 
 #include <osg/Notify>
 #include <osg/ApplicationUsage>
@@ -138,6 +139,30 @@ RenderBin::SortMode RenderBin::getDefaultRenderBinSortMode()
     return s_defaultBinSortMode;
 }
 
+static GeometryBatcher* createDefaultGeometryBatcher()
+{
+    const char* str = getenv("OSG_BATCH_STATIC_GEOMETRY");
+    if (str && (strcmp(str,"ON")==0 || strcmp(str,"on")==0))
+    {
+        return new GeometryBatcher;
+    }
+    return 0;
+}
+
+// created during static initialization so that the cull and draw threads never race to create it.
+static osg::ref_ptr<GeometryBatcher> s_defaultGeometryBatcher = createDefaultGeometryBatcher();
+static osg::ApplicationUsageProxy RenderBin_e1(osg::ApplicationUsage::ENVIRONMENTAL_VARIABLE,"OSG_BATCH_STATIC_GEOMETRY <mode>","ON | OFF - Enable the merging of the draws of consecutive static geometries that share the same state and matrices.");
+
+void RenderBin::setDefaultGeometryBatcher(GeometryBatcher* batcher)
+{
+    s_defaultGeometryBatcher = batcher;
+}
+
+GeometryBatcher* RenderBin::getDefaultGeometryBatcher()
+{
+    return s_defaultGeometryBatcher.get();
+}
+
 RenderBin::RenderBin()
 {
     _binNum = 0;
@@ -450,14 +475,23 @@ void RenderBin::drawImplementation(osg::RenderInfo& renderInfo,RenderLeaf*& prev
         rbitr->second->draw(renderInfo,previous);
     }
 
+    GeometryBatcher* batcher = getDefaultGeometryBatcher();
+
     // draw fine grained ordering.
     for(RenderLeafList::iterator rlitr= _renderLeafList.begin();
         rlitr!= _renderLeafList.end();
         ++rlitr)
     {
         RenderLeaf* rl = *rlitr;
-        rl->render(renderInfo,previous);
-        previous = rl;
+        if (batcher)
+        {
+            batcher->draw(renderInfo,rl,previous);
+        }
+        else
+        {
+            rl->render(renderInfo,previous);
+            previous = rl;
+        }
     }
 
 
@@ -476,9 +510,15 @@ void RenderBin::drawImplementation(osg::RenderInfo& renderInfo,RenderLeaf*& prev
                 ++dw_itr)
             {
                 RenderLeaf* rl = dw_itr->get();
-                rl->render(renderInfo,previous);
-                previous = rl;
-
+                if (batcher)
+                {
+                    batcher->draw(renderInfo,rl,previous);
+                }
+                else
+                {
+                    rl->render(renderInfo,previous);
+                    previous = rl;
+                }
             }
         }
     }
@@ -494,13 +534,22 @@ void RenderBin::drawImplementation(osg::RenderInfo& renderInfo,RenderLeaf*& prev
                 ++dw_itr)
             {
                 RenderLeaf* rl = dw_itr->get();
-                rl->render(renderInfo,previous);
-                previous = rl;
-
+                if (batcher)
+                {
+                    batcher->draw(renderInfo,rl,previous);
+                }
+                else
+                {
+                    rl->render(renderInfo,previous);
+                    previous = rl;
+                }
             }
         }
     }
 
+    // draw any leaves still queued to be batched before moving on to the post bins.
+    if (batcher) batcher->flush(renderInfo,previous);
+
     // draw post bins.
     for(;
         rbitr!=_bins.end();
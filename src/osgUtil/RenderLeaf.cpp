@@ -28,6 +28,23 @@ void RenderLeaf::render(osg::RenderInfo& renderInfo,RenderLeaf* previous)
         return;
     }
 
+    applyState(renderInfo, previous);
+
+    // draw the drawable
+    _drawable->draw(renderInfo);
+
+    if (_dynamic)
+    {
+        state.decrementDynamicObjectCount();
+    }
+
+    // OSG_NOTICE<<"RenderLeaf "<<_drawable->getName()<<" "<<_depth<<std::endl;
+}
+
+void RenderLeaf::applyState(osg::RenderInfo& renderInfo,RenderLeaf* previous)
+{
+    osg::State& state = *renderInfo.getState();
+
     if (previous)
     {
 
@@ -58,9 +75,6 @@ void RenderLeaf::render(osg::RenderInfo& renderInfo,RenderLeaf* previous)
         // if we are using osg::Program which requires OSG's generated uniforms to track
         // modelview and projection matrices then apply them now.
         if (state.getUseModelViewAndProjectionUniforms()) state.applyModelViewAndProjectionUniformsIfRequired();
-
-        // draw the drawable
-        _drawable->draw(renderInfo);
     }
     else
     {
@@ -76,15 +90,5 @@ void RenderLeaf::render(osg::RenderInfo& renderInfo,RenderLeaf* previous)
         // if we are using osg::Program which requires OSG's generated uniforms to track
         // modelview and projection matrices then apply them now.
         if (state.getUseModelViewAndProjectionUniforms()) state.applyModelViewAndProjectionUniformsIfRequired();
-
-        // draw the drawable
-        _drawable->draw(renderInfo);
     }
-
-    if (_dynamic)
-    {
-        state.decrementDynamicObjectCount();
-    }
-
-    // OSG_NOTICE<<"RenderLeaf "<<_drawable->getName()<<" "<<_depth<<std::endl;
 }
@@ -864,6 +864,8 @@ bool SceneView::cullStage(const osg::Matrixd& projection,const osg::Matrixd& mod
     osg::ref_ptr<RefMatrix> proj = new osg::RefMatrix(projection);
     osg::ref_ptr<RefMatrix> mv = new osg::RefMatrix(modelview);
 
+    cullVisitor->setOcclusionBuffer(0);
+
     // collect any occluder in the view frustum.
     if (_camera->containsOccluderNodes())
     {
@@ -876,6 +878,17 @@ bool SceneView::cullStage(const osg::Matrixd& projection,const osg::Matrixd& mod
 
         _collectOccludersVisitor->reset();
 
+        // set up the occlusion buffer for the occluder geometry to be rasterized into.
+        if (_collectOccludersVisitor->getCullingMode() & osg::CullSettings::SOFTWARE_OCCLUSION_CULLING)
+        {
+            if (!_collectOccludersVisitor->getOcclusionBuffer()) _collectOccludersVisitor->setOcclusionBuffer(new osg::OcclusionBuffer);
+            _collectOccludersVisitor->getOcclusionBuffer()->clear(*proj);
+        }
+        else
+        {
+            _collectOccludersVisitor->setOcclusionBuffer(0);
+        }
+
         _collectOccludersVisitor->setFrameStamp(_frameStamp.get());
 
         // use the frame number for the traversal number.
@@ -903,6 +916,8 @@ bool SceneView::cullStage(const osg::Matrixd& projection,const osg::Matrixd& mod
 
         cullVisitor->getOccluderList().clear();
         std::copy(_collectOccludersVisitor->getCollectedOccluderSet().begin(),_collectOccludersVisitor->getCollectedOccluderSet().end(), std::back_insert_iterator<CullStack::OccluderList>(cullVisitor->getOccluderList()));
+
+        cullVisitor->setOcclusionBuffer(_collectOccludersVisitor->getOcclusionBuffer());
     }
 
 
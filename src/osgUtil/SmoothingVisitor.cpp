@@ -10,15 +10,15 @@
  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
  * OpenSceneGraph Public License for more details.
 */
-#include <osg/TriangleFunctor>
 #include <osg/TriangleIndexFunctor>
 #include <osg/io_utils>
 
+#include <osgUtil/RangeOperation>
 #include <osgUtil/SmoothingVisitor>
 
-#include <stdio.h>
-#include <list>
-#include <set>
+#include <string.h>
+#include <math.h>
+#include <vector>
 
 
 using namespace osg;
@@ -27,649 +27,421 @@ using namespace osgUtil;
 namespace Smoother
 {
 
-struct LessPtr
+// small meshes aren't worth the cost of starting threads
+static const unsigned int minimumRangeSize = 16384;
+
+// collect the vertex indices of the non degenerate triangles, along with the range of triangles of each primitive set.
+struct CollectTrianglesFunctor
 {
-    inline bool operator() (const osg::Vec3* lhs,const osg::Vec3* rhs) const
+    CollectTrianglesFunctor():
+        _indices(0) {}
+
+    void operator() (unsigned int p1, unsigned int p2, unsigned int p3)
     {
-        return *lhs<*rhs;
+        if (p1==p2 || p2==p3 || p1==p3) return;
+
+        _indices->push_back(p1);
+        _indices->push_back(p2);
+        _indices->push_back(p3);
     }
+
+    std::vector<unsigned int>* _indices;
 };
 
-// triangle functor.
-struct SmoothTriangleFunctor
+// weld the vertices with identical coordinates through a hash table, setting weld[i] to the welded vertex of vertex i.
+static unsigned int weldVertices(const osg::Vec3Array& vertices, std::vector<unsigned int>& weld)
 {
+    unsigned int numVertices = vertices.size();
+    unsigned int tableSize = 1;
+    while (tableSize < numVertices*2) tableSize <<= 1;
 
-    osg::Vec3* _coordBase;
-    osg::Vec3* _normalBase;
-
-    typedef std::multiset<const osg::Vec3*,LessPtr> CoordinateSet;
-    CoordinateSet _coordSet;
-
-    SmoothTriangleFunctor():
-         _coordBase(0),
-         _normalBase(0) {}
+    std::vector<unsigned int> table(tableSize, 0xffffffff);
+    weld.resize(numVertices);
 
-    void set(osg::Vec3 *cb,int noVertices, osg::Vec3 *nb)
+    unsigned int numWelded = 0;
+    for(unsigned int i=0; i<numVertices; ++i)
     {
-        _coordBase=cb;
-        _normalBase=nb;
+        const osg::Vec3& v = vertices[i];
 
-        osg::Vec3* vptr = cb;
-        for(int i=0;i<noVertices;++i)
+        // hash the bit patterns, with -0.0 treated as 0.0 so that they weld as they compare equal
+        unsigned int hash = 2166136261u;
+        for(unsigned int c=0; c<3; ++c)
         {
-            _coordSet.insert(vptr++);
+            float value = v[c]==0.0f ? 0.0f : v[c];
+            unsigned int bits;
+            memcpy(&bits, &value, sizeof(bits));
+            hash = (hash ^ bits) * 16777619u;
         }
-    }
-
-    inline void updateNormal(const osg::Vec3& normal,const osg::Vec3* vptr)
-    {
-        std::pair<CoordinateSet::iterator,CoordinateSet::iterator> p =
-            _coordSet.equal_range(vptr);
+        hash ^= hash >> 15;
 
-        for(CoordinateSet::iterator itr=p.first;
-            itr!=p.second;
-            ++itr)
+        unsigned int slot = hash & (tableSize-1);
+        while (table[slot]!=0xffffffff && !(vertices[table[slot]]==v))
         {
-            osg::Vec3* nptr = _normalBase + (*itr-_coordBase);
-            (*nptr) += normal;
+            slot = (slot+1) & (tableSize-1);
         }
-    }
 
-    inline void operator() ( const osg::Vec3 &v1, const osg::Vec3 &v2, const osg::Vec3 &v3, bool treatVertexDataAsTemporary )
-    {
-        if (!treatVertexDataAsTemporary)
+        if (table[slot]==0xffffffff)
         {
-            // calc orientation of triangle.
-            osg::Vec3 normal = (v2-v1)^(v3-v1);
-            // normal.normalize();
-
-            updateNormal(normal,&v1);
-            updateNormal(normal,&v2);
-            updateNormal(normal,&v3);
+            table[slot] = i;
+            weld[i] = numWelded++;
         }
-
-    }
-};
-
-static void smooth_old(osg::Geometry& geom)
-{
-    OSG_INFO<<"smooth_old("<<&geom<<")"<<std::endl;
-    Geometry::PrimitiveSetList& primitives = geom.getPrimitiveSetList();
-    Geometry::PrimitiveSetList::iterator itr;
-    unsigned int numSurfacePrimitives=0;
-    for(itr=primitives.begin();
-        itr!=primitives.end();
-        ++itr)
-    {
-        switch((*itr)->getMode())
+        else
         {
-            case(PrimitiveSet::TRIANGLES):
-            case(PrimitiveSet::TRIANGLE_STRIP):
-            case(PrimitiveSet::TRIANGLE_FAN):
-            case(PrimitiveSet::QUADS):
-            case(PrimitiveSet::QUAD_STRIP):
-            case(PrimitiveSet::POLYGON):
-                ++numSurfacePrimitives;
-                break;
-            default:
-                break;
+            weld[i] = weld[table[slot]];
         }
     }
-
-    if (!numSurfacePrimitives) return;
-
-    osg::Vec3Array *coords = dynamic_cast<osg::Vec3Array*>(geom.getVertexArray());
-    if (!coords || !coords->size()) return;
-
-    osg::Vec3Array *normals = new osg::Vec3Array(coords->size());
-
-    osg::Vec3Array::iterator nitr;
-    for(nitr = normals->begin();
-        nitr!=normals->end();
-        ++nitr)
-    {
-        nitr->set(0.0f,0.0f,0.0f);
-    }
-
-    TriangleFunctor<SmoothTriangleFunctor> stf;
-    stf.set(&(coords->front()),coords->size(),&(normals->front()));
-
-    geom.accept(stf);
-
-    for(nitr= normals->begin();
-        nitr!=normals->end();
-        ++nitr)
-    {
-        nitr->normalize();
-    }
-    geom.setNormalArray( normals );
-    geom.setNormalIndices( geom.getVertexIndices() );
-    geom.setNormalBinding(osg::Geometry::BIND_PER_VERTEX);
-
-
-    geom.dirtyDisplayList();
+    return numWelded;
 }
 
-
-struct SmoothTriangleIndexFunctor
+// compute the unit normal of each triangle and the weighted normal that each of its corners contributes to its vertex.
+struct ComputeFaceNormals : public RangeOperation
 {
-    SmoothTriangleIndexFunctor():
-        _vertices(0),
-        _normals(0)
-    {
-    }
+    ComputeFaceNormals(const osg::Vec3Array& vertices, const std::vector<unsigned int>& indices, SmoothingVisitor::NormalWeighting weighting,
+                       std::vector<osg::Vec3>& faceNormals, std::vector<osg::Vec3>& cornerNormals):
+        _vertices(vertices),
+        _indices(indices),
+        _weighting(weighting),
+        _faceNormals(faceNormals),
+        _cornerNormals(cornerNormals) {}
 
-    bool set(osg::Vec3Array* vertices, osg::Vec3Array* normals)
+    virtual void operator() (unsigned int begin, unsigned int end)
     {
-        _vertices = vertices;
-        _normals = normals;
-
-        if (!_vertices)
+        for(unsigned int t=begin; t<end; ++t)
         {
-            OSG_NOTICE<<"Warning: SmoothTriangleIndexFunctor::set(..) requires a valid vertex arrays."<<std::endl;
-            return false;
-        }
+            const osg::Vec3& v1 = _vertices[_indices[t*3]];
+            const osg::Vec3& v2 = _vertices[_indices[t*3+1]];
+            const osg::Vec3& v3 = _vertices[_indices[t*3+2]];
 
-        if (!_normals)
-        {
-            OSG_NOTICE<<"Warning: SmoothTriangleIndexFunctor::set(..) requires a valid normal arrays."<<std::endl;
-            return false;
-        }
+            osg::Vec3 normal( (v2-v1)^(v3-v1) );
+            osg::Vec3 unitNormal(normal);
+            unitNormal.normalize();
+            _faceNormals[t] = unitNormal;
 
-        for(osg::Vec3Array::iterator itr = _normals->begin();
-            itr != _normals->end();
-            ++itr)
-        {
-            (*itr).set(0.0f,0.0f,0.0f);
+            if (_weighting==SmoothingVisitor::ANGLE_WEIGHTED)
+            {
+                _cornerNormals[t*3] = unitNormal * angle(v2-v1, v3-v1);
+                _cornerNormals[t*3+1] = unitNormal * angle(v3-v2, v1-v2);
+                _cornerNormals[t*3+2] = unitNormal * angle(v1-v3, v2-v3);
+            }
+            else
+            {
+                _cornerNormals[t*3] = normal;
+                _cornerNormals[t*3+1] = normal;
+                _cornerNormals[t*3+2] = normal;
+            }
         }
-
-        return true;
     }
 
-    void normalize()
+    static inline float angle(osg::Vec3 a, osg::Vec3 b)
     {
-        if (!_normals) return;
-
-        for(osg::Vec3Array::iterator itr = _normals->begin();
-            itr != _normals->end();
-            ++itr)
-        {
-            (*itr).normalize();
-        }
+        a.normalize();
+        b.normalize();
+        return acosf(osg::clampBetween(a*b, -1.0f, 1.0f));
     }
 
-    void operator() (unsigned int p1, unsigned int p2, unsigned int p3)
-    {
-        if (p1==p2 || p2==p3 || p1==p3)
+    const osg::Vec3Array&               _vertices;
+    const std::vector<unsigned int>&    _indices;
+    SmoothingVisitor::NormalWeighting   _weighting;
+    std::vector<osg::Vec3>&             _faceNormals;
+    std::vector<osg::Vec3>&             _cornerNormals;
+};
+
+// sum the corner normals around each welded vertex, only summing the corners of triangles within the crease angle of each other
+// when crease angle is less than PI.
+struct AccumulateNormals : public RangeOperation
+{
+    AccumulateNormals(const std::vector<unsigned int>& offsets, const std::vector<unsigned int>& corners,
+                      const std::vector<osg::Vec3>& faceNormals, const std::vector<osg::Vec3>& cornerNormals,
+                      std::vector<osg::Vec3>& weldedNormals, std::vector<osg::Vec3>& cornerResults, float minCreaseDotProduct, bool crease):
+        _offsets(offsets),
+        _corners(corners),
+        _faceNormals(faceNormals),
+        _cornerNormals(cornerNormals),
+        _weldedNormals(weldedNormals),
+        _cornerResults(cornerResults),
+        _minCreaseDotProduct(minCreaseDotProduct),
+        _crease(crease) {}
+
+    virtual void operator() (unsigned int begin, unsigned int end)
+    {
+        for(unsigned int w=begin; w<end; ++w)
         {
-            return;
-        }
+            unsigned int first = _offsets[w];
+            unsigned int last = _offsets[w+1];
 
-        const osg::Vec3& v1 = (*_vertices)[p1];
-        const osg::Vec3& v2 = (*_vertices)[p2];
-        const osg::Vec3& v3 = (*_vertices)[p3];
-        osg::Vec3 normal( (v2-v1)^(v3-v1) );
+            osg::Vec3 normal;
+            for(unsigned int i=first; i<last; ++i)
+            {
+                normal += _cornerNormals[_corners[i]];
+            }
+            normal.normalize();
+            _weldedNormals[w] = normal;
+
+            if (!_crease) continue;
 
-        normal.normalize();
+            for(unsigned int i=first; i<last; ++i)
+            {
+                unsigned int c = _corners[i];
+                const osg::Vec3& faceNormal = _faceNormals[c/3];
 
-        (*_normals)[p1] += normal;
-        (*_normals)[p2] += normal;
-        (*_normals)[p3] += normal;
+                osg::Vec3 cornerNormal;
+                for(unsigned int j=first; j<last; ++j)
+                {
+                    unsigned int d = _corners[j];
+                    if (d==c || faceNormal*_faceNormals[d/3] >= _minCreaseDotProduct) cornerNormal += _cornerNormals[d];
+                }
+                cornerNormal.normalize();
+                _cornerResults[c] = cornerNormal;
+            }
+        }
     }
 
-    osg::Vec3Array*     _vertices;
-    osg::Vec3Array*     _normals;
+    const std::vector<unsigned int>&    _offsets;
+    const std::vector<unsigned int>&    _corners;
+    const std::vector<osg::Vec3>&       _faceNormals;
+    const std::vector<osg::Vec3>&       _cornerNormals;
+    std::vector<osg::Vec3>&             _weldedNormals;
+    std::vector<osg::Vec3>&             _cornerResults;
+    float                               _minCreaseDotProduct;
+    bool                                _crease;
 };
 
-
-
-struct FindSharpEdgesFunctor
+struct AssignWeldedNormals : public RangeOperation
 {
-    FindSharpEdgesFunctor():
-        _vertices(0),
-        _normals(0),
-        _maxDeviationDotProduct(0.0f),
-        _currentPrimitiveSetIndex(0)
-    {
-    }
+    AssignWeldedNormals(const std::vector<unsigned int>& weld, const std::vector<osg::Vec3>& weldedNormals, osg::Vec3Array& normals):
+        _weld(weld),
+        _weldedNormals(weldedNormals),
+        _normals(normals) {}
 
-    struct Triangle : public osg::Referenced
+    virtual void operator() (unsigned int begin, unsigned int end)
     {
-        Triangle(unsigned int primitiveSetIndex, unsigned int p1, unsigned int p2, unsigned int p3):
-            _primitiveSetIndex(primitiveSetIndex), _p1(p1), _p2(p2), _p3(p3) {}
-
-        Triangle(const Triangle& tri):
-            _primitiveSetIndex(tri._primitiveSetIndex), _p1(tri._p1), _p2(tri._p2), _p3(tri._p3) {}
-
-        Triangle& operator = (const Triangle& tri)
+        for(unsigned int i=begin; i<end; ++i)
         {
-            _primitiveSetIndex = tri._primitiveSetIndex;
-            _p1 = tri._p1;
-            _p2 = tri._p2;
-            _p3 = tri._p3;
-            return *this;
+            _normals[i] = _weldedNormals[_weld[i]];
         }
+    }
 
-        unsigned int _primitiveSetIndex;
-        unsigned int _p1;
-        unsigned int _p2;
-        unsigned int _p3;
-    };
-
-    typedef std::list< osg::ref_ptr<Triangle> > Triangles;
-
-    struct ProblemVertex : public osg::Referenced
-    {
-        ProblemVertex(unsigned int p):
-            _point(p) {}
-
-        unsigned int _point;
-        Triangles _triangles;
-    };
-
-    typedef std::vector< osg::ref_ptr<ProblemVertex> > ProblemVertexVector;
-    typedef std::list< osg::ref_ptr<ProblemVertex> > ProblemVertexList;
-    typedef std::list< osg::ref_ptr<osg::Array> > ArrayList;
-
-    bool set(osg::Geometry* geom, float creaseAngle)
-    {
-        _geometry = geom;
-        _creaseAngle = creaseAngle;
-
-        if (!_geometry)
-        {
-            OSG_NOTICE<<"Warning: SmoothTriangleIndexFunctor::set(..) requires a geometry."<<std::endl;
-            return false;
-        }
+    const std::vector<unsigned int>&    _weld;
+    const std::vector<osg::Vec3>&       _weldedNormals;
+    osg::Vec3Array&                     _normals;
+};
 
-        _vertices = dynamic_cast<osg::Vec3Array*>(_geometry->getVertexArray());
-        _normals = dynamic_cast<osg::Vec3Array*>(_geometry->getNormalArray());
-        _maxDeviationDotProduct = cos(_creaseAngle*0.5);
+// append copies of the vertices in the source list to the end of an array.
+class DuplicateVertices : public osg::ArrayVisitor
+{
+    public:
 
-        if (!_vertices)
-        {
-            OSG_NOTICE<<"Warning: SmoothTriangleIndexFunctor::set(..) requires a valid vertex arrays."<<std::endl;
-            return false;
-        }
+        DuplicateVertices(const std::vector<unsigned int>& sources):
+            _sources(sources) {}
 
-        if (!_normals)
+        template <class ARRAY>
+        void apply_imp(ARRAY& array)
         {
-            OSG_NOTICE<<"Warning: SmoothTriangleIndexFunctor::set(..) requires a valid normal arrays."<<std::endl;
-            return false;
+            array.reserve(array.size()+_sources.size());
+            for(std::vector<unsigned int>::const_iterator itr = _sources.begin();
+                itr != _sources.end();
+                ++itr)
+            {
+                array.push_back(array[*itr]);
+            }
         }
 
-        _problemVertexVector.resize(_vertices->size());
-
-        addArray(geom->getVertexArray(), osg::Geometry::BIND_PER_VERTEX);
-        addArray(geom->getNormalArray(), geom->getNormalBinding());
-        addArray(geom->getColorArray(), geom->getColorBinding());
-        addArray(geom->getSecondaryColorArray(), geom->getSecondaryColorBinding());
-        addArray(geom->getFogCoordArray(), geom->getFogCoordBinding());
+        virtual void apply(osg::ByteArray& ba) { apply_imp(ba); }
+        virtual void apply(osg::ShortArray& ba) { apply_imp(ba); }
+        virtual void apply(osg::IntArray& ba) { apply_imp(ba); }
+        virtual void apply(osg::UByteArray& ba) { apply_imp(ba); }
+        virtual void apply(osg::UShortArray& ba) { apply_imp(ba); }
+        virtual void apply(osg::UIntArray& ba) { apply_imp(ba); }
+        virtual void apply(osg::Vec4ubArray& ba) { apply_imp(ba); }
+        virtual void apply(osg::FloatArray& ba) { apply_imp(ba); }
+        virtual void apply(osg::DoubleArray& ba) { apply_imp(ba); }
+        virtual void apply(osg::Vec2Array& ba) { apply_imp(ba); }
+        virtual void apply(osg::Vec3Array& ba) { apply_imp(ba); }
+        virtual void apply(osg::Vec4Array& ba) { apply_imp(ba); }
+        virtual void apply(osg::Vec2dArray& ba) { apply_imp(ba); }
+        virtual void apply(osg::Vec3dArray& ba) { apply_imp(ba); }
+        virtual void apply(osg::Vec4dArray& ba) { apply_imp(ba); }
+
+    protected:
+
+        DuplicateVertices& operator = (const DuplicateVertices&) { return *this; }
+
+        const std::vector<unsigned int>& _sources;
+};
 
-        for(unsigned int i=0; i<geom->getNumTexCoordArrays(); ++i)
-        {
-            addArray(geom->getTexCoordArray(i), osg::Geometry::BIND_PER_VERTEX);
-        }
+static void duplicateVertices(osg::Geometry& geom, const std::vector<unsigned int>& sources)
+{
+    DuplicateVertices duplicate(sources);
 
-        return true;
-    }
+    geom.getVertexArray()->accept(duplicate);
+    if (geom.getColorArray() && geom.getColorBinding()==osg::Geometry::BIND_PER_VERTEX) geom.getColorArray()->accept(duplicate);
+    if (geom.getSecondaryColorArray() && geom.getSecondaryColorBinding()==osg::Geometry::BIND_PER_VERTEX) geom.getSecondaryColorArray()->accept(duplicate);
+    if (geom.getFogCoordArray() && geom.getFogCoordBinding()==osg::Geometry::BIND_PER_VERTEX) geom.getFogCoordArray()->accept(duplicate);
 
-    void addArray(osg::Array* array, osg::Geometry::AttributeBinding binding)
+    for(unsigned int i=0; i<geom.getNumTexCoordArrays(); ++i)
     {
-        if (array && binding==osg::Geometry::BIND_PER_VERTEX)
-        {
-            _arrays.push_back(array);
-        }
+        if (geom.getTexCoordArray(i)) geom.getTexCoordArray(i)->accept(duplicate);
     }
 
-    void operator() (unsigned int p1, unsigned int p2, unsigned int p3)
+    for(unsigned int i=0; i<geom.getNumVertexAttribArrays(); ++i)
     {
-        osg::Vec3 normal( computeNormal(p1, p2, p3) );
-
-        if (p1==p2 || p2==p3 || p1==p3)
-        {
-            // OSG_NOTICE<<"NULL triangle ("<<p1<<", "<<p2<<", "<<p3<<")"<<std::endl;
-            return;
-        }
+        if (geom.getVertexAttribArray(i) && geom.getVertexAttribBinding(i)==osg::Geometry::BIND_PER_VERTEX) geom.getVertexAttribArray(i)->accept(duplicate);
+    }
+}
 
-        Triangle* tri = new Triangle(_currentPrimitiveSetIndex, p1, p2, p3);
-        _triangles.push_back(tri);
+static void smooth(osg::Geometry& geom, double creaseAngle, SmoothingVisitor::NormalWeighting weighting)
+{
+    OSG_INFO<<"smooth("<<&geom<<", "<<osg::RadiansToDegrees(creaseAngle)<<")"<<std::endl;
 
-        if (checkDeviation(p1, normal)) markProblemVertex(p1);
-        if (checkDeviation(p2, normal)) markProblemVertex(p2);
-        if (checkDeviation(p3, normal)) markProblemVertex(p3);
-    }
+    osg::Vec3Array* vertices = dynamic_cast<osg::Vec3Array*>(geom.getVertexArray());
+    if (!vertices || vertices->empty()) return;
 
-    void markProblemVertex(unsigned int p)
+    bool crease = creaseAngle<osg::PI;
+    if (crease && geom.getVertexIndices())
     {
-        if (!_problemVertexVector[p])
-        {
-            _problemVertexVector[p] = new ProblemVertex(p);
-            _problemVertexList.push_back(_problemVertexVector[p]);
-        }
+        OSG_INFO<<"SmoothingVisitor::smooth(..) cannot split the vertices of geometry with vertex indices at creases, smoothing across creases."<<std::endl;
+        crease = false;
     }
 
-    void checkTrianglesForProblemVertices()
+    // collect the triangles, recording the first triangle of each primitive set so that those with vertices split at creases can be rebuilt
+    std::vector<unsigned int> indices;
+    std::vector<unsigned int> primitiveSetTriangles;
+    osg::TriangleIndexFunctor<CollectTrianglesFunctor> collect;
+    collect._indices = &indices;
+    if (crease)
     {
-        for(Triangles::iterator itr = _triangles.begin();
-            itr != _triangles.end();
-            ++itr)
+        collect.setVertexArray(vertices->getNumElements(), static_cast<const Vec3*>(vertices->getDataPointer()));
+        for(unsigned int i = 0; i < geom.getNumPrimitiveSets(); ++i)
         {
-            Triangle* tri = itr->get();
-            insertTriangleIfProblemVertex(tri->_p1, tri);
-            insertTriangleIfProblemVertex(tri->_p2, tri);
-            insertTriangleIfProblemVertex(tri->_p3, tri);
+            primitiveSetTriangles.push_back(indices.size()/3);
+            geom.getPrimitiveSet(i)->accept(collect);
         }
+        primitiveSetTriangles.push_back(indices.size()/3);
     }
-
-    void insertTriangleIfProblemVertex(unsigned int p, Triangle* tri)
-    {
-        if (_problemVertexVector[p]) _problemVertexVector[p]->_triangles.push_back(tri);
-    }
-
-    bool checkDeviation(unsigned int p, osg::Vec3& normal)
-    {
-        float deviation = normal * (*_normals)[p];
-        return (deviation < _maxDeviationDotProduct);
-    }
-
-    osg::Vec3 computeNormal(unsigned int p1, unsigned int p2, unsigned int p3)
+    else
     {
-        const osg::Vec3& v1 = (*_vertices)[p1];
-        const osg::Vec3& v2 = (*_vertices)[p2];
-        const osg::Vec3& v3 = (*_vertices)[p3];
-        osg::Vec3 normal( (v2-v1)^(v3-v1) );
-        normal.normalize();
-        return normal;
+        geom.accept(collect);
     }
 
-    void listProblemVertices()
-    {
-        OSG_NOTICE<<"listProblemVertices() "<<_problemVertexList.size()<<std::endl;
-        for(ProblemVertexList::iterator itr = _problemVertexList.begin();
-            itr != _problemVertexList.end();
-            ++itr)
-        {
-            ProblemVertex* pv = itr->get();
-            OSG_NOTICE<<"  pv._point = "<<pv->_point<<" triangles "<<pv->_triangles.size()<<std::endl;
-            for(Triangles::iterator titr = pv->_triangles.begin();
-                titr != pv->_triangles.end();
-                ++titr)
-            {
-                Triangle* tri = titr->get();
-                OSG_NOTICE<<"    triangle("<<tri->_p1<<", "<<tri->_p2<<", "<<tri->_p3<<")"<<std::endl;
-                osg::Vec3 normal( computeNormal(tri->_p1, tri->_p2, tri->_p3) );
-                float deviation = normal * (*_normals)[pv->_point];
-                OSG_NOTICE<<"    deviation "<<deviation<<std::endl;
-            }
+    if (indices.empty()) return;
 
-        }
-    }
-
-    class DuplicateVertex : public osg::ArrayVisitor
-    {
-        public:
+    unsigned int numVertices = vertices->size();
+    unsigned int numTriangles = indices.size()/3;
+    unsigned int numCorners = indices.size();
 
-            unsigned int _i;
-            unsigned int _end;
+    std::vector<unsigned int> weld;
+    unsigned int numWelded = weldVertices(*vertices, weld);
 
-            DuplicateVertex(unsigned int i):
-                                _i(i),
-                                _end(i) {}
+    std::vector<osg::Vec3> faceNormals(numTriangles);
+    std::vector<osg::Vec3> cornerNormals(numCorners);
+    ComputeFaceNormals computeFaceNormals(*vertices, indices, weighting, faceNormals, cornerNormals);
+    runInParallel(computeFaceNormals, numTriangles, 0, minimumRangeSize);
 
-            template <class ARRAY>
-            void apply_imp(ARRAY& array)
-            {
-                _end = array.size();
-                array.push_back(array[_i]);
-            }
+    // bucket the corners by welded vertex
+    std::vector<unsigned int> offsets(numWelded+1, 0);
+    for(unsigned int c=0; c<numCorners; ++c) ++offsets[weld[indices[c]]+1];
+    for(unsigned int w=0; w<numWelded; ++w) offsets[w+1] += offsets[w];
 
-            virtual void apply(osg::ByteArray& ba) { apply_imp(ba); }
-            virtual void apply(osg::ShortArray& ba) { apply_imp(ba); }
-            virtual void apply(osg::IntArray& ba) { apply_imp(ba); }
-            virtual void apply(osg::UByteArray& ba) { apply_imp(ba); }
-            virtual void apply(osg::UShortArray& ba) { apply_imp(ba); }
-            virtual void apply(osg::UIntArray& ba) { apply_imp(ba); }
-            virtual void apply(osg::Vec4ubArray& ba) { apply_imp(ba); }
-            virtual void apply(osg::FloatArray& ba) { apply_imp(ba); }
-            virtual void apply(osg::Vec2Array& ba) { apply_imp(ba); }
-            virtual void apply(osg::Vec3Array& ba) { apply_imp(ba); }
-            virtual void apply(osg::Vec4Array& ba) { apply_imp(ba); }
-
-    };
-
-    unsigned int duplicateVertex(unsigned int i)
+    std::vector<unsigned int> corners(numCorners);
     {
-        DuplicateVertex duplicate(i);
-        for(ArrayList::iterator aItr = _arrays.begin();
-            aItr != _arrays.end();
-            ++aItr)
-        {
-            (*aItr)->accept(duplicate);
-        }
-        return duplicate._end;
+        std::vector<unsigned int> position(offsets.begin(), offsets.end()-1);
+        for(unsigned int c=0; c<numCorners; ++c) corners[position[weld[indices[c]]]++] = c;
     }
 
-    void duplicateProblemVertexAll(ProblemVertex* pv)
-    {
-        unsigned int p = pv->_point;
-        Triangles::iterator titr = pv->_triangles.begin();
-        ++titr;
-        for(;
-            titr != pv->_triangles.end();
-            ++titr)
-        {
-            Triangle* tri = titr->get();
-            unsigned int duplicated_p = duplicateVertex(p);
-            if (tri->_p1==p) tri->_p1 = duplicated_p;
-            if (tri->_p2==p) tri->_p2 = duplicated_p;
-            if (tri->_p3==p) tri->_p3 = duplicated_p;
-        }
-    }
+    std::vector<osg::Vec3> weldedNormals(numWelded);
+    std::vector<osg::Vec3> cornerResults(crease ? numCorners : 0);
+    AccumulateNormals accumulateNormals(offsets, corners, faceNormals, cornerNormals, weldedNormals, cornerResults, cos(creaseAngle), crease);
+    runInParallel(accumulateNormals, numWelded, 0, minimumRangeSize);
+
+    osg::ref_ptr<osg::Vec3Array> normals = new osg::Vec3Array(numVertices);
+    AssignWeldedNormals assignWeldedNormals(weld, weldedNormals, *normals);
+    runInParallel(assignWeldedNormals, numVertices, 0, minimumRangeSize);
 
-    void duplicateProblemVertex(ProblemVertex* pv)
+    if (crease)
     {
-        if (pv->_triangles.size()<=2)
+        // give each distinct corner normal of a vertex its own copy of the vertex
+        std::vector<unsigned char> assigned(numVertices, 0);
+        std::vector<int> nextDuplicate(numVertices, -1);
+        std::vector<unsigned int> sources;
+        std::vector<unsigned char> primitiveSetModified(geom.getNumPrimitiveSets(), 0);
+        unsigned int primitiveSet = 0;
+        for(unsigned int c=0; c<numCorners; ++c)
         {
-            duplicateProblemVertexAll(pv);
-        }
-        else
-        {
-            // implement a form of greedy association based on similar orientation
-            // rather than iterating through all the various permutation of triangles that might
-            // provide the best fit.
-            unsigned int p = pv->_point;
-            Triangles::iterator titr = pv->_triangles.begin();
-            while(titr != pv->_triangles.end())
-            {
-                Triangle* tri = titr->get();
-                osg::Vec3 normal = computeNormal(tri->_p1, tri->_p2, tri->_p3);
+            while (c/3 >= primitiveSetTriangles[primitiveSet+1]) ++primitiveSet;
 
-                Triangles associatedTriangles;
-                associatedTriangles.push_back(tri);
-
-                // remove triangle for list
-                pv->_triangles.erase(titr);
-
-                // reset iterator
-                titr = pv->_triangles.begin();
-                while(titr != pv->_triangles.end())
-                {
-                    Triangle* tri2 = titr->get();
-                    osg::Vec3 normal2 = computeNormal(tri2->_p1, tri2->_p2, tri2->_p3);
-                    float deviation = normal * normal2;
-                    if (deviation >= _maxDeviationDotProduct)
-                    {
-                        // Tri and tri2 are close enough together to associate.
-                        associatedTriangles.push_back(tri2);
-
-                        Triangles::iterator titr_to_erase = titr;
-
-                        ++titr;
-                        pv->_triangles.erase(titr_to_erase);
-                    }
-                    else
-                    {
-                        ++titr;
-                    }
-                }
-
-                // create duplicate vertex to set of associated triangles
-                unsigned int duplicated_p = duplicateVertex(p);
+            unsigned int v = indices[c];
+            const osg::Vec3& normal = cornerResults[c];
+            if (!assigned[v])
+            {
+                assigned[v] = 1;
+                (*normals)[v] = normal;
+                continue;
+            }
 
-                // now rest the index on th triangles of the point that was duplicated
-                for(Triangles::iterator aitr = associatedTriangles.begin();
-                    aitr != associatedTriangles.end();
-                    ++aitr)
+            unsigned int u = v;
+            while (!((*normals)[u]==normal))
+            {
+                if (nextDuplicate[u]<0)
                 {
-                    Triangle* tri = aitr->get();
-                    if (tri->_p1==p) tri->_p1 = duplicated_p;
-                    if (tri->_p2==p) tri->_p2 = duplicated_p;
-                    if (tri->_p3==p) tri->_p3 = duplicated_p;
+                    unsigned int duplicated = numVertices + sources.size();
+                    sources.push_back(v);
+                    nextDuplicate[u] = duplicated;
+                    nextDuplicate.push_back(-1);
+                    normals->push_back(normal);
+                    u = duplicated;
+                    break;
                 }
-
-                // reset iterator to beginning
-                titr = pv->_triangles.begin();
+                u = nextDuplicate[u];
             }
 
-        }
-    }
-
-    void duplicateProblemVertices()
-    {
-        checkTrianglesForProblemVertices();
-
-        for(ProblemVertexList::iterator itr = _problemVertexList.begin();
-            itr != _problemVertexList.end();
-            ++itr)
-        {
-            ProblemVertex* pv = itr->get();
-            if (pv->_triangles.size()>1)
+            if (u!=v)
             {
-                duplicateProblemVertex(itr->get());
+                indices[c] = u;
+                primitiveSetModified[primitiveSet] = 1;
             }
         }
-    }
-
-    osg::PrimitiveSet* createPrimitiveSet(Triangles& triangles)
-    {
-        osg::ref_ptr<osg::DrawElements> elements = (_vertices->size()<16384) ?
-            static_cast<osg::DrawElements*>(new osg::DrawElementsUShort(GL_TRIANGLES)) :
-            static_cast<osg::DrawElements*>(new osg::DrawElementsUInt(GL_TRIANGLES));
-
-        elements->reserveElements(triangles.size()*3);
 
-        for(Triangles::iterator itr = triangles.begin();
-            itr != triangles.end();
-            ++itr)
+        if (!sources.empty())
         {
-            Triangle* tri = itr->get();
-            elements->addElement(tri->_p1);
-            elements->addElement(tri->_p2);
-            elements->addElement(tri->_p3);
-        }
+            OSG_INFO<<"SmoothingVisitor::smooth(..) duplicated "<<sources.size()<<" vertices at creases"<<std::endl;
 
-        return elements.release();
-    }
+            duplicateVertices(geom, sources);
 
-    void updateGeometry()
-    {
-        duplicateProblemVertices();
+            unsigned int totalVertices = numVertices + sources.size();
+            for(unsigned int i=0; i<primitiveSetModified.size(); ++i)
+            {
+                if (!primitiveSetModified[i]) continue;
 
+                osg::ref_ptr<osg::DrawElements> elements = (totalVertices<65536) ?
+                    static_cast<osg::DrawElements*>(new osg::DrawElementsUShort(GL_TRIANGLES)) :
+                    static_cast<osg::DrawElements*>(new osg::DrawElementsUInt(GL_TRIANGLES));
 
-        typedef std::map<unsigned int, Triangles> TriangleMap;
-        TriangleMap triangleMap;
-        for(Triangles::iterator itr = _triangles.begin();
-            itr != _triangles.end();
-            ++itr)
-        {
-            Triangle* tri = itr->get();
-            triangleMap[tri->_primitiveSetIndex].push_back(tri);
-        }
+                elements->reserveElements((primitiveSetTriangles[i+1]-primitiveSetTriangles[i])*3);
+                for(unsigned int c=primitiveSetTriangles[i]*3; c<primitiveSetTriangles[i+1]*3; ++c)
+                {
+                    elements->addElement(indices[c]);
+                }
 
-        for(TriangleMap::iterator itr = triangleMap.begin();
-            itr != triangleMap.end();
-            ++itr)
-        {
-            osg::PrimitiveSet* originalPrimitiveSet = _geometry->getPrimitiveSet(itr->first);
-            osg::PrimitiveSet* newPrimitiveSet = createPrimitiveSet(itr->second);
-            newPrimitiveSet->setName(originalPrimitiveSet->getName());
-            _geometry->setPrimitiveSet(itr->first, newPrimitiveSet);
+                elements->setName(geom.getPrimitiveSet(i)->getName());
+                geom.setPrimitiveSet(i, elements.get());
+            }
         }
     }
 
+    geom.setNormalArray(normals.get());
+    geom.setNormalIndices(geom.getVertexIndices());
+    geom.setNormalBinding(osg::Geometry::BIND_PER_VERTEX);
 
-    osg::Geometry*      _geometry;
-    osg::Vec3Array*     _vertices;
-    osg::Vec3Array*     _normals;
-    ArrayList           _arrays;
-    float               _creaseAngle;
-    float               _maxDeviationDotProduct;
-    ProblemVertexVector _problemVertexVector;
-    ProblemVertexList   _problemVertexList;
-    Triangles           _triangles;
-    unsigned int        _currentPrimitiveSetIndex;
-};
-
-
-static void smooth_new(osg::Geometry& geom, double creaseAngle)
-{
-    OSG_INFO<<"smooth_new("<<&geom<<", "<<osg::RadiansToDegrees(creaseAngle)<<")"<<std::endl;
-
-    osg::Vec3Array* vertices = dynamic_cast<osg::Vec3Array*>(geom.getVertexArray());
-    if (!vertices) return;
-
-    osg::Vec3Array* normals = dynamic_cast<osg::Vec3Array*>(geom.getNormalArray());
-    if (!normals || (normals && normals->size() != vertices->size()))
-    {
-        normals = new osg::Vec3Array(vertices->size());
-        geom.setNormalArray(normals);
-        geom.setNormalBinding(osg::Geometry::BIND_PER_VERTEX);
-    }
-
-    osg::TriangleIndexFunctor<SmoothTriangleIndexFunctor> stif;
-    if (stif.set(vertices, normals))
-    {
-        // accumulate all the normals
-        geom.accept(stif);
-
-        // normalize the normals
-        stif.normalize();
-    }
-
-    osg::TriangleIndexFunctor<FindSharpEdgesFunctor> fsef;
-    if (fsef.set(&geom, creaseAngle))
-    {
-        // look for normals that deviate too far
-
-        fsef.setVertexArray(vertices->getNumElements(), static_cast<const Vec3*>(vertices->getDataPointer()));
-        for(unsigned int i = 0; i < geom.getNumPrimitiveSets(); ++i)
-        {
-            fsef._currentPrimitiveSetIndex = i;
-            geom.getPrimitiveSet(i)->accept(fsef);
-        }
-
-        // fsef.listProblemVertices();
-        fsef.updateGeometry();
-
-        osg::TriangleIndexFunctor<SmoothTriangleIndexFunctor> stif2;
-        if (stif2.set(vertices, normals))
-        {
-            // accumulate all the normals
-            geom.accept(stif);
-
-            // normalize the normals
-            stif.normalize();
-        }
-
-    }
+    geom.dirtyDisplayList();
+    geom.dirtyBound();
 }
 
 }
 
 
 SmoothingVisitor::SmoothingVisitor():
-    _creaseAngle(osg::PI)
+    _creaseAngle(osg::PI),
+    _normalWeighting(AREA_WEIGHTED)
 {
     setTraversalMode(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN);
 }
@@ -680,14 +452,12 @@ SmoothingVisitor::~SmoothingVisitor()
 
 void SmoothingVisitor::smooth(osg::Geometry& geom, double creaseAngle)
 {
-    if (creaseAngle==osg::PI)
-    {
-        Smoother::smooth_old(geom);
-    }
-    else
-    {
-        Smoother::smooth_new(geom, creaseAngle);
-    }
+    Smoother::smooth(geom, creaseAngle, AREA_WEIGHTED);
+}
+
+void SmoothingVisitor::smooth(osg::Geometry& geom, double creaseAngle, NormalWeighting weighting)
+{
+    Smoother::smooth(geom, creaseAngle, weighting);
 }
 
 
@@ -696,6 +466,6 @@ void SmoothingVisitor::apply(osg::Geode& geode)
     for(unsigned int i = 0; i < geode.getNumDrawables(); i++ )
     {
         osg::Geometry* geom = dynamic_cast<osg::Geometry*>(geode.getDrawable(i));
-        if (geom) smooth(*geom, _creaseAngle);
+        if (geom) smooth(*geom, _creaseAngle, _normalWeighting);
     }
 }
@@ -1,10 +1,185 @@
 #include <osgUtil/TangentSpaceGenerator>
+#include <osgUtil/RangeOperation>
 
 #include <osg/Notify>
 #include <osg/io_utils>
 
+#include <vector>
+
 using namespace osgUtil;
 
+namespace
+{
+
+inline osg::Vec3 getVec3(const osg::Array* array, unsigned int i)
+{
+    switch (array->getType())
+    {
+    case osg::Array::Vec2ArrayType: return osg::Vec3(static_cast<const osg::Vec2Array&>(*array)[i], 0.0f);
+    case osg::Array::Vec3ArrayType: return static_cast<const osg::Vec3Array&>(*array)[i];
+    case osg::Array::Vec4ArrayType:
+        {
+            const osg::Vec4& v = static_cast<const osg::Vec4Array&>(*array)[i];
+            return osg::Vec3(v.x(), v.y(), v.z());
+        }
+    default: return osg::Vec3();
+    }
+}
+
+inline osg::Vec2 getVec2(const osg::Array* array, unsigned int i)
+{
+    switch (array->getType())
+    {
+    case osg::Array::Vec2ArrayType: return static_cast<const osg::Vec2Array&>(*array)[i];
+    case osg::Array::Vec3ArrayType:
+        {
+            const osg::Vec3& v = static_cast<const osg::Vec3Array&>(*array)[i];
+            return osg::Vec2(v.x(), v.y());
+        }
+    case osg::Array::Vec4ArrayType:
+        {
+            const osg::Vec4& v = static_cast<const osg::Vec4Array&>(*array)[i];
+            return osg::Vec2(v.x(), v.y());
+        }
+    default: return osg::Vec2();
+    }
+}
+
+inline bool isSupportedArray(const osg::Array* array)
+{
+    return array->getType()==osg::Array::Vec2ArrayType ||
+           array->getType()==osg::Array::Vec3ArrayType ||
+           array->getType()==osg::Array::Vec4ArrayType;
+}
+
+/* Compute the tangent, binormal and normal contributed by a triangle to each of its corners.
+ * With a normal array the tangent and binormal are made orthogonal to the vertex normal and the normal
+ * is the vertex normal, otherwise all three corners get the same tangent and binormal and the face normal. */
+void computeTriangleBasis(const osg::Array* vx, const osg::Array* nx, const osg::Array* tx,
+                          unsigned int iA, unsigned int iB, unsigned int iC,
+                          osg::Vec3* T, osg::Vec3* B, osg::Vec3* N)
+{
+    osg::Vec3 P1 = getVec3(vx, iA);
+    osg::Vec3 P2 = getVec3(vx, iB);
+    osg::Vec3 P3 = getVec3(vx, iC);
+
+    osg::Vec2 uv1 = getVec2(tx, iA);
+    osg::Vec2 uv2 = getVec2(tx, iB);
+    osg::Vec2 uv3 = getVec2(tx, iC);
+
+    osg::Vec3 tangent, binormal;
+    for (int i=0; i<3; ++i) {
+        osg::Vec3 V = osg::Vec3(P2[i] - P1[i], uv2.x() - uv1.x(), uv2.y() - uv1.y()) ^
+                      osg::Vec3(P3[i] - P1[i], uv3.x() - uv1.x(), uv3.y() - uv1.y());
+        if (V.x() != 0) {
+            V.normalize();
+            tangent[i] = -V.y() / V.x();
+            binormal[i] = -V.z() / V.x();
+        }
+    }
+
+    if (nx) {
+        N[0] = getVec3(nx, iA);
+        N[1] = getVec3(nx, iB);
+        N[2] = getVec3(nx, iC);
+        for (int c=0; c<3; ++c) {
+            T[c] = (N[c] ^ tangent) ^ N[c];
+            B[c] = N[c] ^ (binormal ^ N[c]);
+        }
+    } else {
+        osg::Vec3 face_normal = (P2 - P1) ^ (P3 - P1);
+        for (int c=0; c<3; ++c) {
+            T[c] = tangent;
+            B[c] = binormal;
+            N[c] = face_normal;
+        }
+    }
+}
+
+/* The triangles, and then the vertices, are divided into a contiguous range per processor,
+   below this many elements per thread the cost of starting the threads outweighs the gain. */
+const unsigned int min_range_size = 8192;
+
+struct ComputeCorners : public RangeOperation
+{
+    ComputeCorners(const osg::Array *vx, const osg::Array *nx, const osg::Array *tx,
+                   const std::vector<unsigned int> &triangles,
+                   std::vector<osg::Vec3> &T, std::vector<osg::Vec3> &B, std::vector<osg::Vec3> &N)
+    :    vx_(vx), nx_(nx), tx_(tx), triangles_(triangles), T_(T), B_(B), N_(N) {}
+
+    virtual void operator() (unsigned int begin, unsigned int end)
+    {
+        for (unsigned int t=begin; t<end; ++t) {
+            computeTriangleBasis(vx_, nx_, tx_, triangles_[t*3], triangles_[t*3+1], triangles_[t*3+2],
+                                 &T_[t*3], &B_[t*3], &N_[t*3]);
+        }
+    }
+
+    const osg::Array *vx_;
+    const osg::Array *nx_;
+    const osg::Array *tx_;
+    const std::vector<unsigned int> &triangles_;
+    std::vector<osg::Vec3> &T_;
+    std::vector<osg::Vec3> &B_;
+    std::vector<osg::Vec3> &N_;
+};
+
+/* Gather the corners of each vertex in triangle order, so the results match those of calling
+ * TangentSpaceGenerator::compute() on each triangle in turn, then orthonormalize the basis. */
+struct GatherCorners : public RangeOperation
+{
+    GatherCorners(bool assign_tangents, const std::vector<unsigned int> &offsets, const std::vector<unsigned int> &corners,
+                  const std::vector<osg::Vec3> &T, const std::vector<osg::Vec3> &B, const std::vector<osg::Vec3> &N,
+                  osg::Vec4Array &vT, osg::Vec4Array &vB, osg::Vec4Array &vN)
+    :    assign_tangents_(assign_tangents), offsets_(offsets), corners_(corners), T_(T), B_(B), N_(N), vT_(vT), vB_(vB), vN_(vN) {}
+
+    virtual void operator() (unsigned int begin, unsigned int end)
+    {
+        for (unsigned int v=begin; v<end; ++v) {
+            osg::Vec3 T, B, N;
+            for (unsigned int i=offsets_[v]; i<offsets_[v+1]; ++i) {
+                unsigned int c = corners_[i];
+                if (assign_tangents_) {
+                    T = T_[c];
+                    B = B_[c];
+                } else {
+                    T += T_[c];
+                    B += B_[c];
+                }
+                N += N_[c];
+            }
+
+            // force the normal vector to match the triangle normal's direction
+            osg::Vec3 txN = T ^ B;
+            if (txN * N >= 0) {
+                N = txN;
+            } else {
+                N = -txN;
+            }
+
+            T.normalize();
+            B.normalize();
+            N.normalize();
+
+            vT_[v] = osg::Vec4(T, 0);
+            vB_[v] = osg::Vec4(B, 0);
+            vN_[v] = osg::Vec4(N, 0);
+        }
+    }
+
+    bool assign_tangents_;
+    const std::vector<unsigned int> &offsets_;
+    const std::vector<unsigned int> &corners_;
+    const std::vector<osg::Vec3> &T_;
+    const std::vector<osg::Vec3> &B_;
+    const std::vector<osg::Vec3> &N_;
+    osg::Vec4Array &vT_;
+    osg::Vec4Array &vB_;
+    osg::Vec4Array &vN_;
+};
+
+}
+
 TangentSpaceGenerator::TangentSpaceGenerator()
 :    osg::Referenced(),
     T_(new osg::Vec4Array),
@@ -37,6 +212,16 @@ void TangentSpaceGenerator::generate(osg::Geometry *geo, int normal_map_tex_unit
 
     if (!vx || !tx) return;
 
+    if (!isSupportedArray(vx)) {
+        OSG_WARN << "Warning: TangentSpaceGenerator: vertex array must be Vec2Array, Vec3Array or Vec4Array" << std::endl;
+    }
+    if (nx && !isSupportedArray(nx)) {
+        OSG_WARN << "Warning: TangentSpaceGenerator: normal array must be Vec2Array, Vec3Array or Vec4Array" << std::endl;
+    }
+    if (!isSupportedArray(tx)) {
+        OSG_WARN << "Warning: TangentSpaceGenerator: texture coord array must be Vec2Array, Vec3Array or Vec4Array" << std::endl;
+    }
+
 
     unsigned int vertex_count = vx->getNumElements();
     if (geo->getVertexIndices() == NULL) {
@@ -55,6 +240,9 @@ void TangentSpaceGenerator::generate(osg::Geometry *geo, int normal_map_tex_unit
         }
     }
 
+    // collect the vertex indices of the triangles, then compute their basis vectors in parallel
+    std::vector<unsigned int> triangles;
+
     unsigned int i; // VC6 doesn't like for-scoped variables
 
     for (unsigned int pri=0; pri<geo->getNumPrimitiveSets(); ++pri) {
@@ -66,14 +254,14 @@ void TangentSpaceGenerator::generate(osg::Geometry *geo, int normal_map_tex_unit
 
             case osg::PrimitiveSet::TRIANGLES:
                 for (i=0; i<N; i+=3) {
-                    compute(pset, vx, nx, tx, i, i+1, i+2);
+                    addTriangle(triangles, pset, i, i+1, i+2);
                 }
                 break;
 
             case osg::PrimitiveSet::QUADS:
                 for (i=0; i<N; i+=4) {
-                    compute(pset, vx, nx, tx, i, i+1, i+2);
-                    compute(pset, vx, nx, tx, i+2, i+3, i);
+                    addTriangle(triangles, pset, i, i+1, i+2);
+                    addTriangle(triangles, pset, i+2, i+3, i);
                 }
                 break;
 
@@ -85,9 +273,9 @@ void TangentSpaceGenerator::generate(osg::Geometry *geo, int normal_map_tex_unit
                         unsigned int iN = static_cast<unsigned int>(*pi-2);
                         for (i=0; i<iN; ++i, ++j) {
                             if ((i%2) == 0) {
-                                compute(pset, vx, nx, tx, j, j+1, j+2);
+                                addTriangle(triangles, pset, j, j+1, j+2);
                             } else {
-                                compute(pset, vx, nx, tx, j+1, j, j+2);
+                                addTriangle(triangles, pset, j+1, j, j+2);
                             }
                         }
                         j += 2;
@@ -95,9 +283,9 @@ void TangentSpaceGenerator::generate(osg::Geometry *geo, int normal_map_tex_unit
                 } else {
                     for (i=0; i<N-2; ++i) {
                         if ((i%2) == 0) {
-                            compute(pset, vx, nx, tx, i, i+1, i+2);
+                            addTriangle(triangles, pset, i, i+1, i+2);
                         } else {
-                            compute(pset, vx, nx, tx, i+1, i, i+2);
+                            addTriangle(triangles, pset, i+1, i, i+2);
                         }
                     }
                 }
@@ -111,13 +299,13 @@ void TangentSpaceGenerator::generate(osg::Geometry *geo, int normal_map_tex_unit
                     for (osg::DrawArrayLengths::const_iterator pi=dal->begin(); pi!=dal->end(); ++pi) {
                         unsigned int iN = static_cast<unsigned int>(*pi-2);
                         for (i=0; i<iN; ++i) {
-                            compute(pset, vx, nx, tx, 0, j+1, j+2);
+                            addTriangle(triangles, pset, 0, j+1, j+2);
                         }
                         j += 2;
                     }
                 } else {
                     for (i=0; i<N-2; ++i) {
-                        compute(pset, vx, nx, tx, 0, i+1, i+2);
+                        addTriangle(triangles, pset, 0, i+1, i+2);
                     }
                 }
                 break;
@@ -134,33 +322,55 @@ void TangentSpaceGenerator::generate(osg::Geometry *geo, int normal_map_tex_unit
         }
     }
 
-    // normalize basis vectors and force the normal vector to match
-    // the triangle normal's direction
-    unsigned int attrib_count = vx->getNumElements();
-    if (geo->getVertexIndices() != NULL) {
-        attrib_count = geo->getVertexIndices()->getNumElements();
+    unsigned int attrib_count = T_->size();
+    unsigned int triangle_count = triangles.size()/3;
+    unsigned int corner_count = triangles.size();
+
+    // drop the triangles that reference vertices outside of the arrays rather than reading past their ends
+    unsigned int max_index = vertex_count;
+    if (nx && nx->getNumElements() < max_index) max_index = nx->getNumElements();
+    if (tx->getNumElements() < max_index) max_index = tx->getNumElements();
+    if (attrib_count < max_index) max_index = attrib_count;
+    for (i=0; i<corner_count; ++i) {
+        if (triangles[i] >= max_index) {
+            OSG_WARN << "Warning: TangentSpaceGenerator: primitive index " << triangles[i] << " out of range" << std::endl;
+            triangles.clear();
+            triangle_count = corner_count = 0;
+            break;
+        }
     }
-    for (i=0; i<attrib_count; ++i) {
-        osg::Vec4 &vT = (*T_)[i];
-        osg::Vec4 &vB = (*B_)[i];
-        osg::Vec4 &vN = (*N_)[i];
 
-        osg::Vec3 txN = osg::Vec3(vT.x(), vT.y(), vT.z()) ^ osg::Vec3(vB.x(), vB.y(), vB.z());
+    std::vector<osg::Vec3> corner_T(corner_count);
+    std::vector<osg::Vec3> corner_B(corner_count);
+    std::vector<osg::Vec3> corner_N(corner_count);
+    ComputeCorners compute_corners(vx, nx, tx, triangles, corner_T, corner_B, corner_N);
+    runInParallel(compute_corners, triangle_count, 0, min_range_size);
 
-        if (txN * osg::Vec3(vN.x(), vN.y(), vN.z()) >= 0) {
-            vN = osg::Vec4(txN, 0);
-        } else {
-            vN = osg::Vec4(-txN, 0);
-        }
+    // bucket the corners by vertex, in triangle order
+    std::vector<unsigned int> offsets(attrib_count+1, 0);
+    for (i=0; i<corner_count; ++i) ++offsets[triangles[i]+1];
+    for (i=0; i<attrib_count; ++i) offsets[i+1] += offsets[i];
+
+    std::vector<unsigned int> corners(corner_count);
+    std::vector<unsigned int> positions(offsets.begin(), offsets.end()-1);
+    for (i=0; i<corner_count; ++i) corners[positions[triangles[i]]++] = i;
+
+    // normalize basis vectors and force the normal vector to match
+    // the triangle normal's direction
+    GatherCorners gather_corners(nx!=0, offsets, corners, corner_T, corner_B, corner_N, *T_, *B_, *N_);
+    runInParallel(gather_corners, attrib_count, 0, min_range_size);
 
-        vT.normalize();
-        vB.normalize();
-        vN.normalize();
-    }
     /* TO-DO: if indexed, compress the attributes to have only one
      * version of each (different indices for each one?) */
 }
 
+void TangentSpaceGenerator::addTriangle(std::vector<unsigned int> &triangles, osg::PrimitiveSet *pset, int iA, int iB, int iC)
+{
+    triangles.push_back(pset->index(iA));
+    triangles.push_back(pset->index(iB));
+    triangles.push_back(pset->index(iC));
+}
+
 void TangentSpaceGenerator::compute(osg::PrimitiveSet *pset,
                                     const osg::Array* vx,
                                     const osg::Array* nx,
@@ -171,208 +381,19 @@ void TangentSpaceGenerator::compute(osg::PrimitiveSet *pset,
     iB = pset->index(iB);
     iC = pset->index(iC);
 
-    osg::Vec3 P1;
-    osg::Vec3 P2;
-    osg::Vec3 P3;
-
-    int i; // VC6 doesn't like for-scoped variables
-
-    switch (vx->getType())
-    {
-    case osg::Array::Vec2ArrayType:
-        for (i=0; i<2; ++i) {
-            P1.ptr()[i] = static_cast<const osg::Vec2Array&>(*vx)[iA].ptr()[i];
-            P2.ptr()[i] = static_cast<const osg::Vec2Array&>(*vx)[iB].ptr()[i];
-            P3.ptr()[i] = static_cast<const osg::Vec2Array&>(*vx)[iC].ptr()[i];
-        }
-        break;
-
-    case osg::Array::Vec3ArrayType:
-        P1 = static_cast<const osg::Vec3Array&>(*vx)[iA];
-        P2 = static_cast<const osg::Vec3Array&>(*vx)[iB];
-        P3 = static_cast<const osg::Vec3Array&>(*vx)[iC];
-        break;
-
-    case osg::Array::Vec4ArrayType:
-        for (i=0; i<3; ++i) {
-            P1.ptr()[i] = static_cast<const osg::Vec4Array&>(*vx)[iA].ptr()[i];
-            P2.ptr()[i] = static_cast<const osg::Vec4Array&>(*vx)[iB].ptr()[i];
-            P3.ptr()[i] = static_cast<const osg::Vec4Array&>(*vx)[iC].ptr()[i];
-        }
-        break;
-
-    default:
-        OSG_WARN << "Warning: TangentSpaceGenerator: vertex array must be Vec2Array, Vec3Array or Vec4Array" << std::endl;
-    }
-
-    osg::Vec3 N1;
-    osg::Vec3 N2;
-    osg::Vec3 N3;
-
-    if(nx)
-    {
-        switch (nx->getType())
-        {
-        case osg::Array::Vec2ArrayType:
-            for (i=0; i<2; ++i) {
-                N1.ptr()[i] = static_cast<const osg::Vec2Array&>(*nx)[iA].ptr()[i];
-                N2.ptr()[i] = static_cast<const osg::Vec2Array&>(*nx)[iB].ptr()[i];
-                N3.ptr()[i] = static_cast<const osg::Vec2Array&>(*nx)[iC].ptr()[i];
-            }
-            break;
-
-        case osg::Array::Vec3ArrayType:
-            N1 = static_cast<const osg::Vec3Array&>(*nx)[iA];
-            N2 = static_cast<const osg::Vec3Array&>(*nx)[iB];
-            N3 = static_cast<const osg::Vec3Array&>(*nx)[iC];
-            break;
+    osg::Vec3 T[3], B[3], N[3];
+    computeTriangleBasis(vx, nx, tx, iA, iB, iC, T, B, N);
 
-        case osg::Array::Vec4ArrayType:
-            for (i=0; i<3; ++i) {
-                N1.ptr()[i] = static_cast<const osg::Vec4Array&>(*nx)[iA].ptr()[i];
-                N2.ptr()[i] = static_cast<const osg::Vec4Array&>(*nx)[iB].ptr()[i];
-                N3.ptr()[i] = static_cast<const osg::Vec4Array&>(*nx)[iC].ptr()[i];
-            }
-            break;
-
-        default:
-            OSG_WARN << "Warning: TangentSpaceGenerator: normal array must be Vec2Array, Vec3Array or Vec4Array" << std::endl;
-        }
-    }
-
-    osg::Vec2 uv1;
-    osg::Vec2 uv2;
-    osg::Vec2 uv3;
-
-    switch (tx->getType())
-    {
-    case osg::Array::Vec2ArrayType:
-        uv1 = static_cast<const osg::Vec2Array&>(*tx)[iA];
-        uv2 = static_cast<const osg::Vec2Array&>(*tx)[iB];
-        uv3 = static_cast<const osg::Vec2Array&>(*tx)[iC];
-        break;
-
-    case osg::Array::Vec3ArrayType:
-        for (i=0; i<2; ++i) {
-            uv1.ptr()[i] = static_cast<const osg::Vec3Array&>(*tx)[iA].ptr()[i];
-            uv2.ptr()[i] = static_cast<const osg::Vec3Array&>(*tx)[iB].ptr()[i];
-            uv3.ptr()[i] = static_cast<const osg::Vec3Array&>(*tx)[iC].ptr()[i];
-        }
-        break;
-
-    case osg::Array::Vec4ArrayType:
-        for (i=0; i<2; ++i) {
-            uv1.ptr()[i] = static_cast<const osg::Vec4Array&>(*tx)[iA].ptr()[i];
-            uv2.ptr()[i] = static_cast<const osg::Vec4Array&>(*tx)[iB].ptr()[i];
-            uv3.ptr()[i] = static_cast<const osg::Vec4Array&>(*tx)[iC].ptr()[i];
-        }
-        break;
-
-    default:
-        OSG_WARN << "Warning: TangentSpaceGenerator: texture coord array must be Vec2Array, Vec3Array or Vec4Array" << std::endl;
-    }
-
-    if(nx){
-        osg::Vec3 V, T1, T2, T3, B1, B2, B3;
-
-        V = osg::Vec3(P2.x() - P1.x(), uv2.x() - uv1.x(), uv2.y() - uv1.y()) ^
-            osg::Vec3(P3.x() - P1.x(), uv3.x() - uv1.x(), uv3.y() - uv1.y());
-        if (V.x() != 0) {
-            V.normalize();
-            T1.x() += -V.y() / V.x();
-            B1.x() += -V.z() / V.x();
-            T2.x() += -V.y() / V.x();
-            B2.x() += -V.z() / V.x();
-            T3.x() += -V.y() / V.x();
-            B3.x() += -V.z() / V.x();
-        }
-
-        V = osg::Vec3(P2.y() - P1.y(), uv2.x() - uv1.x(), uv2.y() - uv1.y()) ^
-            osg::Vec3(P3.y() - P1.y(), uv3.x() - uv1.x(), uv3.y() - uv1.y());
-        if (V.x() != 0) {
-            V.normalize();
-            T1.y() += -V.y() / V.x();
-            B1.y() += -V.z() / V.x();
-            T2.y() += -V.y() / V.x();
-            B2.y() += -V.z() / V.x();
-            T3.y() += -V.y() / V.x();
-            B3.y() += -V.z() / V.x();
-        }
-
-        V = osg::Vec3(P2.z() - P1.z(), uv2.x() - uv1.x(), uv2.y() - uv1.y()) ^
-            osg::Vec3(P3.z() - P1.z(), uv3.x() - uv1.x(), uv3.y() - uv1.y());
-        if (V.x() != 0) {
-            V.normalize();
-            T1.z() += -V.y() / V.x();
-            B1.z() += -V.z() / V.x();
-            T2.z() += -V.y() / V.x();
-            B2.z() += -V.z() / V.x();
-            T3.z() += -V.y() / V.x();
-            B3.z() += -V.z() / V.x();
-        }
-
-        osg::Vec3 tempvec;
-        tempvec = N1 ^ T1;
-        (*T_)[iA] = osg::Vec4(tempvec ^ N1, 0);
-        tempvec = B1 ^ N1;
-        (*B_)[iA] = osg::Vec4(N1 ^ tempvec, 0);
-        tempvec = N2 ^ T2;
-        (*T_)[iB] = osg::Vec4(tempvec ^ N2, 0);
-        tempvec = B2 ^ N2;
-        (*B_)[iB] = osg::Vec4(N2 ^ tempvec, 0);
-        tempvec = N3 ^ T3;
-        (*T_)[iC] = osg::Vec4(tempvec ^ N3, 0);
-        tempvec = B3 ^ N3;
-        (*B_)[iC] = osg::Vec4(N3 ^ tempvec, 0);
-
-        (*N_)[iA] += osg::Vec4(N1, 0);
-        (*N_)[iB] += osg::Vec4(N2, 0);
-        (*N_)[iC] += osg::Vec4(N3, 0);
-    }
-    else{
-        osg::Vec3 face_normal = (P2 - P1) ^ (P3 - P1);
-
-        osg::Vec3 V;
-
-        V = osg::Vec3(P2.x() - P1.x(), uv2.x() - uv1.x(), uv2.y() - uv1.y()) ^
-            osg::Vec3(P3.x() - P1.x(), uv3.x() - uv1.x(), uv3.y() - uv1.y());
-        if (V.x() != 0) {
-            V.normalize();
-            (*T_)[iA].x() += -V.y() / V.x();
-            (*B_)[iA].x() += -V.z() / V.x();
-            (*T_)[iB].x() += -V.y() / V.x();
-            (*B_)[iB].x() += -V.z() / V.x();
-            (*T_)[iC].x() += -V.y() / V.x();
-            (*B_)[iC].x() += -V.z() / V.x();
-        }
-
-        V = osg::Vec3(P2.y() - P1.y(), uv2.x() - uv1.x(), uv2.y() - uv1.y()) ^
-            osg::Vec3(P3.y() - P1.y(), uv3.x() - uv1.x(), uv3.y() - uv1.y());
-        if (V.x() != 0) {
-            V.normalize();
-            (*T_)[iA].y() += -V.y() / V.x();
-            (*B_)[iA].y() += -V.z() / V.x();
-            (*T_)[iB].y() += -V.y() / V.x();
-            (*B_)[iB].y() += -V.z() / V.x();
-            (*T_)[iC].y() += -V.y() / V.x();
-            (*B_)[iC].y() += -V.z() / V.x();
-        }
-
-        V = osg::Vec3(P2.z() - P1.z(), uv2.x() - uv1.x(), uv2.y() - uv1.y()) ^
-            osg::Vec3(P3.z() - P1.z(), uv3.x() - uv1.x(), uv3.y() - uv1.y());
-        if (V.x() != 0) {
-            V.normalize();
-            (*T_)[iA].z() += -V.y() / V.x();
-            (*B_)[iA].z() += -V.z() / V.x();
-            (*T_)[iB].z() += -V.y() / V.x();
-            (*B_)[iB].z() += -V.z() / V.x();
-            (*T_)[iC].z() += -V.y() / V.x();
-            (*B_)[iC].z() += -V.z() / V.x();
+    int corner_index[3] = { iA, iB, iC };
+    for (int c=0; c<3; ++c) {
+        int i = corner_index[c];
+        if (nx) {
+            (*T_)[i] = osg::Vec4(T[c], 0);
+            (*B_)[i] = osg::Vec4(B[c], 0);
+        } else {
+            (*T_)[i] += osg::Vec4(T[c], 0);
+            (*B_)[i] += osg::Vec4(B[c], 0);
         }
-
-        (*N_)[iA] += osg::Vec4(face_normal, 0);
-        (*N_)[iB] += osg::Vec4(face_normal, 0);
-        (*N_)[iC] += osg::Vec4(face_normal, 0);
+        (*N_)[i] += osg::Vec4(N[c], 0);
     }
 }
-
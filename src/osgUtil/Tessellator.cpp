@@ -15,16 +15,813 @@
 
 #include <osg/Notify>
 #include <osg/io_utils>
+#include <osg/Vec2d>
 #include <osgUtil/Tessellator>
 
+#include <OpenThreads/Thread>
+
+#include <algorithm>
+#include <functional>
+#include <float.h>
+#include <math.h>
+
 using namespace osg;
 using namespace osgUtil;
 
+namespace
+{
+
+// PolygonTessellator tessellates a set of contours that don't intersect or touch each other. The nesting of
+// the contours determines the winding number of each region, and each region that is inside according to the
+// winding rule is triangulated by ear clipping, with its holes bridged into the outer contour. Ears are found
+// with a z-order index of the vertices for larger polygons, along the lines of Mapbox's earcut.
+class PolygonTessellator
+{
+    public:
+
+        typedef std::vector<osg::Vec3*> VertexList;
+        typedef std::vector<VertexList> ContourList;
+
+        PolygonTessellator(GLenum windingRule, const osg::Vec3& normal):
+            _windingRule(windingRule),
+            _normal(normal) {}
+
+        bool tessellate(const ContourList& contours, VertexList& triangles);
+
+    protected:
+
+        struct Contour
+        {
+            unsigned int    first;
+            unsigned int    count;
+            double          area;
+            osg::Vec2d      min;
+            osg::Vec2d      max;
+            int             parent;
+            int             winding;
+        };
+
+        struct Node
+        {
+            unsigned int    i;
+            double          x, y;
+            int             prev, next;
+            int             prevZ, nextZ;
+            unsigned int    z;
+        };
+
+        struct Edge
+        {
+            unsigned int    contour;
+            unsigned int    index;
+            double          minx, maxx;
+            double          miny, maxy;
+            bool operator < (const Edge& rhs) const { return minx<rhs.minx; }
+        };
+
+        bool isInside(int winding) const;
+        bool intersects() const;
+        bool contains(const Contour& contour, const osg::Vec2d& p) const;
+
+        // ear clipping of a polygon with holes
+        bool triangulate(unsigned int outer, const std::vector<unsigned int>& holes, VertexList& triangles);
+        int linkedList(const Contour& contour, bool counterClockwise);
+        int insertNode(unsigned int i, int last);
+        void removeNode(int p);
+        int filterPoints(int start, int end);
+        int eliminateHole(int hole, int outerNode);
+        int findHoleBridge(int hole, int outerNode) const;
+        int splitPolygon(int a, int b);
+        bool locallyInside(int a, int b) const;
+        bool sectorContainsSector(int m, int p) const;
+        bool isEar(int ear) const;
+        bool isEarHashed(int ear) const;
+        void indexCurve(int start);
+        unsigned int zOrder(double x, double y) const;
+        bool earcutLinked(int ear, VertexList& triangles, int pass);
+
+        inline const osg::Vec2d& point(unsigned int contour, unsigned int index) const
+        {
+            const Contour& c = _contours[contour];
+            return _points[c.first + (index % c.count)];
+        }
+
+        // orientation of r relative to p-q, negative if r lies to the left as per earcut's convention.
+        inline double area(int p, int q, int r) const
+        {
+            const Node& P = _nodes[p];
+            const Node& Q = _nodes[q];
+            const Node& R = _nodes[r];
+            return (Q.y - P.y) * (R.x - Q.x) - (Q.x - P.x) * (R.y - Q.y);
+        }
+
+        inline bool equals(int p, int q) const { return _nodes[p].x==_nodes[q].x && _nodes[p].y==_nodes[q].y; }
+
+        static inline bool pointInTriangle(double ax, double ay, double bx, double by, double cx, double cy, double px, double py)
+        {
+            return (cx - px) * (ay - py) >= (ax - px) * (cy - py) &&
+                   (ax - px) * (by - py) >= (bx - px) * (ay - py) &&
+                   (bx - px) * (cy - py) >= (cx - px) * (by - py);
+        }
+
+        static inline double orient(const osg::Vec2d& a, const osg::Vec2d& b, const osg::Vec2d& c)
+        {
+            return (b.x()-a.x())*(c.y()-a.y()) - (b.y()-a.y())*(c.x()-a.x());
+        }
+
+        GLenum                      _windingRule;
+        osg::Vec3                   _normal;
+
+        std::vector<osg::Vec2d>     _points;
+        std::vector<osg::Vec3*>     _vertices;
+        std::vector<Contour>        _contours;
+        std::vector<Node>           _nodes;
+
+        double                      _minX, _minY, _invSize;
+};
+
+bool PolygonTessellator::isInside(int winding) const
+{
+    switch(_windingRule)
+    {
+        case GLU_TESS_WINDING_ODD:          return (winding & 1)!=0;
+        case GLU_TESS_WINDING_NONZERO:      return winding!=0;
+        case GLU_TESS_WINDING_POSITIVE:     return winding>0;
+        case GLU_TESS_WINDING_NEGATIVE:     return winding<0;
+        case GLU_TESS_WINDING_ABS_GEQ_TWO:  return winding>=2 || winding<=-2;
+    }
+    return false;
+}
+
+bool PolygonTessellator::tessellate(const ContourList& contours, VertexList& triangles)
+{
+    // use the Newell normal of the contours unless a normal has been specified, so that the contours have positive area overall.
+    osg::Vec3d normal(_normal);
+    if (normal.length2()==0.0)
+    {
+        for(ContourList::const_iterator citr = contours.begin(); citr != contours.end(); ++citr)
+        {
+            const VertexList& vertices = *citr;
+            for(unsigned int i=0; i<vertices.size(); ++i)
+            {
+                const osg::Vec3& a = *vertices[i];
+                const osg::Vec3& b = *vertices[(i+1)%vertices.size()];
+                normal.x() += (double(a.y())-b.y())*(double(a.z())+b.z());
+                normal.y() += (double(a.z())-b.z())*(double(a.x())+b.x());
+                normal.z() += (double(a.x())-b.x())*(double(a.y())+b.y());
+            }
+        }
+    }
+    if (normal.normalize()==0.0) return false;
+
+    osg::Vec3d axis(1.0,0.0,0.0);
+    if (fabs(normal.y())<fabs(normal.x()) && fabs(normal.y())<=fabs(normal.z())) axis.set(0.0,1.0,0.0);
+    else if (fabs(normal.z())<fabs(normal.x()) && fabs(normal.z())<fabs(normal.y())) axis.set(0.0,0.0,1.0);
+    osg::Vec3d u = normal ^ axis;
+    u.normalize();
+    osg::Vec3d v = normal ^ u;
+
+    // project the contours onto the plane, removing coincident vertices
+    _points.clear();
+    _vertices.clear();
+    _contours.clear();
+    for(ContourList::const_iterator citr = contours.begin(); citr != contours.end(); ++citr)
+    {
+        Contour contour;
+        contour.first = _points.size();
+        for(VertexList::const_iterator vitr = citr->begin(); vitr != citr->end(); ++vitr)
+        {
+            osg::Vec3d p(**vitr);
+            osg::Vec2d pp(p*u, p*v);
+            if (_points.size()>contour.first && _points.back()==pp) continue;
+            _points.push_back(pp);
+            _vertices.push_back(*vitr);
+        }
+        while (_points.size()>contour.first+1 && _points.back()==_points[contour.first])
+        {
+            _points.pop_back();
+            _vertices.pop_back();
+        }
+
+        contour.count = _points.size()-contour.first;
+        contour.area = 0.0;
+        if (contour.count>=3)
+        {
+            contour.min = contour.max = _points[contour.first];
+            for(unsigned int i=0; i<contour.count; ++i)
+            {
+                const osg::Vec2d& a = _points[contour.first+i];
+                const osg::Vec2d& b = _points[contour.first+(i+1)%contour.count];
+                contour.area += (a.x()-b.x())*(a.y()+b.y());
+                contour.min.x() = osg::minimum(contour.min.x(), a.x());
+                contour.min.y() = osg::minimum(contour.min.y(), a.y());
+                contour.max.x() = osg::maximum(contour.max.x(), a.x());
+                contour.max.y() = osg::maximum(contour.max.y(), a.y());
+            }
+            contour.area *= 0.5;
+        }
+
+        // contours without area don't contribute to the winding numbers
+        if (contour.area==0.0)
+        {
+            _points.resize(contour.first);
+            _vertices.resize(contour.first);
+            continue;
+        }
+
+        contour.parent = -1;
+        contour.winding = 0;
+        _contours.push_back(contour);
+    }
+
+    if (_contours.empty()) return true;
+
+    if (intersects()) return false;
+
+    // the parent of each contour is the smallest contour that contains it, as contours are sorted by
+    // decreasing area the parents are processed before their children.
+    std::vector< std::pair<double, unsigned int> > order;
+    for(unsigned int c=0; c<_contours.size(); ++c)
+    {
+        order.push_back(std::pair<double, unsigned int>(-fabs(_contours[c].area), c));
+    }
+    std::sort(order.begin(), order.end());
+
+    std::vector< std::vector<unsigned int> > children(_contours.size());
+    for(unsigned int oi=0; oi<order.size(); ++oi)
+    {
+        Contour& contour = _contours[order[oi].second];
+        const osg::Vec2d& p = _points[contour.first];
+        for(int oj=oi-1; oj>=0; --oj)
+        {
+            if (contains(_contours[order[oj].second], p))
+            {
+                contour.parent = order[oj].second;
+                break;
+            }
+        }
+
+        int parentWinding = contour.parent>=0 ? _contours[contour.parent].winding : 0;
+        contour.winding = parentWinding + (contour.area>0.0 ? 1 : -1);
+        if (contour.parent>=0) children[contour.parent].push_back(order[oi].second);
+    }
+
+    for(unsigned int c=0; c<_contours.size(); ++c)
+    {
+        if (isInside(_contours[c].winding))
+        {
+            if (!triangulate(c, children[c], triangles)) return false;
+        }
+    }
+
+    return true;
+}
+
+bool PolygonTessellator::contains(const Contour& contour, const osg::Vec2d& p) const
+{
+    if (p.x()<contour.min.x() || p.x()>contour.max.x() || p.y()<contour.min.y() || p.y()>contour.max.y()) return false;
+
+    bool inside = false;
+    for(unsigned int i=0, j=contour.count-1; i<contour.count; j=i++)
+    {
+        const osg::Vec2d& a = _points[contour.first+i];
+        const osg::Vec2d& b = _points[contour.first+j];
+        if ((a.y()>p.y()) != (b.y()>p.y()) &&
+            p.x() < (b.x()-a.x()) * (p.y()-a.y()) / (b.y()-a.y()) + a.x())
+        {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+bool PolygonTessellator::intersects() const
+{
+    std::vector<Edge> edges;
+    edges.reserve(_points.size());
+    for(unsigned int c=0; c<_contours.size(); ++c)
+    {
+        for(unsigned int i=0; i<_contours[c].count; ++i)
+        {
+            const osg::Vec2d& a = point(c, i);
+            const osg::Vec2d& b = point(c, i+1);
+            Edge edge;
+            edge.contour = c;
+            edge.index = i;
+            edge.minx = osg::minimum(a.x(), b.x());
+            edge.maxx = osg::maximum(a.x(), b.x());
+            edge.miny = osg::minimum(a.y(), b.y());
+            edge.maxy = osg::maximum(a.y(), b.y());
+            edges.push_back(edge);
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+
+    // sweep along x, testing each edge against the edges whose x range overlaps it
+    std::vector<unsigned int> active;
+    for(unsigned int ei=0; ei<edges.size(); ++ei)
+    {
+        const Edge& e = edges[ei];
+        const osg::Vec2d& a = point(e.contour, e.index);
+        const osg::Vec2d& b = point(e.contour, e.index+1);
+        unsigned int numActive = 0;
+        for(unsigned int ai=0; ai<active.size(); ++ai)
+        {
+            const Edge& f = edges[active[ai]];
+            if (f.maxx<e.minx) continue;
+            active[numActive++] = active[ai];
+
+            if (f.maxy<e.miny || f.miny>e.maxy) continue;
+
+            const osg::Vec2d& c = point(f.contour, f.index);
+            const osg::Vec2d& d = point(f.contour, f.index+1);
+
+            if (e.contour==f.contour)
+            {
+                unsigned int count = _contours[e.contour].count;
+                bool shareEnd = (e.index+1)%count==f.index;
+                bool shareStart = (f.index+1)%count==e.index;
+                if (shareEnd || shareStart)
+                {
+                    // adjacent edges may only meet at their shared vertex, unless the contour only has three vertices
+                    // each pair of edges shares a vertex, in which case they can't overlap as the contour has area.
+                    if (count==3) continue;
+                    if (shareEnd && orient(a, b, d)==0.0 && (a-b)*(d-b)>0.0) return true;
+                    if (shareStart && orient(c, d, b)==0.0 && (c-d)*(b-d)>0.0) return true;
+                    continue;
+                }
+            }
+
+            double o1 = orient(a, b, c);
+            double o2 = orient(a, b, d);
+            double o3 = orient(c, d, a);
+            double o4 = orient(c, d, b);
+            if (((o1>0.0 && o2<0.0) || (o1<0.0 && o2>0.0)) && ((o3>0.0 && o4<0.0) || (o3<0.0 && o4>0.0))) return true;
+
+            // touching, including collinear overlaps
+            if ((o1==0.0 || o2==0.0 || o3==0.0 || o4==0.0) &&
+                osg::maximum(e.minx, f.minx)<=osg::minimum(e.maxx, f.maxx) &&
+                osg::maximum(e.miny, f.miny)<=osg::minimum(e.maxy, f.maxy))
+            {
+                if (o1==0.0 && c.x()>=e.minx && c.x()<=e.maxx && c.y()>=e.miny && c.y()<=e.maxy) return true;
+                if (o2==0.0 && d.x()>=e.minx && d.x()<=e.maxx && d.y()>=e.miny && d.y()<=e.maxy) return true;
+                if (o3==0.0 && a.x()>=f.minx && a.x()<=f.maxx && a.y()>=f.miny && a.y()<=f.maxy) return true;
+                if (o4==0.0 && b.x()>=f.minx && b.x()<=f.maxx && b.y()>=f.miny && b.y()<=f.maxy) return true;
+            }
+        }
+        active.resize(numActive);
+        active.push_back(ei);
+    }
+    return false;
+}
+
+int PolygonTessellator::insertNode(unsigned int i, int last)
+{
+    Node node;
+    node.i = i;
+    node.x = _points[i].x();
+    node.y = _points[i].y();
+    node.prevZ = node.nextZ = -1;
+    node.z = 0;
+
+    int p = _nodes.size();
+    if (last<0)
+    {
+        node.prev = node.next = p;
+    }
+    else
+    {
+        node.next = _nodes[last].next;
+        node.prev = last;
+    }
+    _nodes.push_back(node);
+    if (last>=0)
+    {
+        _nodes[_nodes[last].next].prev = p;
+        _nodes[last].next = p;
+    }
+    return p;
+}
+
+void PolygonTessellator::removeNode(int p)
+{
+    Node& node = _nodes[p];
+    _nodes[node.next].prev = node.prev;
+    _nodes[node.prev].next = node.next;
+    if (node.prevZ>=0) _nodes[node.prevZ].nextZ = node.nextZ;
+    if (node.nextZ>=0) _nodes[node.nextZ].prevZ = node.prevZ;
+}
+
+int PolygonTessellator::linkedList(const Contour& contour, bool counterClockwise)
+{
+    int last = -1;
+    if (counterClockwise == (contour.area>0.0))
+    {
+        for(unsigned int i=0; i<contour.count; ++i) last = insertNode(contour.first+i, last);
+    }
+    else
+    {
+        for(int i=contour.count-1; i>=0; --i) last = insertNode(contour.first+i, last);
+    }
+    return last;
+}
+
+int PolygonTessellator::filterPoints(int start, int end)
+{
+    // remove coincident and collinear points
+    if (start<0) return start;
+    if (end<0) end = start;
+
+    int p = start;
+    bool again;
+    do
+    {
+        again = false;
+        if (equals(p, _nodes[p].next) || area(_nodes[p].prev, p, _nodes[p].next)==0.0)
+        {
+            removeNode(p);
+            p = end = _nodes[p].prev;
+            if (p==_nodes[p].next) break;
+            again = true;
+        }
+        else
+        {
+            p = _nodes[p].next;
+        }
+    } while (again || p!=end);
+
+    return end;
+}
+
+bool PolygonTessellator::locallyInside(int a, int b) const
+{
+    const Node& A = _nodes[a];
+    return area(A.prev, a, A.next) < 0.0 ?
+        area(a, b, A.next) >= 0.0 && area(a, A.prev, b) >= 0.0 :
+        area(a, b, A.prev) < 0.0 || area(a, A.next, b) < 0.0;
+}
+
+bool PolygonTessellator::sectorContainsSector(int m, int p) const
+{
+    return area(_nodes[m].prev, m, _nodes[p].prev) < 0.0 && area(_nodes[p].next, m, _nodes[m].next) < 0.0;
+}
+
+int PolygonTessellator::findHoleBridge(int hole, int outerNode) const
+{
+    // find the segment intersected by a ray from the leftmost point of the hole to the left,
+    // the endpoint of the segment with the lesser x is the potential connection point.
+    double hx = _nodes[hole].x;
+    double hy = _nodes[hole].y;
+    double qx = -DBL_MAX;
+    int m = -1;
+    int p = outerNode;
+
+    if (equals(hole, p)) return p;
+    do
+    {
+        const Node& P = _nodes[p];
+        const Node& N = _nodes[P.next];
+        if (equals(hole, P.next)) return P.next;
+        if (hy <= P.y && hy >= N.y && N.y != P.y)
+        {
+            double x = P.x + (hy - P.y) * (N.x - P.x) / (N.y - P.y);
+            if (x <= hx && x > qx)
+            {
+                qx = x;
+                m = P.x < N.x ? p : P.next;
+                if (x == hx) return m;
+            }
+        }
+        p = P.next;
+    } while (p != outerNode);
+
+    if (m<0) return -1;
+
+    // if there are points inside the triangle of the hole point, the intersection and the endpoint,
+    // connect to the one with the minimum angle to the ray instead.
+    int stop = m;
+    double mx = _nodes[m].x;
+    double my = _nodes[m].y;
+    double tanMin = DBL_MAX;
+    p = m;
+    do
+    {
+        const Node& P = _nodes[p];
+        if (hx >= P.x && P.x >= mx && hx != P.x &&
+            pointInTriangle(hy < my ? hx : qx, hy, mx, my, hy < my ? qx : hx, hy, P.x, P.y))
+        {
+            double tan = fabs(hy - P.y) / (hx - P.x);
+            if (locallyInside(p, hole) &&
+                (tan < tanMin || (tan == tanMin && (P.x > _nodes[m].x || (P.x == _nodes[m].x && sectorContainsSector(m, p))))))
+            {
+                m = p;
+                tanMin = tan;
+            }
+        }
+        p = P.next;
+    } while (p != stop);
+
+    return m;
+}
+
+int PolygonTessellator::splitPolygon(int a, int b)
+{
+    // link a to b with a pair of bridge edges, duplicating both vertices
+    Node a2 = _nodes[a];
+    Node b2 = _nodes[b];
+    int a2i = _nodes.size();
+    int b2i = a2i+1;
+    int an = _nodes[a].next;
+    int bp = _nodes[b].prev;
+
+    a2.prevZ = a2.nextZ = b2.prevZ = b2.nextZ = -1;
+    _nodes.push_back(a2);
+    _nodes.push_back(b2);
+
+    _nodes[a].next = b;
+    _nodes[b].prev = a;
+
+    _nodes[a2i].next = an;
+    _nodes[an].prev = a2i;
+
+    _nodes[b2i].next = a2i;
+    _nodes[a2i].prev = b2i;
+
+    _nodes[bp].next = b2i;
+    _nodes[b2i].prev = bp;
+
+    return b2i;
+}
+
+int PolygonTessellator::eliminateHole(int hole, int outerNode)
+{
+    int bridge = findHoleBridge(hole, outerNode);
+    if (bridge<0) return -1;
+
+    int bridgeReverse = splitPolygon(bridge, hole);
+    filterPoints(bridgeReverse, _nodes[bridgeReverse].next);
+    return filterPoints(bridge, _nodes[bridge].next);
+}
+
+unsigned int PolygonTessellator::zOrder(double x, double y) const
+{
+    // interleave the bits of the 15 bit coordinates
+    unsigned int ix = (unsigned int)((x - _minX) * _invSize);
+    unsigned int iy = (unsigned int)((y - _minY) * _invSize);
+
+    ix = (ix | (ix << 8)) & 0x00FF00FF;
+    ix = (ix | (ix << 4)) & 0x0F0F0F0F;
+    ix = (ix | (ix << 2)) & 0x33333333;
+    ix = (ix | (ix << 1)) & 0x55555555;
+
+    iy = (iy | (iy << 8)) & 0x00FF00FF;
+    iy = (iy | (iy << 4)) & 0x0F0F0F0F;
+    iy = (iy | (iy << 2)) & 0x33333333;
+    iy = (iy | (iy << 1)) & 0x55555555;
+
+    return ix | (iy << 1);
+}
+
+void PolygonTessellator::indexCurve(int start)
+{
+    std::vector< std::pair<unsigned int, int> > sorted;
+    int p = start;
+    do
+    {
+        Node& node = _nodes[p];
+        node.z = zOrder(node.x, node.y);
+        sorted.push_back(std::pair<unsigned int, int>(node.z, p));
+        p = node.next;
+    } while (p != start);
+
+    std::sort(sorted.begin(), sorted.end());
+    for(unsigned int i=0; i<sorted.size(); ++i)
+    {
+        Node& node = _nodes[sorted[i].second];
+        node.prevZ = i>0 ? sorted[i-1].second : -1;
+        node.nextZ = i+1<sorted.size() ? sorted[i+1].second : -1;
+    }
+}
+
+bool PolygonTessellator::isEar(int ear) const
+{
+    int a = _nodes[ear].prev;
+    int c = _nodes[ear].next;
+    if (area(a, ear, c) >= 0.0) return false; // reflex
+
+    // make sure there are no reflex points inside the ear
+    const Node& A = _nodes[a];
+    const Node& B = _nodes[ear];
+    const Node& C = _nodes[c];
+    double x0 = osg::minimum(A.x, osg::minimum(B.x, C.x));
+    double y0 = osg::minimum(A.y, osg::minimum(B.y, C.y));
+    double x1 = osg::maximum(A.x, osg::maximum(B.x, C.x));
+    double y1 = osg::maximum(A.y, osg::maximum(B.y, C.y));
+
+    int p = C.next;
+    while (p != a)
+    {
+        const Node& P = _nodes[p];
+        if (P.x >= x0 && P.x <= x1 && P.y >= y0 && P.y <= y1 &&
+            !(A.x == P.x && A.y == P.y) &&
+            pointInTriangle(A.x, A.y, B.x, B.y, C.x, C.y, P.x, P.y) &&
+            area(P.prev, p, P.next) >= 0.0) return false;
+        p = P.next;
+    }
+    return true;
+}
+
+bool PolygonTessellator::isEarHashed(int ear) const
+{
+    int a = _nodes[ear].prev;
+    int c = _nodes[ear].next;
+    if (area(a, ear, c) >= 0.0) return false; // reflex
+
+    const Node& A = _nodes[a];
+    const Node& B = _nodes[ear];
+    const Node& C = _nodes[c];
+    double x0 = osg::minimum(A.x, osg::minimum(B.x, C.x));
+    double y0 = osg::minimum(A.y, osg::minimum(B.y, C.y));
+    double x1 = osg::maximum(A.x, osg::maximum(B.x, C.x));
+    double y1 = osg::maximum(A.y, osg::maximum(B.y, C.y));
+
+    // only the points within the z-order range of the bounding box of the ear need testing
+    unsigned int minZ = zOrder(x0, y0);
+    unsigned int maxZ = zOrder(x1, y1);
+
+    int p = B.prevZ;
+    int n = B.nextZ;
+    for(int direction=0; direction<2; ++direction)
+    {
+        int q = direction==0 ? p : n;
+        while (q>=0 && (direction==0 ? _nodes[q].z >= minZ : _nodes[q].z <= maxZ))
+        {
+            const Node& Q = _nodes[q];
+            if (Q.x >= x0 && Q.x <= x1 && Q.y >= y0 && Q.y <= y1 && q != a && q != c &&
+                !(A.x == Q.x && A.y == Q.y) &&
+                pointInTriangle(A.x, A.y, B.x, B.y, C.x, C.y, Q.x, Q.y) &&
+                area(Q.prev, q, Q.next) >= 0.0) return false;
+            q = direction==0 ? Q.prevZ : Q.nextZ;
+        }
+    }
+    return true;
+}
+
+bool PolygonTessellator::earcutLinked(int ear, VertexList& triangles, int pass)
+{
+    if (ear<0) return true;
+    if (pass==0 && _invSize>0.0) indexCurve(ear);
+
+    int stop = ear;
+    while (_nodes[ear].prev != _nodes[ear].next)
+    {
+        int prev = _nodes[ear].prev;
+        int next = _nodes[ear].next;
+
+        if (_invSize>0.0 ? isEarHashed(ear) : isEar(ear))
+        {
+            triangles.push_back(_vertices[_nodes[prev].i]);
+            triangles.push_back(_vertices[_nodes[ear].i]);
+            triangles.push_back(_vertices[_nodes[next].i]);
+
+            removeNode(ear);
+
+            // skipping the next vertex leads to fewer sliver triangles
+            ear = _nodes[next].next;
+            stop = _nodes[next].next;
+            continue;
+        }
+
+        ear = next;
+
+        if (ear == stop)
+        {
+            // no ear found, try again without collinear points, otherwise leave the polygon to the glu tessellator
+            if (pass==0) return earcutLinked(filterPoints(ear, -1), triangles, 1);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PolygonTessellator::triangulate(unsigned int outer, const std::vector<unsigned int>& holes, VertexList& triangles)
+{
+    _nodes.clear();
+
+    int outerNode = linkedList(_contours[outer], true);
+    if (_nodes[outerNode].next == _nodes[outerNode].prev) return true;
+
+    if (!holes.empty())
+    {
+        std::vector< std::pair<osg::Vec2d, int> > queue;
+        for(std::vector<unsigned int>::const_iterator hitr = holes.begin(); hitr != holes.end(); ++hitr)
+        {
+            int list = linkedList(_contours[*hitr], false);
+
+            // bridge each hole from its leftmost point
+            int leftmost = list;
+            int p = list;
+            do
+            {
+                const Node& P = _nodes[p];
+                if (P.x < _nodes[leftmost].x || (P.x == _nodes[leftmost].x && P.y < _nodes[leftmost].y)) leftmost = p;
+                p = P.next;
+            } while (p != list);
+            queue.push_back(std::pair<osg::Vec2d, int>(osg::Vec2d(_nodes[leftmost].x, _nodes[leftmost].y), leftmost));
+        }
+        std::sort(queue.begin(), queue.end());
+
+        for(unsigned int i=0; i<queue.size(); ++i)
+        {
+            outerNode = eliminateHole(queue[i].second, outerNode);
+            if (outerNode<0) return false;
+        }
+    }
+
+    // index the points along a z-order curve for polygons large enough to benefit
+    _invSize = 0.0;
+    if (_nodes.size()>80)
+    {
+        const Contour& contour = _contours[outer];
+        _minX = contour.min.x();
+        _minY = contour.min.y();
+        double size = osg::maximum(contour.max.x()-contour.min.x(), contour.max.y()-contour.min.y());
+        _invSize = size!=0.0 ? 32767.0/size : 0.0;
+    }
+
+    return earcutLinked(outerNode, triangles, 0);
+}
+
+// TessellateThread natively tessellates every numThreads'th polygon from first, writing the triangles
+// as indices into the vertex array so that they remain valid if the array is later reallocated.
+class TessellateThread : public OpenThreads::Thread
+{
+    public:
+
+        typedef std::vector<PolygonTessellator::ContourList> PolygonList;
+        typedef std::vector< std::vector<unsigned int> > IndicesList;
+
+        TessellateThread(GLenum windingRule, const osg::Vec3& normal, const osg::Vec3* base, const PolygonList& polygons, IndicesList& indices, std::vector<unsigned char>& valid, unsigned int first, unsigned int numThreads):
+            _windingRule(windingRule),
+            _normal(normal),
+            _base(base),
+            _polygons(polygons),
+            _indices(indices),
+            _valid(valid),
+            _first(first),
+            _numThreads(numThreads) {}
+
+        virtual void run()
+        {
+            PolygonTessellator::VertexList triangles;
+            for(unsigned int i=_first; i<_polygons.size(); i+=_numThreads)
+            {
+                PolygonTessellator tessellator(_windingRule, _normal);
+                triangles.clear();
+                _valid[i] = tessellator.tessellate(_polygons[i], triangles) ? 1 : 0;
+                if (_valid[i])
+                {
+                    _indices[i].reserve(triangles.size());
+                    for(PolygonTessellator::VertexList::iterator itr = triangles.begin(); itr != triangles.end(); ++itr)
+                    {
+                        _indices[i].push_back(*itr - _base);
+                    }
+                }
+            }
+        }
+
+    protected:
+
+        GLenum                      _windingRule;
+        osg::Vec3                   _normal;
+        const osg::Vec3*            _base;
+        const PolygonList&          _polygons;
+        IndicesList&                _indices;
+        std::vector<unsigned char>& _valid;
+        unsigned int                _first;
+        unsigned int                _numThreads;
+};
+
+void addTriangles(Tessellator::PrimList& primList, osg::Vec3Array& vertices, const std::vector<unsigned int>& indices)
+{
+    if (indices.empty()) return;
+
+    Tessellator::Prim* prim = new Tessellator::Prim(GL_TRIANGLES);
+    prim->_vertices.reserve(indices.size());
+    for(std::vector<unsigned int>::const_iterator itr = indices.begin(); itr != indices.end(); ++itr)
+    {
+        prim->_vertices.push_back(&vertices[*itr]);
+    }
+    primList.push_back(prim);
+}
+
+}
+
 
 Tessellator::Tessellator() :
     _wtype(TESS_WINDING_ODD),
     _ttype(TESS_TYPE_POLYGONS),
-    _boundaryOnly(false), _numberVerts(0)
+    _boundaryOnly(false), _useNativeTessellation(true), _numberVerts(0)
 {
     _tobj = gluNewTess();
     if (_tobj)
@@ -51,32 +848,78 @@ Tessellator::~Tessellator()
 void Tessellator::beginTessellation()
 {
     reset();
+}
 
-    if (_tobj)
+void Tessellator::beginContour()
+{
+    _contourList.push_back(VertexList());
+}
+
+void Tessellator::addVertex(osg::Vec3* vertex)
+{
+    if (vertex && vertex->valid())
     {
-        gluTessProperty(_tobj, GLU_TESS_WINDING_RULE, _wtype);
-        gluTessProperty(_tobj, GLU_TESS_BOUNDARY_ONLY, _boundaryOnly);
+        if (_contourList.empty()) beginContour();
+        _contourList.back().push_back(vertex);
+    }
+    else
+    {
+        OSG_INFO<<"Tessellator::addVertex("<<*vertex<<") detected NaN, ignoring vertex."<<std::endl;
+    }
+}
 
-        if (tessNormal.length()>0.0) gluTessNormal(_tobj, tessNormal.x(), tessNormal.y(), tessNormal.z());
+void Tessellator::endContour()
+{
+}
 
-        gluTessBeginPolygon(_tobj,this);
+void Tessellator::endTessellation()
+{
+    VertexList triangles;
+    if (tessellateNative(_contourList, triangles))
+    {
+        if (!triangles.empty())
+        {
+            Prim* prim = new Prim(GL_TRIANGLES);
+            prim->_vertices.swap(triangles);
+            _primList.push_back(prim);
+        }
+    }
+    else
+    {
+        tessellateGLU(_contourList);
     }
 }
 
-void Tessellator::beginContour()
+bool Tessellator::tessellateNative(const ContourList& contours, VertexList& triangles) const
 {
-    if (_tobj)
+    if (!_useNativeTessellation || _boundaryOnly) return false;
+
+    PolygonTessellator tessellator(_wtype, tessNormal);
+    if (!tessellator.tessellate(contours, triangles))
     {
-        gluTessBeginContour(_tobj);
+        triangles.clear();
+        return false;
     }
+    return true;
 }
 
-void Tessellator::addVertex(osg::Vec3* vertex)
+void Tessellator::tessellateGLU(const ContourList& contours)
 {
-    if (_tobj)
+    if (!_tobj) return;
+
+    gluTessProperty(_tobj, GLU_TESS_WINDING_RULE, _wtype);
+    gluTessProperty(_tobj, GLU_TESS_BOUNDARY_ONLY, _boundaryOnly);
+
+    if (tessNormal.length()>0.0) gluTessNormal(_tobj, tessNormal.x(), tessNormal.y(), tessNormal.z());
+
+    gluTessBeginPolygon(_tobj,this);
+
+    for(ContourList::const_iterator citr = contours.begin(); citr != contours.end(); ++citr)
     {
-        if (vertex && vertex->valid())
+        gluTessBeginContour(_tobj);
+        for(VertexList::const_iterator vitr = citr->begin(); vitr != citr->end(); ++vitr)
         {
+            osg::Vec3* vertex = *vitr;
             Vec3d* data = new Vec3d;
             _coordData.push_back(data);
             (*data)._v[0]=(*vertex)[0];
@@ -84,32 +927,15 @@ void Tessellator::addVertex(osg::Vec3* vertex)
             (*data)._v[2]=(*vertex)[2];
             gluTessVertex(_tobj,data->_v,vertex);
         }
-        else
-        {
-            OSG_INFO<<"Tessellator::addVertex("<<*vertex<<") detected NaN, ignoring vertex."<<std::endl;
-        }
-    }
-}
-
-void Tessellator::endContour()
-{
-    if (_tobj)
-    {
         gluTessEndContour(_tobj);
     }
-}
 
-void Tessellator::endTessellation()
-{
-    if (_tobj)
-    {
-        gluTessEndPolygon(_tobj);
+    gluTessEndPolygon(_tobj);
 
-        if (_errorCode!=0)
-        {
-           const GLubyte *estring = gluErrorString((GLenum)_errorCode);
-           OSG_WARN<<"Tessellation Error: "<<estring<< std::endl;
-        }
+    if (_errorCode!=0)
+    {
+       const GLubyte *estring = gluErrorString((GLenum)_errorCode);
+       OSG_WARN<<"Tessellation Error: "<<estring<< std::endl;
     }
 }
 
@@ -131,6 +957,7 @@ void Tessellator::reset()
     _coordData.clear();
     _newVertexList.clear();
     _primList.clear();
+    _contourList.clear();
     _errorCode = 0;
 }
 
@@ -229,6 +1056,71 @@ void Tessellator::retessellatePolygons(osg::Geometry &geom)
     // process all the contours into the Tessellator
     int noContours = _Contours.size();
     int currentPrimitive = 0;
+
+    // the polygons are independent of each other so natively tessellate them all up front, in parallel when
+    // there are enough of them, those that can't be tessellated natively are passed to the glu tessellator below.
+    TessellateThread::IndicesList polygonIndices;
+    std::vector<unsigned char> polygonValid;
+    if ((_ttype==TESS_TYPE_POLYGONS || _ttype==TESS_TYPE_DRAWABLE) && _useNativeTessellation && !_boundaryOnly)
+    {
+        TessellateThread::PolygonList polygons;
+        for(int primNo=0;primNo<noContours;++primNo)
+        {
+            osg::PrimitiveSet* primitive = _Contours[primNo].get();
+            if (primitive->getMode()!=osg::PrimitiveSet::POLYGON && _ttype!=TESS_TYPE_DRAWABLE) continue;
+
+            if (primitive->getType()==osg::PrimitiveSet::DrawArrayLengthsPrimitiveType)
+            {
+                osg::DrawArrayLengths* drawArrayLengths = static_cast<osg::DrawArrayLengths*>(primitive);
+                unsigned int first = drawArrayLengths->getFirst();
+                for(osg::DrawArrayLengths::iterator itr=drawArrayLengths->begin();
+                    itr!=drawArrayLengths->end();
+                    ++itr)
+                {
+                    _contourList.clear();
+                    unsigned int last = first + *itr;
+                    addContour(primitive->getMode(),first,last,vertices);
+                    first = last;
+                    polygons.push_back(ContourList());
+                    polygons.back().swap(_contourList);
+                }
+            }
+            else if (primitive->getNumIndices()>3)
+            {
+                _contourList.clear();
+                addContour(primitive, vertices);
+                polygons.push_back(ContourList());
+                polygons.back().swap(_contourList);
+            }
+        }
+
+        polygonIndices.resize(polygons.size());
+        polygonValid.resize(polygons.size(), 0);
+
+        unsigned int numThreads = osg::maximum(osg::minimum((unsigned int)OpenThreads::GetNumberOfProcessors(), (unsigned int)(polygons.size()/64)), 1u);
+        std::vector<TessellateThread*> threads;
+        for(unsigned int i=1; i<numThreads; ++i)
+        {
+            TessellateThread* thread = new TessellateThread(_wtype, tessNormal, &vertices->front(), polygons, polygonIndices, polygonValid, i, numThreads);
+            if (thread->startThread()==0) threads.push_back(thread);
+            else
+            {
+                thread->run();
+                delete thread;
+            }
+        }
+
+        // the main thread takes the first share
+        TessellateThread(_wtype, tessNormal, &vertices->front(), polygons, polygonIndices, polygonValid, 0, numThreads).run();
+
+        for(std::vector<TessellateThread*>::iterator itr=threads.begin(); itr!=threads.end(); ++itr)
+        {
+            (*itr)->join();
+            delete *itr;
+        }
+    }
+    unsigned int polygonNo = 0;
+
     for(int primNo=0;primNo<noContours;++primNo)
     {
         osg::ref_ptr<osg::PrimitiveSet> primitive = _Contours[primNo].get();
@@ -245,11 +1137,20 @@ void Tessellator::retessellatePolygons(osg::Geometry &geom)
                         itr!=drawArrayLengths->end();
                         ++itr)
                     {
-                        beginTessellation();
-                            unsigned int last = first + *itr;
-                            addContour(primitive->getMode(),first,last,vertices);
-                            first = last;
-                        endTessellation();
+                        unsigned int last = first + *itr;
+                        if (polygonNo<polygonValid.size() && polygonValid[polygonNo])
+                        {
+                            reset();
+                            addTriangles(_primList, *vertices, polygonIndices[polygonNo]);
+                        }
+                        else
+                        {
+                            beginTessellation();
+                                addContour(primitive->getMode(),first,last,vertices);
+                            endTessellation();
+                        }
+                        first = last;
+                        ++polygonNo;
                         collectTessellation(geom, currentPrimitive);
                         currentPrimitive++;
                     }
@@ -257,9 +1158,18 @@ void Tessellator::retessellatePolygons(osg::Geometry &geom)
                 else
                 {
                     if (primitive->getNumIndices()>3) { // April 2005 gwm only retessellate "complex" polygons
-                        beginTessellation();
-                        addContour(primitive.get(), vertices);
-                        endTessellation();
+                        if (polygonNo<polygonValid.size() && polygonValid[polygonNo])
+                        {
+                            reset();
+                            addTriangles(_primList, *vertices, polygonIndices[polygonNo]);
+                        }
+                        else
+                        {
+                            beginTessellation();
+                            addContour(primitive.get(), vertices);
+                            endTessellation();
+                        }
+                        ++polygonNo;
                         collectTessellation(geom, currentPrimitive);
                         currentPrimitive++;
                     } else { // April 2005 gwm triangles don't need to be retessellated
@@ -626,13 +1536,21 @@ void Tessellator::collectTessellation(osg::Geometry &geom, unsigned int original
     osg::Vec3Array* vertices = dynamic_cast<osg::Vec3Array*>(geom.getVertexArray());
     VertexPtrToIndexMap vertexPtrToIndexMap;
 
-    // populate the VertexPtrToIndexMap.
-    for(unsigned int vi=0;vi<vertices->size();++vi)
+    // vertices of the original array are indexed by their position in it, so the VertexPtrToIndexMap
+    // is only needed when new vertices have been created where contours intersect.
+    osg::Vec3* firstVertex = vertices->empty() ? 0 : &vertices->front();
+    osg::Vec3* lastVertex = firstVertex + vertices->size();
+    std::less<const osg::Vec3*> less;
+    if (!_newVertexList.empty())
     {
-        vertexPtrToIndexMap[&((*vertices)[vi])] = vi;
-    }
+        // populate the VertexPtrToIndexMap.
+        for(unsigned int vi=0;vi<vertices->size();++vi)
+        {
+            vertexPtrToIndexMap[&((*vertices)[vi])] = vi;
+        }
 
-    handleNewVertices(geom, vertexPtrToIndexMap);
+        handleNewVertices(geom, vertexPtrToIndexMap);
+    }
 
     // we don't properly handle per primitive and per primitive_set bindings yet
     // will need to address this soon. Robert Oct 2002.
@@ -676,28 +1594,28 @@ void Tessellator::collectTessellation(osg::Geometry &geom, unsigned int original
               Prim* prim=primItr->get();
               int ntris=0;
 
-              if(vertexPtrToIndexMap.size() <= 255)
+              if(vertices->size() <= 255)
               {
                   osg::DrawElementsUByte* elements = new osg::DrawElementsUByte(prim->_mode);
                   for(Prim::VecList::iterator vitr=prim->_vertices.begin();
                   vitr!=prim->_vertices.end();
                   ++vitr)
                 {
-                    elements->push_back(vertexPtrToIndexMap[*vitr]);
+                    elements->push_back(!less(*vitr, firstVertex) && less(*vitr, lastVertex) ? *vitr - firstVertex : vertexPtrToIndexMap[*vitr]);
                 }
 
                   // add to the drawn primitive list.
                   geom.addPrimitiveSet(elements);
                   ntris=elements->getNumIndices()/3;
               }
-              else if(vertexPtrToIndexMap.size() > 255 && vertexPtrToIndexMap.size() <= 65535)
+              else if(vertices->size() > 255 && vertices->size() <= 65535)
               {
                   osg::DrawElementsUShort* elements = new osg::DrawElementsUShort(prim->_mode);
                   for(Prim::VecList::iterator vitr=prim->_vertices.begin();
                     vitr!=prim->_vertices.end();
                     ++vitr)
                   {
-                    elements->push_back(vertexPtrToIndexMap[*vitr]);
+                    elements->push_back(!less(*vitr, firstVertex) && less(*vitr, lastVertex) ? *vitr - firstVertex : vertexPtrToIndexMap[*vitr]);
                   }
 
                   // add to the drawn primitive list.
@@ -711,7 +1629,7 @@ void Tessellator::collectTessellation(osg::Geometry &geom, unsigned int original
                     vitr!=prim->_vertices.end();
                     ++vitr)
                   {
-                    elements->push_back(vertexPtrToIndexMap[*vitr]);
+                    elements->push_back(!less(*vitr, firstVertex) && less(*vitr, lastVertex) ? *vitr - firstVertex : vertexPtrToIndexMap[*vitr]);
                   }
 
                   // add to the drawn primitive list.
@@ -35,6 +35,7 @@ Scene::Scene():
 {
     setDatabasePager(osgDB::DatabasePager::create());
     setImagePager(new osgDB::ImagePager);
+    setBoundsUpdater(new osgUtil::BoundsUpdater);
 
     OpenThreads::ScopedLock<OpenThreads::Mutex> lock(getSceneCacheMutex());
     getSceneCache().push_back(this);
@@ -101,6 +102,9 @@ void Scene::updateSceneGraph(osg::NodeVisitor& updateVisitor)
     {
         updateVisitor.setImageRequestHandler(getImagePager());
         getSceneData()->accept(updateVisitor);
+
+        // compute the bounds dirtied by the update traversal now, a level at a time, rather than on demand during cull
+        if (_boundsUpdater.valid()) _boundsUpdater->update(*getSceneData());
     }
 }
 
@@ -113,6 +113,7 @@ bool StatsHandler::handle(const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAdap
                             }
 
                             viewer->getViewerStats()->collectStats("scene",false);
+                            viewer->getViewerStats()->collectStats("compile",false);
 
                             _camera->setNodeMask(0x0);
                             _switch->setAllChildrenOff();
@@ -181,6 +182,7 @@ bool StatsHandler::handle(const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAdap
                             _switch->setValue(_viewerSceneChildNum, true);
 
                             viewer->getViewerStats()->collectStats("scene",true);
+                            viewer->getViewerStats()->collectStats("compile",true);
 
                             break;
                         }
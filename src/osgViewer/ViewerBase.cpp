@@ -689,6 +689,17 @@ void ViewerBase::renderingTraversals()
 
     osg::FrameStamp* frameStamp = getViewerFrameStamp();
 
+    if (getViewerStats() && getViewerStats()->collectStats("compile") && _incrementalCompileOperation.valid())
+    {
+        unsigned int frameNumber = frameStamp ? frameStamp->getFrameNumber() : 0;
+
+        osg::Stats* stats = getViewerStats();
+        stats->setAttribute(frameNumber, "Compile backlog", _incrementalCompileOperation->getCompileBacklog());
+        stats->setAttribute(frameNumber, "Compile backlog time", _incrementalCompileOperation->getCompileBacklogTime()*1000.0);
+        stats->setAttribute(frameNumber, "Compile time allocated", _incrementalCompileOperation->getAllocatedCompileTime()*1000.0);
+        stats->setAttribute(frameNumber, "Compile time", _incrementalCompileOperation->getCompileTime()*1000.0);
+    }
+
     if (getViewerStats() && getViewerStats()->collectStats("scene"))
     {
         unsigned int frameNumber = frameStamp ? frameStamp->getFrameNumber() : 0;
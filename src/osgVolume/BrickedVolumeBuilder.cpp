@@ -0,0 +1,349 @@
+/* -*-c++-*- OpenSceneGraph - Copyright (C) 1998-2009 Robert Osfield
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+*/
+
+#include <osgVolume/BrickedVolumeBuilder>
+#include <osgVolume/RayTracedTechnique>
+
+#include <osg/Math>
+#include <osg/PagedLOD>
+#include <osg/Notify>
+
+#include <osgDB/Registry>
+
+#include <algorithm>
+#include <limits>
+#include <sstream>
+#include <string.h>
+
+using namespace osgVolume;
+
+namespace
+{
+
+template<typename T>
+void downsample(const osg::Image* source, osg::Image* destination, unsigned int numComponents)
+{
+    const int ss = source->s();
+    const int st = source->t();
+    const int sr = source->r();
+
+    for(int r=0; r<destination->r(); ++r)
+    {
+        for(int t=0; t<destination->t(); ++t)
+        {
+            T* dest = reinterpret_cast<T*>(destination->data(0,t,r));
+            for(int s=0; s<destination->s(); ++s)
+            {
+                for(unsigned int c=0; c<numComponents; ++c)
+                {
+                    // box filter the 2x2x2 source voxels, fewer along the far edges of odd sized images
+                    double total = 0.0;
+                    unsigned int count = 0;
+                    for(int dr=0; dr<2 && r*2+dr<sr; ++dr)
+                    {
+                        for(int dt=0; dt<2 && t*2+dt<st; ++dt)
+                        {
+                            const T* src = reinterpret_cast<const T*>(source->data(s*2,t*2+dt,r*2+dr));
+                            for(int ds=0; ds<2 && s*2+ds<ss; ++ds)
+                            {
+                                total += static_cast<double>(src[ds*numComponents+c]);
+                                ++count;
+                            }
+                        }
+                    }
+
+                    double average = total/static_cast<double>(count);
+                    // round to nearest, flooring as casting truncates negative values of the signed types towards zero
+                    if (std::numeric_limits<T>::is_integer) average = floor(average + 0.5);
+                    *dest++ = static_cast<T>(average);
+                }
+            }
+        }
+    }
+}
+
+osg::Image* createDownsampledImage(const osg::Image* source)
+{
+    osg::ref_ptr<osg::Image> image = new osg::Image;
+    image->allocateImage((source->s()+1)/2, (source->t()+1)/2, (source->r()+1)/2, source->getPixelFormat(), source->getDataType());
+    image->setInternalTextureFormat(source->getInternalTextureFormat());
+
+    unsigned int numComponents = osg::Image::computeNumComponents(source->getPixelFormat());
+    switch(source->getDataType())
+    {
+        case(GL_BYTE):              downsample<signed char>(source, image.get(), numComponents); break;
+        case(GL_UNSIGNED_BYTE):     downsample<unsigned char>(source, image.get(), numComponents); break;
+        case(GL_SHORT):             downsample<short>(source, image.get(), numComponents); break;
+        case(GL_UNSIGNED_SHORT):    downsample<unsigned short>(source, image.get(), numComponents); break;
+        case(GL_INT):               downsample<int>(source, image.get(), numComponents); break;
+        case(GL_UNSIGNED_INT):      downsample<unsigned int>(source, image.get(), numComponents); break;
+        case(GL_FLOAT):             downsample<float>(source, image.get(), numComponents); break;
+        default: return 0;
+    }
+
+    return image.release();
+}
+
+osg::Image* createSubImage(const osg::Image* source, const int begin[3], const int end[3])
+{
+    osg::ref_ptr<osg::Image> image = new osg::Image;
+    image->allocateImage(end[0]-begin[0], end[1]-begin[1], end[2]-begin[2], source->getPixelFormat(), source->getDataType());
+    image->setInternalTextureFormat(source->getInternalTextureFormat());
+
+    unsigned int rowSize = ((end[0]-begin[0])*source->getPixelSizeInBits())/8;
+    for(int r=begin[2]; r<end[2]; ++r)
+    {
+        for(int t=begin[1]; t<end[1]; ++t)
+        {
+            memcpy(image->data(0, t-begin[1], r-begin[2]), source->data(begin[0], t, r), rowSize);
+        }
+    }
+
+    return image.release();
+}
+
+}
+
+BrickedVolumeBuilder::BrickedVolumeBuilder():
+    _brickSize(64),
+    _maximumScreenSpaceError(1.0f),
+    _brickExtension("osgb"),
+    _volumeTechniquePrototype(new RayTracedTechnique),
+    _numLevels(0),
+    _numBricks(0),
+    _brickDataSize(0)
+{
+}
+
+BrickedVolumeBuilder::~BrickedVolumeBuilder()
+{
+}
+
+unsigned int BrickedVolumeBuilder::computeMaximumNumberOfPagedLOD(double memoryBudgetInMegabytes) const
+{
+    if (_brickDataSize==0) return 0;
+
+    return static_cast<unsigned int>((memoryBudgetInMegabytes*1024.0*1024.0)/static_cast<double>(_brickDataSize));
+}
+
+std::string BrickedVolumeBuilder::createBrickFileName(const TileID& tileID) const
+{
+    std::ostringstream str;
+    str<<"L"<<tileID.level<<"_X"<<tileID.x<<"_Y"<<tileID.y<<"_Z"<<tileID.z<<"_children."<<_brickExtension;
+    return str.str();
+}
+
+bool BrickedVolumeBuilder::isBrickValid(const TileID& tileID) const
+{
+    if (tileID.level<0 || tileID.level>=static_cast<int>(_numLevels)) return false;
+
+    const osg::Image* image = _levels[tileID.level].get();
+    int brickSize = static_cast<int>(_brickSize);
+    return tileID.x*brickSize<image->s() &&
+           tileID.y*brickSize<image->t() &&
+           tileID.z*brickSize<image->r();
+}
+
+osg::Node* BrickedVolumeBuilder::createBrick(const TileID& tileID)
+{
+    const osg::Image* image = _levels[tileID.level].get();
+    const osg::Image* sourceImage = _levels.back().get();
+
+    int brickSize = static_cast<int>(_brickSize);
+    int dimensions[3] = { image->s(), image->t(), image->r() };
+    int sourceDimensions[3] = { sourceImage->s(), sourceImage->t(), sourceImage->r() };
+    int position[3] = { tileID.x, tileID.y, tileID.z };
+    int levelScale = 1 << (_numLevels-1-tileID.level);
+
+    int begin[3], end[3], apronBegin[3], apronEnd[3];
+    osg::Vec3d minimum, maximum, apronMinimum, apronMaximum;
+    for(unsigned int i=0; i<3; ++i)
+    {
+        begin[i] = position[i]*brickSize;
+        end[i] = osg::minimum(begin[i]+brickSize, dimensions[i]);
+        apronBegin[i] = osg::maximum(begin[i]-1, 0);
+        apronEnd[i] = osg::minimum(end[i]+1, dimensions[i]);
+
+        // coarser voxels cover levelScale voxels of the original image, clamp the voxels that overhang its far edge
+        double scale = static_cast<double>(levelScale)/static_cast<double>(sourceDimensions[i]);
+        minimum[i] = osg::minimum(static_cast<double>(begin[i])*scale, 1.0);
+        maximum[i] = osg::minimum(static_cast<double>(end[i])*scale, 1.0);
+        apronMinimum[i] = osg::minimum(static_cast<double>(apronBegin[i])*scale, 1.0);
+        apronMaximum[i] = osg::minimum(static_cast<double>(apronEnd[i])*scale, 1.0);
+    }
+
+    osg::Matrixd volumeTransform;
+    if (_layer->getLocator()) volumeTransform = _layer->getLocator()->getTransform();
+
+    osg::ref_ptr<ImageLayer> layer = new ImageLayer(createSubImage(image, apronBegin, apronEnd));
+    layer->setTexelOffset(_layer->getTexelOffset());
+    layer->setTexelScale(_layer->getTexelScale());
+    layer->setLocator(new Locator(osg::Matrixd::scale(apronMaximum-apronMinimum) * osg::Matrixd::translate(apronMinimum) * volumeTransform));
+
+    osg::ref_ptr<VolumeTile> tile = new VolumeTile;
+    tile->setTileID(tileID);
+    tile->setLocator(new Locator(osg::Matrixd::scale(maximum-minimum) * osg::Matrixd::translate(minimum) * volumeTransform));
+    tile->setLayer(layer.get());
+
+    ++_numBricks;
+
+    // every brick gets its own PagedLOD, even those of the finest level, so that the DatabasePager's
+    // target maximum number of PagedLOD maps directly onto the number of resident bricks.
+    osg::ref_ptr<osg::PagedLOD> plod = new osg::PagedLOD;
+    const osg::BoundingSphere& bs = tile->getBound();
+    plod->setCenterMode(osg::LOD::USER_DEFINED_CENTER);
+    plod->setCenter(bs.center());
+    plod->setRadius(bs.radius());
+    plod->setRangeMode(osg::LOD::PIXEL_SIZE_ON_SCREEN);
+
+    if (tileID.level+1<static_cast<int>(_numLevels))
+    {
+        // the pixel size of the PagedLOD is the projected radius of its bounding sphere, so the voxels
+        // reach the maximum screen space error when the radius covers radius/voxelSize times as many pixels.
+        const osg::Matrixd& transform = tile->getLocator()->getTransform();
+        double voxelSize = 0.0;
+        for(unsigned int i=0; i<3; ++i)
+        {
+            osg::Vec3d axis(transform(i,0), transform(i,1), transform(i,2));
+            voxelSize = osg::maximum(voxelSize, axis.length()/static_cast<double>(end[i]-begin[i]));
+        }
+
+        float pixelSize = voxelSize>0.0 ? static_cast<float>(_maximumScreenSpaceError*bs.radius()/voxelSize) : 0.0f;
+
+        plod->addChild(tile.get(), 0.0f, pixelSize);
+        plod->setFileName(1, createBrickFileName(tileID));
+        plod->setRange(1, pixelSize, std::numeric_limits<float>::max());
+    }
+    else
+    {
+        plod->addChild(tile.get(), 0.0f, std::numeric_limits<float>::max());
+    }
+
+    return plod.release();
+}
+
+bool BrickedVolumeBuilder::writeChildBricks(const TileID& tileID)
+{
+    std::vector<TileID> children;
+
+    osg::ref_ptr<osg::Group> group = new osg::Group;
+    for(int dz=0; dz<2; ++dz)
+    {
+        for(int dy=0; dy<2; ++dy)
+        {
+            for(int dx=0; dx<2; ++dx)
+            {
+                TileID child(tileID.level+1, tileID.x*2+dx, tileID.y*2+dy, tileID.z*2+dz);
+                if (isBrickValid(child))
+                {
+                    group->addChild(createBrick(child));
+                    children.push_back(child);
+                }
+            }
+        }
+    }
+
+    std::string fileName = createBrickFileName(tileID);
+    osgDB::ReaderWriter::WriteResult result = _archive->writeNode(*group, fileName, _options.get());
+    if (!result.success())
+    {
+        OSG_NOTICE<<"Warning: BrickedVolumeBuilder unable to write "<<fileName<<" to archive "<<_archive->getArchiveFileName()<<std::endl;
+        return false;
+    }
+
+    // release the bricks before recursing so that only one branch of the hierarchy is held in memory
+    group = 0;
+
+    if (tileID.level+2<static_cast<int>(_numLevels))
+    {
+        for(std::vector<TileID>::iterator itr = children.begin();
+            itr != children.end();
+            ++itr)
+        {
+            if (!writeChildBricks(*itr)) return false;
+        }
+    }
+
+    return true;
+}
+
+Volume* BrickedVolumeBuilder::build(ImageLayer* layer, const std::string& archiveFileName)
+{
+    _numLevels = 0;
+    _numBricks = 0;
+    _brickDataSize = 0;
+
+    osg::Image* image = layer ? layer->getImage() : 0;
+    if (!image || !image->data() || _brickSize==0) return 0;
+
+    // build the levels from the original image up to the coarsest level that fits in a single brick
+    int brickSize = static_cast<int>(_brickSize);
+    _levels.push_back(image);
+    while(_levels.back()->s()>brickSize || _levels.back()->t()>brickSize || _levels.back()->r()>brickSize)
+    {
+        osg::ref_ptr<osg::Image> coarserImage = createDownsampledImage(_levels.back().get());
+        if (!coarserImage)
+        {
+            OSG_NOTICE<<"Warning: BrickedVolumeBuilder::build() image data type not supported."<<std::endl;
+            _levels.clear();
+            return 0;
+        }
+        _levels.push_back(coarserImage);
+    }
+    std::reverse(_levels.begin(), _levels.end());
+
+    _numLevels = _levels.size();
+    _brickDataSize = ((_brickSize+2)*(_brickSize+2)*(_brickSize+2)*image->getPixelSizeInBits())/8;
+
+    _archive = osgDB::openArchive(archiveFileName, osgDB::Archive::CREATE);
+    if (!_archive)
+    {
+        OSG_NOTICE<<"Warning: BrickedVolumeBuilder::build() unable to create archive "<<archiveFileName<<std::endl;
+        _levels.clear();
+        return 0;
+    }
+
+    _layer = layer;
+    _options = new osgDB::Options("WriteImageHint=IncludeData");
+
+    osg::ref_ptr<Volume> volume = new Volume;
+    volume->setVolumeTechniquePrototype(_volumeTechniquePrototype.get());
+    volume->setProperty(layer->getProperty());
+
+    TileID rootID(0,0,0,0);
+    volume->addChild(createBrick(rootID));
+
+    // the first file written becomes the master file of the archive
+    bool result = _archive->writeNode(*volume, std::string("volume.")+_brickExtension, _options.get()).success();
+    if (result && _numLevels>1) result = writeChildBricks(rootID);
+
+    _archive->close();
+    osgDB::Registry::instance()->removeFromArchiveCache(archiveFileName);
+
+    _archive = 0;
+    _options = 0;
+    _layer = 0;
+    _levels.clear();
+
+    if (!result)
+    {
+        OSG_NOTICE<<"Warning: BrickedVolumeBuilder::build() failed to write archive "<<archiveFileName<<std::endl;
+        return 0;
+    }
+
+    // the bricks were written relative to the archive, point the in memory root at it as well
+    osg::PagedLOD* root = dynamic_cast<osg::PagedLOD*>(volume->getChild(0));
+    if (root) root->setDatabasePath(archiveFileName);
+
+    return volume.release();
+}
@@ -23,6 +23,9 @@
 #include <osg/Texture2D>
 #include <osg/Texture3D>
 #include <osg/TransferFunction>
+#include <osg/ImageUtils>
+
+#include <float.h>
 
 #include <osgDB/ReadFile>
 #include <osgDB/WriteFile>
@@ -73,12 +76,319 @@ class TexGenLocatorCallback : public Locator::LocatorCallback
 };
 
 
-RayTracedTechnique::RayTracedTechnique()
+/////////////////////////////////////////////////////////////////////////////
+//
+// EmptySpaceMap
+//
+struct ReadAlphaOperator
+{
+    ReadAlphaOperator(float* values): _values(values) {}
+
+    inline void luminance(float l) { *_values++ = l; }
+    inline void alpha(float a) { *_values++ = a; }
+    inline void luminance_alpha(float,float a) { *_values++ = a; }
+    inline void rgb(float,float,float) { *_values++ = 1.0f; }
+    inline void rgba(float,float,float,float a) { *_values++ = a; }
+
+    float* _values;
+};
+
+/** Records which bricks of a volume image can contribute to the ray cast image. The minimum and maximum alpha values
+  * of each brick, including the voxels that trilinear filtering blends in from the neighbouring bricks, are computed
+  * when the image is modified, and the empty space texture is recomputed from them when the transfer function or
+  * iso surface value are modified.*/
+class RayTracedTechnique::EmptySpaceMap : public osg::Referenced
+{
+    public:
+
+        EmptySpaceMap(osg::Image* image, unsigned int brickSize);
+
+        /** Return true if the image format is supported.*/
+        bool valid() const { return _texture.valid(); }
+
+        const osg::Image* getImage() const { return _image.get(); }
+
+        unsigned int getBrickSize() const { return _brickSize; }
+
+        /** Set how the shaders map the volume values, and recompute the empty space texture.
+          * The brick ranges are kept, so switching between shading models doesn't require the volume to be rescanned.*/
+        void setMapping(osg::TransferFunction1D* tf, float tfScale, float tfOffset, IsoSurfaceProperty* isoProperty);
+
+        /** Recompute the brick ranges and empty space texture if the image, transfer function or iso surface value have been modified.*/
+        void update();
+
+        osg::Texture3D* getTexture() { return _texture.get(); }
+
+        /** Get the number of bricks per texture coordinate unit.*/
+        const osg::Vec3& getBrickScale() const { return _brickScale; }
+
+        /** Get the number of bricks along each axis of the texture.*/
+        osg::Vec3 getTextureSize() const { return osg::Vec3(_numBricks[0], _numBricks[1], _numBricks[2]); }
+
+    protected:
+
+        virtual ~EmptySpaceMap() {}
+
+        void computeBrickRanges();
+
+        void computeEmptySpace();
+
+        inline void brickRange(int v, int numVoxels, int numBricks, int& lo, int& hi) const
+        {
+            // voxel v is sampled by bricks whose voxels, extended by one voxel either side, contain it.
+            lo = osg::maximum((v + _brickSize - 1)/_brickSize - 1, 0);
+            hi = osg::minimum(osg::minimum(v+1, numVoxels-1)/_brickSize, numBricks-1);
+        }
+
+        typedef std::vector<osg::Vec2> Ranges;
+
+        osg::ref_ptr<osg::Image>                _image;
+        int                                     _brickSize;
+        int                                     _numBricks[3];
+        osg::Vec3                               _brickScale;
+        Ranges                                  _brickRanges;
+        unsigned int                            _imageModifiedCount;
+
+        osg::ref_ptr<osg::TransferFunction1D>   _tf;
+        float                                   _tfScale;
+        float                                   _tfOffset;
+        unsigned int                            _tfModifiedCount;
+        std::vector<unsigned int>               _tfNonZeroCount;
+
+        osg::ref_ptr<IsoSurfaceProperty>        _isoProperty;
+        float                                   _isoValue;
+
+        osg::ref_ptr<osg::Image>                _emptySpaceImage;
+        osg::ref_ptr<osg::Texture3D>            _texture;
+};
+
+RayTracedTechnique::EmptySpaceMap::EmptySpaceMap(osg::Image* image, unsigned int brickSize):
+    _image(image),
+    _brickSize(osg::maximum(brickSize, 1u)),
+    _imageModifiedCount(0),
+    _tfScale(1.0f),
+    _tfOffset(0.0f),
+    _tfModifiedCount(0),
+    _isoValue(0.0f)
+{
+    _numBricks[0] = _numBricks[1] = _numBricks[2] = 0;
+
+    // signed data types aren't mapped to the same values by OpenGL as they are by osg::readRow(..),
+    // and RGB images are opaque, so neither benefit from empty space skipping.
+    GLenum dataType = _image->getDataType();
+    GLenum pixelFormat = _image->getPixelFormat();
+    if (dataType!=GL_UNSIGNED_BYTE && dataType!=GL_UNSIGNED_SHORT && dataType!=GL_UNSIGNED_INT && dataType!=GL_FLOAT)
+    {
+        OSG_INFO<<"RayTracedTechnique : empty space skipping not supported for image data type 0x"<<std::hex<<dataType<<std::dec<<std::endl;
+        return;
+    }
+
+    if (pixelFormat!=GL_LUMINANCE && pixelFormat!=GL_ALPHA && pixelFormat!=GL_LUMINANCE_ALPHA &&
+        pixelFormat!=GL_RGBA && pixelFormat!=GL_BGRA)
+    {
+        OSG_INFO<<"RayTracedTechnique : empty space skipping not supported for image pixel format 0x"<<std::hex<<pixelFormat<<std::dec<<std::endl;
+        return;
+    }
+
+    _numBricks[0] = (_image->s() + _brickSize - 1)/_brickSize;
+    _numBricks[1] = (_image->t() + _brickSize - 1)/_brickSize;
+    _numBricks[2] = (_image->r() + _brickSize - 1)/_brickSize;
+
+    _brickScale.set(float(_image->s())/float(_brickSize), float(_image->t())/float(_brickSize), float(_image->r())/float(_brickSize));
+
+    _emptySpaceImage = new osg::Image;
+    _emptySpaceImage->allocateImage(_numBricks[0], _numBricks[1], _numBricks[2], GL_LUMINANCE, GL_UNSIGNED_BYTE);
+
+    _texture = new osg::Texture3D;
+    _texture->setResizeNonPowerOfTwoHint(false);
+    _texture->setFilter(osg::Texture3D::MIN_FILTER, osg::Texture3D::NEAREST);
+    _texture->setFilter(osg::Texture3D::MAG_FILTER, osg::Texture3D::NEAREST);
+    _texture->setWrap(osg::Texture3D::WRAP_R, osg::Texture3D::CLAMP_TO_EDGE);
+    _texture->setWrap(osg::Texture3D::WRAP_S, osg::Texture3D::CLAMP_TO_EDGE);
+    _texture->setWrap(osg::Texture3D::WRAP_T, osg::Texture3D::CLAMP_TO_EDGE);
+    _texture->setImage(_emptySpaceImage.get());
+
+    computeBrickRanges();
+}
+
+void RayTracedTechnique::EmptySpaceMap::setMapping(osg::TransferFunction1D* tf, float tfScale, float tfOffset, IsoSurfaceProperty* isoProperty)
+{
+    _tf = tf;
+    _tfScale = tfScale;
+    _tfOffset = tfOffset;
+    _isoProperty = isoProperty;
+
+    if (valid()) computeEmptySpace();
+}
+
+void RayTracedTechnique::EmptySpaceMap::update()
+{
+    if (!valid()) return;
+
+    bool dirty = false;
+
+    if (_image->getModifiedCount()!=_imageModifiedCount)
+    {
+        computeBrickRanges();
+        dirty = true;
+    }
+
+    if (_tf.valid() && _tf->getImage() && _tf->getImage()->getModifiedCount()!=_tfModifiedCount) dirty = true;
+
+    if (_isoProperty.valid() && _isoProperty->getValue()!=_isoValue) dirty = true;
+
+    if (dirty) computeEmptySpace();
+}
+
+void RayTracedTechnique::EmptySpaceMap::computeBrickRanges()
+{
+    _imageModifiedCount = _image->getModifiedCount();
+
+    int numS = _image->s();
+    int numT = _image->t();
+    int numR = _image->r();
+
+    _brickRanges.assign(_numBricks[0]*_numBricks[1]*_numBricks[2], osg::Vec2(FLT_MAX, -FLT_MAX));
+
+    std::vector<float> rowValues(numS);
+    Ranges rowRanges(_numBricks[0]);
+
+    for(int r=0; r<numR; ++r)
+    {
+        int r_lo, r_hi;
+        brickRange(r, numR, _numBricks[2], r_lo, r_hi);
+
+        for(int t=0; t<numT; ++t)
+        {
+            int t_lo, t_hi;
+            brickRange(t, numT, _numBricks[1], t_lo, t_hi);
+
+            ReadAlphaOperator readOp(&rowValues.front());
+            osg::readRow(numS, _image->getPixelFormat(), _image->getDataType(), _image->data(0,t,r), readOp);
+
+            for(int bs=0; bs<_numBricks[0]; ++bs)
+            {
+                int s_begin = osg::maximum(bs*_brickSize-1, 0);
+                int s_end = osg::minimum((bs+1)*_brickSize, numS-1);
+
+                osg::Vec2 range(FLT_MAX, -FLT_MAX);
+                for(int s=s_begin; s<=s_end; ++s)
+                {
+                    float v = rowValues[s];
+                    if (v<range.x()) range.x() = v;
+                    if (v>range.y()) range.y() = v;
+                }
+                rowRanges[bs] = range;
+            }
+
+            for(int br=r_lo; br<=r_hi; ++br)
+            {
+                for(int bt=t_lo; bt<=t_hi; ++bt)
+                {
+                    osg::Vec2* brickRanges = &_brickRanges[(br*_numBricks[1] + bt)*_numBricks[0]];
+                    for(int bs=0; bs<_numBricks[0]; ++bs)
+                    {
+                        brickRanges[bs].x() = osg::minimum(brickRanges[bs].x(), rowRanges[bs].x());
+                        brickRanges[bs].y() = osg::maximum(brickRanges[bs].y(), rowRanges[bs].y());
+                    }
+                }
+            }
+        }
+    }
+
+    // the bricks on the boundary of the volume are also blended with the transparent black border colour of the texture.
+    for(int br=0; br<_numBricks[2]; ++br)
+    {
+        for(int bt=0; bt<_numBricks[1]; ++bt)
+        {
+            for(int bs=0; bs<_numBricks[0]; ++bs)
+            {
+                if (br==0 || bt==0 || bs==0 || br==_numBricks[2]-1 || bt==_numBricks[1]-1 || bs==_numBricks[0]-1)
+                {
+                    osg::Vec2& range = _brickRanges[(br*_numBricks[1] + bt)*_numBricks[0] + bs];
+                    range.x() = osg::minimum(range.x(), 0.0f);
+                    range.y() = osg::maximum(range.y(), 0.0f);
+                }
+            }
+        }
+    }
+}
+
+void RayTracedTechnique::EmptySpaceMap::computeEmptySpace()
+{
+    int tfNumCells = 0;
+    if (_isoProperty.valid())
+    {
+        _isoValue = _isoProperty->getValue();
+    }
+    else if (_tf.valid() && _tf->getImage())
+    {
+        const osg::Image* tfImage = _tf->getImage();
+        _tfModifiedCount = tfImage->getModifiedCount();
+
+        // count of the transfer function cells with a non zero alpha, so that a range of cells can be checked in constant time.
+        tfNumCells = tfImage->s();
+        _tfNonZeroCount.resize(tfNumCells+1);
+        _tfNonZeroCount[0] = 0;
+
+        const osg::Vec4* colors = reinterpret_cast<const osg::Vec4*>(tfImage->data());
+        for(int i=0; i<tfNumCells; ++i)
+        {
+            _tfNonZeroCount[i+1] = _tfNonZeroCount[i] + ((colors[i].a()!=0.0f) ? 1 : 0);
+        }
+    }
+
+    unsigned char* emptySpace = _emptySpaceImage->data();
+    for(Ranges::const_iterator itr = _brickRanges.begin();
+        itr != _brickRanges.end();
+        ++itr, ++emptySpace)
+    {
+        float minValue = itr->x();
+        float maxValue = itr->y();
+
+        bool empty = false;
+        if (_isoProperty.valid())
+        {
+            // the ray only needs to sample the bricks that the iso surface passes through.
+            empty = (_isoValue<minValue || _isoValue>maxValue);
+        }
+        else if (tfNumCells>0)
+        {
+            float c0 = minValue*_tfScale + _tfOffset;
+            float c1 = maxValue*_tfScale + _tfOffset;
+            if (c0>c1) std::swap(c0, c1);
+
+            // include the neighbouring cells that linear filtering blends in.
+            int i0 = osg::clampBetween(static_cast<int>(floorf(c0*float(tfNumCells) - 0.5f)), 0, tfNumCells-1);
+            int i1 = osg::clampBetween(static_cast<int>(floorf(c1*float(tfNumCells) - 0.5f))+1, 0, tfNumCells-1);
+
+            empty = (_tfNonZeroCount[i1+1]==_tfNonZeroCount[i0]);
+        }
+        else
+        {
+            empty = (maxValue<=0.0f);
+        }
+
+        *emptySpace = empty ? 0 : 255;
+    }
+
+    _emptySpaceImage->dirty();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// RayTracedTechnique
+//
+RayTracedTechnique::RayTracedTechnique():
+    _emptySpaceSkipping(true),
+    _emptySpaceBrickSize(16)
 {
 }
 
 RayTracedTechnique::RayTracedTechnique(const RayTracedTechnique& fft,const osg::CopyOp& copyop):
-    VolumeTechnique(fft,copyop)
+    VolumeTechnique(fft,copyop),
+    _emptySpaceSkipping(fft._emptySpaceSkipping),
+    _emptySpaceBrickSize(fft._emptySpaceBrickSize)
 {
 }
 
@@ -86,6 +396,24 @@ RayTracedTechnique::~RayTracedTechnique()
 {
 }
 
+void RayTracedTechnique::setEmptySpaceSkipping(bool flag)
+{
+    if (_emptySpaceSkipping==flag) return;
+
+    _emptySpaceSkipping = flag;
+
+    if (_volumeTile) _volumeTile->setDirty(true);
+}
+
+void RayTracedTechnique::setEmptySpaceBrickSize(unsigned int size)
+{
+    if (_emptySpaceBrickSize==size) return;
+
+    _emptySpaceBrickSize = size;
+
+    if (_volumeTile) _volumeTile->setDirty(true);
+}
+
 enum ShadingModel
 {
     Standard,
@@ -250,11 +578,11 @@ void RayTracedTechnique::init()
 
         bool enableBlending = false;
 
+        float tfScale = 1.0f;
+        float tfOffset = 0.0f;
+
         if (tf)
         {
-            float tfScale = 1.0f;
-            float tfOffset = 0.0f;
-
             ImageLayer* imageLayer = dynamic_cast<ImageLayer*>(_volumeTile->getLayer());
             if (imageLayer)
             {
@@ -419,6 +747,30 @@ void RayTracedTechnique::init()
             }
         }
 
+        // the maximum intensity projection shader with a transfer function samples the red channel of the volume so doesn't skip empty space.
+        if (_emptySpaceSkipping && !(shadingModel==MaximumIntensityProjection && tf))
+        {
+            // reuse the brick ranges of the previous init() when only the properties have changed.
+            if (!_emptySpaceMap || _emptySpaceMap->getImage()!=image_3d || _emptySpaceMap->getBrickSize()!=osg::maximum(_emptySpaceBrickSize, 1u))
+            {
+                _emptySpaceMap = new EmptySpaceMap(image_3d, _emptySpaceBrickSize);
+            }
+
+            _emptySpaceMap->setMapping(tf, tfScale, tfOffset, shadingModel==Isosurface ? cpv._isoProperty.get() : 0);
+
+            if (_emptySpaceMap->valid())
+            {
+                stateset->setTextureAttributeAndModes(2, _emptySpaceMap->getTexture(), osg::StateAttribute::ON);
+                stateset->addUniform(new osg::Uniform("emptySpaceTexture",2));
+                stateset->addUniform(new osg::Uniform("emptySpaceBrickScale",_emptySpaceMap->getBrickScale()));
+                stateset->addUniform(new osg::Uniform("emptySpaceTextureSize",_emptySpaceMap->getTextureSize()));
+            }
+        }
+        else
+        {
+            _emptySpaceMap = 0;
+        }
+
         if (cpv._sampleDensityProperty.valid())
             stateset->addUniform(cpv._sampleDensityProperty->getUniform());
         else
@@ -536,6 +888,8 @@ void RayTracedTechnique::init()
 void RayTracedTechnique::update(osgUtil::UpdateVisitor* uv)
 {
 //    OSG_NOTICE<<"RayTracedTechnique:update(osgUtil::UpdateVisitor* nv):"<<std::endl;
+
+    if (_emptySpaceMap.valid()) _emptySpaceMap->update();
 }
 
 void RayTracedTechnique::cull(osgUtil::CullVisitor* cv)
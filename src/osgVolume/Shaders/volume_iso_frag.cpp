@@ -1,4 +1,7 @@
 char volume_iso_frag[] = "uniform sampler3D baseTexture;\n"
+                         "uniform sampler3D emptySpaceTexture;\n"
+                         "uniform vec3 emptySpaceBrickScale;\n"
+                         "uniform vec3 emptySpaceTextureSize;\n"
                          "uniform float SampleDensityValue;\n"
                          "uniform float TransparencyValue;\n"
                          "uniform float IsoSurfaceValue;\n"
@@ -122,6 +125,22 @@ char volume_iso_frag[] = "uniform sampler3D baseTexture;\n"
                          "        }\n"
                          "        \n"
                          "        previousColor = color;\n"
+                         "\n"
+                         "        if (emptySpaceBrickScale.x>0.0)\n"
+                         "        {\n"
+                         "            vec3 brick = floor(texcoord*emptySpaceBrickScale);\n"
+                         "            if (texture3D( emptySpaceTexture, (brick+0.5)/emptySpaceTextureSize).r==0.0)\n"
+                         "            {\n"
+                         "                // step over the rest of the empty brick\n"
+                         "                vec3 exitCoord = (brick + step(0.0, deltaTexCoord))/emptySpaceBrickScale;\n"
+                         "                vec3 exitSteps = (exitCoord-texcoord)/(deltaTexCoord + vec3(equal(deltaTexCoord, vec3(0.0)))*1e-10);\n"
+                         "                float numSkipped = clamp(floor(min(exitSteps.x, min(exitSteps.y, exitSteps.z)))+1.0, 1.0, num_iterations);\n"
+                         "                texcoord += deltaTexCoord*numSkipped;\n"
+                         "                num_iterations -= numSkipped;\n"
+                         "                previousColor = texture3D( baseTexture, texcoord-deltaTexCoord);\n"
+                         "                continue;\n"
+                         "            }\n"
+                         "        }\n"
                          "        \n"
                          "        texcoord += deltaTexCoord; \n"
                          "\n"
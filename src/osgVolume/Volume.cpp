@@ -21,7 +21,9 @@ Volume::Volume()
 }
 
 Volume::Volume(const Volume& ts, const osg::CopyOp& copyop):
-    osg::Group(ts,copyop)
+    osg::Group(ts,copyop),
+    _volumeTechnique(ts._volumeTechnique),
+    _property(ts._property)
 {
 }
 
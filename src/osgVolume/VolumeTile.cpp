@@ -98,7 +98,10 @@ void VolumeTile::setTileID(const TileID& tileID)
 
 void VolumeTile::traverse(osg::NodeVisitor& nv)
 {
-    if (!_hasBeenTraversal)
+    // only the update and cull traversals are guaranteed to have the full path from the scene graph root,
+    // other traversals, such as those of the DatabasePager on newly loaded tiles, may not see the Volume above the tile.
+    if (!_hasBeenTraversal &&
+        (nv.getVisitorType()==osg::NodeVisitor::UPDATE_VISITOR || nv.getVisitorType()==osg::NodeVisitor::CULL_VISITOR))
     {
         if (!_volume)
         {
@@ -119,6 +122,19 @@ void VolumeTile::traverse(osg::NodeVisitor& nv)
             }
         }
 
+        if (_volume)
+        {
+            if (!_volumeTechnique && _volume->getVolumeTechniquePrototype())
+            {
+                setVolumeTechnique(osg::clone(_volume->getVolumeTechniquePrototype(), osg::CopyOp::DEEP_COPY_ALL));
+            }
+
+            if (_layer.valid() && !_layer->getProperty() && _volume->getProperty())
+            {
+                _layer->setProperty(_volume->getProperty());
+            }
+        }
+
         _hasBeenTraversal = true;
     }
 
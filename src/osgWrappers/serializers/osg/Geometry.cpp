@@ -46,7 +46,31 @@ static void writeArrayData( osgDB::OutputStream& os, const osg::Geometry::ArrayD
     os << os.PROPERTY("Normalize") << (int)data.normalize << std::endl;
 }
 
-#define ADD_ARRAYDATA_FUNCTIONS( PROP ) \
+// With the QuantizeVertexData option the normals and colors are written as quantized arrays. Vertices are
+// written as they are held, already quantized vertices along with the VertexDecodeMatrix that decodes them.
+static osg::Geometry::ArrayData quantizeNormalData( osgDB::OutputStream& os, const osg::Geometry& geom )
+{
+    osg::Geometry::ArrayData data = geom.getNormalData();
+    if ( os.getQuantizeVertexData() && !data.indices )
+    {
+        osg::Array* quantized = os.getQuantizedNormalArray( data.array.get() );
+        if ( quantized ) data.array = quantized;
+    }
+    return data;
+}
+
+static osg::Geometry::ArrayData quantizeColorData( osgDB::OutputStream& os, const osg::Geometry& geom )
+{
+    osg::Geometry::ArrayData data = geom.getColorData();
+    if ( os.getQuantizeVertexData() && !data.indices )
+    {
+        osg::Array* quantized = os.getQuantizedColorArray( data.array.get() );
+        if ( quantized ) data.array = quantized;
+    }
+    return data;
+}
+
+#define ADD_ARRAYDATA_FUNCTIONS( PROP, WRITTEN_DATA ) \
     static bool check##PROP( const osg::Geometry& geom ) \
     { return geom.get##PROP().array.valid(); } \
     static bool read##PROP( osgDB::InputStream& is, osg::Geometry& geom ) { \
@@ -58,16 +82,16 @@ static void writeArrayData( osgDB::OutputStream& os, const osg::Geometry::ArrayD
     } \
     static bool write##PROP( osgDB::OutputStream& os, const osg::Geometry& geom ) { \
         os << os.BEGIN_BRACKET << std::endl; \
-        writeArrayData(os, geom.get##PROP()); \
+        writeArrayData(os, WRITTEN_DATA); \
         os << os.END_BRACKET << std::endl; \
         return true; \
     }
 
-ADD_ARRAYDATA_FUNCTIONS( VertexData )
-ADD_ARRAYDATA_FUNCTIONS( NormalData )
-ADD_ARRAYDATA_FUNCTIONS( ColorData )
-ADD_ARRAYDATA_FUNCTIONS( SecondaryColorData )
-ADD_ARRAYDATA_FUNCTIONS( FogCoordData )
+ADD_ARRAYDATA_FUNCTIONS( VertexData, geom.getVertexData() )
+ADD_ARRAYDATA_FUNCTIONS( NormalData, quantizeNormalData(os, geom) )
+ADD_ARRAYDATA_FUNCTIONS( ColorData, quantizeColorData(os, geom) )
+ADD_ARRAYDATA_FUNCTIONS( SecondaryColorData, geom.getSecondaryColorData() )
+ADD_ARRAYDATA_FUNCTIONS( FogCoordData, geom.getFogCoordData() )
 
 #define ADD_ARRAYLIST_FUNCTIONS( PROP, LISTNAME ) \
     static bool check##PROP( const osg::Geometry& geom ) \
@@ -97,6 +121,28 @@ ADD_ARRAYDATA_FUNCTIONS( FogCoordData )
 ADD_ARRAYLIST_FUNCTIONS( TexCoordData, TexCoordArrayList )
 ADD_ARRAYLIST_FUNCTIONS( VertexAttribData, VertexAttribArrayList )
 
+static bool checkVertexDecodeMatrix( const osg::Geometry& geom )
+{
+    return geom.getVertexDecodeMatrix()!=NULL;
+}
+
+static bool readVertexDecodeMatrix( osgDB::InputStream& is, osg::Geometry& geom )
+{
+    bool hasMatrix = false; is >> hasMatrix;
+    if ( hasMatrix )
+    {
+        osg::Matrixd matrix; is >> matrix;
+        geom.setVertexDecodeMatrix( new osg::RefMatrix(matrix) );
+    }
+    return true;
+}
+
+static bool writeVertexDecodeMatrix( osgDB::OutputStream& os, const osg::Geometry& geom )
+{
+    os << true << osg::Matrixd(*geom.getVertexDecodeMatrix()) << std::endl;
+    return true;
+}
+
 struct GeometryFinishedObjectReadCallback : public osgDB::FinishedObjectReadCallback
 {
     virtual void objectRead(osgDB::InputStream&, osg::Object& obj)
@@ -126,5 +172,10 @@ REGISTER_OBJECT_WRAPPER( Geometry,
     ADD_BOOL_SERIALIZER( FastPathHint, true );  // _fastPathHint
     //ADD_OBJECT_SERIALIZER( InternalOptimizedGeometry, osg::Geometry, NULL );  // _internalOptimizedGeometry
 
+    UPDATE_TO_VERSION( 93 )
+    {
+        ADD_USER_SERIALIZER( VertexDecodeMatrix );  // _vertexDecodeMatrix
+    }
+
     wrapper->addFinishedObjectReadCallback( new GeometryFinishedObjectReadCallback() );
 }
@@ -0,0 +1,104 @@
+#include <osg/InstancedGeometry>
+#include <osgDB/ObjectWrapper>
+#include <osgDB/InputStream>
+#include <osgDB/OutputStream>
+
+static bool checkInstanceMatrices( const osg::InstancedGeometry& geom )
+{
+    return geom.getNumInstances()>0;
+}
+
+static bool readInstanceMatrices( osgDB::InputStream& is, osg::InstancedGeometry& geom )
+{
+    unsigned int size = is.readSize(); is >> is.BEGIN_BRACKET;
+    osg::ref_ptr<osg::MatrixfArray> matrices = new osg::MatrixfArray(size);
+    for ( unsigned int i=0; i<size; ++i )
+    {
+        is >> (*matrices)[i];
+    }
+    is >> is.END_BRACKET;
+    geom.setInstanceMatrixArray( matrices.get() );
+    return true;
+}
+
+static bool writeInstanceMatrices( osgDB::OutputStream& os, const osg::InstancedGeometry& geom )
+{
+    const osg::MatrixfArray* matrices = geom.getInstanceMatrixArray();
+    os.writeSize(matrices->size()); os << os.BEGIN_BRACKET << std::endl;
+    for ( osg::MatrixfArray::const_iterator itr=matrices->begin();
+          itr!=matrices->end(); ++itr )
+    {
+        os << *itr << std::endl;
+    }
+    os << os.END_BRACKET << std::endl;
+    return true;
+}
+
+static bool checkInstanceMatrixAttribLocations( const osg::InstancedGeometry& geom )
+{
+    return geom.getInstanceMatrixAttribLocation(0)!=1 ||
+           geom.getInstanceMatrixAttribLocation(1)!=6 ||
+           geom.getInstanceMatrixAttribLocation(2)!=7;
+}
+
+static bool readInstanceMatrixAttribLocations( osgDB::InputStream& is, osg::InstancedGeometry& geom )
+{
+    unsigned int row0 = 1, row1 = 6, row2 = 7;
+    is >> row0 >> row1 >> row2;
+    geom.setInstanceMatrixAttribLocations( row0, row1, row2 );
+    return true;
+}
+
+static bool writeInstanceMatrixAttribLocations( osgDB::OutputStream& os, const osg::InstancedGeometry& geom )
+{
+    os << geom.getInstanceMatrixAttribLocation(0) << geom.getInstanceMatrixAttribLocation(1)
+       << geom.getInstanceMatrixAttribLocation(2) << std::endl;
+    return true;
+}
+
+static bool checkInstanceAttribs( const osg::InstancedGeometry& geom )
+{
+    return geom.getInstanceAttribList().size()>0;
+}
+
+static bool readInstanceAttribs( osgDB::InputStream& is, osg::InstancedGeometry& geom )
+{
+    unsigned int size = is.readSize(); is >> is.BEGIN_BRACKET;
+    for ( unsigned int i=0; i<size; ++i )
+    {
+        unsigned int location = 0; int normalizeValue = 0; bool hasArray = false;
+        is >> is.PROPERTY("Location") >> location;
+        is >> is.PROPERTY("Normalize") >> normalizeValue;
+        is >> is.PROPERTY("Array") >> hasArray;
+        if ( hasArray ) geom.setInstanceAttribArray( location, is.readArray(), normalizeValue );
+    }
+    is >> is.END_BRACKET;
+    return true;
+}
+
+static bool writeInstanceAttribs( osgDB::OutputStream& os, const osg::InstancedGeometry& geom )
+{
+    const osg::InstancedGeometry::InstanceAttribList& attribs = geom.getInstanceAttribList();
+    os.writeSize(attribs.size()); os << os.BEGIN_BRACKET << std::endl;
+    for ( unsigned int i=0; i<attribs.size(); ++i )
+    {
+        os << os.PROPERTY("Location") << i << std::endl;
+        os << os.PROPERTY("Normalize") << (int)attribs[i].normalize << std::endl;
+        os << os.PROPERTY("Array") << attribs[i].array.valid();
+        if ( attribs[i].array.valid() ) os << attribs[i].array.get();
+        else os << std::endl;
+    }
+    os << os.END_BRACKET << std::endl;
+    return true;
+}
+
+REGISTER_OBJECT_WRAPPER( InstancedGeometry,
+                         new osg::InstancedGeometry,
+                         osg::InstancedGeometry,
+                         "osg::Object osg::Drawable osg::Geometry osg::InstancedGeometry" )
+{
+    ADD_USER_SERIALIZER( InstanceMatrices );  // _instanceMatrices
+    ADD_USER_SERIALIZER( InstanceMatrixAttribLocations );  // _instanceMatrixAttribLocations
+    ADD_USER_SERIALIZER( InstanceAttribs );  // _instanceAttribList
+    ADD_BOOL_SERIALIZER( CullInstances, true );  // _cullInstances
+}
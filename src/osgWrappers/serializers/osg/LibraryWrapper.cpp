@@ -43,6 +43,7 @@ USE_SERIALIZER_WRAPPER(Hint)
 USE_SERIALIZER_WRAPPER(Image)
 USE_SERIALIZER_WRAPPER(ImageSequence)
 USE_SERIALIZER_WRAPPER(ImageStream)
+USE_SERIALIZER_WRAPPER(InstancedGeometry)
 USE_SERIALIZER_WRAPPER(Light)
 USE_SERIALIZER_WRAPPER(LightModel)
 USE_SERIALIZER_WRAPPER(LightSource)
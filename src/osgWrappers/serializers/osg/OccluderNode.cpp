@@ -9,4 +9,9 @@ REGISTER_OBJECT_WRAPPER( OccluderNode,
                          "osg::Object osg::Node osg::Group osg::OccluderNode" )
 {
     ADD_OBJECT_SERIALIZER( Occluder, osg::ConvexPlanarOccluder, NULL );  // _occluder
+
+    UPDATE_TO_VERSION( 93 )
+    {
+        ADD_OBJECT_SERIALIZER( OccluderGeometry, osg::Geometry, NULL );  // _occluderGeometry
+    }
 }
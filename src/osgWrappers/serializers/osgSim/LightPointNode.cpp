@@ -86,4 +86,9 @@ REGISTER_OBJECT_WRAPPER( osgSim_LightPointNode,
     ADD_FLOAT_SERIALIZER( MaxVisibleDistance2, FLT_MAX );  // _maxVisibleDistance2
     ADD_OBJECT_SERIALIZER( LightPointSystem, osgSim::LightPointSystem, NULL );  // _lightSystem
     ADD_BOOL_SERIALIZER( PointSprite, false );  // _pointSprites
+
+    UPDATE_TO_VERSION( 93 )
+    {
+        ADD_BOOL_SERIALIZER( UseShaders, false );  // _useShaders
+    }
 }
@@ -17,4 +17,11 @@ REGISTER_OBJECT_WRAPPER( osgTerrain_Terrain,
         ADD_ENUM_CLASS_VALUE( osgTerrain::TerrainTile, ENABLE_BLENDING );
         ADD_ENUM_CLASS_VALUE( osgTerrain::TerrainTile, ENABLE_BLENDING_WHEN_ALPHA_PRESENT );
     END_ENUM_SERIALIZER();  // BlendingPolicy
+
+    UPDATE_TO_VERSION( 93 )
+    {
+        ADD_BOOL_SERIALIZER( ShareTileTopology, false );  // _shareTileTopology
+        ADD_BOOL_SERIALIZER( UseCompactNormals, false );  // _useCompactNormals
+        ADD_BOOL_SERIALIZER( InitTilesOnLoad, false );  // _initTilesOnLoad
+    }
 }
@@ -1,4 +1,5 @@
 #include <osgTerrain/TerrainTile>
+#include <osgTerrain/Terrain>
 #include <osgDB/ObjectWrapper>
 #include <osgDB/InputStream>
 #include <osgDB/OutputStream>
@@ -77,6 +78,10 @@ struct TerrainTileFinishedObjectReadCallback : public osgDB::FinishedObjectReadC
 
         if ( osgTerrain::TerrainTile::getTileLoadedCallback().valid() )
             osgTerrain::TerrainTile::getTileLoadedCallback()->loaded( &tile, is.getOptions() );
+
+        osgTerrain::Terrain* terrain = tile.getTerrain();
+        if ( terrain && terrain->getInitTilesOnLoad() && !terrain->getEqualizeBoundaries() )
+            tile.init( osgTerrain::TerrainTile::ALL_DIRTY, false );
         }
 };
 
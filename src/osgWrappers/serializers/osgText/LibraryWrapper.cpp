@@ -4,6 +4,8 @@ USE_SERIALIZER_WRAPPER(osgText_FadeText)
 USE_SERIALIZER_WRAPPER(osgText_Text)
 USE_SERIALIZER_WRAPPER(osgText_Text3D)
 USE_SERIALIZER_WRAPPER(osgText_TextBase)
+USE_SERIALIZER_WRAPPER(osgText_TextBatch)
+USE_SERIALIZER_WRAPPER(osgText_TextBatchUpdateCallback)
 
 extern "C" void wrapper_serializer_library_osgText(void) {}
 
@@ -0,0 +1,47 @@
+#include <osgText/TextBatch>
+#include <osgDB/ObjectWrapper>
+#include <osgDB/InputStream>
+#include <osgDB/OutputStream>
+
+static bool checkTexts( const osgText::TextBatch& batch )
+{
+    return batch.getNumTexts()>0;
+}
+
+static bool readTexts( osgDB::InputStream& is, osgText::TextBatch& batch )
+{
+    unsigned int size = 0; is >> size >> is.BEGIN_BRACKET;
+    for ( unsigned int i=0; i<size; ++i )
+    {
+        osgText::Text* text = dynamic_cast<osgText::Text*>( is.readObject() );
+        if ( text ) batch.addText( text );
+    }
+    is >> is.END_BRACKET;
+    return true;
+}
+
+static bool writeTexts( osgDB::OutputStream& os, const osgText::TextBatch& batch )
+{
+    // removed labels leave empty slots which are not written out
+    unsigned int size = 0;
+    for ( unsigned int i=0; i<batch.getNumTexts(); ++i )
+    {
+        if ( batch.getText(i) ) ++size;
+    }
+
+    os << size << os.BEGIN_BRACKET << std::endl;
+    for ( unsigned int i=0; i<batch.getNumTexts(); ++i )
+    {
+        if ( batch.getText(i) ) os << batch.getText(i);
+    }
+    os << os.END_BRACKET << std::endl;
+    return true;
+}
+
+REGISTER_OBJECT_WRAPPER( osgText_TextBatch,
+                         new osgText::TextBatch,
+                         osgText::TextBatch,
+                         "osg::Object osg::Drawable osgText::TextBatch" )
+{
+    ADD_USER_SERIALIZER( Texts );  // _labels
+}
@@ -0,0 +1,11 @@
+#include <osgText/TextBatch>
+#include <osgDB/ObjectWrapper>
+#include <osgDB/InputStream>
+#include <osgDB/OutputStream>
+
+REGISTER_OBJECT_WRAPPER( osgText_TextBatchUpdateCallback,
+                         new osgText::TextBatchUpdateCallback,
+                         osgText::TextBatchUpdateCallback,
+                         "osg::Object osgText::TextBatchUpdateCallback" )
+{
+}
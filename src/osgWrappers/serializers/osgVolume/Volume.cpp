@@ -9,4 +9,9 @@ REGISTER_OBJECT_WRAPPER( osgVolume_Volume,
                          "osg::Object osg::Node osg::Group osgVolume::Volume" )
 {
     ADD_OBJECT_SERIALIZER( VolumeTechniquePrototype, osgVolume::VolumeTechnique, NULL );  // _volumeTechnique
+
+    UPDATE_TO_VERSION( 93 )
+    {
+        ADD_OBJECT_SERIALIZER( Property, osgVolume::Property, NULL );  // _property
+    }
 }